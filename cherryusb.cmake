@@ -57,6 +57,7 @@ if(CONFIG_CHERRYUSB_DEVICE)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usbd_core.c)
     if(CONFIG_CHERRYUSB_DEVICE_CDC_ACM)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/cdc/usbd_cdc_acm.c)
+        set(CONFIG_CHERRYRB 1)
     endif()
     if(CONFIG_CHERRYUSB_DEVICE_HID)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/hid/usbd_hid.c)
@@ -169,9 +170,12 @@ if(CONFIG_CHERRYUSB_HOST)
     endif()
     if(CONFIG_CHERRYUSB_HOST_HID)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/hid/usbh_hid.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/hid/usbh_hid_poll.c)
+        set(CONFIG_CHERRYRB 1)
     endif()
     if(CONFIG_CHERRYUSB_HOST_MSC)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/msc/usbh_msc.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/msc/usbh_msc_blk.c)
 
         if(CONFIG_CHERRYUSB_HOST_MSC_FATFS)
             list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/third_party/fatfs-0.14/source/port/fatfs_usbh.c)
@@ -185,12 +189,16 @@ if(CONFIG_CHERRYUSB_HOST)
     endif()
     if(CONFIG_CHERRYUSB_HOST_VIDEO)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/video/usbh_video.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/video/usbh_uvc_stream.c)
     endif()
     if(CONFIG_CHERRYUSB_HOST_AUDIO)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/audio/usbh_audio.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/audio/usbh_uac_stream.c)
+        set(CONFIG_CHERRYRB 1)
     endif()
     if(CONFIG_CHERRYUSB_HOST_BLUETOOTH)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/wireless/usbh_bluetooth.c)
+        set(CONFIG_CHERRYRB 1)
 
         set(BLUETOOTH_PATH ${CMAKE_CURRENT_LIST_DIR}/third_party/zephyr_bluetooth-2.7.5)
 
@@ -246,6 +254,14 @@ if(CONFIG_CHERRYUSB_HOST)
     if(CONFIG_CHERRYUSB_HOST_PL2303)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/serial/usbh_pl2303.c)
     endif()
+    if(CONFIG_CHERRYUSB_HOST_CDC_ACM
+    OR CONFIG_CHERRYUSB_HOST_CH34X
+    OR CONFIG_CHERRYUSB_HOST_CP210X
+    OR CONFIG_CHERRYUSB_HOST_FTDI
+    OR CONFIG_CHERRYUSB_HOST_PL2303)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/serial/usbh_serial.c)
+        set(CONFIG_CHERRYRB 1)
+    endif()
     if(CONFIG_CHERRYUSB_HOST_BL616)
         list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/vendor/wifi/usbh_bl616.c)
     endif()
@@ -260,6 +276,9 @@ if(CONFIG_CHERRYUSB_HOST)
     OR CONFIG_CHERRYUSB_HOST_RTL8152
     OR CONFIG_CHERRYUSB_HOST_BL616
     )
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usbh_net_rxbuf.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usbh_net_rxq.c)
+        list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usbh_net_txq.c)
         if("${CONFIG_CHERRYUSB_OSAL}" STREQUAL "idf")
             list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/platform/idf/usbh_net.c)
         else()
@@ -355,6 +374,15 @@ if(DEFINED CONFIG_CHERRYUSB_OSAL)
     endif()
 endif()
 
+if(CONFIG_CHERRYUSB_DEVICE OR CONFIG_CHERRYUSB_HOST)
+    list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usb_trace.c)
+    list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/core/usb_log.c)
+endif()
+
+if(CONFIG_CHERRYUSB_DEVICE_AUDIO OR CONFIG_CHERRYUSB_HOST_AUDIO)
+    list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/class/audio/usb_audio_pcm.c)
+endif()
+
 if(CONFIG_CHERRYRB)
     list(APPEND cherryusb_srcs ${CMAKE_CURRENT_LIST_DIR}/third_party/cherryrb/chry_ringbuffer.c)
     list(APPEND cherryusb_incs ${CMAKE_CURRENT_LIST_DIR}/third_party/cherryrb)
@@ -40,6 +40,48 @@
 */
 // #define CONFIG_USB_MEMCPY_DISABLE
 
+/* Record setup, transfer and irq events into a binary ring per bus, see usb_trace.h and tools/usb_trace */
+// #define CONFIG_USB_TRACE
+/* Events per ring, power of 2, 32 bytes each */
+#ifndef CONFIG_USB_TRACE_EVENTS
+#define CONFIG_USB_TRACE_EVENTS 256
+#endif
+
+/* Count bytes, transfers, errors and latency per endpoint and irqs per bus, see usb_ep_stat.h and lsusb -s */
+// #define CONFIG_USB_EP_STAT
+/* Also measure transfer latency, needs usb_trace_timestamp overridden with a us counter */
+// #define CONFIG_USB_EP_STAT_LATENCY
+
+/* Queue USB_LOG_WRN/INFO/DBG in a ring printed later by usb_log thread instead of printing in place, see usb_log.h */
+// #define CONFIG_USB_LOG_DEFERRED
+/* Messages in ring, power of 2 */
+#ifndef CONFIG_USB_LOG_MSG_NUM
+#define CONFIG_USB_LOG_MSG_NUM 64
+#endif
+/* Bytes of arguments and copied strings per message */
+#ifndef CONFIG_USB_LOG_ARG_SIZE
+#define CONFIG_USB_LOG_ARG_SIZE 32
+#endif
+/* Tags with their own runtime level, see usb_log_set_level */
+#ifndef CONFIG_USB_LOG_TAG_NUM
+#define CONFIG_USB_LOG_TAG_NUM 16
+#endif
+/* Messages per second of each log call, 0 means no limit */
+#ifndef CONFIG_USB_LOG_RATE_LIMIT
+#define CONFIG_USB_LOG_RATE_LIMIT 32
+#endif
+/* Period of usb_log thread in ms */
+#ifndef CONFIG_USB_LOG_INTERVAL
+#define CONFIG_USB_LOG_INTERVAL 100
+#endif
+/* Keep usb_log thread below the other usb threads, larger value is lower priority */
+#ifndef CONFIG_USB_LOG_PRIO
+#define CONFIG_USB_LOG_PRIO 5
+#endif
+#ifndef CONFIG_USB_LOG_STACKSIZE
+#define CONFIG_USB_LOG_STACKSIZE 2048
+#endif
+
 /* ================= USB Device Stack Configuration ================ */
 
 /* Ep0 in and out transfer buffer */
@@ -61,6 +103,13 @@
 /* enable advance desc register api */
 #define CONFIG_USBDEV_ADVANCE_DESC
 
+/* Index descriptors of the raw descriptor array once in usbd_desc_register instead of searching it on every
+ * GET_DESCRIPTOR, only used without CONFIG_USBDEV_ADVANCE_DESC, the array must not change layout after register */
+// #define CONFIG_USBDEV_DESC_INDEX
+#ifndef CONFIG_USBDEV_DESC_INDEX_NUM
+#define CONFIG_USBDEV_DESC_INDEX_NUM 32
+#endif
+
 /* move ep0 setup handler from isr to thread */
 // #define CONFIG_USBDEV_EP0_THREAD
 
@@ -72,6 +121,48 @@
 #define CONFIG_USBDEV_EP0_STACKSIZE 2048
 #endif
 
+/* Report queue for hid input interfaces, see usbd_hid_queue_init */
+// #define CONFIG_USBDEV_HID_QUEUE
+
+/* Number of hid interfaces with report queue on each bus */
+#ifndef CONFIG_USBDEV_HID_QUEUE_MAX_INTF
+#define CONFIG_USBDEV_HID_QUEUE_MAX_INTF 1
+#endif
+
+/* Reports queued on each interface, including the one in flight */
+#ifndef CONFIG_USBDEV_HID_QUEUE_DEPTH
+#define CONFIG_USBDEV_HID_QUEUE_DEPTH 8
+#endif
+
+#ifndef CONFIG_USBDEV_HID_QUEUE_MAX_REPORT_SIZE
+#define CONFIG_USBDEV_HID_QUEUE_MAX_REPORT_SIZE 64
+#endif
+
+/* ring buffered cdc acm data path, see usbd_cdc_acm_stream_init */
+// #define CONFIG_USBDEV_CDC_ACM_STREAM
+
+/* Number of cdc acm interfaces with streaming data path on each bus */
+#ifndef CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF
+#define CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF 1
+#endif
+
+/* Bulk transfer size of each out buffer and of in buffer, must be multiple of 512 */
+#ifndef CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE
+#define CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE 512
+#endif
+
+/* Rx and tx ring size of each interface, must be power of 2 */
+#ifndef CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE
+#define CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE 2048
+#endif
+
+#ifndef CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE
+#define CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE 2048
+#endif
+
+/* Also require RTS from host before sending, by default only DTR is required */
+// #define CONFIG_USBDEV_CDC_ACM_STREAM_RTS_FLOW
+
 #ifndef CONFIG_USBDEV_MSC_MAX_LUN
 #define CONFIG_USBDEV_MSC_MAX_LUN 1
 #endif
@@ -106,6 +197,20 @@
 #define CONFIG_USBDEV_MSC_STACKSIZE 2048
 #endif
 
+/* program dfu blocks in thread, next block is received while previous one is programmed */
+// #define CONFIG_USBDEV_DFU_THREAD
+
+/* program dfu blocks in while(1), you should call usbd_dfu_polling in while(1) */
+// #define CONFIG_USBDEV_DFU_POLLING
+
+#ifndef CONFIG_USBDEV_DFU_PRIO
+#define CONFIG_USBDEV_DFU_PRIO 4
+#endif
+
+#ifndef CONFIG_USBDEV_DFU_STACKSIZE
+#define CONFIG_USBDEV_DFU_STACKSIZE 2048
+#endif
+
 #ifndef CONFIG_USBDEV_MTP_MAX_BUFSIZE
 #define CONFIG_USBDEV_MTP_MAX_BUFSIZE 2048
 #endif
@@ -128,6 +233,36 @@
 #define CONFIG_USBDEV_MTP_STACKSIZE 4096
 #endif
 
+/* Max payload of one adb message, advertised to host in CNXN */
+#ifndef CONFIG_USBDEV_ADB_MAX_PAYLOAD
+#define CONFIG_USBDEV_ADB_MAX_PAYLOAD (4 * 1024)
+#endif
+
+/* Packets shared by rx and tx of all streams, at least 2 and at most 32 */
+#ifndef CONFIG_USBDEV_ADB_PACKET_NUM
+#define CONFIG_USBDEV_ADB_PACKET_NUM 4
+#endif
+
+/* Concurrent streams, local id of stream n is n + 1, ids 1 and 2 are kept for shell and file */
+#ifndef CONFIG_USBDEV_ADB_MAX_STREAMS
+#define CONFIG_USBDEV_ADB_MAX_STREAMS 4
+#endif
+
+/* Device uac explicit feedback, see usbd_audio_feedback_sof */
+/* Number of sof calls used to measure codec rate */
+#ifndef CONFIG_USBDEV_AUDIO_FEEDBACK_SOF_WINDOW
+#define CONFIG_USBDEV_AUDIO_FEEDBACK_SOF_WINDOW 512
+#endif
+
+/* Fill level controller, correction = err / 2^KP + sum(err) / 2^KI samples per (micro)frame */
+#ifndef CONFIG_USBDEV_AUDIO_FEEDBACK_KP_SHIFT
+#define CONFIG_USBDEV_AUDIO_FEEDBACK_KP_SHIFT 8
+#endif
+
+#ifndef CONFIG_USBDEV_AUDIO_FEEDBACK_KI_SHIFT
+#define CONFIG_USBDEV_AUDIO_FEEDBACK_KI_SHIFT 16
+#endif
+
 #ifndef CONFIG_USBDEV_RNDIS_RESP_BUFFER_SIZE
 #define CONFIG_USBDEV_RNDIS_RESP_BUFFER_SIZE 156
 #endif
@@ -192,6 +327,165 @@
 #define CONFIG_USBHOST_MSC_TIMEOUT 5000
 #endif
 
+/* Host msc block layer used by fatfs and filex glue, see usbh_msc_blk.h */
+/* Largest sector handled by cache and bounce buffers, bigger sectors need aligned buffers */
+#ifndef CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE
+#define CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE 512
+#endif
+
+/* Sectors of bounce buffer used for unaligned reads */
+#ifndef CONFIG_USBHOST_MSC_BLK_BOUNCE_SECTORS
+#define CONFIG_USBHOST_MSC_BLK_BOUNCE_SECTORS 4
+#endif
+
+/* Sectors of adjacent writes merged into one WRITE(10) */
+#ifndef CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS
+#define CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS 8
+#endif
+
+/* Cached metadata sectors shared by all disks, replaced in lru order */
+#ifndef CONFIG_USBHOST_MSC_BLK_CACHE_NUM
+#define CONFIG_USBHOST_MSC_BLK_CACHE_NUM 4
+#endif
+
+/* Run complete of urbs flagged USBH_URB_BH in worker threads instead of interrupt, see usbh_urb_giveback */
+// #define CONFIG_USBHOST_URB_BH
+#ifndef CONFIG_USBHOST_URB_BH_NUM
+#define CONFIG_USBHOST_URB_BH_NUM 2
+#endif
+/* Priority of worker 0, worker n runs at CONFIG_USBHOST_URB_BH_PRIO + n */
+#ifndef CONFIG_USBHOST_URB_BH_PRIO
+#define CONFIG_USBHOST_URB_BH_PRIO 0
+#endif
+#ifndef CONFIG_USBHOST_URB_BH_STACKSIZE
+#define CONFIG_USBHOST_URB_BH_STACKSIZE 2048
+#endif
+
+/* Track sync and async urb deadlines in a timer wheel per bus instead of semaphore timeouts, see usbh_urb_timer_start */
+// #define CONFIG_USBHOST_URB_TIMER
+/* Wheel tick, driven by an osal timer or, with CONFIG_USBHOST_URB_TIMER_SOF, by sof interrupt of dwc2 and musb hcd */
+#ifndef CONFIG_USBHOST_URB_TIMER_TICK_US
+#define CONFIG_USBHOST_URB_TIMER_TICK_US 1000
+#endif
+/* Hcd without sof support (ehci, rp2040) keeps semaphore timeouts for sync urbs and no async deadline */
+// #define CONFIG_USBHOST_URB_TIMER_SOF
+/* Each of the 3 wheel levels has (1 << bits) slots */
+#ifndef CONFIG_USBHOST_URB_TIMER_WHEEL_BITS
+#define CONFIG_USBHOST_URB_TIMER_WHEEL_BITS 6
+#endif
+
+/* Endpoints with counters per device when CONFIG_USB_EP_STAT is defined, including ep0 */
+#ifndef CONFIG_USBHOST_EP_STAT_NUM
+#define CONFIG_USBHOST_EP_STAT_NUM 8
+#endif
+
+/* Parse hid report descriptor into field table when connected, costs about 1K ram per hid class */
+// #define CONFIG_USBHOST_HID_PARSE_REPORT
+
+/* Max fields kept for one report descriptor, each variable usage or array takes one field */
+#ifndef CONFIG_USBHOST_HID_MAX_FIELDS
+#define CONFIG_USBHOST_HID_MAX_FIELDS 32
+#endif
+
+/* Max usages kept between two main items */
+#ifndef CONFIG_USBHOST_HID_MAX_USAGES
+#define CONFIG_USBHOST_HID_MAX_USAGES 16
+#endif
+
+/* Max usages kept for arrays whose usage list is not contiguous, shared by all fields */
+#ifndef CONFIG_USBHOST_HID_MAX_ARRAY_USAGES
+#define CONFIG_USBHOST_HID_MAX_ARRAY_USAGES 64
+#endif
+
+/* Max report ids tracked while parsing */
+#ifndef CONFIG_USBHOST_HID_MAX_REPORTS
+#define CONFIG_USBHOST_HID_MAX_REPORTS 8
+#endif
+
+/* Max report descriptor size read on connect when CONFIG_USBHOST_HID_PARSE_REPORT is enabled */
+#ifndef CONFIG_USBHOST_HID_MAX_REPORT_DESC_SIZE
+#define CONFIG_USBHOST_HID_MAX_REPORT_DESC_SIZE 512
+#endif
+
+/* Poll hid interrupt in endpoint from core and deliver reports in one shared thread, see usbh_hid_poll.h */
+// #define CONFIG_USBHOST_HID_POLL
+
+/* Report ring size of each hid class in bytes, must be power of 2 */
+#ifndef CONFIG_USBHOST_HID_POLL_RINGSIZE
+#define CONFIG_USBHOST_HID_POLL_RINGSIZE 512
+#endif
+
+/* Max interrupt in transfer size, larger endpoints are polled with this size */
+#ifndef CONFIG_USBHOST_HID_POLL_MAX_REPORT_SIZE
+#define CONFIG_USBHOST_HID_POLL_MAX_REPORT_SIZE 64
+#endif
+
+#ifndef CONFIG_USBHOST_HID_POLL_PRIO
+#define CONFIG_USBHOST_HID_POLL_PRIO (CONFIG_USBHOST_PSC_PRIO + 1)
+#endif
+
+#ifndef CONFIG_USBHOST_HID_POLL_STACKSIZE
+#define CONFIG_USBHOST_HID_POLL_STACKSIZE 2048
+#endif
+
+/* Host uvc stream engine, see usbh_uvc_stream.h */
+/* Number of transfer buffers the streaming urb takes in turn, at least 2 */
+#ifndef CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM
+#define CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM 2
+#endif
+
+/* Number of iso packets per urb, use 8 for high speed to cover one full frame */
+#ifndef CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS
+#define CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS 8
+#endif
+
+/* Max iso packet size (mps * mult), altsettings above this size are skipped.
+ * Bulk transfers use CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS * this value as transfer size.
+ */
+#ifndef CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE
+#define CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE 1024
+#endif
+
+#ifndef CONFIG_USBHOST_VIDEO_STREAM_STACKSIZE
+#define CONFIG_USBHOST_VIDEO_STREAM_STACKSIZE 2048
+#endif
+
+/* Host uac stream engine, see usbh_uac_stream.h */
+/* Number of iso urbs, each with its own buffer, kept in flight on each streaming endpoint */
+#ifndef CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM
+#define CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM 2
+#endif
+
+/* Number of iso packets per urb, in-flight latency is BUF_NUM * ISO_PACKETS * bInterval */
+#ifndef CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS
+#define CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS 2
+#endif
+
+/* Max iso packet size (mps * mult), altsettings above this size cannot be streamed */
+#ifndef CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE
+#define CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE 1024
+#endif
+
+/* Host serial layer shared by cdc acm, ftdi, ch34x, cp210x and pl2303, see usbh_serial.h */
+#ifndef CONFIG_USBHOST_MAX_SERIAL_CLASS
+#define CONFIG_USBHOST_MAX_SERIAL_CLASS 4
+#endif
+
+/* Bulk in transfer size, must be multiple of 512 */
+#ifndef CONFIG_USBHOST_SERIAL_RX_URB_SIZE
+#define CONFIG_USBHOST_SERIAL_RX_URB_SIZE 512
+#endif
+
+/* Rx ring size of each port, must be power of 2 */
+#ifndef CONFIG_USBHOST_SERIAL_RX_BUFSIZE
+#define CONFIG_USBHOST_SERIAL_RX_BUFSIZE 2048
+#endif
+
+/* Size of each of the two tx aggregation buffers */
+#ifndef CONFIG_USBHOST_SERIAL_TX_BUFSIZE
+#define CONFIG_USBHOST_SERIAL_TX_BUFSIZE 512
+#endif
+
 /* Match Linux CDC-ACM style RNDIS gadgets (class 0x02 / subclass 0x02 / protocol 0xFF) */
 /* #define CONFIG_USBHOST_RNDIS_LINUX_GADGET */
 
@@ -224,10 +518,20 @@
 #ifndef CONFIG_USBHOST_ASIX_ETH_MAX_RX_SIZE
 #define CONFIG_USBHOST_ASIX_ETH_MAX_RX_SIZE (2048)
 #endif
-/* Because lwip do not support multi pbuf at a time, so increasing this variable has no performance improvement */
+/* Without CONFIG_USBHOST_NET_TXQ one frame is sent at a time, so increasing this variable has no performance improvement.
+ * With it, packing needs 1520 bytes per full frame (4 byte header, 1514 byte frame, even padding) plus 4 for the zero
+ * length header, so 2048 packs small frames only, use 4K for two full frames or up to 16K.
+ */
 #ifndef CONFIG_USBHOST_ASIX_ETH_MAX_TX_SIZE
 #define CONFIG_USBHOST_ASIX_ETH_MAX_TX_SIZE (2048)
 #endif
+/* Rx buffers taking turns on asix bulk in urb, every one is CONFIG_USBHOST_ASIX_ETH_MAX_RX_SIZE. More than 1
+ * restarts the urb from its completion while rx thread parses, needs CONFIG_USBHOST_URB_BH. With CONFIG_USBHOST_NET_TXQ,
+ * frames waiting for the bus are packed into tx buffer (up to 16K), so a tx size of several frames helps as well.
+ */
+#ifndef CONFIG_USBHOST_ASIX_RX_URB_NUM
+#define CONFIG_USBHOST_ASIX_RX_URB_NUM 1
+#endif
 
 /* This parameter affects usb performance, and depends on (TCP_WND)tcp eceive windows size,
  * you can change to 2K ~ 16K and must be larger than TCP RX windows size in order to avoid being overflow.
@@ -239,9 +543,49 @@
 #ifndef CONFIG_USBHOST_RTL8152_ETH_MAX_TX_SIZE
 #define CONFIG_USBHOST_RTL8152_ETH_MAX_TX_SIZE (2048)
 #endif
+/* Rx buffers taking turns on rtl8152 bulk in urb, every one is CONFIG_USBHOST_RTL8152_ETH_MAX_RX_SIZE. More than 1
+ * restarts the urb from its completion while rx thread parses, needs CONFIG_USBHOST_URB_BH. With CONFIG_USBHOST_NET_TXQ,
+ * frames waiting for the bus are packed into tx buffer, so a tx size of several frames helps as well.
+ */
+#ifndef CONFIG_USBHOST_RTL8152_RX_URB_NUM
+#define CONFIG_USBHOST_RTL8152_RX_URB_NUM 1
+#endif
+/* Chip fills tcp/udp checksums of sent frames, received frames are still checked by the stack. lwip glue turns off
+ * tcp/udp checksum generation of the netif and needs LWIP_CHECKSUM_CTRL_PER_NETIF, other stacks must do it themselves.
+ */
+// #define CONFIG_USBHOST_RTL8152_CSUM_OFFLOAD
+
+/* Receive host net frames into a pool of refcounted blocks and pass them to lwip as custom pbufs without copy,
+ * drivers whose rx size is larger than CONFIG_USBHOST_NET_RXBUF_SIZE keep their own buffer and warn at build time,
+ * so set it to the largest rx size of the enabled drivers (16K for cdc ncm by default), see usbh_net_rxbuf.h
+ */
+// #define CONFIG_USBHOST_NET_RXBUF
+
+#ifndef CONFIG_USBHOST_NET_RXBUF_NUM
+#define CONFIG_USBHOST_NET_RXBUF_NUM 8
+#endif
+#ifndef CONFIG_USBHOST_NET_RXBUF_SIZE
+#define CONFIG_USBHOST_NET_RXBUF_SIZE (2048)
+#endif
+/* Frames held by lwip at the same time, one custom pbuf each */
+#ifndef CONFIG_USBHOST_NET_RXBUF_PBUF_NUM
+#define CONFIG_USBHOST_NET_RXBUF_PBUF_NUM 32
+#endif
+
+/* Send host net frames from the pbuf itself through a queue completed in urb bh workers instead of copying
+ * them and waiting for the bus, needs CONFIG_USBHOST_URB_BH. PBUF_LINK_ENCAPSULATION_HLEN must leave room for
+ * the driver header (USBH_XXX_TX_HEADROOM) and pbuf memory must be usable by usb dma, other frames are copied.
+ */
+// #define CONFIG_USBHOST_NET_TXQ
+
+#ifndef CONFIG_USBHOST_NET_TXQ_NUM
+#define CONFIG_USBHOST_NET_TXQ_NUM 8
+#endif
 
 #define CONFIG_USBHOST_BLUETOOTH_HCI_H4
 // #define CONFIG_USBHOST_BLUETOOTH_HCI_LOG
+/* Voice over isochronous endpoints of interface 1 */
+// #define CONFIG_USBHOST_BLUETOOTH_SCO
 
 #ifndef CONFIG_USBHOST_BLUETOOTH_TX_SIZE
 #define CONFIG_USBHOST_BLUETOOTH_TX_SIZE 2048
@@ -250,6 +594,30 @@
 #define CONFIG_USBHOST_BLUETOOTH_RX_SIZE 2048
 #endif
 
+/* Bulk in transfer size, must be multiple of 512 */
+#ifndef CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE
+#define CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE 512
+#endif
+
+/* Ring of reassembled acl or h4 packets waiting for rx thread, must be power of 2 */
+#ifndef CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE
+#define CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE 4096
+#endif
+
+/* Ring of packets queued for bulk out, must be power of 2 */
+#ifndef CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE
+#define CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE 4096
+#endif
+
+#ifndef CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS
+#define CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS 8
+#endif
+
+/* Sco rx and tx ring size, must be power of 2 */
+#ifndef CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE
+#define CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE 1024
+#endif
+
 /* ================ USB Device Port Configuration ================*/
 
 #ifndef CONFIG_USBDEV_MAX_BUS
@@ -6,28 +6,33 @@
 #include "usbd_core.h"
 #include "usbd_adb.h"
 
-#define ADB_OUT_EP_IDX        0
-#define ADB_IN_EP_IDX         1
-
-#define ADB_STATE_READ_MSG    0
-#define ADB_STATE_READ_DATA   1
-#define ADB_STATE_WRITE_MSG   2
-#define ADB_STATE_WRITE_DATA  3
-#define ADB_STATE_AWRITE_MSG  4
-#define ADB_STATE_AWRITE_DATA 5
-
-#define MAX_PAYLOAD_V1        (4 * 1024)
-#define MAX_PAYLOAD_V2        (256 * 1024)
-#define MAX_PAYLOAD           MAX_PAYLOAD_V1
-#define A_VERSION             0x01000000
-
-#define A_SYNC                0x434e5953
-#define A_CNXN                0x4e584e43
-#define A_OPEN                0x4e45504f
-#define A_OKAY                0x59414b4f
-#define A_CLSE                0x45534c43
-#define A_WRTE                0x45545257
-#define A_AUTH                0x48545541
+#if (CONFIG_USBDEV_ADB_PACKET_NUM < 2) || (CONFIG_USBDEV_ADB_PACKET_NUM > 32)
+#error "CONFIG_USBDEV_ADB_PACKET_NUM must be between 2 and 32"
+#endif
+
+#define ADB_OUT_EP_IDX          0
+#define ADB_IN_EP_IDX           1
+
+#define ADB_STATE_READ_MSG      0
+#define ADB_STATE_READ_DATA     1
+#define ADB_STATE_WRITE_MSG     2
+#define ADB_STATE_WRITE_DATA    3
+
+#define A_VERSION_MIN           0x01000000
+#define A_VERSION_SKIP_CHECKSUM 0x01000001
+#define A_VERSION               A_VERSION_SKIP_CHECKSUM
+
+#define A_SYNC                  0x434e5953
+#define A_CNXN                  0x4e584e43
+#define A_OPEN                  0x4e45504f
+#define A_OKAY                  0x59414b4f
+#define A_CLSE                  0x45534c43
+#define A_WRTE                  0x45545257
+#define A_AUTH                  0x48545541
+
+#define ADB_SERVICE_NONE        0
+#define ADB_SERVICE_SHELL       1
+#define ADB_SERVICE_SYNC        2
 
 struct adb_msg {
     uint32_t command;     /* command identifier constant (A_CNXN, ...) */
@@ -40,206 +45,501 @@ struct adb_msg {
 
 struct adb_packet {
     USB_MEM_ALIGNX struct adb_msg msg;
-    USB_MEM_ALIGNX uint8_t payload[USB_ALIGN_UP(MAX_PAYLOAD, CONFIG_USB_ALIGN_SIZE)];
+    /* one more byte for terminating destination and banner strings */
+    USB_MEM_ALIGNX uint8_t payload[USB_ALIGN_UP(CONFIG_USBDEV_ADB_MAX_PAYLOAD + 1, CONFIG_USB_ALIGN_SIZE)];
+};
+
+struct usbd_adb_stream {
+    uint32_t remoteid;
+    uint8_t service;
+    bool open;
+    bool close_pending; /* CLSE waiting for a free packet */
+    bool inflight;      /* WRTE waiting for OKAY, without delayed ack */
+    int32_t window;     /* bytes host still accepts, with delayed ack */
 };
 
 struct usbd_adb {
-    uint8_t state;
-    uint8_t common_state;
-    uint8_t write_state;
-    bool writable;
-    uint32_t localid;
-    uint32_t shell_remoteid;
-    uint32_t file_remoteid;
-} adb_client;
+    uint8_t busid;
+    bool delayed_ack;
+    uint32_t version;
+    uint32_t max_payload;
+
+    uint32_t free_mask;
+    uint8_t rx_state;
+    uint8_t rx_index;
+    bool rx_armed;
+    bool rx_wait; /* out ep is idle until a packet is freed */
+
+    uint8_t tx_state;
+    uint8_t tx_index;
+    bool tx_busy;
+    uint8_t tx_head;
+    uint8_t tx_count;
+    uint8_t tx_fifo[CONFIG_USBDEV_ADB_PACKET_NUM];
+
+    struct usbd_adb_stream stream[CONFIG_USBDEV_ADB_MAX_STREAMS];
+} g_usbd_adb;
 
 static struct usbd_endpoint adb_ep_data[2];
 
-USB_NOCACHE_RAM_SECTION struct adb_packet tx_packet;
-USB_NOCACHE_RAM_SECTION struct adb_packet rx_packet;
+USB_NOCACHE_RAM_SECTION struct adb_packet g_adb_packet[CONFIG_USBDEV_ADB_PACKET_NUM];
+
+static const char adb_banner[] = "device::"
+                                 "ro.product.name=cherryadb;"
+                                 "ro.product.model=cherrysh;"
+                                 "ro.product.device=cherryadb;"
+                                 "features=cmd,shell_v1,delayed_ack";
 
-static inline uint32_t adb_packet_checksum(struct adb_packet *packet)
+/* Sum of payload bytes, two 16 bit lanes per word are folded before they can overflow */
+static uint32_t adb_checksum(const uint8_t *data, uint32_t len)
 {
+    const uint32_t *p;
     uint32_t sum = 0;
-    uint32_t i;
+    uint32_t lanes;
+    uint32_t count;
+    uint32_t w;
+
+    while (len && ((uintptr_t)data & 3)) {
+        sum += *data++;
+        len--;
+    }
+
+    p = (const uint32_t *)data;
+    while (len >= 4) {
+        count = MIN(len / 4, 128);
+        len -= count * 4;
+        lanes = 0;
+        while (count--) {
+            w = *p++;
+            lanes += (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
+        }
+        sum += (lanes & 0xffff) + (lanes >> 16);
+    }
 
-    for (i = 0; i < packet->msg.data_length; ++i) {
-        sum += (uint32_t)(packet->payload[i]);
+    data = (const uint8_t *)p;
+    while (len--) {
+        sum += *data++;
     }
 
     return sum;
 }
 
-static uint32_t usbd_adb_get_remoteid(uint32_t localid)
+static void adb_packet_prepare(struct adb_packet *packet)
 {
-    if (localid == ADB_SHELL_LOALID) {
-        return adb_client.shell_remoteid;
+    if ((g_usbd_adb.version >= A_VERSION_SKIP_CHECKSUM) || (packet->msg.data_length == 0)) {
+        packet->msg.data_crc32 = 0;
     } else {
-        return adb_client.file_remoteid;
+        packet->msg.data_crc32 = adb_checksum(packet->payload, packet->msg.data_length);
     }
+    packet->msg.magic = packet->msg.command ^ 0xffffffff;
 }
 
-static void adb_send_msg(struct adb_packet *packet)
+/* Call with critical section held. reserve keeps packets back for rx */
+static int adb_packet_alloc(uint8_t reserve)
 {
-    adb_client.common_state = ADB_STATE_WRITE_MSG;
+    uint32_t free_mask = g_usbd_adb.free_mask;
+    uint8_t count = 0;
 
-    packet->msg.data_crc32 = adb_packet_checksum(packet);
-    packet->msg.magic = packet->msg.command ^ 0xffffffff;
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_PACKET_NUM; i++) {
+        if (free_mask & (1U << i)) {
+            count++;
+        }
+    }
 
-    usbd_ep_start_write(0, adb_ep_data[ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
+    if (count <= reserve) {
+        return -1;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_PACKET_NUM; i++) {
+        if (free_mask & (1U << i)) {
+            g_usbd_adb.free_mask &= ~(1U << i);
+            return i;
+        }
+    }
+    return -1;
 }
 
-static void adb_send_okay(struct adb_packet *packet, uint32_t localid)
+static void adb_tx_start(void)
 {
-    packet->msg.command = A_OKAY;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = usbd_adb_get_remoteid(localid);
-    packet->msg.data_length = 0;
+    struct adb_packet *packet;
+    size_t flags;
 
-    adb_send_msg(&tx_packet);
+    flags = usb_osal_enter_critical_section();
+    if (g_usbd_adb.tx_busy || (g_usbd_adb.tx_count == 0)) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    g_usbd_adb.tx_busy = true;
+    g_usbd_adb.tx_index = g_usbd_adb.tx_fifo[g_usbd_adb.tx_head];
+    g_usbd_adb.tx_head = (g_usbd_adb.tx_head + 1) % CONFIG_USBDEV_ADB_PACKET_NUM;
+    g_usbd_adb.tx_count--;
+    g_usbd_adb.tx_state = ADB_STATE_WRITE_MSG;
+    usb_osal_leave_critical_section(flags);
+
+    packet = &g_adb_packet[g_usbd_adb.tx_index];
+    usbd_ep_start_write(g_usbd_adb.busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
 }
 
-static void adb_send_close(struct adb_packet *packet, uint32_t localid, uint32_t remoteid)
+static void adb_tx_queue(uint8_t index)
 {
-    packet->msg.command = A_CLSE;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = remoteid;
-    packet->msg.data_length = 0;
+    size_t flags;
 
-    adb_send_msg(&tx_packet);
+    adb_packet_prepare(&g_adb_packet[index]);
+
+    flags = usb_osal_enter_critical_section();
+    g_usbd_adb.tx_fifo[(g_usbd_adb.tx_head + g_usbd_adb.tx_count) % CONFIG_USBDEV_ADB_PACKET_NUM] = index;
+    g_usbd_adb.tx_count++;
+    usb_osal_leave_critical_section(flags);
+
+    adb_tx_start();
 }
 
-void usbd_adb_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
+static void adb_send_reply(uint8_t index, uint32_t command, uint32_t arg0, uint32_t arg1, const void *data, uint32_t len)
 {
-    (void)ep;
+    struct adb_packet *packet = &g_adb_packet[index];
 
-    if (adb_client.common_state == ADB_STATE_READ_MSG) {
-        if (nbytes != sizeof(struct adb_msg)) {
-            USB_LOG_ERR("invalid adb msg size:%d\r\n", (unsigned int)nbytes);
+    packet->msg.command = command;
+    packet->msg.arg0 = arg0;
+    packet->msg.arg1 = arg1;
+    packet->msg.data_length = len;
+    if (len) {
+        memmove(packet->payload, data, len);
+    }
+
+    adb_tx_queue(index);
+}
+
+/* Reply OKAY, with delayed ack the payload carries bytes host may send */
+static void adb_send_okay(uint8_t index, uint32_t localid, uint32_t remoteid, uint32_t acked)
+{
+    uint8_t data[4];
+
+    if (g_usbd_adb.delayed_ack) {
+        data[0] = acked & 0xff;
+        data[1] = (acked >> 8) & 0xff;
+        data[2] = (acked >> 16) & 0xff;
+        data[3] = (acked >> 24) & 0xff;
+        adb_send_reply(index, A_OKAY, localid, remoteid, data, 4);
+    } else {
+        adb_send_reply(index, A_OKAY, localid, remoteid, NULL, 0);
+    }
+}
+
+static void adb_rx_arm(void)
+{
+    size_t flags;
+    int index;
+
+    flags = usb_osal_enter_critical_section();
+    if (g_usbd_adb.rx_armed) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    index = adb_packet_alloc(0);
+    if (index < 0) {
+        g_usbd_adb.rx_wait = true;
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    g_usbd_adb.rx_armed = true;
+    g_usbd_adb.rx_wait = false;
+    g_usbd_adb.rx_index = index;
+    g_usbd_adb.rx_state = ADB_STATE_READ_MSG;
+    usb_osal_leave_critical_section(flags);
+
+    usbd_ep_start_read(g_usbd_adb.busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&g_adb_packet[index].msg, sizeof(struct adb_msg));
+}
+
+static void adb_packet_free(uint8_t index)
+{
+    size_t flags;
+    bool rx_wait;
+
+    flags = usb_osal_enter_critical_section();
+    g_usbd_adb.free_mask |= (1U << index);
+    rx_wait = g_usbd_adb.rx_wait;
+    usb_osal_leave_critical_section(flags);
+
+    if (rx_wait) {
+        adb_rx_arm();
+    }
+}
+
+static struct usbd_adb_stream *adb_get_stream(uint32_t localid)
+{
+    if ((localid == 0) || (localid > CONFIG_USBDEV_ADB_MAX_STREAMS)) {
+        return NULL;
+    }
+    return &g_usbd_adb.stream[localid - 1];
+}
+
+/* Stream addressed by host message, arg0 is remote id and arg1 is local id */
+static struct usbd_adb_stream *adb_find_stream(struct adb_msg *msg)
+{
+    struct usbd_adb_stream *stream = adb_get_stream(msg->arg1);
+
+    if (stream && stream->open && (stream->remoteid == msg->arg0)) {
+        return stream;
+    }
+    return NULL;
+}
+
+static int adb_stream_alloc(uint8_t service)
+{
+    uint8_t prefer = (service == ADB_SERVICE_SYNC) ? (ADB_FILE_LOALID - 1) : (ADB_SHELL_LOALID - 1);
+    struct usbd_adb_stream *stream;
+
+    if ((prefer < CONFIG_USBDEV_ADB_MAX_STREAMS) && !g_usbd_adb.stream[prefer].open && !g_usbd_adb.stream[prefer].close_pending) {
+        return prefer;
+    }
+
+    /* shell and file local ids are kept for their own service, other streams take the rest */
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        if ((i == (ADB_SHELL_LOALID - 1)) || (i == (ADB_FILE_LOALID - 1))) {
+            continue;
+        }
+        stream = &g_usbd_adb.stream[i];
+        if (!stream->open && !stream->close_pending) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void adb_send_pending_close(void)
+{
+    struct usbd_adb_stream *stream;
+    size_t flags;
+    int index;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        stream = &g_usbd_adb.stream[i];
+
+        flags = usb_osal_enter_critical_section();
+        if (!stream->close_pending) {
+            usb_osal_leave_critical_section(flags);
+            continue;
+        }
+        index = adb_packet_alloc(0);
+        if (index >= 0) {
+            stream->close_pending = false;
+        }
+        usb_osal_leave_critical_section(flags);
+
+        if (index < 0) {
             return;
         }
+        adb_send_reply(index, A_CLSE, i + 1, stream->remoteid, NULL, 0);
+    }
+}
 
-        USB_LOG_DBG("command:%x arg0:%x arg1:%x len:%d\r\n",
-                     rx_packet.msg.command,
-                     rx_packet.msg.arg0,
-                     rx_packet.msg.arg1,
-                     rx_packet.msg.data_length);
+static void adb_close_all(void)
+{
+    struct usbd_adb_stream *stream;
 
-        if (rx_packet.msg.data_length) {
-            /* setup next out ep read transfer */
-            adb_client.common_state = ADB_STATE_READ_DATA;
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, rx_packet.payload, rx_packet.msg.data_length);
-        } else {
-            if (rx_packet.msg.command == A_CLSE) {
-                adb_client.writable = false;
-                usbd_adb_notify_write_done();
-                USB_LOG_INFO("Close remoteid:%x\r\n", rx_packet.msg.arg0);
-            }
-            adb_client.common_state = ADB_STATE_READ_MSG;
-            /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
+    for (uint8_t i = 0; i < CONFIG_USBDEV_ADB_MAX_STREAMS; i++) {
+        stream = &g_usbd_adb.stream[i];
+        if (stream->open) {
+            stream->open = false;
+            usbd_adb_notify_close(i + 1);
         }
-    } else if (adb_client.common_state == ADB_STATE_READ_DATA) {
-        switch (rx_packet.msg.command) {
-            case A_SYNC:
-
-                break;
-            case A_CNXN: /* CONNECT(version, maxdata, "system-id-string") */
-                char *support_feature = "device::"
-                                        "ro.product.name=cherryadb;"
-                                        "ro.product.model=cherrysh;"
-                                        "ro.product.device=cherryadb;"
-                                        "features=cmd,shell_v1";
-
-                tx_packet.msg.command = A_CNXN;
-                tx_packet.msg.arg0 = A_VERSION;
-                tx_packet.msg.arg1 = MAX_PAYLOAD;
-                tx_packet.msg.data_length = strlen(support_feature);
-                memcpy(tx_packet.payload, support_feature, strlen(support_feature));
-
-                adb_send_msg(&tx_packet);
-
-                adb_client.writable = false;
-                break;
-            case A_OPEN: /* OPEN(local-id, 0, "destination") */
-                rx_packet.payload[rx_packet.msg.data_length] = '\0';
-
-                if (strncmp((const char *)rx_packet.payload, "shell:", 6) == 0) {
-                    adb_client.localid = ADB_SHELL_LOALID;
-                    adb_client.shell_remoteid = rx_packet.msg.arg0;
-                    adb_send_okay(&tx_packet, ADB_SHELL_LOALID);
-
-                    USB_LOG_INFO("Open shell service, remoteid:%x\r\n", rx_packet.msg.arg0);
-                } else if (strncmp((const char *)rx_packet.payload, "sync:", 5) == 0) {
-                    adb_client.localid = ADB_FILE_LOALID;
-                    adb_client.file_remoteid = rx_packet.msg.arg0;
-                    adb_send_okay(&tx_packet, ADB_FILE_LOALID);
-                    USB_LOG_INFO("Open file service, remoteid:%x\r\n", rx_packet.msg.arg0);
-                }
-                break;
-            case A_OKAY:
-
-                break;
-            case A_CLSE:
-
-                break;
-            case A_WRTE: /* WRITE(local-id, remote-id, "data") */
-                if ((rx_packet.msg.arg0 == adb_client.shell_remoteid) && (rx_packet.msg.arg1 == ADB_SHELL_LOALID)) {
-                    adb_send_okay(&tx_packet, rx_packet.msg.arg1);
-                } else if ((rx_packet.msg.arg0 == adb_client.file_remoteid) && (rx_packet.msg.arg1 == ADB_FILE_LOALID)) {
-                    adb_send_okay(&tx_packet, rx_packet.msg.arg1);
+        memset(stream, 0, sizeof(struct usbd_adb_stream));
+    }
+}
+
+static void adb_handle_cnxn(uint8_t index)
+{
+    struct adb_packet *packet = &g_adb_packet[index];
+
+    /* CONNECT(version, maxdata, "system-id-string") */
+    packet->payload[packet->msg.data_length] = '\0';
+
+    adb_close_all();
+    g_usbd_adb.version = MIN(packet->msg.arg0, A_VERSION);
+    g_usbd_adb.max_payload = MIN(packet->msg.arg1, CONFIG_USBDEV_ADB_MAX_PAYLOAD);
+    g_usbd_adb.delayed_ack = (strstr((const char *)packet->payload, "delayed_ack") != NULL);
+
+    USB_LOG_INFO("Connect version:%x maxdata:%u delayed_ack:%d\r\n", (unsigned int)g_usbd_adb.version,
+                 (unsigned int)g_usbd_adb.max_payload, g_usbd_adb.delayed_ack);
+
+    adb_send_reply(index, A_CNXN, A_VERSION, CONFIG_USBDEV_ADB_MAX_PAYLOAD, adb_banner, strlen(adb_banner));
+}
+
+static void adb_handle_open(uint8_t index)
+{
+    struct adb_packet *packet = &g_adb_packet[index];
+    struct usbd_adb_stream *stream;
+    uint32_t remoteid = packet->msg.arg0;
+    uint8_t service;
+    int slot;
+
+    /* OPEN(local-id, window, "destination") */
+    packet->payload[packet->msg.data_length] = '\0';
+
+    if (strncmp((const char *)packet->payload, "shell:", 6) == 0) {
+        service = ADB_SERVICE_SHELL;
+    } else if (strncmp((const char *)packet->payload, "sync:", 5) == 0) {
+        service = ADB_SERVICE_SYNC;
+    } else {
+        service = ADB_SERVICE_NONE;
+    }
+
+    slot = (service != ADB_SERVICE_NONE) ? adb_stream_alloc(service) : -1;
+    if (slot < 0) {
+        USB_LOG_WRN("Refuse service %s\r\n", (const char *)packet->payload);
+        adb_send_reply(index, A_CLSE, 0, remoteid, NULL, 0);
+        return;
+    }
+
+    stream = &g_usbd_adb.stream[slot];
+    stream->remoteid = remoteid;
+    stream->service = service;
+    stream->inflight = false;
+    stream->window = g_usbd_adb.delayed_ack ? (int32_t)packet->msg.arg1 : 0;
+
+    USB_LOG_INFO("Open %s, localid:%x remoteid:%x\r\n", (const char *)packet->payload, slot + 1, (unsigned int)remoteid);
+    usbd_adb_notify_open(slot + 1, (const char *)packet->payload);
+
+    /* our window covers every packet of the pool */
+    adb_send_okay(index, slot + 1, remoteid, CONFIG_USBDEV_ADB_PACKET_NUM * CONFIG_USBDEV_ADB_MAX_PAYLOAD);
+    stream->open = true;
+}
+
+static void adb_handle_msg(uint8_t index)
+{
+    struct adb_packet *packet = &g_adb_packet[index];
+    struct usbd_adb_stream *stream;
+    uint32_t acked;
+    uint32_t len;
+    size_t flags;
+
+    USB_LOG_DBG("command:%x arg0:%x arg1:%x len:%d\r\n",
+                packet->msg.command,
+                packet->msg.arg0,
+                packet->msg.arg1,
+                packet->msg.data_length);
+
+    switch (packet->msg.command) {
+        case A_CNXN:
+            adb_handle_cnxn(index);
+            return;
+        case A_OPEN:
+            adb_handle_open(index);
+            return;
+        case A_OKAY: /* READY(remote-id, local-id, [acked]) */
+            stream = adb_find_stream(&packet->msg);
+            if (stream) {
+                flags = usb_osal_enter_critical_section();
+                if (g_usbd_adb.delayed_ack && (packet->msg.data_length == 4)) {
+                    acked = packet->payload[0] | (packet->payload[1] << 8) | (packet->payload[2] << 16) | ((uint32_t)packet->payload[3] << 24);
+                    stream->window += (int32_t)acked;
                 } else {
-                    adb_send_close(&tx_packet, 0, rx_packet.msg.arg0);
+                    stream->inflight = false;
                 }
-                break;
-            case A_AUTH:
+                usb_osal_leave_critical_section(flags);
+                usbd_adb_notify_write_done();
+            }
+            break;
+        case A_WRTE: /* WRITE(remote-id, local-id, "data") */
+            stream = adb_find_stream(&packet->msg);
+            if (stream == NULL) {
+                adb_send_reply(index, A_CLSE, 0, packet->msg.arg0, NULL, 0);
+                return;
+            }
+            len = packet->msg.data_length;
+            usbd_adb_notify_read(packet->msg.arg1, packet->payload, len);
+            adb_send_okay(index, packet->msg.arg1, packet->msg.arg0, len);
+            return;
+        case A_CLSE: /* CLOSE(remote-id, local-id) */
+            stream = adb_get_stream(packet->msg.arg1);
+            if (stream && stream->open && ((packet->msg.arg0 == 0) || (stream->remoteid == packet->msg.arg0))) {
+                USB_LOG_INFO("Close localid:%x remoteid:%x\r\n", (unsigned int)packet->msg.arg1, (unsigned int)packet->msg.arg0);
+                stream->open = false;
+                usbd_adb_notify_close(packet->msg.arg1);
+                usbd_adb_notify_write_done();
+            }
+            break;
+        case A_SYNC:
+        case A_AUTH:
+        default:
+            break;
+    }
+
+    adb_packet_free(index);
+}
 
-                break;
+void usbd_adb_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct adb_packet *packet = &g_adb_packet[g_usbd_adb.rx_index];
+    uint8_t index = g_usbd_adb.rx_index;
+
+    (void)ep;
+
+    if (g_usbd_adb.rx_state == ADB_STATE_READ_MSG) {
+        if ((nbytes != sizeof(struct adb_msg)) || (packet->msg.magic != (packet->msg.command ^ 0xffffffff)) ||
+            (packet->msg.data_length > CONFIG_USBDEV_ADB_MAX_PAYLOAD)) {
+            USB_LOG_ERR("invalid adb msg size:%d\r\n", (unsigned int)nbytes);
+            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
+            return;
+        }
 
-            default:
-                break;
+        if (packet->msg.data_length) {
+            g_usbd_adb.rx_state = ADB_STATE_READ_DATA;
+            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, packet->payload, packet->msg.data_length);
+            return;
         }
     }
+
+    /* keep out ep busy with the next message while this one is handled */
+    g_usbd_adb.rx_armed = false;
+    adb_rx_arm();
+
+    adb_handle_msg(index);
 }
 
 void usbd_adb_bulk_in(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    struct adb_packet *packet = &g_adb_packet[g_usbd_adb.tx_index];
+    size_t flags;
+
     (void)ep;
     (void)nbytes;
 
-    if (adb_client.common_state == ADB_STATE_WRITE_MSG) {
-        if (tx_packet.msg.data_length) {
-            adb_client.common_state = ADB_STATE_WRITE_DATA;
-            usbd_ep_start_write(busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, tx_packet.payload, tx_packet.msg.data_length);
-        } else {
-            if (rx_packet.msg.command == A_WRTE) {
-                adb_client.writable = true;
-                if (adb_client.localid == ADB_SHELL_LOALID) {
-                    usbd_adb_notify_shell_read(rx_packet.payload, rx_packet.msg.data_length);
-                } else {
-                }
-            }
-            adb_client.common_state = ADB_STATE_READ_MSG;
-            /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
-        }
-    } else if (adb_client.common_state == ADB_STATE_WRITE_DATA) {
-        adb_client.common_state = ADB_STATE_READ_MSG;
-        /* setup first out ep read transfer */
-        usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
-    } else if (adb_client.write_state == ADB_STATE_AWRITE_MSG) {
-        if (tx_packet.msg.data_length) {
-            adb_client.write_state = ADB_STATE_AWRITE_DATA;
-            usbd_ep_start_write(busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, tx_packet.payload, tx_packet.msg.data_length);
-        } else {
-        }
-    } else if (adb_client.write_state == ADB_STATE_AWRITE_DATA) {
-        usbd_adb_notify_write_done();
+    if ((g_usbd_adb.tx_state == ADB_STATE_WRITE_MSG) && packet->msg.data_length) {
+        g_usbd_adb.tx_state = ADB_STATE_WRITE_DATA;
+        usbd_ep_start_write(busid, adb_ep_data[ADB_IN_EP_IDX].ep_addr, packet->payload, packet->msg.data_length);
+        return;
     }
+
+    flags = usb_osal_enter_critical_section();
+    g_usbd_adb.tx_busy = false;
+    usb_osal_leave_critical_section(flags);
+
+    adb_packet_free(g_usbd_adb.tx_index);
+    adb_tx_start();
+    adb_send_pending_close();
+
+    usbd_adb_notify_write_done();
+}
+
+static void adb_reset(void)
+{
+    adb_close_all();
+
+    g_usbd_adb.version = A_VERSION_MIN;
+    g_usbd_adb.max_payload = CONFIG_USBDEV_ADB_MAX_PAYLOAD;
+    g_usbd_adb.delayed_ack = false;
+    g_usbd_adb.free_mask = 0xffffffffU >> (32 - CONFIG_USBDEV_ADB_PACKET_NUM);
+    g_usbd_adb.rx_armed = false;
+    g_usbd_adb.rx_wait = false;
+    g_usbd_adb.tx_busy = false;
+    g_usbd_adb.tx_head = 0;
+    g_usbd_adb.tx_count = 0;
 }
 
 void adb_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
+    (void)busid;
     (void)arg;
 
     switch (event) {
@@ -248,11 +548,13 @@ void adb_notify_handler(uint8_t busid, uint8_t event, void *arg)
         case USBD_EVENT_DEINIT:
             break;
         case USBD_EVENT_RESET:
+            adb_reset();
+            usbd_adb_notify_write_done();
             break;
         case USBD_EVENT_CONFIGURED:
-            adb_client.common_state = ADB_STATE_READ_MSG;
+            adb_reset();
             /* setup first out ep read transfer */
-            usbd_ep_start_read(busid, adb_ep_data[ADB_OUT_EP_IDX].ep_addr, (uint8_t *)&rx_packet.msg, sizeof(struct adb_msg));
+            adb_rx_arm();
             break;
 
         default:
@@ -262,13 +564,13 @@ void adb_notify_handler(uint8_t busid, uint8_t event, void *arg)
 
 struct usbd_interface *usbd_adb_init_intf(uint8_t busid, struct usbd_interface *intf, uint8_t in_ep, uint8_t out_ep)
 {
-    (void)busid;
-
     intf->class_interface_handler = NULL;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
     intf->notify_handler = adb_notify_handler;
 
+    g_usbd_adb.busid = busid;
+
     adb_ep_data[ADB_OUT_EP_IDX].ep_addr = out_ep;
     adb_ep_data[ADB_OUT_EP_IDX].ep_cb = usbd_adb_bulk_out;
     adb_ep_data[ADB_IN_EP_IDX].ep_addr = in_ep;
@@ -280,31 +582,137 @@ struct usbd_interface *usbd_adb_init_intf(uint8_t busid, struct usbd_interface *
     return intf;
 }
 
+int usbd_adb_write(uint32_t localid, const uint8_t *data, uint32_t len)
+{
+    struct usbd_adb_stream *stream = adb_get_stream(localid);
+    struct adb_packet *packet;
+    uint32_t written = 0;
+    uint32_t remoteid;
+    uint32_t chunk;
+    size_t flags;
+    int index;
+    int ret = 0;
+
+    if (stream == NULL) {
+        return -USB_ERR_INVAL;
+    }
+
+    while (written < len) {
+        flags = usb_osal_enter_critical_section();
+        if (!stream->open) {
+            usb_osal_leave_critical_section(flags);
+            ret = -USB_ERR_NOTCONN;
+            break;
+        }
+
+        chunk = MIN(len - written, g_usbd_adb.max_payload);
+        if (g_usbd_adb.delayed_ack) {
+            chunk = (stream->window > 0) ? MIN(chunk, (uint32_t)stream->window) : 0;
+        } else if (stream->inflight) {
+            chunk = 0;
+        }
+
+        /* the last free packet is kept for rx */
+        index = chunk ? adb_packet_alloc(1) : -1;
+        if (index < 0) {
+            usb_osal_leave_critical_section(flags);
+            ret = -USB_ERR_BUSY;
+            break;
+        }
+
+        if (g_usbd_adb.delayed_ack) {
+            stream->window -= chunk;
+        } else {
+            stream->inflight = true;
+        }
+        remoteid = stream->remoteid;
+        usb_osal_leave_critical_section(flags);
+
+        packet = &g_adb_packet[index];
+        packet->msg.command = A_WRTE;
+        packet->msg.arg0 = localid;
+        packet->msg.arg1 = remoteid;
+        packet->msg.data_length = chunk;
+        memcpy(packet->payload, &data[written], chunk);
+        adb_tx_queue(index);
+
+        written += chunk;
+    }
+
+    if (written) {
+        return written;
+    }
+    return ret;
+}
+
+bool usbd_adb_is_open(uint32_t localid)
+{
+    struct usbd_adb_stream *stream = adb_get_stream(localid);
+
+    return stream && stream->open;
+}
+
+void usbd_adb_close(uint32_t localid)
+{
+    struct usbd_adb_stream *stream = adb_get_stream(localid);
+    size_t flags;
+    int index;
+
+    if (stream == NULL) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (!stream->open) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    stream->open = false;
+    index = adb_packet_alloc(1);
+    if (index < 0) {
+        stream->close_pending = true;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (index >= 0) {
+        adb_send_reply(index, A_CLSE, localid, stream->remoteid, NULL, 0);
+    }
+}
+
 bool usbd_adb_can_write(void)
 {
-    return adb_client.writable;
+    return usbd_adb_is_open(ADB_SHELL_LOALID);
 }
 
 int usbd_abd_write(uint32_t localid, const uint8_t *data, uint32_t len)
 {
-    struct adb_packet *packet;
+    return usbd_adb_write(localid, data, len);
+}
 
-    packet = &tx_packet;
-    packet->msg.command = A_WRTE;
-    packet->msg.arg0 = localid;
-    packet->msg.arg1 = usbd_adb_get_remoteid(localid);
-    packet->msg.data_length = len;
-    memcpy(packet->payload, data, len);
+__WEAK void usbd_adb_notify_open(uint32_t localid, const char *destination)
+{
+    (void)localid;
+    (void)destination;
+}
 
-    packet->msg.data_crc32 = adb_packet_checksum(packet);
-    packet->msg.magic = packet->msg.command ^ 0xffffffff;
+__WEAK void usbd_adb_notify_close(uint32_t localid)
+{
+    (void)localid;
+}
 
-    adb_client.write_state = ADB_STATE_AWRITE_MSG;
-    usbd_ep_start_write(0, adb_ep_data[ADB_IN_EP_IDX].ep_addr, (uint8_t *)&packet->msg, sizeof(struct adb_msg));
-    return 0;
+__WEAK void usbd_adb_notify_read(uint32_t localid, uint8_t *data, uint32_t len)
+{
+    struct usbd_adb_stream *stream = adb_get_stream(localid);
+
+    if (stream->service == ADB_SERVICE_SHELL) {
+        usbd_adb_notify_shell_read(data, len);
+    } else if (stream->service == ADB_SERVICE_SYNC) {
+        usbd_adb_notify_file_read(data, len);
+    }
 }
 
-void usbd_adb_close(uint32_t localid)
+__WEAK void usbd_adb_notify_file_read(uint8_t *data, uint32_t len)
 {
-    adb_send_close(&tx_packet, 0, usbd_adb_get_remoteid(localid));
-}
\ No newline at end of file
+    (void)data;
+    (void)len;
+}
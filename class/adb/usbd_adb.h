@@ -24,15 +24,34 @@ extern "C" {
 
 struct usbd_interface *usbd_adb_init_intf(uint8_t busid, struct usbd_interface *intf, uint8_t in_ep, uint8_t out_ep);
 
+/* Called in interrupt context. ADB_SHELL_LOALID is only given to a shell stream and ADB_FILE_LOALID to a sync stream */
+void usbd_adb_notify_open(uint32_t localid, const char *destination);
+void usbd_adb_notify_close(uint32_t localid);
+/* Data of one WRTE, default dispatches to shell or file read by service of stream */
+void usbd_adb_notify_read(uint32_t localid, uint8_t *data, uint32_t len);
 void usbd_adb_notify_shell_read(uint8_t *data, uint32_t len);
 void usbd_adb_notify_file_read(uint8_t *data, uint32_t len);
+/* Called in interrupt context when a packet is sent, writers blocked with -USB_ERR_BUSY may retry */
 void usbd_adb_notify_write_done(void);
+
+/**
+ * @brief Queue data on a stream, never blocks.
+ *
+ * Data is split into packets of negotiated max payload. Without delayed ack one packet is in flight
+ * until host answers OKAY, with delayed ack packets are sent while host window allows.
+ *
+ * @return number of bytes queued, -USB_ERR_BUSY when nothing could be queued, -USB_ERR_NOTCONN if stream is closed.
+ */
+int usbd_adb_write(uint32_t localid, const uint8_t *data, uint32_t len);
+bool usbd_adb_is_open(uint32_t localid);
+void usbd_adb_close(uint32_t localid);
+
+/* Return true when shell stream is open */
 bool usbd_adb_can_write(void);
 int usbd_abd_write(uint32_t localid, const uint8_t *data, uint32_t len);
-void usbd_adb_close(uint32_t localid);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* USBD_ADB_H */
\ No newline at end of file
+#endif /* USBD_ADB_H */
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "usb_audio_pcm.h"
+
+#if defined(__ARM_FEATURE_MVE) && (__ARM_FEATURE_MVE & 1)
+#include <arm_mve.h>
+#define USB_AUDIO_PCM_USE_MVE
+#elif defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include <arm_acle.h>
+#define USB_AUDIO_PCM_USE_ARM_DSP
+#elif defined(__riscv_dsp) && defined(__has_include)
+#if __has_include(<nds_intrinsic.h>)
+#include <nds_intrinsic.h>
+#define USB_AUDIO_PCM_USE_RVP
+#endif
+#endif
+
+#define USB_AUDIO_PCM_CHUNK 64
+
+static inline uint32_t usb_audio_pcm_load32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void usb_audio_pcm_store32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+static void usb_audio_pcm_s16_to_s32(int32_t *dst, const int16_t *src, uint32_t n)
+{
+#ifdef USB_AUDIO_PCM_USE_MVE
+    int32_t remain = (int32_t)n;
+
+    while (remain > 0) {
+        mve_pred16_t p = vctp32q(remain);
+        int32x4_t v = vldrhq_z_s32(src, p);
+
+        vstrwq_p_s32(dst, vshlq_n_s32(v, 16), p);
+        src += 4;
+        dst += 4;
+        remain -= 4;
+    }
+#else
+    for (uint32_t i = 0; i < n; i++) {
+        dst[i] = (int32_t)((uint32_t)src[i] << 16);
+    }
+#endif
+}
+
+static void usb_audio_pcm_s32_to_s16(int16_t *dst, const int32_t *src, uint32_t n)
+{
+#ifdef USB_AUDIO_PCM_USE_MVE
+    int32_t remain = (int32_t)n;
+
+    while (remain > 0) {
+        mve_pred16_t p = vctp32q(remain);
+        int32x4_t v = vldrwq_z_s32(src, p);
+
+        vstrhq_p_s32(dst, vshrq_n_s32(v, 16), p);
+        src += 4;
+        dst += 4;
+        remain -= 4;
+    }
+#else
+    for (uint32_t i = 0; i < n; i++) {
+        dst[i] = (int16_t)(src[i] >> 16);
+    }
+#endif
+}
+
+/* four packed samples are three words, unpack them without byte loads */
+static void usb_audio_pcm_s24_3_to_s32(int32_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t w0, w1, w2;
+
+    while (n >= 4) {
+        w0 = usb_audio_pcm_load32(&src[0]);
+        w1 = usb_audio_pcm_load32(&src[4]);
+        w2 = usb_audio_pcm_load32(&src[8]);
+        dst[0] = (int32_t)(w0 << 8);
+        dst[1] = (int32_t)(((w0 >> 16) & 0xff00) | (w1 << 16));
+        dst[2] = (int32_t)(((w1 >> 8) & 0xffff00) | (w2 << 24));
+        dst[3] = (int32_t)(w2 & 0xffffff00);
+        src += 12;
+        dst += 4;
+        n -= 4;
+    }
+
+    while (n--) {
+        *dst++ = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24));
+        src += 3;
+    }
+}
+
+static void usb_audio_pcm_s32_to_s24_3(uint8_t *dst, const int32_t *src, uint32_t n)
+{
+    uint32_t s0, s1, s2, s3;
+
+    while (n >= 4) {
+        s0 = (uint32_t)src[0];
+        s1 = (uint32_t)src[1];
+        s2 = (uint32_t)src[2];
+        s3 = (uint32_t)src[3];
+        usb_audio_pcm_store32(&dst[0], ((s0 >> 8) & 0xffffff) | ((s1 << 16) & 0xff000000));
+        usb_audio_pcm_store32(&dst[4], ((s1 >> 16) & 0xffff) | ((s2 << 8) & 0xffff0000));
+        usb_audio_pcm_store32(&dst[8], ((s2 >> 24) & 0xff) | (s3 & 0xffffff00));
+        src += 4;
+        dst += 12;
+        n -= 4;
+    }
+
+    while (n--) {
+        s0 = (uint32_t)*src++;
+        dst[0] = (uint8_t)(s0 >> 8);
+        dst[1] = (uint8_t)(s0 >> 16);
+        dst[2] = (uint8_t)(s0 >> 24);
+        dst += 3;
+    }
+}
+
+static void usb_audio_pcm_to_s32(int32_t *dst, const void *src, uint8_t fmt, uint32_t n)
+{
+    switch (fmt) {
+        case USB_AUDIO_PCM_S16:
+            usb_audio_pcm_s16_to_s32(dst, (const int16_t *)src, n);
+            break;
+        case USB_AUDIO_PCM_S24_3:
+            usb_audio_pcm_s24_3_to_s32(dst, (const uint8_t *)src, n);
+            break;
+        case USB_AUDIO_PCM_S24_4:
+            for (uint32_t i = 0; i < n; i++) {
+                dst[i] = (int32_t)((uint32_t)((const int32_t *)src)[i] << 8);
+            }
+            break;
+        default:
+            memmove(dst, src, n * 4);
+            break;
+    }
+}
+
+static void usb_audio_pcm_from_s32(void *dst, uint8_t fmt, const int32_t *src, uint32_t n)
+{
+    switch (fmt) {
+        case USB_AUDIO_PCM_S16:
+            usb_audio_pcm_s32_to_s16((int16_t *)dst, src, n);
+            break;
+        case USB_AUDIO_PCM_S24_3:
+            usb_audio_pcm_s32_to_s24_3((uint8_t *)dst, src, n);
+            break;
+        case USB_AUDIO_PCM_S24_4:
+            for (uint32_t i = 0; i < n; i++) {
+                ((int32_t *)dst)[i] = src[i] >> 8;
+            }
+            break;
+        default:
+            memmove(dst, src, n * 4);
+            break;
+    }
+}
+
+uint8_t usb_audio_pcm_sample_bytes(uint8_t fmt)
+{
+    switch (fmt) {
+        case USB_AUDIO_PCM_S16:
+            return 2;
+        case USB_AUDIO_PCM_S24_3:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+void usb_audio_pcm_convert(void *dst, uint8_t dst_fmt, const void *src, uint8_t src_fmt, uint32_t samples)
+{
+    int32_t tmp[USB_AUDIO_PCM_CHUNK];
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    uint32_t n;
+
+    if (dst_fmt == src_fmt) {
+        memmove(dst, src, samples * usb_audio_pcm_sample_bytes(src_fmt));
+        return;
+    }
+
+    if (dst_fmt == USB_AUDIO_PCM_S32) {
+        usb_audio_pcm_to_s32((int32_t *)dst, src, src_fmt, samples);
+        return;
+    }
+
+    if (src_fmt == USB_AUDIO_PCM_S32) {
+        usb_audio_pcm_from_s32(dst, dst_fmt, (const int32_t *)src, samples);
+        return;
+    }
+
+    /* go through s32 in small chunks to stay in cache */
+    while (samples) {
+        n = (samples > USB_AUDIO_PCM_CHUNK) ? USB_AUDIO_PCM_CHUNK : samples;
+        usb_audio_pcm_to_s32(tmp, s, src_fmt, n);
+        usb_audio_pcm_from_s32(d, dst_fmt, tmp, n);
+        s += n * usb_audio_pcm_sample_bytes(src_fmt);
+        d += n * usb_audio_pcm_sample_bytes(dst_fmt);
+        samples -= n;
+    }
+}
+
+void usb_audio_pcm_interleave_s16(int16_t *dst, int16_t *const *src, uint8_t channels, uint32_t frames)
+{
+    if (channels == 2) {
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[2 * i] = src[0][i];
+            dst[2 * i + 1] = src[1][i];
+        }
+        return;
+    }
+
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[i * channels + ch] = src[ch][i];
+        }
+    }
+}
+
+void usb_audio_pcm_deinterleave_s16(int16_t *const *dst, const int16_t *src, uint8_t channels, uint32_t frames)
+{
+    if (channels == 2) {
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[0][i] = src[2 * i];
+            dst[1][i] = src[2 * i + 1];
+        }
+        return;
+    }
+
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[ch][i] = src[i * channels + ch];
+        }
+    }
+}
+
+void usb_audio_pcm_interleave_s32(int32_t *dst, int32_t *const *src, uint8_t channels, uint32_t frames)
+{
+    for (uint8_t ch = 0; ch < channels; ch++) {
+#ifdef USB_AUDIO_PCM_USE_MVE
+        /* scatter store with channel stride */
+        uint32x4_t offset = vmulq_n_u32(vidupq_n_u32(0, 1), channels * 4);
+        const int32_t *s = src[ch];
+        int32_t *d = &dst[ch];
+        int32_t remain = (int32_t)frames;
+
+        while (remain > 0) {
+            mve_pred16_t p = vctp32q(remain);
+
+            vstrwq_scatter_offset_p_s32(d, offset, vldrwq_z_s32(s, p), p);
+            s += 4;
+            d += 4 * channels;
+            remain -= 4;
+        }
+#else
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[i * channels + ch] = src[ch][i];
+        }
+#endif
+    }
+}
+
+void usb_audio_pcm_deinterleave_s32(int32_t *const *dst, const int32_t *src, uint8_t channels, uint32_t frames)
+{
+    for (uint8_t ch = 0; ch < channels; ch++) {
+#ifdef USB_AUDIO_PCM_USE_MVE
+        /* gather load with channel stride */
+        uint32x4_t offset = vmulq_n_u32(vidupq_n_u32(0, 1), channels * 4);
+        const int32_t *s = &src[ch];
+        int32_t *d = dst[ch];
+        int32_t remain = (int32_t)frames;
+
+        while (remain > 0) {
+            mve_pred16_t p = vctp32q(remain);
+
+            vstrwq_p_s32(d, vldrwq_gather_offset_z_s32(s, offset, p), p);
+            s += 4 * channels;
+            d += 4;
+            remain -= 4;
+        }
+#else
+        for (uint32_t i = 0; i < frames; i++) {
+            dst[ch][i] = src[i * channels + ch];
+        }
+#endif
+    }
+}
+
+void usb_audio_pcm_channel_map_s16(int16_t *dst, uint8_t dst_channels, const int16_t *src, uint8_t src_channels,
+                                   const int8_t *map, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint8_t ch = 0; ch < dst_channels; ch++) {
+            dst[ch] = (map[ch] < 0) ? 0 : src[map[ch]];
+        }
+        dst += dst_channels;
+        src += src_channels;
+    }
+}
+
+void usb_audio_pcm_channel_map_s32(int32_t *dst, uint8_t dst_channels, const int32_t *src, uint8_t src_channels,
+                                   const int8_t *map, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint8_t ch = 0; ch < dst_channels; ch++) {
+            dst[ch] = (map[ch] < 0) ? 0 : src[map[ch]];
+        }
+        dst += dst_channels;
+        src += src_channels;
+    }
+}
+
+int16_t usb_audio_pcm_db_to_gain(int volume_db)
+{
+    int32_t gain = 32767;
+
+    if (volume_db >= 0) {
+        return 32767;
+    }
+    if (volume_db < -127) {
+        return 0;
+    }
+
+    /* 10^(-1/20) = 0.891251 = 29205 in Q15 */
+    while (volume_db++ < 0) {
+        gain = (gain * 29205 + 16384) >> 15;
+    }
+    return (int16_t)gain;
+}
+
+void usb_audio_pcm_volume_s16(int16_t *buf, uint32_t samples, int16_t gain)
+{
+#if defined(USB_AUDIO_PCM_USE_MVE)
+    int32_t remain = (int32_t)samples;
+
+    while (remain > 0) {
+        mve_pred16_t p = vctp16q(remain);
+        int16x8_t v = vldrhq_z_s16(buf, p);
+
+        vstrhq_p_s16(buf, vqrdmulhq_n_s16(v, gain), p);
+        buf += 8;
+        remain -= 8;
+    }
+#elif defined(USB_AUDIO_PCM_USE_ARM_DSP) || defined(USB_AUDIO_PCM_USE_RVP)
+    uint32_t v;
+    int32_t lo;
+    int32_t hi;
+
+    while (samples >= 2) {
+        memcpy(&v, buf, 4);
+#if defined(USB_AUDIO_PCM_USE_ARM_DSP)
+        lo = __smulbb((int32_t)v, gain) >> 15;
+        hi = __smultb((int32_t)v, gain) >> 15;
+        v = ((uint32_t)lo & 0xffff) | ((uint32_t)hi << 16);
+#else
+        (void)lo;
+        (void)hi;
+        v = __nds__khm16(v, ((uint32_t)(uint16_t)gain << 16) | (uint16_t)gain);
+#endif
+        memcpy(buf, &v, 4);
+        buf += 2;
+        samples -= 2;
+    }
+    if (samples) {
+        *buf = (int16_t)(((int32_t)*buf * gain) >> 15);
+    }
+#else
+    for (uint32_t i = 0; i < samples; i++) {
+        buf[i] = (int16_t)(((int32_t)buf[i] * gain) >> 15);
+    }
+#endif
+}
+
+void usb_audio_pcm_volume_s32(int32_t *buf, uint32_t samples, int16_t gain)
+{
+#if defined(USB_AUDIO_PCM_USE_MVE)
+    int32_t remain = (int32_t)samples;
+
+    while (remain > 0) {
+        mve_pred16_t p = vctp32q(remain);
+        int32x4_t v = vldrwq_z_s32(buf, p);
+
+        vstrwq_p_s32(buf, vqrdmulhq_n_s32(v, (int32_t)((uint32_t)gain << 16)), p);
+        buf += 4;
+        remain -= 4;
+    }
+#else
+    for (uint32_t i = 0; i < samples; i++) {
+        buf[i] = (int32_t)(((int64_t)buf[i] * gain) >> 15);
+    }
+#endif
+}
+
+uint32_t usb_audio_pcm_slip(void *buf, uint32_t frames, uint32_t frame_bytes, int slip)
+{
+    uint8_t *p = (uint8_t *)buf;
+
+    if (frames == 0) {
+        return 0;
+    }
+
+    if (slip > 0) {
+        memcpy(&p[frames * frame_bytes], &p[(frames - 1) * frame_bytes], frame_bytes);
+        return frames + 1;
+    } else if ((slip < 0) && (frames > 1)) {
+        return frames - 1;
+    }
+
+    return frames;
+}
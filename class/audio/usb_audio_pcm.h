@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USB_AUDIO_PCM_H
+#define USB_AUDIO_PCM_H
+
+#include <stdint.h>
+
+/* pcm sample formats, all little endian */
+#define USB_AUDIO_PCM_S16   0 /* 16 bit in 2 bytes */
+#define USB_AUDIO_PCM_S24_3 1 /* 24 bit packed in 3 bytes */
+#define USB_AUDIO_PCM_S24_4 2 /* 24 bit in low bits of 4 bytes, sign extended */
+#define USB_AUDIO_PCM_S32   3 /* 32 bit, or 24 bit left aligned in 4 bytes */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t usb_audio_pcm_sample_bytes(uint8_t fmt);
+
+/**
+ * @brief Convert samples between formats, narrowing truncates low bits.
+ *
+ * Buffers must be aligned to their container size, S24_3 can be byte aligned.
+ * In-place conversion is only supported when both formats have the same sample size.
+ */
+void usb_audio_pcm_convert(void *dst, uint8_t dst_fmt, const void *src, uint8_t src_fmt, uint32_t samples);
+
+void usb_audio_pcm_interleave_s16(int16_t *dst, int16_t *const *src, uint8_t channels, uint32_t frames);
+void usb_audio_pcm_deinterleave_s16(int16_t *const *dst, const int16_t *src, uint8_t channels, uint32_t frames);
+void usb_audio_pcm_interleave_s32(int32_t *dst, int32_t *const *src, uint8_t channels, uint32_t frames);
+void usb_audio_pcm_deinterleave_s32(int32_t *const *dst, const int32_t *src, uint8_t channels, uint32_t frames);
+
+/**
+ * @brief Build dst frames from src frames, map[i] is the src channel of dst channel i, or -1 for silence.
+ */
+void usb_audio_pcm_channel_map_s16(int16_t *dst, uint8_t dst_channels, const int16_t *src, uint8_t src_channels,
+                                   const int8_t *map, uint32_t frames);
+void usb_audio_pcm_channel_map_s32(int32_t *dst, uint8_t dst_channels, const int32_t *src, uint8_t src_channels,
+                                   const int8_t *map, uint32_t frames);
+
+/* Convert attenuation in dB (0 ~ -127) to Q15 gain */
+int16_t usb_audio_pcm_db_to_gain(int volume_db);
+void usb_audio_pcm_volume_s16(int16_t *buf, uint32_t samples, int16_t gain);
+void usb_audio_pcm_volume_s32(int32_t *buf, uint32_t samples, int16_t gain);
+
+/**
+ * @brief Insert (slip > 0) or drop (slip < 0) one frame at the end of buf for rate correction.
+ *
+ * Inserting repeats the last frame, so buf must have room for frames + 1.
+ * @return new number of frames.
+ */
+uint32_t usb_audio_pcm_slip(void *buf, uint32_t frames, uint32_t frame_bytes, int slip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USB_AUDIO_PCM_H */
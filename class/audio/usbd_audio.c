@@ -19,6 +19,22 @@ struct usbd_audio_priv {
     uint16_t uac_version;
 } g_usbd_audio[CONFIG_USBDEV_MAX_BUS];
 
+struct usbd_audio_feedback {
+    volatile bool running;
+    bool high_speed;
+    bool sof_valid;
+    uint32_t nominal;    /* samples per (micro)frame, 16.16 */
+    uint32_t rate;       /* measured codec rate, samples per (micro)frame, 16.16 */
+    int32_t correction;  /* fill level controller output, 16.16 */
+    int32_t integral;
+    uint32_t sof_count;
+    uint32_t sof_start;  /* sample count at window start */
+} g_usbd_audio_feedback[CONFIG_USBDEV_MAX_BUS];
+
+static struct usbd_endpoint audio_feedback_ep[CONFIG_USBDEV_MAX_BUS];
+
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbd_audio_feedback_buf[CONFIG_USBDEV_MAX_BUS][USB_ALIGN_UP(4, CONFIG_USB_ALIGN_SIZE)];
+
 static int audio_class_endpoint_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     uint8_t control_selector;
@@ -276,7 +292,7 @@ static void audio_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
     switch (event) {
         case USBD_EVENT_RESET:
-
+            g_usbd_audio_feedback[busid].running = false;
             break;
 
         case USBD_EVENT_SET_INTERFACE: {
@@ -320,6 +336,134 @@ struct usbd_interface *usbd_audio_init_intf(uint8_t busid,
     return intf;
 }
 
+uint32_t usbd_audio_feedback_get_value(uint8_t busid)
+{
+    struct usbd_audio_feedback *fb = &g_usbd_audio_feedback[busid];
+    int32_t limit = (int32_t)(fb->nominal >> 6);
+    int32_t correction = fb->correction;
+
+    /* keep requested rate within 1.5% of nominal */
+    if (correction > limit) {
+        correction = limit;
+    } else if (correction < -limit) {
+        correction = -limit;
+    }
+
+    return (uint32_t)((int32_t)fb->rate + correction);
+}
+
+static void usbd_audio_feedback_send(uint8_t busid)
+{
+    uint8_t *buf = g_usbd_audio_feedback_buf[busid];
+    uint32_t value = usbd_audio_feedback_get_value(busid);
+
+    if (g_usbd_audio_feedback[busid].high_speed) {
+        buf[0] = value & 0xff;
+        buf[1] = (value >> 8) & 0xff;
+        buf[2] = (value >> 16) & 0xff;
+        buf[3] = (value >> 24) & 0xff;
+        usbd_ep_start_write(busid, audio_feedback_ep[busid].ep_addr, buf, 4);
+    } else {
+        value >>= 2; /* 16.16 to 10.14 */
+        buf[0] = value & 0xff;
+        buf[1] = (value >> 8) & 0xff;
+        buf[2] = (value >> 16) & 0xff;
+        usbd_ep_start_write(busid, audio_feedback_ep[busid].ep_addr, buf, 3);
+    }
+}
+
+static void usbd_audio_feedback_ep_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    (void)ep;
+    (void)nbytes;
+
+    if (g_usbd_audio_feedback[busid].running) {
+        usbd_audio_feedback_send(busid);
+    }
+}
+
+void usbd_audio_feedback_init(uint8_t busid, uint8_t ep)
+{
+    memset(&g_usbd_audio_feedback[busid], 0, sizeof(struct usbd_audio_feedback));
+
+    audio_feedback_ep[busid].ep_addr = ep;
+    audio_feedback_ep[busid].ep_cb = usbd_audio_feedback_ep_callback;
+    usbd_add_endpoint(busid, &audio_feedback_ep[busid]);
+}
+
+void usbd_audio_feedback_start(uint8_t busid, uint32_t sampling_freq)
+{
+    struct usbd_audio_feedback *fb = &g_usbd_audio_feedback[busid];
+
+    fb->high_speed = (usbd_get_port_speed(busid) >= USB_SPEED_HIGH) ? true : false;
+    fb->nominal = (uint32_t)(((uint64_t)sampling_freq << 16) / (fb->high_speed ? 8000 : 1000));
+    fb->rate = fb->nominal;
+    fb->correction = 0;
+    fb->integral = 0;
+    fb->sof_count = 0;
+    fb->sof_valid = false;
+    fb->running = true;
+
+    usbd_audio_feedback_send(busid);
+}
+
+void usbd_audio_feedback_stop(uint8_t busid)
+{
+    g_usbd_audio_feedback[busid].running = false;
+}
+
+void usbd_audio_feedback_sof(uint8_t busid, uint32_t sample_count)
+{
+    struct usbd_audio_feedback *fb = &g_usbd_audio_feedback[busid];
+    uint32_t rate;
+
+    if (!fb->running) {
+        return;
+    }
+
+    if (!fb->sof_valid) {
+        fb->sof_start = sample_count;
+        fb->sof_count = 0;
+        fb->sof_valid = true;
+        return;
+    }
+
+    if (++fb->sof_count < CONFIG_USBDEV_AUDIO_FEEDBACK_SOF_WINDOW) {
+        return;
+    }
+
+    rate = (uint32_t)(((uint64_t)(sample_count - fb->sof_start) << 16) / CONFIG_USBDEV_AUDIO_FEEDBACK_SOF_WINDOW);
+    fb->sof_start = sample_count;
+    fb->sof_count = 0;
+
+    /* ignore windows broken by missed sof or codec restart */
+    if ((rate > (fb->nominal - (fb->nominal >> 3))) && (rate < (fb->nominal + (fb->nominal >> 3)))) {
+        fb->rate = rate;
+    }
+}
+
+void usbd_audio_feedback_set_level(uint8_t busid, uint32_t level, uint32_t target)
+{
+    struct usbd_audio_feedback *fb = &g_usbd_audio_feedback[busid];
+    int32_t error = (int32_t)target - (int32_t)level;
+    int32_t limit = (int32_t)1 << CONFIG_USBDEV_AUDIO_FEEDBACK_KI_SHIFT; /* integral term saturates at one sample */
+
+    if (!fb->running) {
+        return;
+    }
+
+    fb->integral += error;
+    if (fb->integral > limit) {
+        fb->integral = limit;
+    } else if (fb->integral < -limit) {
+        fb->integral = -limit;
+    }
+
+    /* ring too empty asks host for more samples, too full asks for less */
+    fb->correction = (int32_t)(((int64_t)error << 16) >> CONFIG_USBDEV_AUDIO_FEEDBACK_KP_SHIFT) +
+                     (int32_t)(((int64_t)fb->integral << 16) >> CONFIG_USBDEV_AUDIO_FEEDBACK_KI_SHIFT);
+}
+
 __WEAK void usbd_audio_set_volume(uint8_t busid, uint8_t ep, uint8_t ch, int volume_db)
 {
     (void)busid;
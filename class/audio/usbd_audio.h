@@ -36,6 +36,17 @@ uint32_t usbd_audio_get_sampling_freq(uint8_t busid, uint8_t ep);
 
 void usbd_audio_get_sampling_freq_table(uint8_t busid, uint8_t ep, uint8_t **sampling_freq_table);
 
+/* Explicit feedback endpoint for asynchronous out stream, 10.14 in full speed and 16.16 in high speed */
+void usbd_audio_feedback_init(uint8_t busid, uint8_t ep);
+void usbd_audio_feedback_start(uint8_t busid, uint32_t sampling_freq);
+void usbd_audio_feedback_stop(uint8_t busid);
+/* Call once per (micro)frame with a free running count of samples consumed by codec */
+void usbd_audio_feedback_sof(uint8_t busid, uint32_t sample_count);
+/* Report ring buffer fill level and target level in audio frames */
+void usbd_audio_feedback_set_level(uint8_t busid, uint32_t level, uint32_t target);
+/* Return current feedback in 16.16 samples per (micro)frame */
+uint32_t usbd_audio_feedback_get_value(uint8_t busid);
+
 #ifdef __cplusplus
 }
 #endif
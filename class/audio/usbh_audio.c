@@ -66,10 +66,6 @@ int usbh_audio_open(struct usbh_audio *audio_class, const char *name, uint32_t s
     }
     setup = audio_class->hport->setup;
 
-    if (audio_class->is_opened) {
-        return 0;
-    }
-
     for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
         if (strcmp(name, audio_class->as_msg_table[i].stream_name) == 0) {
             intf = audio_class->as_msg_table[i].stream_intf;
@@ -92,6 +88,15 @@ int usbh_audio_open(struct usbh_audio *audio_class, const char *name, uint32_t s
 
 freq_found:
 
+    if (audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_altsetting) {
+        /* already streaming: only an identical request is a no-op, close first to reconfigure */
+        if ((audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_altsetting == altsetting) &&
+            (audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_freq == samp_freq)) {
+            return 0;
+        }
+        return -USB_ERR_BUSY;
+    }
+
     setup->bmRequestType = USB_REQUEST_DIR_OUT | USB_REQUEST_STANDARD | USB_REQUEST_RECIPIENT_INTERFACE;
     setup->bRequest = USB_REQUEST_SET_INTERFACE;
     setup->wValue = altsetting;
@@ -130,6 +135,8 @@ freq_found:
     }
 
     USB_LOG_INFO("Open audio stream :%s, altsetting: %u\r\n", name, altsetting);
+    audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_altsetting = altsetting;
+    audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_freq = samp_freq;
     audio_class->is_opened = true;
     return ret;
 }
@@ -168,7 +175,14 @@ int usbh_audio_close(struct usbh_audio *audio_class, const char *name)
         return ret;
     }
     USB_LOG_INFO("Close audio stream :%s\r\n", name);
+    audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_altsetting = 0;
+    audio_class->as_msg_table[intf - audio_class->ctrl_intf - 1].cur_freq = 0;
     audio_class->is_opened = false;
+    for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
+        if (audio_class->as_msg_table[i].cur_altsetting) {
+            audio_class->is_opened = true;
+        }
+    }
 
     ep_desc = &audio_class->hport->config.intf[intf].altsetting[altsetting].ep[0].ep_desc;
     if (ep_desc->bEndpointAddress & 0x80) {
@@ -26,6 +26,8 @@ struct usbh_audio_as_msg {
     uint8_t output_terminal_id;
     uint8_t ep_attr;
     uint8_t num_of_altsetting;
+    uint8_t cur_altsetting; /* 0 when stream is closed */
+    uint32_t cur_freq;
     uint16_t volume_min;
     uint16_t volume_max;
     uint16_t volume_res;
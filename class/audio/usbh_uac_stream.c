@@ -0,0 +1,581 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_audio.h"
+#include "usbh_uac_stream.h"
+
+#undef USB_DBG_TAG
+#define USB_DBG_TAG "usbh_uac_stream"
+#include "usb_log.h"
+
+#define UAC_STREAM_URB_BUFSIZE (CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS * CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE)
+#define UAC_STREAM_FB_BUFSIZE  USB_ALIGN_UP(4, CONFIG_USB_ALIGN_SIZE)
+
+#if CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE % CONFIG_USB_ALIGN_SIZE
+#error "CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE must be multiple of CONFIG_USB_ALIGN_SIZE"
+#endif
+
+struct usbh_audio_stream {
+    struct usbh_audio *audio_class;
+    const char *name;
+    struct usb_endpoint_descriptor *ep;
+    struct usb_endpoint_descriptor *fb_ep; /* async feedback endpoint, playback only */
+    struct usbh_urb *urb[CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM]; /* iso urbs queued back to back, each on its own buffer */
+    struct usbh_urb *fb_urb;
+    uint32_t urb_samples[CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM]; /* samples held by each queued urb */
+    chry_ringbuffer_t rb;
+    bool rb_ready;
+    bool primed;
+    volatile bool streaming;
+
+    uint32_t samp_freq;
+    uint32_t packet_interval; /* in us */
+    uint16_t mps;
+    uint8_t frame_bytes;      /* bNrChannels * bSubframeSize */
+    uint8_t fb_units;         /* bus (micro)frames per data packet */
+    uint32_t nominal;         /* samples per packet, 16.16 */
+    uint32_t accum;           /* fractional samples carried to next packet, 16.16 */
+
+    struct usbh_audio_stream_stat stat;
+};
+
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_uac_stream_buf[2][CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM][UAC_STREAM_URB_BUFSIZE];
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_uac_fb_buf[UAC_STREAM_FB_BUFSIZE];
+
+static struct usbh_audio_stream g_uac_stream[2];
+
+static struct usbh_urb *usbh_audio_stream_urb_alloc(uint8_t num_of_iso_packets)
+{
+    struct usbh_urb *urb;
+    size_t urb_size;
+
+    urb_size = sizeof(struct usbh_urb) + num_of_iso_packets * sizeof(struct usbh_iso_frame_packet);
+    urb = usb_osal_malloc(urb_size);
+    if (urb == NULL) {
+        return NULL;
+    }
+    memset(urb, 0, urb_size);
+#if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
+    urb->iso_packet = (struct usbh_iso_frame_packet *)(urb + 1);
+#endif
+    return urb;
+}
+
+static void usbh_audio_stream_complete_callback(void *arg, int nbytes);
+
+static void usbh_audio_stream_iso_fill(struct usbh_audio_stream *stream, struct usbh_urb *urb,
+                                       struct usb_endpoint_descriptor *ep, uint8_t *buf, uint32_t num_of_iso_packets)
+{
+    struct usbh_hubport *hport = stream->audio_class->hport;
+
+    urb->hport = hport;
+    urb->ep = ep;
+    urb->setup = NULL;
+    urb->transfer_buffer = buf;
+    urb->transfer_buffer_length = 0;
+    urb->actual_length = 0;
+    urb->timeout = 0;
+    urb->complete = usbh_audio_stream_complete_callback;
+    urb->arg = urb;
+    urb->interval = USBH_GET_URB_INTERVAL(ep->bInterval, hport->speed);
+    urb->num_of_iso_packets = num_of_iso_packets;
+}
+
+/* fill one playback urb with pcm, packet sizes follow the feedback rate */
+static void usbh_audio_stream_playback_fill(struct usbh_audio_stream *stream, uint8_t index)
+{
+    struct usbh_urb *urb = stream->urb[index];
+    uint8_t *buf = g_uac_stream_buf[USBH_AUDIO_STREAM_PLAYBACK][index];
+    uint32_t max_samples = stream->mps / stream->frame_bytes;
+    uint32_t samples;
+    uint32_t total = 0;
+    uint32_t avail;
+    uint32_t len;
+    uint32_t got;
+
+    usbh_audio_stream_iso_fill(stream, urb, stream->ep, buf, CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS);
+
+    for (uint32_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS; i++) {
+        stream->accum += stream->stat.feedback;
+        samples = stream->accum >> 16;
+        stream->accum &= 0xffff;
+        if (samples > max_samples) {
+            samples = max_samples;
+        }
+
+        len = samples * stream->frame_bytes;
+
+        /* only consume whole audio frames so the ring never loses channel alignment */
+        avail = chry_ringbuffer_get_used(&stream->rb);
+        avail -= avail % stream->frame_bytes;
+        got = chry_ringbuffer_read(&stream->rb, &buf[i * CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE], MIN(len, avail));
+        if (got < len) {
+            memset(&buf[i * CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE + got], 0, len - got);
+            if (stream->primed) {
+                stream->stat.xruns++;
+            }
+        } else if (len) {
+            stream->primed = true;
+        }
+
+        urb->iso_packet[i].transfer_buffer = &buf[i * CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE];
+        urb->iso_packet[i].transfer_buffer_length = len;
+        urb->iso_packet[i].actual_length = 0;
+        urb->iso_packet[i].errorcode = 0;
+        total += len;
+    }
+
+    urb->transfer_buffer_length = total;
+    stream->urb_samples[index] = total / stream->frame_bytes;
+}
+
+static void usbh_audio_stream_capture_fill(struct usbh_audio_stream *stream, uint8_t index)
+{
+    struct usbh_urb *urb = stream->urb[index];
+    uint8_t *buf = g_uac_stream_buf[USBH_AUDIO_STREAM_CAPTURE][index];
+
+    usbh_audio_stream_iso_fill(stream, urb, stream->ep, buf, CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS);
+
+    for (uint32_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS; i++) {
+        urb->iso_packet[i].transfer_buffer = &buf[i * CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE];
+        urb->iso_packet[i].transfer_buffer_length = stream->mps;
+        urb->iso_packet[i].actual_length = 0;
+        urb->iso_packet[i].errorcode = 0;
+    }
+    urb->transfer_buffer_length = stream->mps * CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS;
+}
+
+static void usbh_audio_stream_feedback_fill(struct usbh_audio_stream *stream)
+{
+    struct usbh_urb *urb = stream->fb_urb;
+
+    usbh_audio_stream_iso_fill(stream, urb, stream->fb_ep, g_uac_fb_buf, 1);
+
+    urb->transfer_buffer_length = MIN(USB_GET_MAXPACKETSIZE(stream->fb_ep->wMaxPacketSize), 4);
+    urb->iso_packet[0].transfer_buffer = g_uac_fb_buf;
+    urb->iso_packet[0].transfer_buffer_length = urb->transfer_buffer_length;
+    urb->iso_packet[0].actual_length = 0;
+    urb->iso_packet[0].errorcode = 0;
+}
+
+/*
+ * Full speed devices report samples per frame in 10.14 (3 bytes), high speed devices
+ * report samples per microframe in 16.16 (4 bytes). Convert it to samples per packet in 16.16.
+ */
+static void usbh_audio_stream_feedback_update(struct usbh_audio_stream *stream, uint8_t *buf, uint32_t len)
+{
+    uint32_t value;
+
+    if (len == 3) {
+        value = (buf[0] | (buf[1] << 8) | ((uint32_t)buf[2] << 16)) << 2;
+    } else if (len == 4) {
+        value = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    } else {
+        return;
+    }
+
+    value *= stream->fb_units;
+
+    if ((value < (stream->nominal - (stream->nominal >> 3))) || (value > (stream->nominal + (stream->nominal >> 3)))) {
+        stream->stat.feedback_errors++;
+        return;
+    }
+
+    stream->stat.feedback = value;
+    stream->stat.feedback_updates++;
+}
+
+static struct usbh_audio_stream *usbh_audio_stream_find(struct usbh_urb *urb, uint8_t *dir, uint8_t *index)
+{
+    for (uint8_t i = 0; i < 2; i++) {
+        for (uint8_t j = 0; j < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; j++) {
+            if (g_uac_stream[i].urb[j] == urb) {
+                *dir = i;
+                *index = j;
+                return &g_uac_stream[i];
+            }
+        }
+    }
+    if (g_uac_stream[USBH_AUDIO_STREAM_PLAYBACK].fb_urb == urb) {
+        *dir = USBH_AUDIO_STREAM_PLAYBACK;
+        *index = 0xff;
+        return &g_uac_stream[USBH_AUDIO_STREAM_PLAYBACK];
+    }
+    return NULL;
+}
+
+static void usbh_audio_stream_complete_callback(void *arg, int nbytes)
+{
+    struct usbh_urb *urb = (struct usbh_urb *)arg;
+    struct usbh_audio_stream *stream;
+    uint32_t moved = 0;
+    uint32_t len;
+    uint8_t dir;
+    uint8_t index;
+
+    stream = usbh_audio_stream_find(urb, &dir, &index);
+    if (!stream || !stream->streaming) {
+        return;
+    }
+
+    if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN)) {
+        return;
+    }
+
+    if (index == 0xff) {
+        if ((nbytes >= 0) && (urb->iso_packet[0].errorcode >= 0)) {
+            usbh_audio_stream_feedback_update(stream, urb->iso_packet[0].transfer_buffer, urb->iso_packet[0].actual_length);
+        }
+        usbh_audio_stream_feedback_fill(stream);
+        usbh_submit_urb(urb);
+        return;
+    }
+
+    if (nbytes < 0) {
+        stream->stat.urb_errors++;
+    }
+
+    if (dir == USBH_AUDIO_STREAM_CAPTURE) {
+        for (uint32_t i = 0; (nbytes >= 0) && (i < urb->num_of_iso_packets); i++) {
+            if (urb->iso_packet[i].errorcode < 0) {
+                stream->stat.urb_errors++;
+                continue;
+            }
+            len = chry_ringbuffer_write(&stream->rb, urb->iso_packet[i].transfer_buffer, urb->iso_packet[i].actual_length);
+            if (len < urb->iso_packet[i].actual_length) {
+                stream->stat.xruns++;
+            }
+            moved += len;
+        }
+        usbh_audio_stream_capture_fill(stream, index);
+    } else {
+        for (uint32_t i = 0; (nbytes >= 0) && (i < urb->num_of_iso_packets); i++) {
+            if (urb->iso_packet[i].errorcode < 0) {
+                stream->stat.urb_errors++;
+            }
+        }
+        moved = stream->urb_samples[index] * stream->frame_bytes;
+        usbh_audio_stream_playback_fill(stream, index);
+    }
+
+    stream->stat.bytes += moved;
+
+    if (usbh_submit_urb(urb) < 0) {
+        stream->stat.urb_errors++;
+    }
+
+    usbh_audio_stream_callback(dir, moved);
+}
+
+int usbh_audio_stream_init(uint8_t dir, uint8_t *ringbuf, uint32_t ringsize)
+{
+    struct usbh_audio_stream *stream;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = &g_uac_stream[dir];
+    if (stream->rb_ready) {
+        return -USB_ERR_BUSY;
+    }
+
+    memset(stream, 0, sizeof(struct usbh_audio_stream));
+
+    if (chry_ringbuffer_init(&stream->rb, ringbuf, ringsize) < 0) {
+        return -USB_ERR_INVAL;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+        stream->urb[i] = usbh_audio_stream_urb_alloc(CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS);
+        if (stream->urb[i] == NULL) {
+            goto errout;
+        }
+    }
+
+    if (dir == USBH_AUDIO_STREAM_PLAYBACK) {
+        stream->fb_urb = usbh_audio_stream_urb_alloc(1);
+        if (stream->fb_urb == NULL) {
+            goto errout;
+        }
+    }
+
+    stream->rb_ready = true;
+    return 0;
+
+errout:
+    USB_LOG_ERR("Fail to init audio stream\r\n");
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+        if (stream->urb[i]) {
+            usb_osal_free(stream->urb[i]);
+        }
+    }
+    memset(stream, 0, sizeof(struct usbh_audio_stream));
+    return -USB_ERR_NOMEM;
+}
+
+int usbh_audio_stream_deinit(uint8_t dir)
+{
+    struct usbh_audio_stream *stream;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = &g_uac_stream[dir];
+    if (!stream->rb_ready) {
+        return 0;
+    }
+
+    usbh_audio_stream_stop(dir);
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+        usb_osal_free(stream->urb[i]);
+    }
+    if (stream->fb_urb) {
+        usb_osal_free(stream->fb_urb);
+    }
+    memset(stream, 0, sizeof(struct usbh_audio_stream));
+    return 0;
+}
+
+int usbh_audio_stream_start(uint8_t dir, struct usbh_audio *audio_class, const char *name, uint32_t samp_freq, uint8_t bitresolution)
+{
+    struct usbh_audio_stream *stream;
+    struct usbh_audio_as_msg *as_msg = NULL;
+    struct usbh_interface_altsetting *alt;
+    struct usb_endpoint_descriptor *ep_desc;
+    int ret;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = &g_uac_stream[dir];
+    if (!stream->rb_ready || !audio_class || !audio_class->hport) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (stream->streaming) {
+        return -USB_ERR_BUSY;
+    }
+
+    ret = usbh_audio_open(audio_class, name, samp_freq, bitresolution);
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (uint8_t i = 0; i < audio_class->stream_intf_num; i++) {
+        if (strcmp(name, audio_class->as_msg_table[i].stream_name) == 0) {
+            as_msg = &audio_class->as_msg_table[i];
+        }
+    }
+
+    if (as_msg == NULL) {
+        ret = -USB_ERR_NODEV;
+        goto errout;
+    }
+
+    alt = &audio_class->hport->config.intf[as_msg->stream_intf].altsetting[as_msg->cur_altsetting];
+    ep_desc = &alt->ep[0].ep_desc;
+
+    if (((ep_desc->bEndpointAddress & 0x80) ? USBH_AUDIO_STREAM_CAPTURE : USBH_AUDIO_STREAM_PLAYBACK) != dir) {
+        USB_LOG_ERR("Stream %s does not match direction\r\n", name);
+        ret = -USB_ERR_INVAL;
+        goto errout;
+    }
+
+    stream->audio_class = audio_class;
+    stream->name = name;
+    stream->ep = ep_desc;
+    stream->fb_ep = NULL;
+    stream->samp_freq = samp_freq;
+    stream->frame_bytes = as_msg->as_format[as_msg->cur_altsetting].bNrChannels * as_msg->as_format[as_msg->cur_altsetting].bSubframeSize;
+    stream->mps = (dir == USBH_AUDIO_STREAM_CAPTURE) ? audio_class->isoin_mps : audio_class->isoout_mps;
+    stream->packet_interval = USBH_GET_URB_INTERVAL(ep_desc->bInterval, audio_class->hport->speed);
+    stream->fb_units = (audio_class->hport->speed == USB_SPEED_HIGH) ? (stream->packet_interval / 125) : (stream->packet_interval / 1000);
+    stream->nominal = (uint32_t)(((uint64_t)samp_freq << 16) * stream->packet_interval / 1000000);
+    stream->accum = 0;
+    stream->primed = false;
+    memset(&stream->stat, 0, sizeof(struct usbh_audio_stream_stat));
+    stream->stat.feedback = stream->nominal;
+
+    if ((stream->mps > CONFIG_USBHOST_AUDIO_STREAM_MAX_PACKET_SIZE) || (stream->frame_bytes == 0)) {
+        USB_LOG_ERR("Stream %s mps %u is not supported\r\n", name, stream->mps);
+        ret = -USB_ERR_RANGE;
+        goto errout;
+    }
+
+    if ((dir == USBH_AUDIO_STREAM_PLAYBACK) &&
+        ((ep_desc->bmAttributes & USB_ENDPOINT_SYNC_MASK) == USB_ENDPOINT_SYNC_ASYNCHRONOUS)) {
+        for (uint8_t i = 1; i < alt->intf_desc.bNumEndpoints; i++) {
+            if (((alt->ep[i].ep_desc.bmAttributes & USB_ENDPOINT_USAGE_MASK) == USB_ENDPOINT_USAGE_FEEDBACK) &&
+                (alt->ep[i].ep_desc.bEndpointAddress & 0x80)) {
+                stream->fb_ep = &alt->ep[i].ep_desc;
+            }
+        }
+    }
+
+    if (dir == USBH_AUDIO_STREAM_CAPTURE) {
+        chry_ringbuffer_reset(&stream->rb);
+    }
+
+    stream->streaming = true;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+        if (dir == USBH_AUDIO_STREAM_CAPTURE) {
+            usbh_audio_stream_capture_fill(stream, i);
+        } else {
+            usbh_audio_stream_playback_fill(stream, i);
+        }
+        ret = usbh_submit_urb(stream->urb[i]);
+        if (ret < 0) {
+            USB_LOG_ERR("Fail to submit audio urb %u, ret:%d\r\n", i, ret);
+            usbh_audio_stream_stop(dir);
+            return ret;
+        }
+    }
+
+    if (stream->fb_ep) {
+        usbh_audio_stream_feedback_fill(stream);
+        ret = usbh_submit_urb(stream->fb_urb);
+        if (ret < 0) {
+            USB_LOG_ERR("Fail to submit feedback urb, ret:%d\r\n", ret);
+            usbh_audio_stream_stop(dir);
+            return ret;
+        }
+    }
+
+    USB_LOG_INFO("Start audio stream %s, packet interval:%uus, mps:%u, feedback:%s\r\n",
+                 name, (unsigned int)stream->packet_interval, stream->mps, stream->fb_ep ? "yes" : "no");
+    return 0;
+
+errout:
+    usbh_audio_close(audio_class, name);
+    return ret;
+}
+
+int usbh_audio_stream_stop(uint8_t dir)
+{
+    struct usbh_audio_stream *stream;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return -USB_ERR_INVAL;
+    }
+
+    stream = &g_uac_stream[dir];
+    if (!stream->streaming) {
+        return 0;
+    }
+
+    stream->streaming = false;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+        usbh_kill_urb(stream->urb[i]);
+        stream->urb_samples[i] = 0;
+    }
+    if (stream->fb_ep) {
+        usbh_kill_urb(stream->fb_urb);
+    }
+
+    return usbh_audio_close(stream->audio_class, stream->name);
+}
+
+uint32_t usbh_audio_stream_write(const uint8_t *data, uint32_t len)
+{
+    struct usbh_audio_stream *stream = &g_uac_stream[USBH_AUDIO_STREAM_PLAYBACK];
+    uint32_t free;
+
+    if (!stream->rb_ready) {
+        return 0;
+    }
+
+    free = chry_ringbuffer_get_free(&stream->rb);
+    if (len > free) {
+        len = free;
+        if (stream->frame_bytes) {
+            len -= len % stream->frame_bytes;
+        }
+    }
+
+    return chry_ringbuffer_write(&stream->rb, (void *)data, len);
+}
+
+uint32_t usbh_audio_stream_read(uint8_t *data, uint32_t len)
+{
+    struct usbh_audio_stream *stream = &g_uac_stream[USBH_AUDIO_STREAM_CAPTURE];
+
+    if (!stream->rb_ready) {
+        return 0;
+    }
+
+    return chry_ringbuffer_read(&stream->rb, data, len);
+}
+
+uint32_t usbh_audio_stream_get_used(uint8_t dir)
+{
+    if ((dir > USBH_AUDIO_STREAM_PLAYBACK) || !g_uac_stream[dir].rb_ready) {
+        return 0;
+    }
+
+    return chry_ringbuffer_get_used(&g_uac_stream[dir].rb);
+}
+
+uint32_t usbh_audio_stream_get_free(uint8_t dir)
+{
+    if ((dir > USBH_AUDIO_STREAM_PLAYBACK) || !g_uac_stream[dir].rb_ready) {
+        return 0;
+    }
+
+    return chry_ringbuffer_get_free(&g_uac_stream[dir].rb);
+}
+
+uint32_t usbh_audio_stream_get_latency(uint8_t dir)
+{
+    struct usbh_audio_stream *stream;
+    uint32_t samples;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return 0;
+    }
+
+    stream = &g_uac_stream[dir];
+    if (!stream->streaming || !stream->frame_bytes || !stream->samp_freq) {
+        return 0;
+    }
+
+    samples = chry_ringbuffer_get_used(&stream->rb) / stream->frame_bytes;
+
+    if (dir == USBH_AUDIO_STREAM_PLAYBACK) {
+        for (uint8_t i = 0; i < CONFIG_USBHOST_AUDIO_STREAM_BUF_NUM; i++) {
+            samples += stream->urb_samples[i];
+        }
+    } else {
+        /* data waits for one urb to complete before it reaches the ring */
+        samples += (uint32_t)(((uint64_t)stream->nominal * CONFIG_USBHOST_AUDIO_STREAM_ISO_PACKETS) >> 16);
+    }
+
+    return (uint32_t)((uint64_t)samples * 1000000 / stream->samp_freq);
+}
+
+void usbh_audio_stream_get_stat(uint8_t dir, struct usbh_audio_stream_stat *stat)
+{
+    size_t flags;
+
+    if (dir > USBH_AUDIO_STREAM_PLAYBACK) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stat, &g_uac_stream[dir].stat, sizeof(struct usbh_audio_stream_stat));
+    usb_osal_leave_critical_section(flags);
+}
+
+__WEAK void usbh_audio_stream_callback(uint8_t dir, uint32_t nbytes)
+{
+    (void)dir;
+    (void)nbytes;
+}
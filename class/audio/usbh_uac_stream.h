@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_UAC_STREAM_H
+#define USBH_UAC_STREAM_H
+
+#include "usbh_core.h"
+#include "usbh_audio.h"
+#include "chry_ringbuffer.h"
+
+#define USBH_AUDIO_STREAM_CAPTURE  0
+#define USBH_AUDIO_STREAM_PLAYBACK 1
+
+struct usbh_audio_stream_stat {
+    uint32_t xruns;            /* playback underruns or capture overruns, counted per packet */
+    uint32_t urb_errors;       /* urbs or iso packets that completed with error */
+    uint32_t feedback_updates; /* feedback values accepted */
+    uint32_t feedback_errors;  /* feedback values out of nominal rate +/- 12.5% */
+    uint32_t feedback;         /* current rate, samples per iso packet in 16.16 */
+    uint32_t bytes;            /* pcm bytes moved on the bus */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Attach a pcm ring buffer to capture or playback stream.
+ *
+ * @param dir USBH_AUDIO_STREAM_CAPTURE or USBH_AUDIO_STREAM_PLAYBACK.
+ * @param ringbuf ring buffer memory.
+ * @param ringsize ring buffer size in bytes, must be power of 2.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_audio_stream_init(uint8_t dir, uint8_t *ringbuf, uint32_t ringsize);
+int usbh_audio_stream_deinit(uint8_t dir);
+
+/**
+ * @brief Open stream interface and keep iso urbs queued. Playback ring can be prefilled before start.
+ *
+ * @param dir USBH_AUDIO_STREAM_CAPTURE or USBH_AUDIO_STREAM_PLAYBACK.
+ * @param audio_class audio class instance.
+ * @param name stream name, such as "mic", "speaker" or "headphoens".
+ * @param samp_freq sampling frequency.
+ * @param bitresolution bit resolution.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_audio_stream_start(uint8_t dir, struct usbh_audio *audio_class, const char *name, uint32_t samp_freq, uint8_t bitresolution);
+int usbh_audio_stream_stop(uint8_t dir);
+
+/* Queue pcm for playback, only whole audio frames are accepted, return bytes written */
+uint32_t usbh_audio_stream_write(const uint8_t *data, uint32_t len);
+/* Fetch captured pcm, return bytes read */
+uint32_t usbh_audio_stream_read(uint8_t *data, uint32_t len);
+
+/* Return pcm bytes queued in ring buffer, or free space for playback */
+uint32_t usbh_audio_stream_get_used(uint8_t dir);
+uint32_t usbh_audio_stream_get_free(uint8_t dir);
+
+/* Return stream latency in us, includes ring buffer level and samples held by urbs */
+uint32_t usbh_audio_stream_get_latency(uint8_t dir);
+void usbh_audio_stream_get_stat(uint8_t dir, struct usbh_audio_stream_stat *stat);
+
+/* Called in urb complete context after pcm bytes have been moved between ring and bus */
+void usbh_audio_stream_callback(uint8_t dir, uint32_t nbytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USBH_UAC_STREAM_H */
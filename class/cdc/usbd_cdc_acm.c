@@ -9,6 +9,209 @@
 const char *stop_name[] = { "1", "1.5", "2" };
 const char *parity_name[] = { "N", "O", "E", "M", "S" };
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+#include "chry_ringbuffer.h"
+
+#if CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE % 512
+#error "CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE must be multiple of 512"
+#endif
+
+#if (CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE & (CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE - 1)) || \
+    (CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE & (CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE - 1))
+#error "CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE and CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE must be power of 2"
+#endif
+
+struct usbd_cdc_acm_stream {
+    uint8_t in_ep; /* 0 when slot is unused */
+    uint8_t out_ep;
+    uint8_t intf;
+    volatile bool dtr;
+    volatile bool rts;
+    volatile bool configured;
+    volatile bool rx_busy; /* bulk out armed */
+    uint8_t rx_index;      /* out buffer owned by bulk out */
+    volatile bool tx_busy; /* bulk in or zlp in flight */
+    bool tx_zlp;           /* last transfer was mps multiple, zlp is due when ring runs empty */
+    chry_ringbuffer_t rx_rb;
+    chry_ringbuffer_t tx_rb;
+    struct usbd_cdc_acm_stream_stat stat;
+};
+
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbd_cdc_acm_rx_buf[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF][2][CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbd_cdc_acm_tx_buf[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF][CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE];
+
+static uint8_t g_usbd_cdc_acm_rx_pool[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF][CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE];
+static uint8_t g_usbd_cdc_acm_tx_pool[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF][CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE];
+static struct usbd_cdc_acm_stream g_usbd_cdc_acm_stream[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF];
+static struct usbd_endpoint cdc_acm_stream_in_ep[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF];
+static struct usbd_endpoint cdc_acm_stream_out_ep[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF];
+
+static int usbd_cdc_acm_stream_find(uint8_t busid, uint8_t intf)
+{
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF; i++) {
+        if (g_usbd_cdc_acm_stream[busid][i].in_ep && (g_usbd_cdc_acm_stream[busid][i].intf == intf)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int usbd_cdc_acm_stream_find_ep(uint8_t busid, uint8_t ep)
+{
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF; i++) {
+        if (g_usbd_cdc_acm_stream[busid][i].in_ep &&
+            ((g_usbd_cdc_acm_stream[busid][i].in_ep == ep) || (g_usbd_cdc_acm_stream[busid][i].out_ep == ep))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool usbd_cdc_acm_stream_tx_ready(struct usbd_cdc_acm_stream *stream)
+{
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM_RTS_FLOW
+    return stream->configured && stream->dtr && stream->rts;
+#else
+    return stream->configured && stream->dtr;
+#endif
+}
+
+/* Arm bulk out on the current buffer if rx ring can take reserve bytes plus a full transfer */
+static void usbd_cdc_acm_stream_rx_start(uint8_t busid, uint8_t index, uint32_t reserve)
+{
+    struct usbd_cdc_acm_stream *stream = &g_usbd_cdc_acm_stream[busid][index];
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (stream->rx_busy || !stream->configured ||
+        (chry_ringbuffer_get_free(&stream->rx_rb) < (reserve + CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE))) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    stream->rx_busy = true;
+    usb_osal_leave_critical_section(flags);
+
+    usbd_ep_start_read(busid, stream->out_ep, g_usbd_cdc_acm_rx_buf[busid][index][stream->rx_index], CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE);
+}
+
+/* Send whatever is in tx ring up to one transfer, whoever sets tx_busy is the only ring consumer */
+static void usbd_cdc_acm_stream_tx_start(uint8_t busid, uint8_t index)
+{
+    struct usbd_cdc_acm_stream *stream = &g_usbd_cdc_acm_stream[busid][index];
+    uint32_t len;
+    size_t flags;
+
+    while (1) {
+        flags = usb_osal_enter_critical_section();
+        if (stream->tx_busy || !usbd_cdc_acm_stream_tx_ready(stream)) {
+            usb_osal_leave_critical_section(flags);
+            return;
+        }
+        stream->tx_busy = true;
+        usb_osal_leave_critical_section(flags);
+
+        len = chry_ringbuffer_read(&stream->tx_rb, g_usbd_cdc_acm_tx_buf[busid][index], CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE);
+        if (len) {
+            /* more data terminates the host read as well, no zlp needed */
+            stream->tx_zlp = false;
+            usbd_ep_start_write(busid, stream->in_ep, g_usbd_cdc_acm_tx_buf[busid][index], len);
+            return;
+        }
+
+        if (stream->tx_zlp) {
+            stream->tx_zlp = false;
+            stream->stat.zlps++;
+            usbd_ep_start_write(busid, stream->in_ep, NULL, 0);
+            return;
+        }
+
+        stream->tx_busy = false;
+
+        /* writer may have queued bytes after the read above and seen tx_busy set */
+        if (chry_ringbuffer_get_used(&stream->tx_rb) == 0) {
+            return;
+        }
+    }
+}
+
+static void usbd_cdc_acm_stream_out_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_cdc_acm_stream *stream;
+    uint8_t *buffer;
+    int index;
+
+    index = usbd_cdc_acm_stream_find_ep(busid, ep);
+    if (index < 0) {
+        return;
+    }
+    stream = &g_usbd_cdc_acm_stream[busid][index];
+
+    buffer = g_usbd_cdc_acm_rx_buf[busid][index][stream->rx_index];
+    stream->rx_index ^= 1;
+    stream->rx_busy = false;
+    stream->stat.rx_bytes += nbytes;
+
+    /* rearm on the other buffer before copying when ring can hold both transfers */
+    usbd_cdc_acm_stream_rx_start(busid, index, nbytes);
+
+    chry_ringbuffer_write(&stream->rx_rb, buffer, nbytes);
+
+    if (!stream->rx_busy) {
+        usbd_cdc_acm_stream_rx_start(busid, index, 0);
+        if (!stream->rx_busy) {
+            /* host is naked until usbd_cdc_acm_read makes room */
+            stream->stat.rx_pauses++;
+        }
+    }
+
+    if (nbytes) {
+        usbd_cdc_acm_stream_rx_callback(busid, stream->intf, nbytes);
+    }
+}
+
+static void usbd_cdc_acm_stream_in_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_cdc_acm_stream *stream;
+    int index;
+
+    index = usbd_cdc_acm_stream_find_ep(busid, ep);
+    if (index < 0) {
+        return;
+    }
+    stream = &g_usbd_cdc_acm_stream[busid][index];
+
+    stream->stat.tx_bytes += nbytes;
+    if (nbytes && ((nbytes % usbd_get_ep_mps(busid, ep)) == 0)) {
+        stream->tx_zlp = true;
+    }
+    stream->tx_busy = false;
+
+    usbd_cdc_acm_stream_tx_start(busid, index);
+
+    if (chry_ringbuffer_get_free(&stream->tx_rb)) {
+        usbd_cdc_acm_stream_tx_callback(busid, stream->intf);
+    }
+}
+
+static void usbd_cdc_acm_stream_line_state(uint8_t busid, uint8_t intf, bool dtr, bool rts)
+{
+    struct usbd_cdc_acm_stream *stream;
+    int index;
+
+    index = usbd_cdc_acm_stream_find(busid, intf);
+    if (index < 0) {
+        return;
+    }
+    stream = &g_usbd_cdc_acm_stream[busid][index];
+
+    stream->dtr = dtr;
+    stream->rts = rts;
+
+    /* bytes written while port was closed are sent on open */
+    usbd_cdc_acm_stream_tx_start(busid, index);
+}
+#endif
+
 static int cdc_acm_class_interface_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     USB_LOG_DBG("CDC Class request: "
@@ -57,6 +260,9 @@ static int cdc_acm_class_interface_request_handler(uint8_t busid, struct usb_set
                         intf_num,
                         dtr,
                         rts);
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+            usbd_cdc_acm_stream_line_state(busid, intf_num, dtr, rts);
+#endif
             usbd_cdc_acm_set_dtr(busid, intf_num, dtr);
             usbd_cdc_acm_set_rts(busid, intf_num, rts);
             break;
@@ -83,6 +289,46 @@ static int cdc_acm_class_interface_request_handler(uint8_t busid, struct usb_set
     return 0;
 }
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+static void cdc_acm_notify_handler(uint8_t busid, uint8_t event, void *arg)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    (void)arg;
+
+    /* every cdc acm interface gets the event, streams are only started once */
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF; i++) {
+        stream = &g_usbd_cdc_acm_stream[busid][i];
+        if (stream->in_ep == 0) {
+            continue;
+        }
+
+        switch (event) {
+            case USBD_EVENT_RESET:
+                /* transfers are gone, ring contents are kept for the next session */
+                stream->configured = false;
+                stream->dtr = false;
+                stream->rts = false;
+                stream->rx_busy = false;
+                stream->tx_busy = false;
+                stream->tx_zlp = false;
+                break;
+
+            case USBD_EVENT_CONFIGURED:
+                if (!stream->configured) {
+                    stream->configured = true;
+                    usbd_cdc_acm_stream_rx_start(busid, i, 0);
+                    usbd_cdc_acm_stream_tx_start(busid, i);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+#endif
+
 struct usbd_interface *usbd_cdc_acm_init_intf(uint8_t busid, struct usbd_interface *intf)
 {
     (void)busid;
@@ -90,11 +336,118 @@ struct usbd_interface *usbd_cdc_acm_init_intf(uint8_t busid, struct usbd_interfa
     intf->class_interface_handler = cdc_acm_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+    intf->notify_handler = cdc_acm_notify_handler;
+#else
     intf->notify_handler = NULL;
+#endif
 
     return intf;
 }
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+int usbd_cdc_acm_stream_init(uint8_t busid, uint8_t intf, uint8_t in_ep, uint8_t out_ep)
+{
+    struct usbd_cdc_acm_stream *stream;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_CDC_ACM_STREAM_MAX_INTF; i++) {
+        stream = &g_usbd_cdc_acm_stream[busid][i];
+        if (stream->in_ep == 0) {
+            memset(stream, 0, sizeof(struct usbd_cdc_acm_stream));
+            stream->in_ep = in_ep;
+            stream->out_ep = out_ep;
+            stream->intf = intf;
+            chry_ringbuffer_init(&stream->rx_rb, g_usbd_cdc_acm_rx_pool[busid][i], CONFIG_USBDEV_CDC_ACM_STREAM_RX_BUFSIZE);
+            chry_ringbuffer_init(&stream->tx_rb, g_usbd_cdc_acm_tx_pool[busid][i], CONFIG_USBDEV_CDC_ACM_STREAM_TX_BUFSIZE);
+
+            cdc_acm_stream_in_ep[busid][i].ep_addr = in_ep;
+            cdc_acm_stream_in_ep[busid][i].ep_cb = usbd_cdc_acm_stream_in_callback;
+            cdc_acm_stream_out_ep[busid][i].ep_addr = out_ep;
+            cdc_acm_stream_out_ep[busid][i].ep_cb = usbd_cdc_acm_stream_out_callback;
+            usbd_add_endpoint(busid, &cdc_acm_stream_out_ep[busid][i]);
+            usbd_add_endpoint(busid, &cdc_acm_stream_in_ep[busid][i]);
+            return 0;
+        }
+    }
+
+    return -USB_ERR_NOMEM;
+}
+
+uint32_t usbd_cdc_acm_write(uint8_t busid, uint8_t intf, const uint8_t *data, uint32_t len)
+{
+    uint32_t written;
+    int index;
+
+    index = usbd_cdc_acm_stream_find(busid, intf);
+    if (index < 0) {
+        return 0;
+    }
+
+    written = chry_ringbuffer_write(&g_usbd_cdc_acm_stream[busid][index].tx_rb, (void *)data, len);
+    usbd_cdc_acm_stream_tx_start(busid, index);
+
+    return written;
+}
+
+uint32_t usbd_cdc_acm_read(uint8_t busid, uint8_t intf, uint8_t *data, uint32_t len)
+{
+    uint32_t nbytes;
+    int index;
+
+    index = usbd_cdc_acm_stream_find(busid, intf);
+    if (index < 0) {
+        return 0;
+    }
+
+    nbytes = chry_ringbuffer_read(&g_usbd_cdc_acm_stream[busid][index].rx_rb, data, len);
+    /* resume bulk out paused on a full ring */
+    usbd_cdc_acm_stream_rx_start(busid, index, 0);
+
+    return nbytes;
+}
+
+uint32_t usbd_cdc_acm_get_rx_used(uint8_t busid, uint8_t intf)
+{
+    int index = usbd_cdc_acm_stream_find(busid, intf);
+
+    if (index < 0) {
+        return 0;
+    }
+    return chry_ringbuffer_get_used(&g_usbd_cdc_acm_stream[busid][index].rx_rb);
+}
+
+uint32_t usbd_cdc_acm_get_tx_free(uint8_t busid, uint8_t intf)
+{
+    int index = usbd_cdc_acm_stream_find(busid, intf);
+
+    if (index < 0) {
+        return 0;
+    }
+    return chry_ringbuffer_get_free(&g_usbd_cdc_acm_stream[busid][index].tx_rb);
+}
+
+bool usbd_cdc_acm_is_open(uint8_t busid, uint8_t intf)
+{
+    int index = usbd_cdc_acm_stream_find(busid, intf);
+
+    if (index < 0) {
+        return false;
+    }
+    return g_usbd_cdc_acm_stream[busid][index].configured && g_usbd_cdc_acm_stream[busid][index].dtr;
+}
+
+void usbd_cdc_acm_stream_get_stat(uint8_t busid, uint8_t intf, struct usbd_cdc_acm_stream_stat *stat)
+{
+    int index = usbd_cdc_acm_stream_find(busid, intf);
+
+    if (index < 0) {
+        memset(stat, 0, sizeof(struct usbd_cdc_acm_stream_stat));
+        return;
+    }
+    memcpy(stat, &g_usbd_cdc_acm_stream[busid][index].stat, sizeof(struct usbd_cdc_acm_stream_stat));
+}
+#endif
+
 __WEAK void usbd_cdc_acm_set_line_coding(uint8_t busid, uint8_t intf, struct cdc_line_coding *line_coding)
 {
     (void)busid;
@@ -132,3 +485,18 @@ __WEAK void usbd_cdc_acm_send_break(uint8_t busid, uint8_t intf)
     (void)busid;
     (void)intf;
 }
+
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+__WEAK void usbd_cdc_acm_stream_rx_callback(uint8_t busid, uint8_t intf, uint32_t nbytes)
+{
+    (void)busid;
+    (void)intf;
+    (void)nbytes;
+}
+
+__WEAK void usbd_cdc_acm_stream_tx_callback(uint8_t busid, uint8_t intf)
+{
+    (void)busid;
+    (void)intf;
+}
+#endif
@@ -8,6 +8,15 @@
 
 #include "usb_cdc.h"
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+struct usbd_cdc_acm_stream_stat {
+    uint32_t rx_bytes;  /* bytes received on bulk out */
+    uint32_t tx_bytes;  /* bytes completed on bulk in, without zlp */
+    uint32_t rx_pauses; /* bulk out left idle because rx ring had no room for a full transfer */
+    uint32_t zlps;      /* zero length packets sent after transfers of mps multiple */
+};
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -22,6 +31,38 @@ void usbd_cdc_acm_set_dtr(uint8_t busid, uint8_t intf, bool dtr);
 void usbd_cdc_acm_set_rts(uint8_t busid, uint8_t intf, bool rts);
 void usbd_cdc_acm_send_break(uint8_t busid, uint8_t intf);
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+/**
+ * @brief Attach ring buffered data path to cdc acm interface, must be called before usbd_initialize.
+ *
+ * Bulk out is received into two buffers in turn and stays armed while rx ring has room for a full transfer.
+ * Bytes written are sent in transfers of up to CONFIG_USBDEV_CDC_ACM_STREAM_XFER_SIZE when host has set DTR,
+ * and a zlp is sent when the ring runs empty after a transfer of mps multiple.
+ *
+ * @param busid bus index.
+ * @param intf communication interface number, the one receiving SET_CONTROL_LINE_STATE.
+ * @param in_ep bulk in endpoint address, registered by stream.
+ * @param out_ep bulk out endpoint address, registered by stream.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbd_cdc_acm_stream_init(uint8_t busid, uint8_t intf, uint8_t in_ep, uint8_t out_ep);
+
+/* Queue bytes for bulk in, never blocks, return number of bytes queued */
+uint32_t usbd_cdc_acm_write(uint8_t busid, uint8_t intf, const uint8_t *data, uint32_t len);
+/* Read received bytes, never blocks, return number of bytes read */
+uint32_t usbd_cdc_acm_read(uint8_t busid, uint8_t intf, uint8_t *data, uint32_t len);
+uint32_t usbd_cdc_acm_get_rx_used(uint8_t busid, uint8_t intf);
+uint32_t usbd_cdc_acm_get_tx_free(uint8_t busid, uint8_t intf);
+/* Return true when host has the port open, which is DTR set */
+bool usbd_cdc_acm_is_open(uint8_t busid, uint8_t intf);
+void usbd_cdc_acm_stream_get_stat(uint8_t busid, uint8_t intf, struct usbd_cdc_acm_stream_stat *stat);
+
+/* Called in interrupt context after nbytes were put into rx ring */
+void usbd_cdc_acm_stream_rx_callback(uint8_t busid, uint8_t intf, uint32_t nbytes);
+/* Called in interrupt context when bulk in completes and tx ring has free space */
+void usbd_cdc_acm_stream_tx_callback(uint8_t busid, uint8_t intf);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,8 @@
  */
 #include "usbh_core.h"
 #include "usbh_cdc_ecm.h"
+#include "usbh_net_rxbuf.h"
+#include "usbh_net_txq.h"
 
 #undef USB_DBG_TAG
 #define USB_DBG_TAG "usbh_cdc_ecm"
@@ -28,6 +30,10 @@ static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_rx_buffer[USB_AL
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_tx_buffer[USB_ALIGN_UP(CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, CONFIG_USB_ALIGN_SIZE)];
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ecm_inttx_buffer[USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+static struct usbh_net_txq g_cdc_ecm_txq;
+#endif
+
 static struct usbh_cdc_ecm g_cdc_ecm_class;
 
 static int usbh_cdc_ecm_set_eth_packet_filter(struct usbh_cdc_ecm *cdc_ecm_class, uint16_t filter_value)
@@ -197,6 +203,9 @@ get_mac:
 
     USB_LOG_INFO("Register CDC ECM Class:%s\r\n", hport->config.intf[intf].devname);
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+    usbh_net_txq_init(&g_cdc_ecm_txq, &cdc_ecm_class->bulkout_urb, hport, cdc_ecm_class->bulkout);
+#endif
     usbh_cdc_ecm_run(cdc_ecm_class);
     return ret;
 }
@@ -214,6 +223,9 @@ static int usbh_cdc_ecm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
         if (cdc_ecm_class->bulkout) {
             usbh_kill_urb(&cdc_ecm_class->bulkout_urb);
+#ifdef CONFIG_USBHOST_NET_TXQ
+            usbh_net_txq_flush(&g_cdc_ecm_txq);
+#endif
         }
 
         if (cdc_ecm_class->intin) {
@@ -235,6 +247,7 @@ static int usbh_cdc_ecm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 void usbh_cdc_ecm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
     uint32_t g_cdc_ecm_rx_length;
+    uint8_t *rx_buffer = NULL;
     int ret;
 
     (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
@@ -258,7 +271,8 @@ find_class:
 
     g_cdc_ecm_rx_length = 0;
     while (1) {
-        usbh_bulk_urb_fill(&g_cdc_ecm_class.bulkin_urb, g_cdc_ecm_class.hport, g_cdc_ecm_class.bulkin, g_cdc_ecm_rx_buffer, CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        rx_buffer = usbh_net_rxbuf_renew(rx_buffer, g_cdc_ecm_rx_buffer, CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE);
+        usbh_bulk_urb_fill(&g_cdc_ecm_class.bulkin_urb, g_cdc_ecm_class.hport, g_cdc_ecm_class.bulkin, rx_buffer, CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE, USB_OSAL_WAITING_FOREVER, NULL, NULL);
         ret = usbh_submit_urb(&g_cdc_ecm_class.bulkin_urb);
         if (ret < 0) {
             goto find_class;
@@ -275,7 +289,7 @@ find_class:
             (g_cdc_ecm_class.bulkin_urb.actual_length < CONFIG_USBHOST_CDC_ECM_ETH_MAX_SIZE)) {
             USB_LOG_DBG("rxlen:%d\r\n", g_cdc_ecm_rx_length);
 
-            usbh_cdc_ecm_eth_input(g_cdc_ecm_rx_buffer, g_cdc_ecm_rx_length);
+            usbh_cdc_ecm_eth_input(rx_buffer, g_cdc_ecm_rx_length);
 
             g_cdc_ecm_rx_length = 0;
         } else {
@@ -284,6 +298,7 @@ find_class:
     }
     // clang-format off
 delete:
+    usbh_net_rxbuf_free(rx_buffer);
     USB_LOG_INFO("Delete cdc ecm rx thread\r\n");
     usb_osal_thread_delete(NULL);
     // clang-format on
@@ -306,6 +321,19 @@ int usbh_cdc_ecm_eth_output(uint32_t buflen)
     return usbh_submit_urb(&g_cdc_ecm_class.bulkout_urb);
 }
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+int usbh_cdc_ecm_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg)
+{
+    (void)tailroom;
+
+    if (g_cdc_ecm_class.connect_status == false) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    return usbh_net_txq_push(&g_cdc_ecm_txq, buf, buflen, done, arg);
+}
+#endif
+
 __WEAK void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
 {
     (void)cdc_ecm_class;
@@ -7,6 +7,10 @@
 #define USBH_CDC_ECM_H
 
 #include "usb_cdc.h"
+#include "usbh_net_txq.h"
+
+/* ECM frames go out without header */
+#define USBH_CDC_ECM_TX_HEADROOM 0
 
 struct usbh_cdc_ecm {
     struct usbh_hubport *hport;
@@ -40,6 +44,9 @@ void usbh_cdc_ecm_stop(struct usbh_cdc_ecm *cdc_ecm_class);
 
 uint8_t *usbh_cdc_ecm_get_eth_txbuf(void);
 int usbh_cdc_ecm_eth_output(uint32_t buflen);
+/* Queue frame at buf without copy, USBH_CDC_ECM_TX_HEADROOM bytes before buf are overwritten by the driver header
+ * and must start CONFIG_USB_ALIGN_SIZE aligned, tailroom bytes after frame may be used for padding. done is called once sent */
+int usbh_cdc_ecm_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg);
 void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen);
 void usbh_cdc_ecm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
@@ -5,6 +5,8 @@
  */
 #include "usbh_core.h"
 #include "usbh_cdc_ncm.h"
+#include "usbh_net_rxbuf.h"
+#include "usbh_net_txq.h"
 #include "lwip/netif.h"
 #include "lwip/pbuf.h"
 #include "lwip/etharp.h"
@@ -44,10 +46,18 @@ struct cdc_ncm_max_datagram_cmd {
     uint16_t wReserved;
 } __PACKED;
 
+#if defined(CONFIG_USBHOST_NET_RXBUF) && (CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE > CONFIG_USBHOST_NET_RXBUF_SIZE)
+#warning "CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE is larger than CONFIG_USBHOST_NET_RXBUF_SIZE, ncm rx frames are copied"
+#endif
+
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_rx_buffer[CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE];
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_tx_buffer[CONFIG_USBHOST_CDC_NCM_ETH_MAX_TX_SIZE];
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_inttx_buffer[USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+static struct usbh_net_txq g_cdc_ncm_txq;
+#endif
+
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_cdc_ncm_buf[USB_ALIGN_UP(32, CONFIG_USB_ALIGN_SIZE)];
 
 static struct usbh_cdc_ncm g_cdc_ncm_class;
@@ -381,6 +391,9 @@ get_mac:
 
     USB_LOG_INFO("Register CDC NCM Class:%s\r\n", hport->config.intf[intf].devname);
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+    usbh_net_txq_init(&g_cdc_ncm_txq, &cdc_ncm_class->bulkout_urb, hport, cdc_ncm_class->bulkout);
+#endif
     usbh_cdc_ncm_run(cdc_ncm_class);
     return 0;
 }
@@ -398,6 +411,9 @@ static int usbh_cdc_ncm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
         if (cdc_ncm_class->bulkout) {
             usbh_kill_urb(&cdc_ncm_class->bulkout_urb);
+#ifdef CONFIG_USBHOST_NET_TXQ
+            usbh_net_txq_flush(&g_cdc_ncm_txq);
+#endif
         }
 
         if (cdc_ncm_class->intin) {
@@ -419,6 +435,7 @@ static int usbh_cdc_ncm_disconnect(struct usbh_hubport *hport, uint8_t intf)
 void usbh_cdc_ncm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
     uint32_t g_cdc_ncm_rx_length;
+    uint8_t *rx_buffer = NULL;
     int ret;
     /* Reduce transfer size to avoid DWC2 FIFO overflow on ESP32-S3.
      * Use endpoint max packet size (64 bytes) to minimize FIFO pressure.
@@ -483,7 +500,10 @@ find_class:
         /* Linux-style: submit URB immediately, process on completion, then submit next immediately.
          * This minimizes gaps where the host isn't ready to receive data.
          */
-        usbh_bulk_urb_fill(&g_cdc_ncm_class.bulkin_urb, g_cdc_ncm_class.hport, g_cdc_ncm_class.bulkin, &g_cdc_ncm_rx_buffer[g_cdc_ncm_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        if (g_cdc_ncm_rx_length == 0) {
+            rx_buffer = usbh_net_rxbuf_renew(rx_buffer, g_cdc_ncm_rx_buffer, CONFIG_USBHOST_CDC_NCM_ETH_MAX_RX_SIZE);
+        }
+        usbh_bulk_urb_fill(&g_cdc_ncm_class.bulkin_urb, g_cdc_ncm_class.hport, g_cdc_ncm_class.bulkin, &rx_buffer[g_cdc_ncm_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
         ret = usbh_submit_urb(&g_cdc_ncm_class.bulkin_urb);
         if (ret < 0) {
             USB_LOG_DBG("bulk IN submit error ret=%d\r\n", ret);
@@ -512,7 +532,7 @@ find_class:
         }
 
         g_cdc_ncm_rx_length += g_cdc_ncm_class.bulkin_urb.actual_length;
-        USB_LOG_INFO("NCM bulk IN completed: len=%u\r\n", (unsigned int)g_cdc_ncm_class.bulkin_urb.actual_length);
+        USB_LOG_DBG("NCM bulk IN completed: len=%u\r\n", (unsigned int)g_cdc_ncm_class.bulkin_urb.actual_length);
 
         /* A transfer is complete because last packet is a short packet.
          * Short packet is not zero, match g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ncm_class.bulkin->wMaxPacketSize).
@@ -520,10 +540,12 @@ find_class:
         */
         if ((g_cdc_ncm_rx_length % USB_GET_MAXPACKETSIZE(g_cdc_ncm_class.bulkin->wMaxPacketSize)) ||
             (g_cdc_ncm_class.bulkin_urb.actual_length < transfer_size)) {
-            USB_LOG_INFO("NCM RX block length:%d\r\n", g_cdc_ncm_rx_length);
-            usb_hexdump(&g_cdc_ncm_rx_buffer[0], MIN(g_cdc_ncm_rx_length, 64));
+            USB_LOG_DBG("NCM RX block length:%d\r\n", g_cdc_ncm_rx_length);
+#if (CONFIG_USB_DBG_LEVEL >= USB_DBG_LOG) && !defined(CONFIG_USB_LOG_DEFERRED)
+            usb_hexdump(&rx_buffer[0], MIN(g_cdc_ncm_rx_length, 64));
+#endif
 
-            struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&g_cdc_ncm_rx_buffer[0];
+            struct cdc_ncm_nth16 *nth16 = (struct cdc_ncm_nth16 *)&rx_buffer[0];
             if ((nth16->dwSignature != CDC_NCM_NTH16_SIGNATURE) ||
                 (nth16->wHeaderLength != 12) ||
                 (nth16->wBlockLength != g_cdc_ncm_rx_length)) {
@@ -532,7 +554,7 @@ find_class:
                 continue;
             }
 
-            struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&g_cdc_ncm_rx_buffer[nth16->wNdpIndex];
+            struct cdc_ncm_ndp16 *ndp16 = (struct cdc_ncm_ndp16 *)&rx_buffer[nth16->wNdpIndex];
             if ((ndp16->dwSignature != CDC_NCM_NDP16_SIGNATURE) &&
                 (ndp16->dwSignature != CDC_NCM_NDP16_SIGNATURE_NCM0) &&
                 (ndp16->dwSignature != CDC_NCM_NDP16_SIGNATURE_NCM1)) {
@@ -543,11 +565,11 @@ find_class:
 
             uint16_t datagram_num = (ndp16->wLength - 8) / 4;
 
-            USB_LOG_INFO("NCM datagram count:%u\r\n", datagram_num);
+            USB_LOG_DBG("NCM datagram count:%u\r\n", datagram_num);
             for (uint16_t i = 0; i < datagram_num; i++) {
-                struct cdc_ncm_ndp16_datagram *ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&g_cdc_ncm_rx_buffer[nth16->wNdpIndex + 8 + 4 * i];
+                struct cdc_ncm_ndp16_datagram *ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&rx_buffer[nth16->wNdpIndex + 8 + 4 * i];
                 if (ndp16_datagram->wDatagramIndex && ndp16_datagram->wDatagramLength) {
-                    uint8_t *buf = (uint8_t *)&g_cdc_ncm_rx_buffer[ndp16_datagram->wDatagramIndex];
+                    uint8_t *buf = (uint8_t *)&rx_buffer[ndp16_datagram->wDatagramIndex];
                     usbh_cdc_ncm_eth_input(buf, ndp16_datagram->wDatagramLength);
                 }
             }
@@ -567,6 +589,7 @@ find_class:
     }
     // clang-format off
 delete:
+    usbh_net_rxbuf_free(rx_buffer);
     USB_LOG_INFO("Delete cdc ncm rx thread\r\n");
     usb_osal_thread_delete(NULL);
     // clang-format on
@@ -623,7 +646,9 @@ int usbh_cdc_ncm_eth_output(uint32_t buflen)
     ndp16_datagram->wDatagramLength = buflen;
 
     USB_LOG_DBG("txlen:%d\r\n", nth16->wBlockLength);
+#if (CONFIG_USB_DBG_LEVEL >= USB_DBG_LOG) && !defined(CONFIG_USB_LOG_DEFERRED)
     usb_hexdump(g_cdc_ncm_tx_buffer, MIN(nth16->wBlockLength, 64));
+#endif
 
     usbh_bulk_urb_fill(&g_cdc_ncm_class.bulkout_urb, g_cdc_ncm_class.hport, g_cdc_ncm_class.bulkout, g_cdc_ncm_tx_buffer, nth16->wBlockLength, USB_OSAL_WAITING_FOREVER, NULL, NULL);
     int ret = usbh_submit_urb(&g_cdc_ncm_class.bulkout_urb);
@@ -631,6 +656,50 @@ int usbh_cdc_ncm_eth_output(uint32_t buflen)
     return ret;
 }
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+int usbh_cdc_ncm_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg)
+{
+    struct cdc_ncm_nth16 *nth16;
+    struct cdc_ncm_ndp16 *ndp16;
+    struct cdc_ncm_ndp16_datagram *ndp16_datagram;
+    uint8_t *hdr = buf - USBH_CDC_NCM_TX_HEADROOM;
+
+    (void)tailroom;
+
+    if (g_cdc_ncm_class.connect_status == false) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    /* nth16 at 0, standard ndp at 16 and NCM0 ndp at 32 in front of the datagram, nothing is appended */
+    memset(hdr, 0, USBH_CDC_NCM_TX_HEADROOM);
+
+    nth16 = (struct cdc_ncm_nth16 *)hdr;
+    nth16->dwSignature = CDC_NCM_NTH16_SIGNATURE;
+    nth16->wHeaderLength = 12;
+    nth16->wSequence = g_cdc_ncm_class.bulkout_sequence++;
+    nth16->wBlockLength = USBH_CDC_NCM_TX_HEADROOM + buflen;
+    nth16->wNdpIndex = 16;
+
+    ndp16 = (struct cdc_ncm_ndp16 *)&hdr[16];
+    ndp16->dwSignature = CDC_NCM_NDP16_SIGNATURE;
+    ndp16->wLength = 16;
+    ndp16->wNextNdpIndex = 32;
+    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&hdr[16 + 8];
+    ndp16_datagram->wDatagramIndex = USBH_CDC_NCM_TX_HEADROOM;
+    ndp16_datagram->wDatagramLength = buflen;
+
+    ndp16 = (struct cdc_ncm_ndp16 *)&hdr[32];
+    ndp16->dwSignature = CDC_NCM_NDP16_SIGNATURE_NCM0;
+    ndp16->wLength = 16;
+    ndp16->wNextNdpIndex = 0;
+    ndp16_datagram = (struct cdc_ncm_ndp16_datagram *)&hdr[32 + 8];
+    ndp16_datagram->wDatagramIndex = USBH_CDC_NCM_TX_HEADROOM;
+    ndp16_datagram->wDatagramLength = buflen;
+
+    return usbh_net_txq_push(&g_cdc_ncm_txq, hdr, nth16->wBlockLength, done, arg);
+}
+#endif
+
 __WEAK void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
 {
     (void)cdc_ncm_class;
@@ -7,6 +7,10 @@
 #define USBH_CDC_NCM_H
 
 #include "usb_cdc.h"
+#include "usbh_net_txq.h"
+
+/* nth16 and two ndp16 in front of the datagram */
+#define USBH_CDC_NCM_TX_HEADROOM 48
 
 struct usbh_cdc_ncm {
     struct usbh_hubport *hport;
@@ -44,6 +48,9 @@ void usbh_cdc_ncm_stop(struct usbh_cdc_ncm *cdc_ncm_class);
 
 uint8_t *usbh_cdc_ncm_get_eth_txbuf(void);
 int usbh_cdc_ncm_eth_output(uint32_t buflen);
+/* Queue frame at buf without copy, USBH_CDC_NCM_TX_HEADROOM bytes before buf are overwritten by the driver header
+ * and must start CONFIG_USB_ALIGN_SIZE aligned, tailroom bytes after frame may be used for padding. done is called once sent */
+int usbh_cdc_ncm_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg);
 void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen);
 void usbh_cdc_ncm_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
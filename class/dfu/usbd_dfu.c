@@ -23,6 +23,42 @@
 #define FLASH_ERASE_TIME 50
 #endif
 
+/* Erase and program jobs queued ahead of the flash, erase jobs carry no data */
+#ifndef USBD_DFU_QUEUE_DEPTH
+#define USBD_DFU_QUEUE_DEPTH 8
+#endif
+
+/* Block buffers, one is programmed while the next one is received */
+#ifndef USBD_DFU_BUF_NUM
+#define USBD_DFU_BUF_NUM 2
+#endif
+
+#if defined(CONFIG_USBDEV_DFU_THREAD) && defined(CONFIG_USBDEV_DFU_POLLING)
+#error "CONFIG_USBDEV_DFU_THREAD and CONFIG_USBDEV_DFU_POLLING cannot be enabled at the same time"
+#endif
+
+struct dfu_job {
+    uint8_t cmd; /* DFU_MEDIA_ERASE or DFU_MEDIA_PROGRAM */
+    uint8_t buf;
+    uint16_t len;
+    uint32_t addr;
+};
+
+struct usbd_dfu_queue {
+    struct dfu_job job[USBD_DFU_QUEUE_DEPTH];
+    uint8_t head;
+    uint8_t count;
+    uint8_t buf_free; /* bitmask of free block buffers */
+    bool running;     /* worker owns running_job */
+    struct dfu_job running_job;
+    uint8_t error; /* DFU_STATUS_xxx of first failed job */
+    uint32_t block[USBD_DFU_BUF_NUM][USBD_DFU_XFER_SIZE / 4U];
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+    usb_osal_mq_t mq;
+    usb_osal_thread_t thread;
+#endif
+} g_usbd_dfu_queue;
+
 struct usbd_dfu_priv {
     struct dfu_info info;
     union {
@@ -39,9 +75,160 @@ struct usbd_dfu_priv {
     uint8_t ReservedForAlign[2];
     uint8_t dev_state;
     uint8_t manif_state;
-    uint8_t firmwar_flag;
 } g_usbd_dfu;
 
+static void dfu_queue_reset(void)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    g_usbd_dfu_queue.head = 0;
+    g_usbd_dfu_queue.count = 0;
+    g_usbd_dfu_queue.buf_free = (1U << USBD_DFU_BUF_NUM) - 1;
+    /* job still running keeps its block until it ends, its failure is then reported in error */
+    if (g_usbd_dfu_queue.running && (g_usbd_dfu_queue.running_job.cmd == DFU_MEDIA_PROGRAM)) {
+        g_usbd_dfu_queue.buf_free &= ~(1U << g_usbd_dfu_queue.running_job.buf);
+    }
+    g_usbd_dfu_queue.error = DFU_STATUS_OK;
+    usb_osal_leave_critical_section(flags);
+}
+
+static bool dfu_queue_pending(void)
+{
+    return g_usbd_dfu_queue.running || g_usbd_dfu_queue.count;
+}
+
+/* Host may send next block when a job slot and a block buffer are free */
+static bool dfu_queue_ready(void)
+{
+    return (g_usbd_dfu_queue.count < USBD_DFU_QUEUE_DEPTH) && g_usbd_dfu_queue.buf_free;
+}
+
+static uint32_t dfu_job_time(struct dfu_job *job)
+{
+    return (job->cmd == DFU_MEDIA_ERASE) ? FLASH_ERASE_TIME : FLASH_PROGRAM_TIME;
+}
+
+/* Estimated time until dfu_queue_ready() or, with all set, until the queue is drained */
+static uint32_t dfu_queue_busy_time(bool all)
+{
+    struct dfu_job *job;
+    uint32_t time = 0;
+    size_t flags;
+    bool need_buf;
+
+    flags = usb_osal_enter_critical_section();
+    need_buf = (g_usbd_dfu_queue.buf_free == 0);
+
+    if (g_usbd_dfu_queue.running) {
+        job = &g_usbd_dfu_queue.running_job;
+        time += dfu_job_time(job);
+        if (!all && (!need_buf || (job->cmd == DFU_MEDIA_PROGRAM))) {
+            usb_osal_leave_critical_section(flags);
+            return time;
+        }
+    }
+
+    for (uint8_t i = 0; i < g_usbd_dfu_queue.count; i++) {
+        job = &g_usbd_dfu_queue.job[(g_usbd_dfu_queue.head + i) % USBD_DFU_QUEUE_DEPTH];
+        time += dfu_job_time(job);
+        if (!all && (!need_buf || (job->cmd == DFU_MEDIA_PROGRAM))) {
+            break;
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+
+    return time;
+}
+
+static int dfu_queue_push(uint8_t cmd, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    struct dfu_job *job;
+    size_t flags;
+    uint8_t buf = 0;
+
+    flags = usb_osal_enter_critical_section();
+    if (g_usbd_dfu_queue.count == USBD_DFU_QUEUE_DEPTH) {
+        usb_osal_leave_critical_section(flags);
+        return -USB_ERR_BUSY;
+    }
+    if (cmd == DFU_MEDIA_PROGRAM) {
+        if (g_usbd_dfu_queue.buf_free == 0) {
+            usb_osal_leave_critical_section(flags);
+            return -USB_ERR_BUSY;
+        }
+        while ((g_usbd_dfu_queue.buf_free & (1U << buf)) == 0) {
+            buf++;
+        }
+        g_usbd_dfu_queue.buf_free &= ~(1U << buf);
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (cmd == DFU_MEDIA_PROGRAM) {
+        memcpy(g_usbd_dfu_queue.block[buf], data, len);
+    }
+
+    flags = usb_osal_enter_critical_section();
+    job = &g_usbd_dfu_queue.job[(g_usbd_dfu_queue.head + g_usbd_dfu_queue.count) % USBD_DFU_QUEUE_DEPTH];
+    job->cmd = cmd;
+    job->buf = buf;
+    job->len = len;
+    job->addr = addr;
+    g_usbd_dfu_queue.count++;
+    usb_osal_leave_critical_section(flags);
+
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+    usb_osal_mq_send(g_usbd_dfu_queue.mq, 0);
+#endif
+    return 0;
+}
+
+/* Run the oldest job, return false if the queue is empty */
+static bool dfu_queue_run(void)
+{
+    struct dfu_job *job = &g_usbd_dfu_queue.running_job;
+    uint8_t status = DFU_STATUS_OK;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (g_usbd_dfu_queue.count == 0) {
+        usb_osal_leave_critical_section(flags);
+        return false;
+    }
+    memcpy(job, &g_usbd_dfu_queue.job[g_usbd_dfu_queue.head], sizeof(struct dfu_job));
+    g_usbd_dfu_queue.head = (g_usbd_dfu_queue.head + 1) % USBD_DFU_QUEUE_DEPTH;
+    g_usbd_dfu_queue.count--;
+    g_usbd_dfu_queue.running = true;
+    usb_osal_leave_critical_section(flags);
+
+    /* after a failure the remaining jobs are only drained */
+    if (g_usbd_dfu_queue.error == DFU_STATUS_OK) {
+        if (job->cmd == DFU_MEDIA_ERASE) {
+            USB_LOG_DBG("Erase start add %08x \r\n", job->addr);
+            if (dfu_erase_flash(job->addr) != 0) {
+                status = DFU_STATUS_ERR_ERASE;
+            }
+        } else {
+            USB_LOG_DBG("Write start add %08x length %d\r\n", job->addr, job->len);
+            if (dfu_write_flash((uint8_t *)g_usbd_dfu_queue.block[job->buf], (uint8_t *)job->addr, job->len) != 0) {
+                status = DFU_STATUS_ERR_WRITE;
+            }
+        }
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (job->cmd == DFU_MEDIA_PROGRAM) {
+        g_usbd_dfu_queue.buf_free |= (1U << job->buf);
+    }
+    if ((status != DFU_STATUS_OK) && (g_usbd_dfu_queue.error == DFU_STATUS_OK)) {
+        g_usbd_dfu_queue.error = status;
+    }
+    g_usbd_dfu_queue.running = false;
+    usb_osal_leave_critical_section(flags);
+
+    return true;
+}
+
 static void dfu_reset(void)
 {
     memset(&g_usbd_dfu, 0, sizeof(g_usbd_dfu));
@@ -62,24 +249,11 @@ static void dfu_reset(void)
     g_usbd_dfu.dev_status[5] = 0U;
 }
 
-static uint16_t dfu_getstatus(uint32_t add, uint8_t cmd, uint8_t *buffer)
+static void dfu_set_poll_timeout(uint32_t ms)
 {
-    switch (cmd) {
-        case DFU_MEDIA_PROGRAM:
-            buffer[1] = (uint8_t)FLASH_PROGRAM_TIME;
-            buffer[2] = (uint8_t)(FLASH_PROGRAM_TIME << 8);
-            buffer[3] = 0;
-            break;
-
-        case DFU_MEDIA_ERASE:
-            buffer[1] = (uint8_t)FLASH_ERASE_TIME;
-            buffer[2] = (uint8_t)(FLASH_ERASE_TIME << 8);
-            buffer[3] = 0;
-        default:
-
-            break;
-    }
-    return (0);
+    g_usbd_dfu.dev_status[1] = (uint8_t)ms;
+    g_usbd_dfu.dev_status[2] = (uint8_t)(ms >> 8);
+    g_usbd_dfu.dev_status[3] = (uint8_t)(ms >> 16);
 }
 
 static void dfu_request_detach(void)
@@ -180,6 +354,41 @@ static void dfu_request_upload(struct usb_setup_packet *setup, uint8_t **data, u
     }
 }
 
+static int dfu_request_dnload_block(const uint8_t *data)
+{
+    uint32_t addr;
+
+    /* Decode the Special Command */
+    if (g_usbd_dfu.wblock_num == 0U) {
+        if ((g_usbd_dfu.wlength == 1U) && (data[0] == DFU_CMD_GETCOMMANDS)) {
+            /* Nothing to do */
+            return 0;
+        } else if (g_usbd_dfu.wlength == 5U) {
+            addr = data[1];
+            addr += (uint32_t)data[2] << 8;
+            addr += (uint32_t)data[3] << 16;
+            addr += (uint32_t)data[4] << 24;
+
+            if (data[0] == DFU_CMD_SETADDRESSPOINTER) {
+                g_usbd_dfu.data_ptr = addr;
+                return 0;
+            } else if (data[0] == DFU_CMD_ERASE) {
+                g_usbd_dfu.data_ptr = addr;
+                return dfu_queue_push(DFU_MEDIA_ERASE, addr, NULL, 0);
+            }
+        }
+        USB_LOG_ERR("Unsupported dfu special command\r\n");
+        return -1;
+    }
+    /* Regular Download Command */
+    else if (g_usbd_dfu.wblock_num > 1U) {
+        /* Decode the required address */
+        addr = ((g_usbd_dfu.wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu.data_ptr;
+        return dfu_queue_push(DFU_MEDIA_PROGRAM, addr, data, g_usbd_dfu.wlength);
+    }
+    return 0;
+}
+
 static void dfu_request_dnload(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     /* Data setup request */
@@ -194,10 +403,12 @@ static void dfu_request_dnload(struct usb_setup_packet *setup, uint8_t **data, u
             g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_SYNC;
             g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
 
-            /*!< Data has received complete */
-            memcpy((uint8_t *)g_usbd_dfu.buffer.d8, (uint8_t *)*data, g_usbd_dfu.wlength);
-            /*!< Set flag = 1 Write the firmware to the flash in the next dfu_request_getstatus */
-            g_usbd_dfu.firmwar_flag = 1;
+            /*!< Data has received complete, queue it for flash so the next block can be received meanwhile */
+            if (dfu_request_dnload_block(*data) < 0) {
+                g_usbd_dfu.dev_state = DFU_STATE_DFU_ERROR;
+                g_usbd_dfu.dev_status[0] = DFU_STATUS_ERR_UNKNOWN;
+                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            }
         }
         /* Unsupported state */
         else {
@@ -221,72 +432,33 @@ static void dfu_request_dnload(struct usb_setup_packet *setup, uint8_t **data, u
     }
 }
 
-static int8_t dfu_getstatus_special_handler(void)
+static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
-    uint32_t addr;
-    if (g_usbd_dfu.dev_state == DFU_STATE_DFU_DNLOAD_BUSY) {
-        /* Decode the Special Command */
-        if (g_usbd_dfu.wblock_num == 0U) {
-            if (g_usbd_dfu.wlength == 1U) {
-                if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_GETCOMMANDS) {
-                    /* Nothing to do */
-                }
-            } else if (g_usbd_dfu.wlength == 5U) {
-                if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_SETADDRESSPOINTER) {
-                    g_usbd_dfu.data_ptr = g_usbd_dfu.buffer.d8[1];
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[2] << 8;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[3] << 16;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[4] << 24;
-                } else if (g_usbd_dfu.buffer.d8[0] == DFU_CMD_ERASE) {
-                    g_usbd_dfu.data_ptr = g_usbd_dfu.buffer.d8[1];
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[2] << 8;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[3] << 16;
-                    g_usbd_dfu.data_ptr += (uint32_t)g_usbd_dfu.buffer.d8[4] << 24;
-
-                    USB_LOG_DBG("Erase start add %08x \r\n", g_usbd_dfu.data_ptr);
-                    /*!< Erase */
-                    dfu_erase_flash(g_usbd_dfu.data_ptr);
-                } else {
-                    return -1;
-                }
-            } else {
-                /* Reset the global length and block number */
-                g_usbd_dfu.wlength = 0U;
-                g_usbd_dfu.wblock_num = 0U;
-                /* Call the error management function (command will be NAKed) */
-                USB_LOG_ERR("Reset the global length and block number\r\n");
-            }
-        }
-        /* Regular Download Command */
-        else {
-            if (g_usbd_dfu.wblock_num > 1U) {
-                /* Decode the required address */
-                addr = ((g_usbd_dfu.wblock_num - 2U) * USBD_DFU_XFER_SIZE) + g_usbd_dfu.data_ptr;
-
-                /* Perform the write operation */
-                /* Write flash */
-                USB_LOG_DBG("Write start add %08x length %d\r\n", addr, g_usbd_dfu.wlength);
-                dfu_write_flash(g_usbd_dfu.buffer.d8, (uint8_t *)addr, g_usbd_dfu.wlength);
-            }
+    uint32_t time;
+
+    /*!< Blocks still queued for flash must be written before manifestation */
+    if ((g_usbd_dfu.dev_state == DFU_STATE_DFU_MANIFEST_SYNC) &&
+        ((g_usbd_dfu_queue.error != DFU_STATUS_OK) || dfu_queue_pending())) {
+        if (g_usbd_dfu_queue.error != DFU_STATUS_OK) {
+            g_usbd_dfu.manif_state = DFU_MANIFEST_COMPLETE;
+            g_usbd_dfu.dev_state = DFU_STATE_DFU_ERROR;
+            g_usbd_dfu.dev_status[0] = g_usbd_dfu_queue.error;
+            dfu_set_poll_timeout(0);
+            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+            memcpy(*data, g_usbd_dfu.dev_status, 6);
+        } else {
+            /* report manifest in progress, keep dev_status clean for the check below */
+            time = dfu_queue_busy_time(true);
+            memcpy(*data, g_usbd_dfu.dev_status, 6);
+            (*data)[1] = (uint8_t)time;
+            (*data)[2] = (uint8_t)(time >> 8);
+            (*data)[3] = (uint8_t)(time >> 16);
+            (*data)[4] = DFU_STATE_DFU_MANIFEST;
         }
-
-        /* Reset the global length and block number */
-        g_usbd_dfu.wlength = 0U;
-        g_usbd_dfu.wblock_num = 0U;
-
-        /* Update the state machine */
-        g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_SYNC;
-
-        g_usbd_dfu.dev_status[1] = 0U;
-        g_usbd_dfu.dev_status[2] = 0U;
-        g_usbd_dfu.dev_status[3] = 0U;
-        g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+        *len = 6;
+        return;
     }
-    return 0;
-}
 
-static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
-{
     /*!< Determine whether to leave DFU mode */
     if (g_usbd_dfu.manif_state == DFU_MANIFEST_IN_PROGRESS &&
         g_usbd_dfu.dev_state == DFU_STATE_DFU_MANIFEST_SYNC &&
@@ -318,28 +490,25 @@ static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data
 
     switch (g_usbd_dfu.dev_state) {
         case DFU_STATE_DFU_DNLOAD_SYNC:
-            if (g_usbd_dfu.wlength != 0U) {
-                g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_BUSY;
-
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
-
-                if ((g_usbd_dfu.wblock_num == 0U) && (g_usbd_dfu.buffer.d8[0] == DFU_CMD_ERASE)) {
-                    dfu_getstatus(g_usbd_dfu.data_ptr, DFU_MEDIA_ERASE, g_usbd_dfu.dev_status);
-                } else {
-                    dfu_getstatus(g_usbd_dfu.data_ptr, DFU_MEDIA_PROGRAM, g_usbd_dfu.dev_status);
-                }
-            } else /* (g_usbd_dfu.wlength==0)*/
-            {
+        case DFU_STATE_DFU_DNLOAD_BUSY:
+#if !defined(CONFIG_USBDEV_DFU_THREAD) && !defined(CONFIG_USBDEV_DFU_POLLING)
+            /* program in this request, status is sent once flash is done so host needs no extra poll */
+            while (dfu_queue_run()) {
+            }
+#endif
+            if (g_usbd_dfu_queue.error != DFU_STATUS_OK) {
+                g_usbd_dfu.dev_state = DFU_STATE_DFU_ERROR;
+                g_usbd_dfu.dev_status[0] = g_usbd_dfu_queue.error;
+                dfu_set_poll_timeout(0);
+            } else if (dfu_queue_ready()) {
+                /* previous blocks may still be programming, host can send the next one */
                 g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_IDLE;
-
-                g_usbd_dfu.dev_status[1] = 0U;
-                g_usbd_dfu.dev_status[2] = 0U;
-                g_usbd_dfu.dev_status[3] = 0U;
-                g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
+                dfu_set_poll_timeout(0);
+            } else {
+                g_usbd_dfu.dev_state = DFU_STATE_DFU_DNLOAD_BUSY;
+                dfu_set_poll_timeout(dfu_queue_busy_time(false));
             }
+            g_usbd_dfu.dev_status[4] = g_usbd_dfu.dev_state;
             break;
 
         case DFU_STATE_DFU_MANIFEST_SYNC:
@@ -370,18 +539,12 @@ static void dfu_request_getstatus(struct usb_setup_packet *setup, uint8_t **data
     /* Send the status data over EP0 */
     memcpy(*data, g_usbd_dfu.dev_status, 6);
     *len = 6;
-
-    if (g_usbd_dfu.firmwar_flag == 1) {
-        if (dfu_getstatus_special_handler() != 0) {
-            USB_LOG_ERR("dfu_getstatus_special_handler error \r\n");
-        }
-        g_usbd_dfu.firmwar_flag = 0;
-    }
 }
 
 static void dfu_request_clrstatus(void)
 {
     if (g_usbd_dfu.dev_state == DFU_STATE_DFU_ERROR) {
+        dfu_queue_reset();
         g_usbd_dfu.dev_state = DFU_STATE_DFU_IDLE;
         g_usbd_dfu.dev_status[0] = DFU_STATUS_OK; /* bStatus */
         g_usbd_dfu.dev_status[1] = 0U;
@@ -463,11 +626,59 @@ static int dfu_class_interface_request_handler(uint8_t busid, struct usb_setup_p
     return 0;
 }
 
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+static void usbdev_dfu_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    uintptr_t event;
+    int ret;
+
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+
+    while (1) {
+        ret = usb_osal_mq_recv(g_usbd_dfu_queue.mq, &event, USB_OSAL_WAITING_FOREVER);
+        if (ret < 0) {
+            continue;
+        }
+        dfu_queue_run();
+    }
+}
+#elif defined(CONFIG_USBDEV_DFU_POLLING)
+void usbd_dfu_polling(void)
+{
+    while (dfu_queue_run()) {
+    }
+}
+#endif
+
 static void dfu_notify_handler(uint8_t busid, uint8_t event, void *arg)
 {
     switch (event) {
+        case USBD_EVENT_INIT:
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+            g_usbd_dfu_queue.mq = usb_osal_mq_create(USBD_DFU_QUEUE_DEPTH);
+            if (g_usbd_dfu_queue.mq == NULL) {
+                USB_LOG_ERR("No memory to alloc for g_usbd_dfu_queue.mq\r\n");
+            }
+            g_usbd_dfu_queue.thread = usb_osal_thread_create("usbd_dfu", CONFIG_USBDEV_DFU_STACKSIZE, CONFIG_USBDEV_DFU_PRIO, usbdev_dfu_thread, NULL);
+            if (g_usbd_dfu_queue.thread == NULL) {
+                USB_LOG_ERR("No memory to alloc for g_usbd_dfu_queue.thread\r\n");
+            }
+#endif
+            dfu_queue_reset();
+            break;
+        case USBD_EVENT_DEINIT:
+#if defined(CONFIG_USBDEV_DFU_THREAD)
+            if (g_usbd_dfu_queue.mq) {
+                usb_osal_mq_delete(g_usbd_dfu_queue.mq);
+            }
+            if (g_usbd_dfu_queue.thread) {
+                usb_osal_thread_delete(g_usbd_dfu_queue.thread);
+            }
+#endif
+            break;
         case USBD_EVENT_RESET:
             dfu_reset();
+            dfu_queue_reset();
             break;
         default:
             break;
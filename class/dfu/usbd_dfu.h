@@ -15,7 +15,14 @@ extern "C" {
 /* Init dfu interface driver */
 struct usbd_interface *usbd_dfu_init_intf(struct usbd_interface *intf);
 
-/* Interface functions that need to be implemented by the user */
+#ifdef CONFIG_USBDEV_DFU_POLLING
+/* Program queued blocks, call in while(1) */
+void usbd_dfu_polling(void);
+#endif
+
+/* Interface functions that need to be implemented by the user, flash functions return 0 on success.
+ * With CONFIG_USBDEV_DFU_THREAD or CONFIG_USBDEV_DFU_POLLING they run while next block is received.
+ */
 uint8_t *dfu_read_flash(uint8_t *src, uint8_t *dest, uint32_t len);
 uint16_t dfu_write_flash(uint8_t *src, uint8_t *dest, uint32_t len);
 uint16_t dfu_erase_flash(uint32_t add);
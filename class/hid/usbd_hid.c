@@ -6,6 +6,55 @@
 #include "usbd_core.h"
 #include "usbd_hid.h"
 
+#ifdef CONFIG_USBDEV_HID_QUEUE
+struct usbd_hid_queue {
+    uint8_t ep; /* 0 when slot is unused */
+    uint8_t intf;
+    volatile bool busy;
+    uint8_t head; /* oldest report, in flight when busy */
+    uint8_t count;
+    uint8_t idle_rate; /* 4ms units, 0 is infinite */
+    uint32_t idle_elapsed;
+    uint16_t len[CONFIG_USBDEV_HID_QUEUE_DEPTH];
+    uint32_t timestamp[CONFIG_USBDEV_HID_QUEUE_DEPTH];
+    uint8_t last[CONFIG_USBDEV_HID_QUEUE_MAX_REPORT_SIZE];
+    uint16_t last_len;
+    bool coalesce_enable;
+    struct usbd_hid_queue_coalesce coalesce;
+    struct usbd_hid_queue_stat stat;
+};
+
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbd_hid_queue_buf[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_HID_QUEUE_MAX_INTF][CONFIG_USBDEV_HID_QUEUE_DEPTH][USB_ALIGN_UP(CONFIG_USBDEV_HID_QUEUE_MAX_REPORT_SIZE, CONFIG_USB_ALIGN_SIZE)];
+
+static struct usbd_hid_queue g_usbd_hid_queue[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_HID_QUEUE_MAX_INTF];
+static struct usbd_endpoint hid_queue_ep[CONFIG_USBDEV_MAX_BUS][CONFIG_USBDEV_HID_QUEUE_MAX_INTF];
+
+static struct usbd_hid_queue *usbd_hid_queue_find(uint8_t busid, uint8_t intf)
+{
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_QUEUE_MAX_INTF; i++) {
+        if (g_usbd_hid_queue[busid][i].ep && (g_usbd_hid_queue[busid][i].intf == intf)) {
+            return &g_usbd_hid_queue[busid][i];
+        }
+    }
+    return NULL;
+}
+
+static void usbd_hid_queue_reset(uint8_t busid)
+{
+    struct usbd_hid_queue *queue;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_QUEUE_MAX_INTF; i++) {
+        queue = &g_usbd_hid_queue[busid][i];
+        queue->busy = false;
+        queue->head = 0;
+        queue->count = 0;
+        queue->idle_rate = 0;
+        queue->idle_elapsed = 0;
+        queue->last_len = 0;
+    }
+}
+#endif
+
 static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_packet *setup, uint8_t **data, uint32_t *len)
 {
     USB_LOG_DBG("HID Class request: "
@@ -13,6 +62,9 @@ static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_p
                 setup->bRequest);
 
     uint8_t intf_num = LO_BYTE(setup->wIndex);
+#ifdef CONFIG_USBDEV_HID_QUEUE
+    struct usbd_hid_queue *queue;
+#endif
 
     switch (setup->bRequest) {
         case HID_REQUEST_GET_REPORT:
@@ -20,6 +72,14 @@ static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_p
             usbd_hid_get_report(busid, intf_num, LO_BYTE(setup->wValue), HI_BYTE(setup->wValue), data, len);
             break;
         case HID_REQUEST_GET_IDLE:
+#ifdef CONFIG_USBDEV_HID_QUEUE
+            queue = usbd_hid_queue_find(busid, intf_num);
+            if (queue) {
+                (*data)[0] = queue->idle_rate;
+                *len = 1;
+                break;
+            }
+#endif
             (*data)[0] = usbd_hid_get_idle(busid, intf_num, LO_BYTE(setup->wValue));
             *len = 1;
             break;
@@ -32,6 +92,14 @@ static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_p
             usbd_hid_set_report(busid, intf_num, LO_BYTE(setup->wValue), HI_BYTE(setup->wValue), *data, *len);
             break;
         case HID_REQUEST_SET_IDLE:
+#ifdef CONFIG_USBDEV_HID_QUEUE
+            /* one idle rate is kept for all reports of the queue */
+            queue = usbd_hid_queue_find(busid, intf_num);
+            if (queue) {
+                queue->idle_rate = HI_BYTE(setup->wValue);
+                queue->idle_elapsed = 0;
+            }
+#endif
             /* report id, duration */
             usbd_hid_set_idle(busid, intf_num, LO_BYTE(setup->wValue), HI_BYTE(setup->wValue));
             break;
@@ -48,6 +116,23 @@ static int hid_class_interface_request_handler(uint8_t busid, struct usb_setup_p
     return 0;
 }
 
+#ifdef CONFIG_USBDEV_HID_QUEUE
+static void hid_notify_handler(uint8_t busid, uint8_t event, void *arg)
+{
+    (void)arg;
+
+    switch (event) {
+        case USBD_EVENT_RESET:
+        case USBD_EVENT_CONFIGURED:
+            usbd_hid_queue_reset(busid);
+            break;
+
+        default:
+            break;
+    }
+}
+#endif
+
 struct usbd_interface *usbd_hid_init_intf(uint8_t busid, struct usbd_interface *intf, const uint8_t *desc, uint32_t desc_len)
 {
     (void)busid;
@@ -55,13 +140,252 @@ struct usbd_interface *usbd_hid_init_intf(uint8_t busid, struct usbd_interface *
     intf->class_interface_handler = hid_class_interface_request_handler;
     intf->class_endpoint_handler = NULL;
     intf->vendor_handler = NULL;
+#ifdef CONFIG_USBDEV_HID_QUEUE
+    intf->notify_handler = hid_notify_handler;
+#else
     intf->notify_handler = NULL;
+#endif
 
     intf->hid_report_descriptor = desc;
     intf->hid_report_descriptor_len = desc_len;
     return intf;
 }
 
+#ifdef CONFIG_USBDEV_HID_QUEUE
+static void usbd_hid_queue_in_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
+{
+    struct usbd_hid_queue *queue = NULL;
+    uint32_t latency;
+    uint8_t bucket = 0;
+    uint8_t index;
+
+    (void)nbytes;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_QUEUE_MAX_INTF; i++) {
+        if (g_usbd_hid_queue[busid][i].ep == ep) {
+            queue = &g_usbd_hid_queue[busid][i];
+            index = i;
+            break;
+        }
+    }
+
+    if (!queue || !queue->busy || !queue->count) {
+        return;
+    }
+
+    latency = usbd_hid_queue_timestamp() - queue->timestamp[queue->head];
+    while (latency && (bucket < (USBD_HID_QUEUE_HIST_BUCKETS - 1))) {
+        latency >>= 1;
+        bucket++;
+    }
+    queue->stat.latency_hist[bucket]++;
+    queue->stat.sent++;
+
+    memcpy(queue->last, g_usbd_hid_queue_buf[busid][index][queue->head], queue->len[queue->head]);
+    queue->last_len = queue->len[queue->head];
+    queue->idle_elapsed = 0;
+
+    queue->head = (queue->head + 1) % CONFIG_USBDEV_HID_QUEUE_DEPTH;
+    queue->count--;
+
+    if (queue->count) {
+        usbd_ep_start_write(busid, ep, g_usbd_hid_queue_buf[busid][index][queue->head], queue->len[queue->head]);
+    } else {
+        queue->busy = false;
+    }
+}
+
+int usbd_hid_queue_init(uint8_t busid, uint8_t intf, uint8_t ep, const struct usbd_hid_queue_coalesce *coalesce)
+{
+    struct usbd_hid_queue *queue;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_QUEUE_MAX_INTF; i++) {
+        queue = &g_usbd_hid_queue[busid][i];
+        if (queue->ep == 0) {
+            memset(queue, 0, sizeof(struct usbd_hid_queue));
+            queue->ep = ep;
+            queue->intf = intf;
+            if (coalesce && coalesce->rel_count && ((coalesce->rel_size == 1) || (coalesce->rel_size == 2))) {
+                memcpy(&queue->coalesce, coalesce, sizeof(struct usbd_hid_queue_coalesce));
+                queue->coalesce_enable = true;
+            }
+
+            hid_queue_ep[busid][i].ep_addr = ep;
+            hid_queue_ep[busid][i].ep_cb = usbd_hid_queue_in_callback;
+            usbd_add_endpoint(busid, &hid_queue_ep[busid][i]);
+            return 0;
+        }
+    }
+
+    return -USB_ERR_NOMEM;
+}
+
+static bool usbd_hid_queue_merge(struct usbd_hid_queue *queue, uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+    struct usbd_hid_queue_coalesce *co = &queue->coalesce;
+    uint32_t rel_end = co->rel_offset + co->rel_count * co->rel_size;
+    int32_t sum[8];
+    int32_t a, b;
+    uint8_t n;
+
+    if ((rel_end > len) || (co->rel_count > 8)) {
+        return false;
+    }
+
+    /* buttons and absolute values must be unchanged */
+    if (memcmp(dst, src, co->rel_offset) || memcmp(dst + rel_end, src + rel_end, len - rel_end)) {
+        return false;
+    }
+
+    for (n = 0; n < co->rel_count; n++) {
+        if (co->rel_size == 1) {
+            a = (int8_t)dst[co->rel_offset + n];
+            b = (int8_t)src[co->rel_offset + n];
+        } else {
+            a = (int16_t)(dst[co->rel_offset + 2 * n] | (dst[co->rel_offset + 2 * n + 1] << 8));
+            b = (int16_t)(src[co->rel_offset + 2 * n] | (src[co->rel_offset + 2 * n + 1] << 8));
+        }
+        sum[n] = a + b;
+        /* keep reports apart instead of clipping motion */
+        if ((co->rel_size == 1) && ((sum[n] > 127) || (sum[n] < -127))) {
+            return false;
+        }
+        if ((co->rel_size == 2) && ((sum[n] > 32767) || (sum[n] < -32767))) {
+            return false;
+        }
+    }
+
+    for (n = 0; n < co->rel_count; n++) {
+        if (co->rel_size == 1) {
+            dst[co->rel_offset + n] = (uint8_t)sum[n];
+        } else {
+            dst[co->rel_offset + 2 * n] = (uint8_t)(sum[n] & 0xff);
+            dst[co->rel_offset + 2 * n + 1] = (uint8_t)((sum[n] >> 8) & 0xff);
+        }
+    }
+    return true;
+}
+
+int usbd_hid_queue_send(uint8_t busid, uint8_t intf, const uint8_t *report, uint32_t len)
+{
+    struct usbd_hid_queue *queue;
+    uint8_t index;
+    uint8_t slot;
+    size_t flags;
+    bool start = false;
+
+    queue = usbd_hid_queue_find(busid, intf);
+    if (queue == NULL) {
+        return -USB_ERR_NODEV;
+    }
+
+    if ((len == 0) || (len > CONFIG_USBDEV_HID_QUEUE_MAX_REPORT_SIZE)) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (!usb_device_is_configured(busid)) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    index = queue - g_usbd_hid_queue[busid];
+
+    flags = usb_osal_enter_critical_section();
+    /* merge into the newest report if it is not in flight yet */
+    if (queue->coalesce_enable && (queue->count > (queue->busy ? 1 : 0))) {
+        slot = (queue->head + queue->count - 1) % CONFIG_USBDEV_HID_QUEUE_DEPTH;
+        if ((queue->len[slot] == len) && usbd_hid_queue_merge(queue, g_usbd_hid_queue_buf[busid][index][slot], report, len)) {
+            queue->stat.coalesced++;
+            usb_osal_leave_critical_section(flags);
+            return 0;
+        }
+    }
+
+    if (queue->count >= CONFIG_USBDEV_HID_QUEUE_DEPTH) {
+        queue->stat.dropped++;
+        usb_osal_leave_critical_section(flags);
+        return -USB_ERR_BUSY;
+    }
+
+    slot = (queue->head + queue->count) % CONFIG_USBDEV_HID_QUEUE_DEPTH;
+    memcpy(g_usbd_hid_queue_buf[busid][index][slot], report, len);
+    queue->len[slot] = len;
+    queue->timestamp[slot] = usbd_hid_queue_timestamp();
+    queue->count++;
+    if (!queue->busy) {
+        queue->busy = true;
+        start = true;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (start) {
+        usbd_ep_start_write(busid, queue->ep, g_usbd_hid_queue_buf[busid][index][queue->head], queue->len[queue->head]);
+    }
+    return 0;
+}
+
+void usbd_hid_queue_tick(uint8_t busid, uint32_t ms)
+{
+    struct usbd_hid_queue *queue;
+    struct usbd_hid_queue_coalesce *co;
+    uint8_t *buf;
+    size_t flags;
+    bool start;
+
+    for (uint8_t i = 0; i < CONFIG_USBDEV_HID_QUEUE_MAX_INTF; i++) {
+        queue = &g_usbd_hid_queue[busid][i];
+        if (!queue->ep || !queue->idle_rate || !queue->last_len) {
+            continue;
+        }
+
+        start = false;
+        flags = usb_osal_enter_critical_section();
+        if (!queue->busy) {
+            queue->idle_elapsed += ms;
+            if (queue->idle_elapsed >= ((uint32_t)queue->idle_rate * 4)) {
+                queue->idle_elapsed = 0;
+
+                buf = g_usbd_hid_queue_buf[busid][i][queue->head];
+                memcpy(buf, queue->last, queue->last_len);
+                if (queue->coalesce_enable) {
+                    /* repeating relative motion would move it again */
+                    co = &queue->coalesce;
+                    if ((co->rel_offset + co->rel_count * co->rel_size) <= queue->last_len) {
+                        memset(buf + co->rel_offset, 0, co->rel_count * co->rel_size);
+                    }
+                }
+                queue->len[queue->head] = queue->last_len;
+                queue->timestamp[queue->head] = usbd_hid_queue_timestamp();
+                queue->count = 1;
+                queue->busy = true;
+                queue->stat.repeats++;
+                start = true;
+            }
+        }
+        usb_osal_leave_critical_section(flags);
+
+        if (start) {
+            usbd_ep_start_write(busid, queue->ep, g_usbd_hid_queue_buf[busid][i][queue->head], queue->len[queue->head]);
+        }
+    }
+}
+
+void usbd_hid_queue_get_stat(uint8_t busid, uint8_t intf, struct usbd_hid_queue_stat *stat)
+{
+    struct usbd_hid_queue *queue = usbd_hid_queue_find(busid, intf);
+
+    if (queue == NULL) {
+        memset(stat, 0, sizeof(struct usbd_hid_queue_stat));
+        return;
+    }
+    memcpy(stat, &queue->stat, sizeof(struct usbd_hid_queue_stat));
+}
+
+__WEAK uint32_t usbd_hid_queue_timestamp(void)
+{
+    return 0;
+}
+#endif
+
 /*
  * Appendix G: HID Request Support Requirements
  *
@@ -8,6 +8,28 @@
 
 #include "usb_hid.h"
 
+#ifdef CONFIG_USBDEV_HID_QUEUE
+#define USBD_HID_QUEUE_HIST_BUCKETS 12
+
+/* Relative axes summed when reports are coalesced, other bytes must match to merge */
+struct usbd_hid_queue_coalesce {
+    uint8_t rel_offset; /* offset of first axis in report, including report id byte */
+    uint8_t rel_count;  /* number of axes */
+    uint8_t rel_size;   /* 1 or 2, signed little endian */
+};
+
+struct usbd_hid_queue_stat {
+    uint32_t sent;      /* reports completed on in endpoint */
+    uint32_t coalesced; /* reports merged into a queued report */
+    uint32_t dropped;   /* reports rejected because queue was full */
+    uint32_t repeats;   /* reports resent because of idle rate */
+    /* latency from enqueue to in complete in usbd_hid_queue_timestamp units,
+     * bucket 0 counts 0, bucket n counts [2^(n-1), 2^n), last bucket counts the rest
+     */
+    uint32_t latency_hist[USBD_HID_QUEUE_HIST_BUCKETS];
+};
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,6 +45,26 @@ void usbd_hid_set_report(uint8_t busid, uint8_t intf, uint8_t report_id, uint8_t
 void usbd_hid_set_idle(uint8_t busid, uint8_t intf, uint8_t report_id, uint8_t duration);
 void usbd_hid_set_protocol(uint8_t busid, uint8_t intf, uint8_t protocol);
 
+#ifdef CONFIG_USBDEV_HID_QUEUE
+/**
+ * @brief Attach a report queue to hid interface, must be called before usbd_initialize.
+ *
+ * @param busid bus id.
+ * @param intf interface number.
+ * @param ep interrupt in endpoint address, registered by queue.
+ * @param coalesce relative axes to merge queued reports, NULL to disable coalescing.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbd_hid_queue_init(uint8_t busid, uint8_t intf, uint8_t ep, const struct usbd_hid_queue_coalesce *coalesce);
+/* Queue one input report, return -USB_ERR_BUSY when queue is full and report can not be coalesced */
+int usbd_hid_queue_send(uint8_t busid, uint8_t intf, const uint8_t *report, uint32_t len);
+/* Advance idle timers and repeat last report when idle rate expires, call from timer or with 1 on every 1ms sof */
+void usbd_hid_queue_tick(uint8_t busid, uint32_t ms);
+void usbd_hid_queue_get_stat(uint8_t busid, uint8_t intf, struct usbd_hid_queue_stat *stat);
+/* Free running counter for latency histogram, such as us or cpu cycles, default returns 0 */
+uint32_t usbd_hid_queue_timestamp(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
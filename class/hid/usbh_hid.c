@@ -5,6 +5,9 @@
  */
 #include "usbh_core.h"
 #include "usbh_hid.h"
+#ifdef CONFIG_USBHOST_HID_POLL
+#include "usbh_hid_poll.h"
+#endif
 
 #undef USB_DBG_TAG
 #define USB_DBG_TAG "usbh_hid"
@@ -21,6 +24,9 @@
 #define INTF_DESC_bAlternateSetting 3 /** Alternate setting offset */
 
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hid_buf[CONFIG_USBHOST_MAX_HID_CLASS][USB_ALIGN_UP(64, CONFIG_USB_ALIGN_SIZE)];
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hid_report_desc_buf[USB_ALIGN_UP(CONFIG_USBHOST_HID_MAX_REPORT_DESC_SIZE, CONFIG_USB_ALIGN_SIZE)];
+#endif
 
 static struct usbh_hid g_hid_class[CONFIG_USBHOST_MAX_HID_CLASS];
 static uint32_t g_devinuse = 0;
@@ -194,6 +200,415 @@ int usbh_hid_get_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t
     return ret;
 }
 
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+struct usbh_hid_parse_state {
+    /* global items */
+    uint16_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint8_t report_size;
+    uint16_t report_count;
+    uint8_t report_id;
+    /* local items, extended usage (page << 16 | usage) */
+    uint32_t usages[CONFIG_USBHOST_HID_MAX_USAGES];
+    uint8_t usage_num;
+    uint32_t usage_min;
+    uint32_t usage_max;
+    bool usage_range;
+};
+
+struct usbh_hid_parse_report {
+    uint8_t report_id;
+    uint16_t bits[3];
+};
+
+static uint32_t usbh_hid_resolve_usage(struct usbh_hid_parse_state *state, uint32_t usage)
+{
+    /* 1 or 2 bytes usage uses current usage page */
+    if ((usage >> 16) == 0) {
+        usage |= ((uint32_t)state->usage_page << 16);
+    }
+    return usage;
+}
+
+static void usbh_hid_add_field(struct usbh_hid_report_map *map, struct usbh_hid_parse_state *state,
+                               uint8_t type, uint16_t flags, uint32_t usage_min, uint32_t usage_max,
+                               uint16_t bit_offset, uint16_t count)
+{
+    struct usbh_hid_field *field;
+
+    if (map->field_count >= CONFIG_USBHOST_HID_MAX_FIELDS) {
+        return;
+    }
+
+    field = &map->fields[map->field_count++];
+    field->usage_page = usage_min >> 16;
+    field->usage_min = usage_min & 0xffff;
+    field->usage_max = usage_max & 0xffff;
+    field->bit_offset = bit_offset;
+    field->count = count;
+    field->flags = flags;
+    field->bit_size = state->report_size;
+    field->report_id = state->report_id;
+    field->type = type;
+    field->logical_min = state->logical_min;
+    field->logical_max = state->logical_max;
+}
+
+/* Array of listed usages, the list is kept unless usages are contiguous */
+static void usbh_hid_add_array(struct usbh_hid_report_map *map, struct usbh_hid_parse_state *state,
+                               uint8_t type, uint16_t flags, uint16_t bit_offset)
+{
+    struct usbh_hid_field *field;
+    uint32_t first = usbh_hid_resolve_usage(state, state->usages[0]);
+    uint32_t usage;
+    uint16_t usage_min = 0xffff;
+    uint16_t usage_max = 0;
+    uint8_t i;
+
+    for (i = 1; i < state->usage_num; i++) {
+        if (usbh_hid_resolve_usage(state, state->usages[i]) != (first + i)) {
+            break;
+        }
+    }
+    if (i == state->usage_num) {
+        usbh_hid_add_field(map, state, type, flags, first, first + state->usage_num - 1, bit_offset, state->report_count);
+        return;
+    }
+
+    if (map->field_count >= CONFIG_USBHOST_HID_MAX_FIELDS) {
+        return;
+    }
+    if ((map->usage_count + state->usage_num) > CONFIG_USBHOST_HID_MAX_ARRAY_USAGES) {
+        USB_LOG_WRN("No room for hid array usages, field dropped\r\n");
+        return;
+    }
+
+    usbh_hid_add_field(map, state, type, flags, first, first, bit_offset, state->report_count);
+    field = &map->fields[map->field_count - 1];
+    field->usage_index = map->usage_count;
+    field->usage_num = state->usage_num;
+
+    for (i = 0; i < state->usage_num; i++) {
+        usage = usbh_hid_resolve_usage(state, state->usages[i]);
+        /* callback reports usages with field usage page only */
+        if ((usage >> 16) != field->usage_page) {
+            usage = 0;
+        }
+        usage &= 0xffff;
+        map->usages[map->usage_count++] = (uint16_t)usage;
+        if (usage) {
+            usage_min = MIN(usage_min, (uint16_t)usage);
+            usage_max = MAX(usage_max, (uint16_t)usage);
+        }
+    }
+    field->usage_min = (usage_max != 0) ? usage_min : 0;
+    field->usage_max = usage_max;
+}
+
+static void usbh_hid_add_main_item(struct usbh_hid_report_map *map, struct usbh_hid_parse_state *state,
+                                   uint8_t type, uint16_t flags, uint16_t bit_offset)
+{
+    uint32_t usage;
+    uint16_t i;
+
+    if (flags & HID_MAIN_ITEM_CONSTANT) {
+        /* padding */
+        return;
+    }
+
+    if (state->usage_range) {
+        usage = usbh_hid_resolve_usage(state, state->usage_min);
+        usbh_hid_add_field(map, state, type, flags, usage, usbh_hid_resolve_usage(state, state->usage_max), bit_offset, state->report_count);
+    } else if (state->usage_num == 0) {
+        usage = usbh_hid_resolve_usage(state, 0);
+        usbh_hid_add_field(map, state, type, flags, usage, usage, bit_offset, state->report_count);
+    } else if (!(flags & HID_MAIN_ITEM_VARIABLE)) {
+        usbh_hid_add_array(map, state, type, flags, bit_offset);
+    } else {
+        /* one field per listed usage, the last usage repeats for the remaining elements */
+        for (i = 0; (i < state->usage_num - 1) && (i < state->report_count - 1); i++) {
+            usage = usbh_hid_resolve_usage(state, state->usages[i]);
+            usbh_hid_add_field(map, state, type, flags, usage, usage, bit_offset + i * state->report_size, 1);
+        }
+        usage = usbh_hid_resolve_usage(state, state->usages[i]);
+        usbh_hid_add_field(map, state, type, flags, usage, usage, bit_offset + i * state->report_size, state->report_count - i);
+    }
+}
+
+int usbh_hid_parse_report_descriptor(struct usbh_hid_report_map *map, const uint8_t *desc, uint32_t desc_len)
+{
+    struct usbh_hid_parse_state state;
+    struct usbh_hid_parse_state stack;
+    struct usbh_hid_parse_report reports[CONFIG_USBHOST_HID_MAX_REPORTS];
+    struct usbh_hid_parse_report *report;
+    const uint8_t *p = desc;
+    const uint8_t *end = desc + desc_len;
+    uint8_t report_num = 1;
+    bool pushed = false;
+    uint8_t prefix;
+    uint8_t size;
+    uint8_t type;
+    uint32_t udata;
+    int32_t sdata;
+    uint16_t bytes;
+
+    memset(map, 0, sizeof(struct usbh_hid_report_map));
+    memset(&state, 0, sizeof(struct usbh_hid_parse_state));
+    memset(reports, 0, sizeof(reports));
+    report = &reports[0];
+
+    while (p < end) {
+        prefix = *p++;
+
+        if (prefix == 0xfe) {
+            /* long item, skip */
+            if ((end - p) < 2) {
+                return -USB_ERR_INVAL;
+            }
+            p += 2 + p[0];
+            continue;
+        }
+
+        size = prefix & HID_REPORT_ITEM_SIZE_MASK;
+        size = (size == HID_REPORT_ITEM_SIZE_4) ? 4 : size;
+        if ((uint32_t)(end - p) < size) {
+            return -USB_ERR_INVAL;
+        }
+
+        udata = 0;
+        for (uint8_t i = 0; i < size; i++) {
+            udata |= ((uint32_t)p[i] << (8 * i));
+        }
+        if ((size > 0) && (size < 4) && (udata & (1U << (8 * size - 1)))) {
+            sdata = (int32_t)(udata | (0xffffffffU << (8 * size)));
+        } else {
+            sdata = (int32_t)udata;
+        }
+        p += size;
+
+        switch (prefix & ~HID_REPORT_ITEM_SIZE_MASK) {
+            case HID_MAIN_ITEM_INPUT_PREFIX:
+            case HID_MAIN_ITEM_OUTPUT_PREFIX:
+            case HID_MAIN_ITEM_FEATURE_PREFIX:
+                if ((prefix & ~HID_REPORT_ITEM_SIZE_MASK) == HID_MAIN_ITEM_INPUT_PREFIX) {
+                    type = USBH_HID_FIELD_INPUT;
+                } else if ((prefix & ~HID_REPORT_ITEM_SIZE_MASK) == HID_MAIN_ITEM_OUTPUT_PREFIX) {
+                    type = USBH_HID_FIELD_OUTPUT;
+                } else {
+                    type = USBH_HID_FIELD_FEATURE;
+                }
+
+                if ((state.report_size == 0) || (state.report_size > 32)) {
+                    return -USB_ERR_INVAL;
+                }
+
+                usbh_hid_add_main_item(map, &state, type, (uint16_t)udata, report->bits[type]);
+                report->bits[type] += state.report_size * state.report_count;
+
+                if (type == USBH_HID_FIELD_INPUT) {
+                    bytes = (report->bits[type] + 7) / 8 + (map->has_report_id ? 1 : 0);
+                    if (bytes > map->input_size) {
+                        map->input_size = bytes;
+                    }
+                }
+                state.usage_num = 0;
+                state.usage_range = false;
+                break;
+            case HID_MAIN_ITEM_COLLECTION_PREFIX:
+            case HID_MAIN_ITEM_ENDCOLLECTION_PREFIX:
+                state.usage_num = 0;
+                state.usage_range = false;
+                break;
+
+            case HID_GLOBAL_ITEM_USAGEPAGE_PREFIX:
+                state.usage_page = (uint16_t)udata;
+                break;
+            case HID_GLOBAL_ITEM_LOGICALMIN_PREFIX:
+                state.logical_min = sdata;
+                break;
+            case HID_GLOBAL_ITEM_LOGICALMAX_PREFIX:
+                /* logical max is unsigned when logical min is not negative */
+                state.logical_max = (state.logical_min >= 0) ? (int32_t)udata : sdata;
+                break;
+            case HID_GLOBAL_ITEM_REPORTSIZE_PREFIX:
+                state.report_size = (uint8_t)udata;
+                break;
+            case HID_GLOBAL_ITEM_REPORTCOUNT_PREFIX:
+                state.report_count = (uint16_t)udata;
+                break;
+            case HID_GLOBAL_ITEM_REPORTID_PREFIX:
+                state.report_id = (uint8_t)udata;
+                map->has_report_id = true;
+                report = NULL;
+                for (uint8_t i = 0; i < report_num; i++) {
+                    if (reports[i].report_id == state.report_id) {
+                        report = &reports[i];
+                    }
+                }
+                if (report == NULL) {
+                    if (report_num >= CONFIG_USBHOST_HID_MAX_REPORTS) {
+                        return -USB_ERR_NOMEM;
+                    }
+                    report = &reports[report_num++];
+                    report->report_id = state.report_id;
+                }
+                break;
+            case HID_GLOBAL_ITEM_PUSH_PREFIX:
+                memcpy(&stack, &state, sizeof(struct usbh_hid_parse_state));
+                pushed = true;
+                break;
+            case HID_GLOBAL_ITEM_POP_PREFIX:
+                if (pushed) {
+                    stack.usage_num = state.usage_num;
+                    stack.usage_range = state.usage_range;
+                    stack.usage_min = state.usage_min;
+                    stack.usage_max = state.usage_max;
+                    memcpy(stack.usages, state.usages, sizeof(state.usages));
+                    memcpy(&state, &stack, sizeof(struct usbh_hid_parse_state));
+                    pushed = false;
+                }
+                break;
+
+            case HID_LOCAL_ITEM_USAGE_PREFIX:
+                if (state.usage_num < CONFIG_USBHOST_HID_MAX_USAGES) {
+                    state.usages[state.usage_num++] = (size == 4) ? udata : (udata & 0xffff);
+                }
+                break;
+            case HID_LOCAL_ITEM_USAGEMIN_PREFIX:
+                state.usage_min = (size == 4) ? udata : (udata & 0xffff);
+                state.usage_range = true;
+                break;
+            case HID_LOCAL_ITEM_USAGEMAX_PREFIX:
+                state.usage_max = (size == 4) ? udata : (udata & 0xffff);
+                state.usage_range = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (map->has_report_id && (reports[0].bits[0] || reports[0].bits[1] || reports[0].bits[2])) {
+        USB_LOG_WRN("Report items found before report id\r\n");
+    }
+
+    return map->field_count;
+}
+
+static bool usbh_hid_array_has_usage(const struct usbh_hid_report_map *map, const struct usbh_hid_field *field, uint16_t usage)
+{
+    for (uint8_t i = 0; i < field->usage_num; i++) {
+        if (map->usages[field->usage_index + i] == usage) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const struct usbh_hid_field *usbh_hid_find_field(const struct usbh_hid_report_map *map, uint8_t type, uint16_t usage_page, uint16_t usage)
+{
+    const struct usbh_hid_field *field;
+
+    for (uint8_t i = 0; i < map->field_count; i++) {
+        field = &map->fields[i];
+        if ((field->type == type) && (field->usage_page == usage_page) &&
+            (usage >= field->usage_min) && (usage <= field->usage_max) &&
+            ((field->usage_num == 0) || usbh_hid_array_has_usage(map, field, usage))) {
+            return field;
+        }
+    }
+    return NULL;
+}
+
+int32_t usbh_hid_get_field_value(const struct usbh_hid_report_map *map, const struct usbh_hid_field *field,
+                                 const uint8_t *report, uint32_t report_len, uint8_t index)
+{
+    uint64_t value = 0;
+    uint32_t bitpos;
+    uint32_t first;
+    uint32_t nbytes;
+
+    if (map->has_report_id) {
+        if ((report_len < 1) || (report[0] != field->report_id)) {
+            return 0;
+        }
+        report++;
+        report_len--;
+    }
+
+    if (index >= field->count) {
+        return 0;
+    }
+
+    bitpos = field->bit_offset + (uint32_t)index * field->bit_size;
+    first = bitpos >> 3;
+    nbytes = ((bitpos & 7) + field->bit_size + 7) >> 3;
+    if ((first + nbytes) > report_len) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < nbytes; i++) {
+        value |= ((uint64_t)report[first + i] << (8 * i));
+    }
+    value >>= (bitpos & 7);
+    value &= ((uint64_t)1 << field->bit_size) - 1;
+
+    if ((field->logical_min < 0) && (field->bit_size < 32) && (value & ((uint64_t)1 << (field->bit_size - 1)))) {
+        value |= ~(((uint64_t)1 << field->bit_size) - 1);
+    }
+
+    return (int32_t)value;
+}
+
+int usbh_hid_decode_report(const struct usbh_hid_report_map *map, const uint8_t *report, uint32_t report_len,
+                           usbh_hid_usage_callback_t callback, void *arg)
+{
+    const struct usbh_hid_field *field;
+    uint32_t usage;
+    int32_t value;
+    int count = 0;
+
+    if (map->has_report_id && (report_len < 1)) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < map->field_count; i++) {
+        field = &map->fields[i];
+        if ((field->type != USBH_HID_FIELD_INPUT) || (map->has_report_id && (field->report_id != report[0]))) {
+            continue;
+        }
+
+        for (uint16_t j = 0; j < field->count; j++) {
+            value = usbh_hid_get_field_value(map, field, report, report_len, j);
+            if (field->flags & HID_MAIN_ITEM_VARIABLE) {
+                usage = MIN((uint32_t)field->usage_min + j, field->usage_max);
+            } else {
+                /* array element holds index of a usage, out of range means no usage */
+                if ((value < field->logical_min) || (value > field->logical_max)) {
+                    continue;
+                }
+                if (field->usage_num) {
+                    if ((uint32_t)(value - field->logical_min) >= field->usage_num) {
+                        continue;
+                    }
+                    usage = map->usages[field->usage_index + (uint32_t)(value - field->logical_min)];
+                } else {
+                    usage = (uint32_t)field->usage_min + (uint32_t)(value - field->logical_min);
+                }
+                if ((usage == 0) || (usage > field->usage_max)) {
+                    continue;
+                }
+                value = 1;
+            }
+            callback(arg, field, (uint16_t)usage, value);
+            count++;
+        }
+    }
+
+    return count;
+}
+#endif
+
 int usbh_hid_connect(struct usbh_hubport *hport, uint8_t intf)
 {
     struct usb_endpoint_descriptor *ep_desc;
@@ -260,11 +675,30 @@ found:
         USB_LOG_WRN("Do not support set idle\r\n");
     }
 
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+    /* connect runs in hub thread one by one, so one descriptor buffer is shared by all hid classes */
+    ret = usbh_hid_get_report_descriptor(hid_class, g_hid_report_desc_buf, MIN(sizeof(g_hid_report_desc_buf), hid_class->report_size));
+    if (ret < 0) {
+        return ret;
+    }
+    if (ret < 8) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (hid_class->report_size > sizeof(g_hid_report_desc_buf)) {
+        USB_LOG_WRN("Report desc is truncated to %u bytes\r\n", (unsigned int)sizeof(g_hid_report_desc_buf));
+    }
+
+    if (usbh_hid_parse_report_descriptor(&hid_class->report_map, g_hid_report_desc_buf, ret - 8) < 0) {
+        USB_LOG_WRN("Fail to parse report desc\r\n");
+    }
+#else
     /* We read report desc but do nothing (because of too much memory usage for parsing report desc, parsed by users) */
     ret = usbh_hid_get_report_descriptor(hid_class, g_hid_buf[hid_class->minor], MIN(sizeof(g_hid_buf[hid_class->minor]), hid_class->report_size));
     if (ret < 0) {
         return ret;
     }
+#endif
 
     for (uint8_t i = 0; i < hport->config.intf[intf].altsetting[0].intf_desc.bNumEndpoints; i++) {
         ep_desc = &hport->config.intf[intf].altsetting[0].ep[i].ep_desc;
@@ -279,6 +713,14 @@ found:
 
     USB_LOG_INFO("Register HID Class:%s\r\n", hport->config.intf[intf].devname);
 
+#ifdef CONFIG_USBHOST_HID_POLL
+    if (hid_class->intin) {
+        ret = usbh_hid_poll_start(hid_class);
+        if (ret < 0) {
+            USB_LOG_WRN("Fail to start hid poll\r\n");
+        }
+    }
+#endif
     usbh_hid_run(hid_class);
     return ret;
 }
@@ -290,6 +732,9 @@ int usbh_hid_disconnect(struct usbh_hubport *hport, uint8_t intf)
     struct usbh_hid *hid_class = (struct usbh_hid *)hport->config.intf[intf].priv;
 
     if (hid_class) {
+#ifdef CONFIG_USBHOST_HID_POLL
+        usbh_hid_poll_stop(hid_class);
+#endif
         if (hid_class->intin) {
             usbh_kill_urb(&hid_class->intin_urb);
         }
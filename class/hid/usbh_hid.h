@@ -8,6 +8,40 @@
 
 #include "usb_hid.h"
 
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+#define USBH_HID_FIELD_INPUT   0
+#define USBH_HID_FIELD_OUTPUT  1
+#define USBH_HID_FIELD_FEATURE 2
+
+struct usbh_hid_field {
+    uint16_t usage_page;
+    uint16_t usage_min;   /* usage of first element, or first usage of array */
+    uint16_t usage_max;   /* usage of last element, or last usage of array */
+    uint16_t bit_offset;  /* offset from report start, report id byte excluded */
+    uint16_t count;       /* report count */
+    uint16_t flags;       /* HID_MAIN_ITEM_xxx */
+    uint8_t bit_size;     /* report size of one element, up to 32 */
+    uint8_t report_id;
+    uint8_t type;         /* USBH_HID_FIELD_INPUT/OUTPUT/FEATURE */
+    uint8_t usage_num;    /* array usage list length in map usages, 0 when usages are usage_min..usage_max */
+    uint16_t usage_index; /* first entry of array usage list in map usages */
+    int32_t logical_min;
+    int32_t logical_max;
+};
+
+struct usbh_hid_report_map {
+    struct usbh_hid_field fields[CONFIG_USBHOST_HID_MAX_FIELDS];
+    uint16_t usages[CONFIG_USBHOST_HID_MAX_ARRAY_USAGES]; /* 0 for usages from another usage page */
+    uint16_t usage_count;
+    uint8_t field_count;
+    bool has_report_id;
+    uint16_t input_size; /* largest input report in bytes, report id byte included */
+};
+
+/* Called for every decoded usage, value is 1 for array usages that are present */
+typedef void (*usbh_hid_usage_callback_t)(void *arg, const struct usbh_hid_field *field, uint16_t usage, int32_t value);
+#endif
+
 struct usbh_hid {
     struct usbh_hubport *hport;
     struct usb_endpoint_descriptor *intin;  /* INTR IN endpoint */
@@ -21,6 +55,9 @@ struct usbh_hid {
     uint8_t intf; /* interface number */
     uint8_t minor;
 
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+    struct usbh_hid_report_map report_map;
+#endif
     void *user_data;
 };
 
@@ -36,6 +73,22 @@ int usbh_hid_get_protocol(struct usbh_hid *hid_class, uint8_t *protocol);
 int usbh_hid_set_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t report_id, uint8_t *buffer, uint32_t buflen);
 int usbh_hid_get_report(struct usbh_hid *hid_class, uint8_t report_type, uint8_t report_id, uint8_t *buffer, uint32_t buflen);
 
+#ifdef CONFIG_USBHOST_HID_PARSE_REPORT
+/**
+ * @brief Compile report descriptor into field table, fields beyond CONFIG_USBHOST_HID_MAX_FIELDS are dropped.
+ *
+ * @return number of fields on success, and negative value indicate fail.
+ */
+int usbh_hid_parse_report_descriptor(struct usbh_hid_report_map *map, const uint8_t *desc, uint32_t desc_len);
+const struct usbh_hid_field *usbh_hid_find_field(const struct usbh_hid_report_map *map, uint8_t type, uint16_t usage_page, uint16_t usage);
+/* Extract element index of field from report, report starts with report id byte if map has report id */
+int32_t usbh_hid_get_field_value(const struct usbh_hid_report_map *map, const struct usbh_hid_field *field,
+                                 const uint8_t *report, uint32_t report_len, uint8_t index);
+/* Decode input report into usages with field table, return number of usages reported */
+int usbh_hid_decode_report(const struct usbh_hid_report_map *map, const uint8_t *report, uint32_t report_len,
+                           usbh_hid_usage_callback_t callback, void *arg);
+#endif
+
 void usbh_hid_run(struct usbh_hid *hid_class);
 void usbh_hid_stop(struct usbh_hid *hid_class);
 
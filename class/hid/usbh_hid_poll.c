@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_hid.h"
+#include "usbh_hid_poll.h"
+#include "chry_ringbuffer.h"
+
+#undef USB_DBG_TAG
+#define USB_DBG_TAG "usbh_hid_poll"
+#include "usb_log.h"
+
+#if CONFIG_USBHOST_MAX_HID_CLASS > 32
+#error "usbh_hid_poll supports up to 32 hid classes"
+#endif
+
+#if (CONFIG_USBHOST_HID_POLL_RINGSIZE & (CONFIG_USBHOST_HID_POLL_RINGSIZE - 1))
+#error "CONFIG_USBHOST_HID_POLL_RINGSIZE must be power of 2"
+#endif
+
+/*
+ * With CONFIG_USBHOST_URB_BH the urb completes in a bh worker, which only queues the report and resubmits.
+ * Reports are still delivered by the dispatcher thread, so a slow callback never stalls the shared worker.
+ */
+
+/* record header in report ring, followed by len bytes of report */
+struct usbh_hid_poll_hdr {
+    uint16_t len;
+    uint16_t reserved;
+    uint32_t timestamp;
+};
+
+struct usbh_hid_poll {
+    struct usbh_hid *hid_class; /* NULL when not polling, protected by g_hid_poll_mutex */
+    volatile bool running;
+    chry_ringbuffer_t rb;
+    struct usbh_hid_poll_stat stat;
+};
+
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_hid_poll_buf[CONFIG_USBHOST_MAX_HID_CLASS][USB_ALIGN_UP(CONFIG_USBHOST_HID_POLL_MAX_REPORT_SIZE, CONFIG_USB_ALIGN_SIZE)];
+
+static struct usbh_hid_poll g_hid_poll[CONFIG_USBHOST_MAX_HID_CLASS];
+static usb_osal_mutex_t g_hid_poll_mutex;
+
+static uint8_t g_hid_poll_pool[CONFIG_USBHOST_MAX_HID_CLASS][CONFIG_USBHOST_HID_POLL_RINGSIZE];
+static uint8_t g_hid_poll_report[CONFIG_USBHOST_HID_POLL_MAX_REPORT_SIZE];
+
+static usb_osal_thread_t g_hid_poll_thread;
+static usb_osal_mq_t g_hid_poll_mq;
+/* one bit per hid class with a wakeup in mq, so mq never holds more than CONFIG_USBHOST_MAX_HID_CLASS messages */
+static volatile uint32_t g_hid_poll_pending;
+
+static void usbh_hid_poll_notify(uint8_t minor)
+{
+    size_t flags;
+    bool send = false;
+
+    flags = usb_osal_enter_critical_section();
+    if ((g_hid_poll_pending & (1U << minor)) == 0) {
+        g_hid_poll_pending |= (1U << minor);
+        send = true;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (send) {
+        usb_osal_mq_send(g_hid_poll_mq, (uintptr_t)minor);
+    }
+}
+
+static void usbh_hid_poll_complete(void *arg, int nbytes)
+{
+    struct usbh_hid_poll *poll = (struct usbh_hid_poll *)arg;
+    struct usbh_hid *hid_class = poll->hid_class;
+    struct usbh_hid_poll_hdr hdr;
+    uint32_t used;
+
+    if (nbytes < 0) {
+        if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN)) {
+            return;
+        }
+        if (nbytes != -USB_ERR_NAK) {
+            poll->stat.urb_errors++;
+        }
+        if (nbytes == -USB_ERR_STALL) {
+            /* resubmitting a halted endpoint only loops on errors */
+            poll->running = false;
+            return;
+        }
+    } else if (nbytes > 0) {
+        if (chry_ringbuffer_get_free(&poll->rb) < (sizeof(struct usbh_hid_poll_hdr) + nbytes)) {
+            poll->stat.overflows++;
+        } else {
+            hdr.len = nbytes;
+            hdr.reserved = 0;
+            hdr.timestamp = usbh_hid_poll_timestamp();
+
+            /* dispatcher only consumes a record when all of it is in ring */
+            chry_ringbuffer_write(&poll->rb, &hdr, sizeof(struct usbh_hid_poll_hdr));
+            chry_ringbuffer_write(&poll->rb, g_hid_poll_buf[hid_class->minor], nbytes);
+
+            used = chry_ringbuffer_get_used(&poll->rb);
+            if (used > poll->stat.ring_max) {
+                poll->stat.ring_max = used;
+            }
+            usbh_hid_poll_notify(hid_class->minor);
+        }
+    }
+
+    if (poll->running) {
+        usbh_submit_urb(&hid_class->intin_urb);
+    }
+}
+
+static void usbh_hid_poll_drain(struct usbh_hid_poll *poll)
+{
+    struct usbh_hid_poll_hdr hdr;
+    uint32_t latency;
+
+    while (chry_ringbuffer_peek(&poll->rb, &hdr, sizeof(struct usbh_hid_poll_hdr)) == sizeof(struct usbh_hid_poll_hdr)) {
+        if (chry_ringbuffer_get_used(&poll->rb) < (sizeof(struct usbh_hid_poll_hdr) + hdr.len)) {
+            /* producer is still writing, it will notify again */
+            break;
+        }
+        chry_ringbuffer_drop(&poll->rb, sizeof(struct usbh_hid_poll_hdr));
+        chry_ringbuffer_read(&poll->rb, g_hid_poll_report, hdr.len);
+
+        latency = usbh_hid_poll_timestamp() - hdr.timestamp;
+        if (latency > poll->stat.latency_max) {
+            poll->stat.latency_max = latency;
+        }
+        poll->stat.latency_avg = poll->stat.latency_avg - (poll->stat.latency_avg >> 4) + (latency >> 4);
+        poll->stat.reports++;
+
+        usbh_hid_poll_report_callback(poll->hid_class, g_hid_poll_report, hdr.len);
+    }
+}
+
+static void usbh_hid_poll_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    struct usbh_hid_poll *poll;
+    uintptr_t minor;
+    size_t flags;
+    int ret;
+
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+
+    while (1) {
+        ret = usb_osal_mq_recv(g_hid_poll_mq, &minor, USB_OSAL_WAITING_FOREVER);
+        if ((ret < 0) || (minor >= CONFIG_USBHOST_MAX_HID_CLASS)) {
+            continue;
+        }
+
+        /* clear before draining, reports arriving from now on send a new wakeup */
+        flags = usb_osal_enter_critical_section();
+        g_hid_poll_pending &= ~(1U << minor);
+        usb_osal_leave_critical_section(flags);
+
+        usb_osal_mutex_take(g_hid_poll_mutex);
+        poll = &g_hid_poll[minor];
+        if (poll->hid_class) {
+            usbh_hid_poll_drain(poll);
+        }
+        usb_osal_mutex_give(g_hid_poll_mutex);
+    }
+}
+
+static int usbh_hid_poll_init(void)
+{
+    if (g_hid_poll_thread) {
+        return 0;
+    }
+
+    g_hid_poll_mq = usb_osal_mq_create(CONFIG_USBHOST_MAX_HID_CLASS);
+    if (g_hid_poll_mq == NULL) {
+        goto errout;
+    }
+
+    g_hid_poll_mutex = usb_osal_mutex_create();
+    if (g_hid_poll_mutex == NULL) {
+        goto errout;
+    }
+
+    g_hid_poll_thread = usb_osal_thread_create("usbh_hid_poll", CONFIG_USBHOST_HID_POLL_STACKSIZE, CONFIG_USBHOST_HID_POLL_PRIO, usbh_hid_poll_thread, NULL);
+    if (g_hid_poll_thread == NULL) {
+        goto errout;
+    }
+
+    return 0;
+
+errout:
+    USB_LOG_ERR("Fail to init hid poll\r\n");
+    if (g_hid_poll_mutex) {
+        usb_osal_mutex_delete(g_hid_poll_mutex);
+        g_hid_poll_mutex = NULL;
+    }
+    if (g_hid_poll_mq) {
+        usb_osal_mq_delete(g_hid_poll_mq);
+        g_hid_poll_mq = NULL;
+    }
+    return -USB_ERR_NOMEM;
+}
+
+int usbh_hid_poll_start(struct usbh_hid *hid_class)
+{
+    struct usbh_hid_poll *poll;
+    uint32_t size;
+    int ret;
+
+    if (!hid_class || !hid_class->hport || (hid_class->minor >= CONFIG_USBHOST_MAX_HID_CLASS)) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (!hid_class->intin) {
+        return -USB_ERR_NODEV;
+    }
+
+    ret = usbh_hid_poll_init();
+    if (ret < 0) {
+        return ret;
+    }
+
+    poll = &g_hid_poll[hid_class->minor];
+    if (poll->running) {
+        return -USB_ERR_BUSY;
+    }
+
+    usb_osal_mutex_take(g_hid_poll_mutex);
+    memset(&poll->stat, 0, sizeof(struct usbh_hid_poll_stat));
+    chry_ringbuffer_init(&poll->rb, g_hid_poll_pool[hid_class->minor], CONFIG_USBHOST_HID_POLL_RINGSIZE);
+    poll->hid_class = hid_class;
+    poll->running = true;
+    usb_osal_mutex_give(g_hid_poll_mutex);
+
+    size = MIN(USB_GET_MAXPACKETSIZE(hid_class->intin->wMaxPacketSize), CONFIG_USBHOST_HID_POLL_MAX_REPORT_SIZE);
+    usbh_int_urb_fill(&hid_class->intin_urb, hid_class->hport, hid_class->intin, g_hid_poll_buf[hid_class->minor], size,
+                      0, usbh_hid_poll_complete, poll);
+#ifdef CONFIG_USBHOST_URB_BH
+    hid_class->intin_urb.transfer_flags |= USBH_URB_BH;
+#endif
+    ret = usbh_submit_urb(&hid_class->intin_urb);
+    if (ret < 0) {
+        poll->running = false;
+        usb_osal_mutex_take(g_hid_poll_mutex);
+        poll->hid_class = NULL;
+        usb_osal_mutex_give(g_hid_poll_mutex);
+        return ret;
+    }
+
+    return 0;
+}
+
+int usbh_hid_poll_stop(struct usbh_hid *hid_class)
+{
+    struct usbh_hid_poll *poll;
+
+    if (!hid_class || (hid_class->minor >= CONFIG_USBHOST_MAX_HID_CLASS)) {
+        return -USB_ERR_INVAL;
+    }
+
+    poll = &g_hid_poll[hid_class->minor];
+    if (poll->hid_class != hid_class) {
+        return 0;
+    }
+
+    poll->running = false;
+    usbh_kill_urb(&hid_class->intin_urb);
+
+    /* wait for dispatcher to leave this class, stale wakeups are skipped */
+    usb_osal_mutex_take(g_hid_poll_mutex);
+    poll->hid_class = NULL;
+    chry_ringbuffer_reset(&poll->rb);
+    usb_osal_mutex_give(g_hid_poll_mutex);
+
+    return 0;
+}
+
+void usbh_hid_poll_get_stat(struct usbh_hid *hid_class, struct usbh_hid_poll_stat *stat)
+{
+    if (!hid_class || (hid_class->minor >= CONFIG_USBHOST_MAX_HID_CLASS)) {
+        memset(stat, 0, sizeof(struct usbh_hid_poll_stat));
+        return;
+    }
+
+    memcpy(stat, &g_hid_poll[hid_class->minor].stat, sizeof(struct usbh_hid_poll_stat));
+}
+
+__WEAK void usbh_hid_poll_report_callback(struct usbh_hid *hid_class, uint8_t *report, uint32_t len)
+{
+    (void)hid_class;
+    (void)report;
+    (void)len;
+}
+
+__WEAK uint32_t usbh_hid_poll_timestamp(void)
+{
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_HID_POLL_H
+#define USBH_HID_POLL_H
+
+#include "usbh_core.h"
+#include "usbh_hid.h"
+
+struct usbh_hid_poll_stat {
+    uint32_t reports;     /* reports delivered to usbh_hid_poll_report_callback */
+    uint32_t overflows;   /* reports dropped because ring was full */
+    uint32_t urb_errors;  /* urbs completed with error */
+    uint32_t ring_max;    /* ring high water mark in bytes */
+    uint32_t latency_max; /* max time from urb complete to delivery, in usbh_hid_poll_timestamp units */
+    uint32_t latency_avg; /* average time from urb complete to delivery, 1/16 weighted */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Keep interrupt in urb of hid class queued and deliver reports in shared dispatcher thread.
+ *
+ * Urb is resubmitted from complete callback, so the endpoint is polled at its bInterval.
+ * Dispatcher thread is created on first call and serves all hid classes. With CONFIG_USBHOST_URB_BH
+ * the urb completes and is resubmitted in the bh worker, reports are still delivered by the dispatcher.
+ *
+ * @param hid_class hid class instance.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_hid_poll_start(struct usbh_hid *hid_class);
+int usbh_hid_poll_stop(struct usbh_hid *hid_class);
+
+void usbh_hid_poll_get_stat(struct usbh_hid *hid_class, struct usbh_hid_poll_stat *stat);
+
+/* Called in dispatcher thread for every report, in order of arrival for each hid class */
+void usbh_hid_poll_report_callback(struct usbh_hid *hid_class, uint8_t *report, uint32_t len);
+
+/* Free running counter for latency statistics, such as us or cpu cycles, default returns 0 */
+uint32_t usbh_hid_poll_timestamp(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USBH_HID_POLL_H */
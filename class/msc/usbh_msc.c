@@ -5,6 +5,7 @@
  */
 #include "usbh_core.h"
 #include "usbh_msc.h"
+#include "usbh_msc_blk.h"
 #include "usb_scsi.h"
 
 #undef USB_DBG_TAG
@@ -323,6 +324,7 @@ static int usbh_msc_connect(struct usbh_hubport *hport, uint8_t intf)
 
     USB_LOG_INFO("Register MSC Class:%s\r\n", hport->config.intf[intf].devname);
 
+    usbh_msc_blk_attach(msc_class);
     usbh_msc_run(msc_class);
     return ret;
 }
@@ -348,6 +350,7 @@ static int usbh_msc_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_msc_stop(msc_class);
         }
 
+        usbh_msc_blk_detach(msc_class);
         usbh_msc_class_free(msc_class);
     }
 
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_msc_blk.h"
+
+#undef USB_DBG_TAG
+#define USB_DBG_TAG "usbh_msc_blk"
+#include "usb_log.h"
+
+#if CONFIG_USBHOST_MSC_BLK_CACHE_NUM < 1
+#error "CONFIG_USBHOST_MSC_BLK_CACHE_NUM must be at least 1"
+#endif
+
+#if CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE < CONFIG_USB_ALIGN_SIZE
+#error "CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE must not be smaller than CONFIG_USB_ALIGN_SIZE"
+#endif
+
+#define USBH_MSC_BLK_LINE_SIZE USB_ALIGN_UP(CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE, CONFIG_USB_ALIGN_SIZE)
+#define USBH_MSC_BLK_ALIGNED(p) ((((uintptr_t)(p)) & (CONFIG_USB_ALIGN_SIZE - 1)) == 0)
+
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_msc_blk_bounce[CONFIG_USBHOST_MSC_BLK_BOUNCE_SECTORS * USBH_MSC_BLK_LINE_SIZE];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_msc_blk_wbuf[CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS * USBH_MSC_BLK_LINE_SIZE];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_msc_blk_cache[CONFIG_USBHOST_MSC_BLK_CACHE_NUM][USBH_MSC_BLK_LINE_SIZE];
+
+struct usbh_msc_blk_line {
+    struct usbh_msc *msc_class; /* NULL when empty */
+    uint32_t sector;
+    uint32_t age;
+};
+
+static struct usbh_msc_blk {
+    usb_osal_mutex_t mutex;
+    struct usbh_msc_blk_line line[CONFIG_USBHOST_MSC_BLK_CACHE_NUM];
+    uint32_t age;
+
+    struct usbh_msc *wmsc; /* disk owning pending writes */
+    uint32_t wsector;
+    uint32_t wcount;
+
+    struct usbh_msc *emsc; /* disk whose merged write failed, error is kept for its next sync */
+    int eret;
+
+    struct usbh_msc_blk_stat stat;
+} g_msc_blk;
+
+static int usbh_msc_blk_xfer_read(struct usbh_msc *msc_class, uint32_t sector, uint8_t *buffer, uint32_t nsectors)
+{
+    g_msc_blk.stat.read_cmds++;
+    return usbh_msc_scsi_read10(msc_class, sector, buffer, nsectors);
+}
+
+static int usbh_msc_blk_xfer_write(struct usbh_msc *msc_class, uint32_t sector, const uint8_t *buffer, uint32_t nsectors)
+{
+    g_msc_blk.stat.write_cmds++;
+    return usbh_msc_scsi_write10(msc_class, sector, buffer, nsectors);
+}
+
+static int usbh_msc_blk_flush(void)
+{
+    int ret;
+
+    if (g_msc_blk.wcount == 0) {
+        return 0;
+    }
+
+    ret = usbh_msc_blk_xfer_write(g_msc_blk.wmsc, g_msc_blk.wsector, g_msc_blk_wbuf, g_msc_blk.wcount);
+    g_msc_blk.wcount = 0;
+    if (ret < 0) {
+        USB_LOG_ERR("merged write of sector %u failed: %d\r\n", (unsigned int)g_msc_blk.wsector, ret);
+        g_msc_blk.emsc = g_msc_blk.wmsc;
+        g_msc_blk.eret = ret;
+    }
+    return ret;
+}
+
+static bool usbh_msc_blk_pending_overlap(struct usbh_msc *msc_class, uint32_t sector, uint32_t nsectors)
+{
+    return g_msc_blk.wcount && (g_msc_blk.wmsc == msc_class) &&
+           (sector < g_msc_blk.wsector + g_msc_blk.wcount) && (g_msc_blk.wsector < sector + nsectors);
+}
+
+static int usbh_msc_blk_cache_find(struct usbh_msc *msc_class, uint32_t sector)
+{
+    for (uint8_t i = 0; i < CONFIG_USBHOST_MSC_BLK_CACHE_NUM; i++) {
+        if ((g_msc_blk.line[i].msc_class == msc_class) && (g_msc_blk.line[i].sector == sector)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int usbh_msc_blk_cache_victim(void)
+{
+    int victim = 0;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_MSC_BLK_CACHE_NUM; i++) {
+        if (g_msc_blk.line[i].msc_class == NULL) {
+            return i;
+        }
+        if (g_msc_blk.line[i].age < g_msc_blk.line[victim].age) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* cache is write through, keep cached copies equal to what is sent to disk */
+static void usbh_msc_blk_cache_update(struct usbh_msc *msc_class, uint32_t sector, const uint8_t *buffer, uint32_t nsectors)
+{
+    for (uint8_t i = 0; i < CONFIG_USBHOST_MSC_BLK_CACHE_NUM; i++) {
+        if ((g_msc_blk.line[i].msc_class == msc_class) &&
+            (g_msc_blk.line[i].sector >= sector) && (g_msc_blk.line[i].sector < sector + nsectors)) {
+            usb_memcpy(g_msc_blk_cache[i], &buffer[(g_msc_blk.line[i].sector - sector) * msc_class->blocksize], msc_class->blocksize);
+        }
+    }
+}
+
+static int usbh_msc_blk_read_meta(struct usbh_msc *msc_class, uint32_t sector, uint8_t *buffer)
+{
+    int idx;
+    int ret;
+
+    idx = usbh_msc_blk_cache_find(msc_class, sector);
+    if (idx < 0) {
+        g_msc_blk.stat.cache_misses++;
+        idx = usbh_msc_blk_cache_victim();
+        g_msc_blk.line[idx].msc_class = NULL;
+
+        ret = usbh_msc_blk_xfer_read(msc_class, sector, g_msc_blk_cache[idx], 1);
+        if (ret < 0) {
+            return ret;
+        }
+        g_msc_blk.line[idx].msc_class = msc_class;
+        g_msc_blk.line[idx].sector = sector;
+    } else {
+        g_msc_blk.stat.cache_hits++;
+    }
+
+    g_msc_blk.line[idx].age = ++g_msc_blk.age;
+    usb_memcpy(buffer, g_msc_blk_cache[idx], msc_class->blocksize);
+    return 0;
+}
+
+static int usbh_msc_blk_read_data(struct usbh_msc *msc_class, uint32_t sector, uint8_t *buffer, uint32_t nsectors)
+{
+    uint32_t blocksize = msc_class->blocksize;
+    uint8_t *aligned;
+    uint32_t count;
+    int ret;
+
+    if (USBH_MSC_BLK_ALIGNED(buffer)) {
+        return usbh_msc_blk_xfer_read(msc_class, sector, buffer, nsectors);
+    }
+
+    if (nsectors > CONFIG_USBHOST_MSC_BLK_BOUNCE_SECTORS) {
+        /* read sectors after the first into the aligned part of caller buffer, then slide them into place */
+        aligned = (uint8_t *)USB_ALIGN_UP((uintptr_t)buffer, CONFIG_USB_ALIGN_SIZE);
+        ret = usbh_msc_blk_xfer_read(msc_class, sector + 1, aligned, nsectors - 1);
+        if (ret < 0) {
+            return ret;
+        }
+        memmove(buffer + blocksize, aligned, (nsectors - 1) * blocksize);
+
+        ret = usbh_msc_blk_xfer_read(msc_class, sector, g_msc_blk_bounce, 1);
+        if (ret < 0) {
+            return ret;
+        }
+        usb_memcpy(buffer, g_msc_blk_bounce, blocksize);
+        g_msc_blk.stat.bounce_sectors++;
+        return 0;
+    }
+
+    while (nsectors) {
+        count = MIN(nsectors, CONFIG_USBHOST_MSC_BLK_BOUNCE_SECTORS);
+        ret = usbh_msc_blk_xfer_read(msc_class, sector, g_msc_blk_bounce, count);
+        if (ret < 0) {
+            return ret;
+        }
+        usb_memcpy(buffer, g_msc_blk_bounce, count * blocksize);
+        g_msc_blk.stat.bounce_sectors += count;
+
+        sector += count;
+        buffer += count * blocksize;
+        nsectors -= count;
+    }
+    return 0;
+}
+
+static int usbh_msc_blk_write_data(struct usbh_msc *msc_class, uint32_t sector, const uint8_t *buffer, uint32_t nsectors)
+{
+    uint32_t blocksize = msc_class->blocksize;
+    uint32_t count;
+    int ret;
+
+    if (nsectors <= CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS) {
+        if (g_msc_blk.wcount &&
+            ((g_msc_blk.wmsc != msc_class) || ((g_msc_blk.wsector + g_msc_blk.wcount) != sector) ||
+             ((g_msc_blk.wcount + nsectors) > CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS))) {
+            /* failure belongs to earlier writes, it is latched for usbh_msc_blk_sync */
+            usbh_msc_blk_flush();
+        }
+
+        if (g_msc_blk.wcount == 0) {
+            g_msc_blk.wmsc = msc_class;
+            g_msc_blk.wsector = sector;
+        } else {
+            g_msc_blk.stat.merged_writes++;
+        }
+
+        usb_memcpy(&g_msc_blk_wbuf[g_msc_blk.wcount * blocksize], buffer, nsectors * blocksize);
+        g_msc_blk.wcount += nsectors;
+
+        if (g_msc_blk.wcount == CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS) {
+            return usbh_msc_blk_flush();
+        }
+        return 0;
+    }
+
+    usbh_msc_blk_flush();
+
+    if (USBH_MSC_BLK_ALIGNED(buffer)) {
+        return usbh_msc_blk_xfer_write(msc_class, sector, buffer, nsectors);
+    }
+
+    /* merge buffer is empty now, use it as bounce buffer */
+    while (nsectors) {
+        count = MIN(nsectors, CONFIG_USBHOST_MSC_BLK_WRITE_SECTORS);
+        usb_memcpy(g_msc_blk_wbuf, buffer, count * blocksize);
+        g_msc_blk.stat.bounce_sectors += count;
+
+        ret = usbh_msc_blk_xfer_write(msc_class, sector, g_msc_blk_wbuf, count);
+        if (ret < 0) {
+            return ret;
+        }
+
+        sector += count;
+        buffer += count * blocksize;
+        nsectors -= count;
+    }
+    return 0;
+}
+
+void usbh_msc_blk_attach(struct usbh_msc *msc_class)
+{
+    (void)msc_class;
+
+    /* connect runs in hub thread only, creation cannot race */
+    if (g_msc_blk.mutex == NULL) {
+        g_msc_blk.mutex = usb_osal_mutex_create();
+    }
+}
+
+void usbh_msc_blk_detach(struct usbh_msc *msc_class)
+{
+    if (g_msc_blk.mutex == NULL) {
+        return;
+    }
+
+    usb_osal_mutex_take(g_msc_blk.mutex);
+    for (uint8_t i = 0; i < CONFIG_USBHOST_MSC_BLK_CACHE_NUM; i++) {
+        if (g_msc_blk.line[i].msc_class == msc_class) {
+            g_msc_blk.line[i].msc_class = NULL;
+        }
+    }
+    if (g_msc_blk.wmsc == msc_class) {
+        g_msc_blk.wcount = 0;
+        g_msc_blk.wmsc = NULL;
+    }
+    if (g_msc_blk.emsc == msc_class) {
+        g_msc_blk.emsc = NULL;
+    }
+    usb_osal_mutex_give(g_msc_blk.mutex);
+}
+
+int usbh_msc_blk_read(struct usbh_msc *msc_class, uint32_t sector, uint8_t *buffer, uint32_t nsectors, bool meta)
+{
+    int ret;
+
+    if (!msc_class || !msc_class->hport || !g_msc_blk.mutex) {
+        return -USB_ERR_NODEV;
+    }
+
+    if (nsectors == 0) {
+        return 0;
+    }
+
+    if (msc_class->blocksize > CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE) {
+        if (!USBH_MSC_BLK_ALIGNED(buffer)) {
+            return -USB_ERR_INVAL;
+        }
+        return usbh_msc_scsi_read10(msc_class, sector, buffer, nsectors);
+    }
+
+    usb_osal_mutex_take(g_msc_blk.mutex);
+
+    if (usbh_msc_blk_pending_overlap(msc_class, sector, nsectors)) {
+        usbh_msc_blk_flush();
+    }
+
+    if (meta && (nsectors == 1)) {
+        ret = usbh_msc_blk_read_meta(msc_class, sector, buffer);
+    } else {
+        ret = usbh_msc_blk_read_data(msc_class, sector, buffer, nsectors);
+    }
+
+    usb_osal_mutex_give(g_msc_blk.mutex);
+    return ret;
+}
+
+int usbh_msc_blk_write(struct usbh_msc *msc_class, uint32_t sector, const uint8_t *buffer, uint32_t nsectors, bool meta)
+{
+    int idx;
+    int ret;
+
+    if (!msc_class || !msc_class->hport || !g_msc_blk.mutex) {
+        return -USB_ERR_NODEV;
+    }
+
+    if (nsectors == 0) {
+        return 0;
+    }
+
+    if (msc_class->blocksize > CONFIG_USBHOST_MSC_BLK_SECTOR_SIZE) {
+        if (!USBH_MSC_BLK_ALIGNED(buffer)) {
+            return -USB_ERR_INVAL;
+        }
+        return usbh_msc_scsi_write10(msc_class, sector, buffer, nsectors);
+    }
+
+    usb_osal_mutex_take(g_msc_blk.mutex);
+    usbh_msc_blk_cache_update(msc_class, sector, buffer, nsectors);
+    if (meta && (nsectors == 1) && (usbh_msc_blk_cache_find(msc_class, sector) < 0)) {
+        idx = usbh_msc_blk_cache_victim();
+        usb_memcpy(g_msc_blk_cache[idx], buffer, msc_class->blocksize);
+        g_msc_blk.line[idx].msc_class = msc_class;
+        g_msc_blk.line[idx].sector = sector;
+        g_msc_blk.line[idx].age = ++g_msc_blk.age;
+    }
+    ret = usbh_msc_blk_write_data(msc_class, sector, buffer, nsectors);
+    usb_osal_mutex_give(g_msc_blk.mutex);
+
+    return ret;
+}
+
+int usbh_msc_blk_sync(struct usbh_msc *msc_class)
+{
+    int ret = 0;
+
+    if (!g_msc_blk.mutex) {
+        return 0;
+    }
+
+    usb_osal_mutex_take(g_msc_blk.mutex);
+    if (g_msc_blk.wmsc == msc_class) {
+        usbh_msc_blk_flush();
+    }
+    if (g_msc_blk.emsc == msc_class) {
+        ret = g_msc_blk.eret;
+        g_msc_blk.emsc = NULL;
+    }
+    usb_osal_mutex_give(g_msc_blk.mutex);
+
+    return ret;
+}
+
+void usbh_msc_blk_get_stat(struct usbh_msc_blk_stat *stat)
+{
+    memcpy(stat, &g_msc_blk.stat, sizeof(struct usbh_msc_blk_stat));
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_MSC_BLK_H
+#define USBH_MSC_BLK_H
+
+#include "usbh_msc.h"
+
+struct usbh_msc_blk_stat {
+    uint32_t read_cmds;      /* READ(10) issued */
+    uint32_t write_cmds;     /* WRITE(10) issued */
+    uint32_t cache_hits;     /* metadata reads served from cache */
+    uint32_t cache_misses;
+    uint32_t bounce_sectors; /* sectors copied because caller buffer was unaligned */
+    uint32_t merged_writes;  /* writes appended to a pending WRITE(10) */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called by msc class on connect and disconnect, detach drops cached and pending sectors of the disk */
+void usbh_msc_blk_attach(struct usbh_msc *msc_class);
+void usbh_msc_blk_detach(struct usbh_msc *msc_class);
+
+/**
+ * @brief Read sectors, buffer may have any alignment.
+ *
+ * @param meta single sector filesystem metadata (fat, directory), served from and kept in cache.
+ */
+int usbh_msc_blk_read(struct usbh_msc *msc_class, uint32_t sector, uint8_t *buffer, uint32_t nsectors, bool meta);
+
+/**
+ * @brief Write sectors, buffer may have any alignment.
+ *
+ * Small writes are copied and merged with adjacent ones, they reach the disk when the merge buffer is full,
+ * a non adjacent sector is accessed or usbh_msc_blk_sync is called. When a merged write fails its data is
+ * lost, the error is kept and returned by the next usbh_msc_blk_sync of the disk (and by the write that
+ * filled the merge buffer), other calls are not failed by it. Single sector metadata writes are also kept in cache.
+ */
+int usbh_msc_blk_write(struct usbh_msc *msc_class, uint32_t sector, const uint8_t *buffer, uint32_t nsectors, bool meta);
+
+/* Issue pending writes of the disk, returns error of any merged write that failed since last sync */
+int usbh_msc_blk_sync(struct usbh_msc *msc_class);
+
+void usbh_msc_blk_get_stat(struct usbh_msc_blk_stat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USBH_MSC_BLK_H */
@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_video.h"
+#include "usbh_uvc_stream.h"
+
+#undef USB_DBG_TAG
+#define USB_DBG_TAG "usbh_uvc_stream"
+#include "usb_log.h"
+
+/* payload header bmHeaderInfo bits */
+#define UVC_STREAM_FID (1 << 0)
+#define UVC_STREAM_EOF (1 << 1)
+#define UVC_STREAM_PTS (1 << 2)
+#define UVC_STREAM_SCR (1 << 3)
+#define UVC_STREAM_ERR (1 << 6)
+#define UVC_STREAM_EOH (1 << 7)
+
+#define UVC_STREAM_URB_BUFSIZE (CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS * CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE)
+
+#if CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE % CONFIG_USB_ALIGN_SIZE
+#error "CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE must be multiple of CONFIG_USB_ALIGN_SIZE"
+#endif
+
+#if CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM < 2
+#error "CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM must be at least 2"
+#endif
+
+struct usbh_video_stream {
+    struct usbh_video *video_class;
+    struct usb_endpoint_descriptor *ep;
+    struct usbh_urb *urb;     /* only one urb per endpoint, it takes the buffers in turn */
+    uint8_t buf_index;        /* buffer the urb is filling */
+    uint32_t packet_size;     /* iso packet size or bulk transfer size */
+    uint32_t max_payload;     /* dwMaxPayloadTransferSize from commit */
+    uint32_t max_frame_size;  /* dwMaxVideoFrameSize from commit */
+    uint8_t format_type;
+    volatile bool streaming;
+
+    /* frame ring, frames in [frame_rd, frame_wr) are owned by stream thread */
+    struct usbh_videoframe *frame_pool;
+    uint8_t frame_num;
+    volatile uint32_t frame_wr;
+    volatile uint32_t frame_rd;
+
+    /* frame assembly state, only touched in urb complete context */
+    struct usbh_videoframe *cur_frame;
+    uint32_t cur_offset;
+    uint8_t cur_fid;
+    uint8_t last_fid;
+    bool in_frame;
+    bool last_fid_valid;
+    bool discard;
+    bool corrupt;
+    bool payload_eof;
+    bool bulk_in_payload;
+    bool bulk_skip;
+    uint32_t bulk_payload_len;
+
+    usb_osal_thread_t thread;
+    usb_osal_mq_t mq;
+    struct usbh_video_stream_stat stat;
+};
+
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_uvc_stream_buf[CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM][UVC_STREAM_URB_BUFSIZE];
+
+static struct usbh_video_stream g_uvc_stream;
+static struct usb_osal_timer *g_uvc_fps_timer;
+static uint32_t g_uvc_fps_last_frames;
+
+volatile uint32_t g_uvc_fps;
+
+static void usbh_video_stream_frame_begin(struct usbh_video_stream *stream, uint8_t fid)
+{
+    stream->in_frame = true;
+    stream->cur_fid = fid;
+    stream->cur_offset = 0;
+    stream->corrupt = false;
+
+    if ((stream->frame_wr - stream->frame_rd) >= stream->frame_num) {
+        /* all buffers are held by the thread, drop this frame */
+        stream->discard = true;
+        stream->cur_frame = NULL;
+        stream->stat.dropped_frames++;
+        return;
+    }
+
+    stream->discard = false;
+    stream->cur_frame = &stream->frame_pool[stream->frame_wr % stream->frame_num];
+    stream->cur_frame->frame_size = 0;
+    stream->cur_frame->pts_valid = false;
+    stream->cur_frame->scr_valid = false;
+}
+
+static void usbh_video_stream_frame_end(struct usbh_video_stream *stream)
+{
+    stream->in_frame = false;
+    stream->last_fid = stream->cur_fid;
+    stream->last_fid_valid = true;
+
+    if (stream->discard) {
+        return;
+    }
+
+    if (stream->corrupt || (stream->cur_offset == 0)) {
+        stream->stat.corrupt_frames++;
+        return;
+    }
+
+    stream->cur_frame->frame_size = stream->cur_offset;
+    stream->cur_frame->frame_format = stream->format_type;
+    stream->frame_wr++;
+    usb_osal_mq_send(stream->mq, (uintptr_t)stream->cur_frame);
+}
+
+static void usbh_video_stream_append(struct usbh_video_stream *stream, uint8_t *data, uint32_t len)
+{
+    if (!stream->in_frame || stream->discard || (len == 0)) {
+        return;
+    }
+
+    if ((stream->cur_offset + len) > stream->cur_frame->frame_bufsize) {
+        stream->corrupt = true;
+        len = stream->cur_frame->frame_bufsize - stream->cur_offset;
+    }
+
+    usb_memcpy(&stream->cur_frame->frame_buf[stream->cur_offset], data, len);
+    stream->cur_offset += len;
+    stream->stat.bytes += len;
+}
+
+/* parse payload header and return header length, or 0 if payload must be skipped */
+static uint32_t usbh_video_stream_parse_header(struct usbh_video_stream *stream, uint8_t *buf, uint32_t len)
+{
+    uint8_t hlen;
+    uint8_t bfh;
+    uint8_t fid;
+    uint8_t minlen;
+    uint8_t *p;
+
+    stream->payload_eof = false;
+
+    if (len < 2) {
+        return 0;
+    }
+
+    hlen = buf[0];
+    bfh = buf[1];
+
+    minlen = 2;
+    if (bfh & UVC_STREAM_PTS) {
+        minlen += 4;
+    }
+    if (bfh & UVC_STREAM_SCR) {
+        minlen += 6;
+    }
+
+    if ((hlen < minlen) || (hlen > len)) {
+        /* broken header, the frame cannot be trusted anymore */
+        if (stream->in_frame) {
+            stream->corrupt = true;
+        }
+        return 0;
+    }
+
+    fid = bfh & UVC_STREAM_FID;
+
+    if (stream->in_frame && (fid != stream->cur_fid)) {
+        /* fid toggled without eof */
+        usbh_video_stream_frame_end(stream);
+    }
+
+    if (!stream->in_frame) {
+        if (stream->last_fid_valid && (fid == stream->last_fid)) {
+            /* trailing payloads of the frame we have already closed */
+            return 0;
+        }
+        usbh_video_stream_frame_begin(stream, fid);
+    }
+
+    if (bfh & UVC_STREAM_ERR) {
+        stream->corrupt = true;
+    }
+
+    p = &buf[2];
+    if (bfh & UVC_STREAM_PTS) {
+        if (stream->cur_frame && !stream->cur_frame->pts_valid) {
+            stream->cur_frame->pts = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+            stream->cur_frame->pts_valid = true;
+        }
+        p += 4;
+    }
+    if ((bfh & UVC_STREAM_SCR) && stream->cur_frame) {
+        stream->cur_frame->scr_stc = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        stream->cur_frame->scr_sof = (p[4] | (p[5] << 8)) & 0x7ff;
+        stream->cur_frame->scr_valid = true;
+    }
+
+    stream->payload_eof = (bfh & UVC_STREAM_EOF) ? true : false;
+
+    return hlen;
+}
+
+static void usbh_video_stream_payload(struct usbh_video_stream *stream, uint8_t *buf, uint32_t len)
+{
+    uint32_t hlen;
+
+    hlen = usbh_video_stream_parse_header(stream, buf, len);
+    if (hlen == 0) {
+        return;
+    }
+
+    usbh_video_stream_append(stream, &buf[hlen], len - hlen);
+
+    if (stream->payload_eof && stream->in_frame) {
+        usbh_video_stream_frame_end(stream);
+    }
+}
+
+static void usbh_video_stream_bulk_complete(struct usbh_video_stream *stream, uint8_t *buf, uint32_t nbytes)
+{
+    uint32_t hlen = 0;
+
+    if (!stream->bulk_in_payload) {
+        /* header is only present at the start of a bulk payload */
+        hlen = usbh_video_stream_parse_header(stream, buf, nbytes);
+        stream->bulk_skip = (hlen == 0) ? true : false;
+    }
+
+    if (!stream->bulk_skip) {
+        usbh_video_stream_append(stream, &buf[hlen], nbytes - hlen);
+    }
+
+    stream->bulk_payload_len += nbytes;
+
+    /* a payload ends with a short packet or when dwMaxPayloadTransferSize is reached */
+    if ((nbytes < stream->packet_size) || (stream->bulk_payload_len >= stream->max_payload)) {
+        stream->bulk_in_payload = false;
+        stream->bulk_payload_len = 0;
+        if (!stream->bulk_skip && stream->payload_eof && stream->in_frame) {
+            usbh_video_stream_frame_end(stream);
+        }
+    } else {
+        stream->bulk_in_payload = true;
+    }
+}
+
+static void usbh_video_stream_urb_fill(struct usbh_video_stream *stream, struct usbh_urb *urb, uint8_t *buf);
+
+static void usbh_video_stream_complete_callback(void *arg, int nbytes)
+{
+    struct usbh_urb *urb = (struct usbh_urb *)arg;
+    struct usbh_video_stream *stream = &g_uvc_stream;
+    uint8_t *buf = urb->transfer_buffer;
+    int32_t iso_len[CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS]; /* -1 for packet error */
+    uint32_t num_of_iso_packets = 0;
+
+    if (!stream->streaming) {
+        return;
+    }
+
+    if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN)) {
+        return;
+    }
+
+    /* iso packet results are cleared by the refill below */
+    if ((nbytes >= 0) && !stream->video_class->is_bulk) {
+        num_of_iso_packets = MIN(urb->num_of_iso_packets, CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS);
+        for (uint32_t i = 0; i < num_of_iso_packets; i++) {
+            iso_len[i] = (urb->iso_packet[i].errorcode < 0) ? -1 : (int32_t)urb->iso_packet[i].actual_length;
+        }
+    }
+
+    /* keep the endpoint busy on the next buffer while this one is parsed */
+    stream->buf_index = (stream->buf_index + 1) % CONFIG_USBHOST_VIDEO_STREAM_BUF_NUM;
+    usbh_video_stream_urb_fill(stream, urb, g_uvc_stream_buf[stream->buf_index]);
+    if (usbh_submit_urb(urb) < 0) {
+        stream->stat.urb_errors++;
+    }
+
+    if (nbytes < 0) {
+        stream->stat.urb_errors++;
+        if (stream->in_frame) {
+            stream->corrupt = true;
+        }
+        stream->bulk_in_payload = false;
+        stream->bulk_payload_len = 0;
+    } else if (stream->video_class->is_bulk) {
+        usbh_video_stream_bulk_complete(stream, buf, nbytes);
+    } else {
+        for (uint32_t i = 0; i < num_of_iso_packets; i++) {
+            if (iso_len[i] < 0) {
+                stream->stat.urb_errors++;
+                if (stream->in_frame) {
+                    stream->corrupt = true;
+                }
+                continue;
+            }
+            usbh_video_stream_payload(stream, &buf[i * stream->packet_size], (uint32_t)iso_len[i]);
+        }
+    }
+}
+
+static void usbh_video_stream_urb_fill(struct usbh_video_stream *stream, struct usbh_urb *urb, uint8_t *buf)
+{
+    struct usbh_hubport *hport = stream->video_class->hport;
+
+    if (stream->video_class->is_bulk) {
+        usbh_bulk_urb_fill(urb, hport, stream->ep, buf, stream->packet_size, 0, usbh_video_stream_complete_callback, urb);
+        return;
+    }
+
+    urb->hport = hport;
+    urb->ep = stream->ep;
+    urb->setup = NULL;
+    urb->transfer_buffer = buf;
+    urb->transfer_buffer_length = stream->packet_size * CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS;
+    urb->timeout = 0;
+    urb->complete = usbh_video_stream_complete_callback;
+    urb->arg = urb;
+    urb->interval = USBH_GET_URB_INTERVAL(stream->ep->bInterval, hport->speed);
+    urb->num_of_iso_packets = CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS;
+    for (uint32_t i = 0; i < CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS; i++) {
+        urb->iso_packet[i].transfer_buffer = &buf[i * stream->packet_size];
+        urb->iso_packet[i].transfer_buffer_length = stream->packet_size;
+        urb->iso_packet[i].actual_length = 0;
+        urb->iso_packet[i].errorcode = 0;
+    }
+}
+
+static bool usbh_video_stream_check_frame(struct usbh_video_stream *stream, struct usbh_videoframe *frame)
+{
+    uint8_t *buf = frame->frame_buf;
+    uint32_t size = frame->frame_size;
+
+    if (frame->frame_format == USBH_VIDEO_FORMAT_MJPEG) {
+        if ((size < 4) || (buf[0] != 0xff) || (buf[1] != 0xd8)) {
+            return false;
+        }
+        /* strip padding after EOI */
+        while ((size >= 4) && !((buf[size - 2] == 0xff) && (buf[size - 1] == 0xd9))) {
+            size--;
+        }
+        if (size < 4) {
+            return false;
+        }
+        frame->frame_size = size;
+    } else {
+        if (stream->max_frame_size && (size != stream->max_frame_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void usbh_video_stream_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    struct usbh_video_stream *stream = &g_uvc_stream;
+    struct usbh_videoframe *frame;
+    size_t flags;
+    int ret;
+
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
+
+    while (1) {
+        ret = usb_osal_mq_recv(stream->mq, (uintptr_t *)&frame, USB_OSAL_WAITING_FOREVER);
+        if (ret < 0) {
+            continue;
+        }
+
+        if (usbh_video_stream_check_frame(stream, frame)) {
+            stream->stat.complete_frames++;
+            usbh_video_frame_callback(frame);
+        } else {
+            flags = usb_osal_enter_critical_section();
+            stream->stat.corrupt_frames++;
+            usb_osal_leave_critical_section(flags);
+        }
+
+        /* give the buffer back to the ring */
+        stream->frame_rd++;
+    }
+}
+
+int usbh_video_stream_init(uint8_t prio, struct usbh_videoframe *frame_pool, uint8_t frame_num)
+{
+    struct usbh_video_stream *stream = &g_uvc_stream;
+    size_t urb_size;
+
+    if (!frame_pool || (frame_num < 2)) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (stream->frame_pool) {
+        return -USB_ERR_BUSY;
+    }
+
+    memset(stream, 0, sizeof(struct usbh_video_stream));
+
+    urb_size = sizeof(struct usbh_urb) + CONFIG_USBHOST_VIDEO_STREAM_ISO_PACKETS * sizeof(struct usbh_iso_frame_packet);
+    stream->urb = usb_osal_malloc(urb_size);
+    if (stream->urb == NULL) {
+        goto errout;
+    }
+    memset(stream->urb, 0, urb_size);
+#if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
+    stream->urb->iso_packet = (struct usbh_iso_frame_packet *)(stream->urb + 1);
+#endif
+
+    stream->mq = usb_osal_mq_create(frame_num);
+    if (stream->mq == NULL) {
+        goto errout;
+    }
+
+    stream->frame_pool = frame_pool;
+    stream->frame_num = frame_num;
+
+    stream->thread = usb_osal_thread_create("usbh_uvc", CONFIG_USBHOST_VIDEO_STREAM_STACKSIZE, prio, usbh_video_stream_thread, NULL);
+    if (stream->thread == NULL) {
+        goto errout;
+    }
+
+    return 0;
+
+errout:
+    USB_LOG_ERR("Fail to init video stream\r\n");
+    if (stream->mq) {
+        usb_osal_mq_delete(stream->mq);
+    }
+    if (stream->urb) {
+        usb_osal_free(stream->urb);
+    }
+    memset(stream, 0, sizeof(struct usbh_video_stream));
+    return -USB_ERR_NOMEM;
+}
+
+int usbh_video_stream_deinit(void)
+{
+    struct usbh_video_stream *stream = &g_uvc_stream;
+
+    if (!stream->frame_pool) {
+        return 0;
+    }
+
+    usbh_video_stream_stop();
+
+    usb_osal_thread_delete(stream->thread);
+    usb_osal_mq_delete(stream->mq);
+    usb_osal_free(stream->urb);
+    memset(stream, 0, sizeof(struct usbh_video_stream));
+    return 0;
+}
+
+int usbh_video_stream_start(uint16_t width, uint16_t height, uint8_t format_type)
+{
+    struct usbh_video_stream *stream = &g_uvc_stream;
+    struct usbh_video *video_class;
+    struct usb_endpoint_descriptor *ep_desc;
+    uint32_t size = 0;
+    uint8_t altsetting = 0;
+    int ret;
+
+    if (!stream->frame_pool) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (stream->streaming) {
+        return -USB_ERR_BUSY;
+    }
+
+    video_class = (struct usbh_video *)usbh_find_class_instance("/dev/video0");
+    if (video_class == NULL) {
+        return -USB_ERR_NODEV;
+    }
+
+    if (!video_class->is_bulk) {
+        /* select the largest bandwidth altsetting that fits our packet buffers */
+        for (altsetting = video_class->num_of_intf_altsettings - 1; altsetting > 0; altsetting--) {
+            ep_desc = &video_class->hport->config.intf[video_class->data_intf].altsetting[altsetting].ep[0].ep_desc;
+            size = USB_GET_MAXPACKETSIZE(ep_desc->wMaxPacketSize) * (USB_GET_MULT(ep_desc->wMaxPacketSize) + 1);
+            if (size <= CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE) {
+                break;
+            }
+        }
+        if (altsetting == 0) {
+            USB_LOG_ERR("No altsetting fits CONFIG_USBHOST_VIDEO_STREAM_MAX_PACKET_SIZE\r\n");
+            return -USB_ERR_RANGE;
+        }
+    }
+
+    ret = usbh_video_open(video_class, format_type, width, height, altsetting);
+    if (ret < 0) {
+        return ret;
+    }
+
+    stream->video_class = video_class;
+    stream->format_type = format_type;
+    stream->max_frame_size = video_class->commit.dwMaxVideoFrameSize;
+    stream->max_payload = video_class->commit.dwMaxPayloadTransferSize;
+    if (video_class->is_bulk) {
+        stream->ep = video_class->bulkin;
+        stream->packet_size = MIN(stream->max_payload, UVC_STREAM_URB_BUFSIZE);
+        if (stream->max_payload == 0) {
+            stream->packet_size = UVC_STREAM_URB_BUFSIZE;
+            stream->max_payload = UVC_STREAM_URB_BUFSIZE;
+        }
+    } else {
+        stream->ep = video_class->isoin;
+        stream->packet_size = size;
+    }
+
+    stream->in_frame = false;
+    stream->last_fid_valid = false;
+    stream->bulk_in_payload = false;
+    stream->bulk_payload_len = 0;
+    stream->streaming = true;
+
+    stream->buf_index = 0;
+    usbh_video_stream_urb_fill(stream, stream->urb, g_uvc_stream_buf[0]);
+    ret = usbh_submit_urb(stream->urb);
+    if (ret < 0) {
+        USB_LOG_ERR("Fail to submit video urb, ret:%d\r\n", ret);
+        usbh_video_stream_stop();
+        return ret;
+    }
+
+    USB_LOG_INFO("Start video stream, %s, packet size:%u, max payload:%u\r\n",
+                 video_class->is_bulk ? "bulk" : "iso", (unsigned int)stream->packet_size, (unsigned int)stream->max_payload);
+    return 0;
+}
+
+int usbh_video_stream_stop(void)
+{
+    struct usbh_video_stream *stream = &g_uvc_stream;
+
+    if (!stream->streaming) {
+        return 0;
+    }
+
+    stream->streaming = false;
+
+    usbh_kill_urb(stream->urb);
+
+    stream->in_frame = false;
+
+    return usbh_video_close(stream->video_class);
+}
+
+void usbh_video_stream_get_stat(struct usbh_video_stream_stat *stat)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    memcpy(stat, &g_uvc_stream.stat, sizeof(struct usbh_video_stream_stat));
+    usb_osal_leave_critical_section(flags);
+}
+
+static void usbh_video_fps_timeout(void *argument)
+{
+    uint32_t frames = g_uvc_stream.stat.complete_frames;
+
+    (void)argument;
+
+    g_uvc_fps = frames - g_uvc_fps_last_frames;
+    g_uvc_fps_last_frames = frames;
+}
+
+void usbh_video_fps_init(void)
+{
+    if (g_uvc_fps_timer) {
+        return;
+    }
+
+    g_uvc_fps_timer = usb_osal_timer_create("usbh_uvc_fps", 1000, usbh_video_fps_timeout, NULL, true);
+    if (g_uvc_fps_timer) {
+        usb_osal_timer_start(g_uvc_fps_timer);
+    }
+}
+
+__WEAK void usbh_video_frame_callback(struct usbh_videoframe *frame)
+{
+    (void)frame;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_UVC_STREAM_H
+#define USBH_UVC_STREAM_H
+
+#include "usbh_core.h"
+#include "usbh_video.h"
+
+struct usbh_video_stream_stat {
+    uint32_t complete_frames; /* frames delivered to usbh_video_frame_callback */
+    uint32_t corrupt_frames;  /* frames with ERR bit, packet error, overflow or bad format */
+    uint32_t dropped_frames;  /* frames discarded because no free buffer was available */
+    uint32_t urb_errors;      /* urbs or iso packets that completed with error */
+    uint32_t bytes;           /* payload bytes received, without headers */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Init uvc stream engine with a ring of caller-provided frame buffers.
+ *
+ * @param prio priority of the frame delivery thread.
+ * @param frame_pool frame ring, frame_buf and frame_bufsize must be filled by caller.
+ * @param frame_num number of frames in frame_pool, at least 2.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_video_stream_init(uint8_t prio, struct usbh_videoframe *frame_pool, uint8_t frame_num);
+int usbh_video_stream_deinit(void);
+
+/**
+ * @brief Open /dev/video0 with selected format and keep the streaming urb queued.
+ *
+ * @param width frame width.
+ * @param height frame height.
+ * @param format_type USBH_VIDEO_FORMAT_UNCOMPRESSED or USBH_VIDEO_FORMAT_MJPEG.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_video_stream_start(uint16_t width, uint16_t height, uint8_t format_type);
+int usbh_video_stream_stop(void);
+
+void usbh_video_stream_get_stat(struct usbh_video_stream_stat *stat);
+
+/* Update g_uvc_fps once a second with delivered frame count */
+void usbh_video_fps_init(void);
+
+/* Called in stream thread for every complete frame, frame is returned to ring when it returns */
+void usbh_video_frame_callback(struct usbh_videoframe *frame);
+
+extern volatile uint32_t g_uvc_fps;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USBH_UVC_STREAM_H */
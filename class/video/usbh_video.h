@@ -28,6 +28,11 @@ struct usbh_videoframe {
     uint32_t frame_bufsize;
     uint32_t frame_format;
     uint32_t frame_size;
+    uint32_t pts;     /* presentation time stamp of the first payload, valid if pts_valid */
+    uint32_t scr_stc; /* source clock of the last payload carrying scr */
+    uint16_t scr_sof; /* usb sof token of the last payload carrying scr */
+    bool pts_valid;
+    bool scr_valid;
 };
 
 struct usbh_videostreaming {
@@ -5,6 +5,7 @@
  */
 #include "usbh_core.h"
 #include "usbh_bluetooth.h"
+#include "chry_ringbuffer.h"
 
 #undef USB_DBG_TAG
 #define USB_DBG_TAG "usbh_bluetooth"
@@ -12,16 +13,745 @@
 
 #define DEV_FORMAT "/dev/bluetooth"
 
+#if CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE % 512
+#error "CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE must be multiple of 512"
+#endif
+
+#if (CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE & (CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE - 1)) || \
+    (CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE & (CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE - 1))
+#error "CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE and CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE must be power of 2"
+#endif
+
+#if CONFIG_USBHOST_BLUETOOTH_RX_SIZE < 260
+#error "CONFIG_USBHOST_BLUETOOTH_RX_SIZE must hold a full event or sco packet"
+#endif
+
+/* type byte, header and 255 bytes of parameters */
+#define USBH_BLUETOOTH_SHORT_PACKET_SIZE 260
+#define USBH_BLUETOOTH_EVT_RINGSIZE      1024
+#define USBH_BLUETOOTH_EVT_URB_SIZE      64
+#define USBH_BLUETOOTH_SCO_MPS           64
+
+/* hci packets are rebuilt from header lengths, so one may span several urbs and one urb may hold several */
+struct usbh_bluetooth_rx {
+    uint8_t type; /* hci type of endpoint, USB_BLUETOOTH_HCI_NONE when every packet starts with h4 type byte */
+    bool discard; /* current packet does not fit in packet buffer */
+    uint32_t size;
+    uint32_t len;    /* bytes of current packet collected, including type byte */
+    uint32_t expect; /* total bytes of current packet, 0 until header is complete */
+    uint8_t *packet;
+    chry_ringbuffer_t rb;
+    usb_osal_sem_t *sem; /* wakes rx thread */
+
+    struct usbh_urb *urb;
+    struct usb_endpoint_descriptor *ep;
+    uint8_t *buf[2];
+    uint32_t buflen;
+    bool intr;
+    uint8_t index;  /* buffer owned by urb */
+    uint8_t errors; /* consecutive urb errors */
+    volatile bool running;
+};
+
+struct usbh_bluetooth_tx {
+    chry_ringbuffer_t rb; /* records of 2 bytes length followed by packet */
+    usb_osal_sem_t sem;   /* given when ring space is freed */
+    usb_osal_mutex_t mutex;
+    volatile bool busy;
+};
+
 static struct usbh_bluetooth g_bluetooth_class;
+static struct usbh_bluetooth_stat g_bluetooth_stat;
+static volatile bool g_bluetooth_running;
+static volatile uint8_t g_bluetooth_threads;
+
+static struct usbh_bluetooth_tx g_bluetooth_tx;
+static uint8_t g_bluetooth_tx_pool[CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE];
+
+static struct usbh_bluetooth_rx g_bluetooth_acl_rx;
+static usb_osal_sem_t g_bluetooth_acl_sem;
+static uint8_t g_bluetooth_acl_pool[CONFIG_USBHOST_BLUETOOTH_RX_RINGSIZE];
+static uint8_t g_bluetooth_acl_packet[CONFIG_USBHOST_BLUETOOTH_RX_SIZE];
+static uint8_t g_bluetooth_acl_dispatch[CONFIG_USBHOST_BLUETOOTH_RX_SIZE];
 
-#ifdef CONFIG_USBHOST_BLUETOOTH_HCI_H4
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_tx_buf[USB_ALIGN_UP(CONFIG_USBHOST_BLUETOOTH_TX_SIZE, CONFIG_USB_ALIGN_SIZE)];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[USB_ALIGN_UP(CONFIG_USBHOST_BLUETOOTH_RX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[2][CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE];
+
+#ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+static struct usbh_bluetooth_rx g_bluetooth_evt_rx;
+static usb_osal_sem_t g_bluetooth_evt_sem;
+static uint8_t g_bluetooth_evt_pool[USBH_BLUETOOTH_EVT_RINGSIZE];
+static uint8_t g_bluetooth_evt_packet[USBH_BLUETOOTH_SHORT_PACKET_SIZE];
+static uint8_t g_bluetooth_evt_dispatch[USBH_BLUETOOTH_SHORT_PACKET_SIZE];
+
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_cmd_buf[USB_ALIGN_UP(USBH_BLUETOOTH_SHORT_PACKET_SIZE, CONFIG_USB_ALIGN_SIZE)];
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_evt_buf[2][USB_ALIGN_UP(USBH_BLUETOOTH_EVT_URB_SIZE, CONFIG_USB_ALIGN_SIZE)];
+
+#ifdef CONFIG_USBHOST_BLUETOOTH_SCO
+#if (CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE & (CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE - 1))
+#error "CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE must be power of 2"
+#endif
+
+static struct usbh_bluetooth_rx g_bluetooth_sco_rx;
+static chry_ringbuffer_t g_bluetooth_sco_tx_rb;
+static volatile bool g_bluetooth_sco_running;
+static uint8_t g_bluetooth_sco_rx_pool[CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE];
+static uint8_t g_bluetooth_sco_tx_pool[CONFIG_USBHOST_BLUETOOTH_SCO_RINGSIZE];
+static uint8_t g_bluetooth_sco_packet[USBH_BLUETOOTH_SHORT_PACKET_SIZE];
+
+/* [in/out][urb] */
+USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_sco_buf[2][2][CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS * USBH_BLUETOOTH_SCO_MPS];
+#endif
+#endif
+
+static int usbh_bluetooth_init(void)
+{
+    if (g_bluetooth_tx.mutex) {
+        return 0;
+    }
+
+    g_bluetooth_tx.sem = usb_osal_sem_create(0);
+    g_bluetooth_acl_sem = usb_osal_sem_create(0);
+#ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+    g_bluetooth_evt_sem = usb_osal_sem_create(0);
+    if (g_bluetooth_evt_sem == NULL) {
+        return -USB_ERR_NOMEM;
+    }
+#endif
+    if ((g_bluetooth_tx.sem == NULL) || (g_bluetooth_acl_sem == NULL)) {
+        return -USB_ERR_NOMEM;
+    }
+
+    /* created last, it marks the objects above as ready */
+    g_bluetooth_tx.mutex = usb_osal_mutex_create();
+    if (g_bluetooth_tx.mutex == NULL) {
+        return -USB_ERR_NOMEM;
+    }
+    return 0;
+}
+
+static void usbh_bluetooth_rx_setup(struct usbh_bluetooth_rx *rx, uint8_t type, uint8_t *packet, uint32_t size,
+                                    uint8_t *pool, uint32_t poolsize, usb_osal_sem_t *sem)
+{
+    memset(rx, 0, sizeof(struct usbh_bluetooth_rx));
+    rx->type = type;
+    rx->packet = packet;
+    rx->size = size;
+    rx->sem = sem;
+    chry_ringbuffer_init(&rx->rb, pool, poolsize);
+}
+
+#ifdef CONFIG_USBHOST_BLUETOOTH_HCI_LOG
+static void usbh_bluetooth_hci_dump(uint8_t *data, uint32_t len)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        if (i % 16 == 0) {
+            USB_LOG_RAW("\r\n");
+        }
+
+        USB_LOG_RAW("%02x ", data[i]);
+    }
+
+    USB_LOG_RAW("\r\n");
+}
 #else
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_cmd_buf[USB_ALIGN_UP(256, CONFIG_USB_ALIGN_SIZE)];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_evt_buf[USB_ALIGN_UP(256, CONFIG_USB_ALIGN_SIZE)];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_tx_buf[USB_ALIGN_UP(CONFIG_USBHOST_BLUETOOTH_TX_SIZE, CONFIG_USB_ALIGN_SIZE)];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_bluetooth_rx_buf[USB_ALIGN_UP(CONFIG_USBHOST_BLUETOOTH_RX_SIZE, CONFIG_USB_ALIGN_SIZE)];
+#define usbh_bluetooth_hci_dump(data, len)
+#endif
+
+static uint8_t usbh_bluetooth_hdr_len(uint8_t type)
+{
+    switch (type) {
+        case USB_BLUETOOTH_HCI_CMD:
+        case USB_BLUETOOTH_HCI_SCO:
+            return 3;
+        case USB_BLUETOOTH_HCI_ACL:
+        case USB_BLUETOOTH_HCI_ISO:
+            return 4;
+        case USB_BLUETOOTH_HCI_EVT:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/* packet[0] is type byte, header follows */
+static uint32_t usbh_bluetooth_payload_len(const uint8_t *packet)
+{
+    switch (packet[0]) {
+        case USB_BLUETOOTH_HCI_CMD:
+        case USB_BLUETOOTH_HCI_SCO:
+            return packet[3];
+        case USB_BLUETOOTH_HCI_ACL:
+            return packet[3] | (packet[4] << 8);
+        case USB_BLUETOOTH_HCI_ISO:
+            return (packet[3] | (packet[4] << 8)) & 0x3fff;
+        case USB_BLUETOOTH_HCI_EVT:
+            return packet[2];
+        default:
+            return 0;
+    }
+}
+
+static void usbh_bluetooth_rx_reset(struct usbh_bluetooth_rx *rx)
+{
+    rx->len = 0;
+    rx->expect = 0;
+    rx->discard = false;
+}
+
+static void usbh_bluetooth_rx_put(struct usbh_bluetooth_rx *rx)
+{
+    uint16_t len = rx->len;
+
+    if (rx->discard || (chry_ringbuffer_get_free(&rx->rb) < (sizeof(uint16_t) + len))) {
+        g_bluetooth_stat.rx_drops++;
+    } else {
+        /* rx thread only consumes a record when all of it is in ring */
+        chry_ringbuffer_write(&rx->rb, &len, sizeof(uint16_t));
+        chry_ringbuffer_write(&rx->rb, rx->packet, len);
+        usb_osal_sem_give(*rx->sem);
+    }
+    usbh_bluetooth_rx_reset(rx);
+}
+
+static void usbh_bluetooth_rx_feed(struct usbh_bluetooth_rx *rx, const uint8_t *data, uint32_t nbytes)
+{
+    uint32_t hdr_end;
+    uint32_t copy;
+
+    while (nbytes) {
+        if (rx->len == 0) {
+            if (rx->type == USB_BLUETOOTH_HCI_NONE) {
+                rx->packet[0] = *data++;
+                nbytes--;
+            } else {
+                rx->packet[0] = rx->type;
+            }
+            if (usbh_bluetooth_hdr_len(rx->packet[0]) == 0) {
+                /* lost sync on h4 stream, skip bytes until a known type */
+                g_bluetooth_stat.rx_errors++;
+                continue;
+            }
+            rx->len = 1;
+            continue;
+        }
+
+        hdr_end = 1 + usbh_bluetooth_hdr_len(rx->packet[0]);
+        if (rx->len < hdr_end) {
+            copy = MIN(nbytes, hdr_end - rx->len);
+            memcpy(&rx->packet[rx->len], data, copy);
+            rx->len += copy;
+            data += copy;
+            nbytes -= copy;
+            if (rx->len < hdr_end) {
+                break;
+            }
+            rx->expect = hdr_end + usbh_bluetooth_payload_len(rx->packet);
+            rx->discard = (rx->expect > rx->size);
+        }
+
+        copy = MIN(nbytes, rx->expect - rx->len);
+        if (!rx->discard) {
+            memcpy(&rx->packet[rx->len], data, copy);
+        }
+        rx->len += copy;
+        data += copy;
+        nbytes -= copy;
+
+        if (rx->len == rx->expect) {
+            usbh_bluetooth_rx_put(rx);
+        }
+    }
+}
+
+static void usbh_bluetooth_rx_complete(void *arg, int nbytes);
+
+static int usbh_bluetooth_rx_submit(struct usbh_bluetooth_rx *rx)
+{
+    struct usbh_hubport *hport = g_bluetooth_class.hport;
+
+    if (rx->intr) {
+        usbh_int_urb_fill(rx->urb, hport, rx->ep, rx->buf[rx->index], rx->buflen, 0, usbh_bluetooth_rx_complete, rx);
+    } else {
+        usbh_bulk_urb_fill(rx->urb, hport, rx->ep, rx->buf[rx->index], rx->buflen, 0, usbh_bluetooth_rx_complete, rx);
+    }
+    return usbh_submit_urb(rx->urb);
+}
+
+static void usbh_bluetooth_rx_complete(void *arg, int nbytes)
+{
+    struct usbh_bluetooth_rx *rx = (struct usbh_bluetooth_rx *)arg;
+    uint8_t *buffer = rx->buf[rx->index];
+
+    if (nbytes < 0) {
+        if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN)) {
+            return;
+        }
+        if (nbytes != -USB_ERR_NAK) {
+            g_bluetooth_stat.rx_errors++;
+            usbh_bluetooth_rx_reset(rx);
+            if ((nbytes == -USB_ERR_STALL) || (++rx->errors >= 3)) {
+                /* do not spin on a broken endpoint */
+                rx->running = false;
+                return;
+            }
+        }
+        nbytes = 0;
+    } else {
+        rx->errors = 0;
+    }
+
+    /* requeue on the other buffer before parsing, so the endpoint is polled again as soon as possible */
+    if (rx->running) {
+        rx->index ^= 1;
+        if (usbh_bluetooth_rx_submit(rx) < 0) {
+            g_bluetooth_stat.rx_errors++;
+            rx->running = false;
+        }
+    }
+
+    usbh_bluetooth_rx_feed(rx, buffer, nbytes);
+}
+
+static int usbh_bluetooth_rx_start(struct usbh_bluetooth_rx *rx, struct usbh_urb *urb, struct usb_endpoint_descriptor *ep,
+                                   uint8_t *buf0, uint8_t *buf1, uint32_t buflen, bool intr)
+{
+    int ret;
+
+    rx->urb = urb;
+    rx->ep = ep;
+    rx->buf[0] = buf0;
+    rx->buf[1] = buf1;
+    rx->buflen = buflen;
+    rx->intr = intr;
+    rx->index = 0;
+    rx->errors = 0;
+    rx->running = true;
+    usbh_bluetooth_rx_reset(rx);
+
+    ret = usbh_bluetooth_rx_submit(rx);
+    if (ret < 0) {
+        USB_LOG_ERR("usbh_submit_urb failed: %d\r\n", ret);
+        rx->running = false;
+    }
+    return ret;
+}
+
+static void usbh_bluetooth_rx_drain(struct usbh_bluetooth_rx *rx, uint8_t *buffer)
+{
+    uint16_t len;
+
+    while (chry_ringbuffer_peek(&rx->rb, &len, sizeof(uint16_t)) == sizeof(uint16_t)) {
+        if (chry_ringbuffer_get_used(&rx->rb) < (sizeof(uint16_t) + len)) {
+            /* producer is still writing, it will give sem again */
+            break;
+        }
+        chry_ringbuffer_drop(&rx->rb, sizeof(uint16_t));
+        chry_ringbuffer_read(&rx->rb, buffer, len);
+
+        g_bluetooth_stat.rx_packets++;
+        usbh_bluetooth_hci_dump(buffer, len);
+        usbh_bluetooth_hci_read_callback(buffer, len);
+    }
+}
+
+/* Runs in rx thread created by glue, returns when class is disconnected */
+static void usbh_bluetooth_rx_loop(usb_osal_sem_t sem, struct usbh_bluetooth_rx *rx, struct usbh_bluetooth_rx *rx2, uint8_t *buffer)
+{
+    while (g_bluetooth_running) {
+        usb_osal_sem_take(sem, USB_OSAL_WAITING_FOREVER);
+        usbh_bluetooth_rx_drain(rx, buffer);
+        if (rx2) {
+            usbh_bluetooth_rx_drain(rx2, buffer);
+        }
+    }
+}
+
+/* Count rx thread in, a thread that starts after disconnect must not touch the class */
+static bool usbh_bluetooth_thread_enter(void)
+{
+    size_t flags;
+    bool running;
+
+    flags = usb_osal_enter_critical_section();
+    running = g_bluetooth_running;
+    if (running) {
+        g_bluetooth_threads++;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    return running;
+}
+
+static void usbh_bluetooth_thread_leave(void)
+{
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    g_bluetooth_threads--;
+    usb_osal_leave_critical_section(flags);
+}
+
+static bool usbh_bluetooth_tx_peek(uint16_t *len)
+{
+    if (chry_ringbuffer_peek(&g_bluetooth_tx.rb, len, sizeof(uint16_t)) != sizeof(uint16_t)) {
+        return false;
+    }
+    return chry_ringbuffer_get_used(&g_bluetooth_tx.rb) >= (sizeof(uint16_t) + *len);
+}
+
+static void usbh_bluetooth_tx_complete(void *arg, int nbytes);
+
+/* Send next queued packet, whoever sets busy is the only ring consumer */
+static void usbh_bluetooth_tx_start(void)
+{
+    struct usbh_bluetooth *bluetooth_class = &g_bluetooth_class;
+    struct usbh_urb *urb = &bluetooth_class->bulkout_urb;
+    uint16_t len;
+    size_t flags;
+    int ret;
+
+    while (1) {
+        flags = usb_osal_enter_critical_section();
+        if (g_bluetooth_tx.busy || !g_bluetooth_running) {
+            usb_osal_leave_critical_section(flags);
+            return;
+        }
+        g_bluetooth_tx.busy = true;
+        usb_osal_leave_critical_section(flags);
+
+        if (!usbh_bluetooth_tx_peek(&len)) {
+            g_bluetooth_tx.busy = false;
+            /* writer may have finished a record after the peek above and seen busy set */
+            if (!usbh_bluetooth_tx_peek(&len)) {
+                return;
+            }
+            continue;
+        }
+
+        chry_ringbuffer_drop(&g_bluetooth_tx.rb, sizeof(uint16_t));
+        chry_ringbuffer_read(&g_bluetooth_tx.rb, g_bluetooth_tx_buf, len);
+        usb_osal_sem_give(g_bluetooth_tx.sem);
+
+        usbh_bulk_urb_fill(urb, bluetooth_class->hport, bluetooth_class->bulkout, g_bluetooth_tx_buf, len, 0, usbh_bluetooth_tx_complete, NULL);
+        ret = usbh_submit_urb(urb);
+        if (ret < 0) {
+            g_bluetooth_stat.tx_errors++;
+            g_bluetooth_tx.busy = false;
+            continue;
+        }
+        return;
+    }
+}
+
+static void usbh_bluetooth_tx_complete(void *arg, int nbytes)
+{
+    (void)arg;
+
+    if (nbytes < 0) {
+        if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN)) {
+            return;
+        }
+        g_bluetooth_stat.tx_errors++;
+    } else {
+        g_bluetooth_stat.tx_packets++;
+    }
+
+    g_bluetooth_tx.busy = false;
+    usbh_bluetooth_tx_start();
+}
+
+/* Queue one packet for bulk out, h4_type is put in front of packet unless it is USB_BLUETOOTH_HCI_NONE */
+static int usbh_bluetooth_tx_queue(uint8_t h4_type, uint8_t *buffer, uint32_t buflen)
+{
+    uint16_t len = buflen + ((h4_type != USB_BLUETOOTH_HCI_NONE) ? 1 : 0);
+    int ret = 0;
+
+    if (!g_bluetooth_running) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    if ((len > CONFIG_USBHOST_BLUETOOTH_TX_SIZE) || ((sizeof(uint16_t) + len) > CONFIG_USBHOST_BLUETOOTH_TX_RINGSIZE)) {
+        return -USB_ERR_INVAL;
+    }
+
+    usb_osal_mutex_take(g_bluetooth_tx.mutex);
+    while (chry_ringbuffer_get_free(&g_bluetooth_tx.rb) < (sizeof(uint16_t) + len)) {
+        if (!g_bluetooth_running) {
+            ret = -USB_ERR_NOTCONN;
+            break;
+        }
+        ret = usb_osal_sem_take(g_bluetooth_tx.sem, USB_OSAL_WAITING_FOREVER);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        chry_ringbuffer_write(&g_bluetooth_tx.rb, &len, sizeof(uint16_t));
+        if (h4_type != USB_BLUETOOTH_HCI_NONE) {
+            chry_ringbuffer_write(&g_bluetooth_tx.rb, &h4_type, 1);
+        }
+        chry_ringbuffer_write(&g_bluetooth_tx.rb, buffer, buflen);
+    }
+    usb_osal_mutex_give(g_bluetooth_tx.mutex);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    usbh_bluetooth_tx_start();
+    return buflen;
+}
+
+#if !defined(CONFIG_USBHOST_BLUETOOTH_HCI_H4) && defined(CONFIG_USBHOST_BLUETOOTH_SCO)
+static struct usbh_urb *usbh_bluetooth_sco_urb_alloc(void)
+{
+    struct usbh_urb *urb;
+    size_t urb_size;
+
+    urb_size = sizeof(struct usbh_urb) + CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS * sizeof(struct usbh_iso_frame_packet);
+    urb = usb_osal_malloc(urb_size);
+    if (urb == NULL) {
+        return NULL;
+    }
+    memset(urb, 0, urb_size);
+#if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
+    urb->iso_packet = (struct usbh_iso_frame_packet *)(urb + 1);
+#endif
+    return urb;
+}
+
+static void usbh_bluetooth_sco_in_complete(void *arg, int nbytes);
+static void usbh_bluetooth_sco_out_complete(void *arg, int nbytes);
+
+static void usbh_bluetooth_sco_fill(struct usbh_urb *urb, struct usb_endpoint_descriptor *ep, uint8_t *buf)
+{
+    struct usbh_hubport *hport = g_bluetooth_class.hport;
+    uint32_t mps = USB_GET_MAXPACKETSIZE(ep->wMaxPacketSize);
+    uint32_t total = 0;
+    uint32_t len;
+
+    urb->hport = hport;
+    urb->ep = ep;
+    urb->setup = NULL;
+    urb->transfer_buffer = buf;
+    urb->actual_length = 0;
+    urb->timeout = 0;
+    urb->arg = urb;
+    urb->interval = USBH_GET_URB_INTERVAL(ep->bInterval, hport->speed);
+    urb->num_of_iso_packets = CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS;
+
+    for (uint32_t i = 0; i < CONFIG_USBHOST_BLUETOOTH_SCO_ISO_PACKETS; i++) {
+        if (ep->bEndpointAddress & 0x80) {
+            urb->complete = usbh_bluetooth_sco_in_complete;
+            len = mps;
+        } else {
+            /* controller rebuilds sco packets from headers, so ring bytes are cut at mps */
+            urb->complete = usbh_bluetooth_sco_out_complete;
+            len = chry_ringbuffer_read(&g_bluetooth_sco_tx_rb, &buf[i * USBH_BLUETOOTH_SCO_MPS], mps);
+            if (len == 0) {
+                g_bluetooth_stat.sco_underruns++;
+            }
+        }
+
+        urb->iso_packet[i].transfer_buffer = &buf[i * USBH_BLUETOOTH_SCO_MPS];
+        urb->iso_packet[i].transfer_buffer_length = len;
+        urb->iso_packet[i].actual_length = 0;
+        urb->iso_packet[i].errorcode = 0;
+        total += len;
+    }
+    urb->transfer_buffer_length = total;
+}
+
+static void usbh_bluetooth_sco_in_complete(void *arg, int nbytes)
+{
+    struct usbh_urb *urb = (struct usbh_urb *)arg;
+
+    if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN) || !g_bluetooth_sco_running) {
+        return;
+    }
+
+    if (nbytes < 0) {
+        g_bluetooth_stat.rx_errors++;
+        usbh_bluetooth_rx_reset(&g_bluetooth_sco_rx);
+    } else {
+        for (uint32_t i = 0; i < urb->num_of_iso_packets; i++) {
+            if (urb->iso_packet[i].errorcode < 0) {
+                /* lost bytes break header lengths, start over with next packet */
+                g_bluetooth_stat.rx_errors++;
+                usbh_bluetooth_rx_reset(&g_bluetooth_sco_rx);
+                continue;
+            }
+            usbh_bluetooth_rx_feed(&g_bluetooth_sco_rx, urb->iso_packet[i].transfer_buffer, urb->iso_packet[i].actual_length);
+        }
+    }
+
+    usbh_bluetooth_sco_fill(urb, urb->ep, urb->transfer_buffer);
+    usbh_submit_urb(urb);
+}
+
+static void usbh_bluetooth_sco_out_complete(void *arg, int nbytes)
+{
+    struct usbh_urb *urb = (struct usbh_urb *)arg;
+
+    if ((nbytes == -USB_ERR_SHUTDOWN) || (nbytes == -USB_ERR_NOTCONN) || !g_bluetooth_sco_running) {
+        return;
+    }
+
+    usbh_bluetooth_sco_fill(urb, urb->ep, urb->transfer_buffer);
+    usbh_submit_urb(urb);
+}
+
+static void usbh_bluetooth_sco_stop(struct usbh_bluetooth *bluetooth_class)
+{
+    g_bluetooth_sco_running = false;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (bluetooth_class->isoin_urb[i]) {
+            usbh_kill_urb(bluetooth_class->isoin_urb[i]);
+        }
+        if (bluetooth_class->isoout_urb[i]) {
+            usbh_kill_urb(bluetooth_class->isoout_urb[i]);
+        }
+    }
+    bluetooth_class->isoin = NULL;
+    bluetooth_class->isoout = NULL;
+}
+
+static void usbh_bluetooth_sco_free(struct usbh_bluetooth *bluetooth_class)
+{
+    usbh_bluetooth_sco_stop(bluetooth_class);
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (bluetooth_class->isoin_urb[i]) {
+            usb_osal_free(bluetooth_class->isoin_urb[i]);
+            bluetooth_class->isoin_urb[i] = NULL;
+        }
+        if (bluetooth_class->isoout_urb[i]) {
+            usb_osal_free(bluetooth_class->isoout_urb[i]);
+            bluetooth_class->isoout_urb[i] = NULL;
+        }
+    }
+}
+
+/* Same altsetting choice as core specification table for usb transport, 3 links at most */
+static uint8_t usbh_bluetooth_sco_altsetting(uint8_t sco_num, uint16_t voice_setting)
+{
+    static const uint8_t alts_16bit[3] = { 2, 4, 5 };
+
+    if (sco_num == 0) {
+        return 0;
+    }
+    if (sco_num > 3) {
+        sco_num = 3;
+    }
+
+    if ((voice_setting & 0x0003) == 0x0003) {
+        /* transparent air coding such as msbc, one 8 bit slot per link */
+        return 1;
+    }
+    if (voice_setting & 0x0020) {
+        return alts_16bit[sco_num - 1];
+    }
+    return sco_num;
+}
+
+int usbh_bluetooth_sco_set(uint8_t sco_num, uint16_t voice_setting)
+{
+    struct usbh_bluetooth *bluetooth_class = &g_bluetooth_class;
+    struct usb_endpoint_descriptor *ep_desc;
+    struct usbh_interface_altsetting *altsetting;
+    uint8_t alt;
+    int ret;
+
+    if (!bluetooth_class->hport || !g_bluetooth_running) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    if (bluetooth_class->num_of_intf_altsettings < 2) {
+        return -USB_ERR_NOTSUPP;
+    }
+
+    alt = usbh_bluetooth_sco_altsetting(sco_num, voice_setting);
+    if (alt >= bluetooth_class->num_of_intf_altsettings) {
+        alt = bluetooth_class->num_of_intf_altsettings - 1;
+    }
+
+    if ((alt == bluetooth_class->sco_altsetting) && ((alt == 0) || g_bluetooth_sco_running)) {
+        return 0;
+    }
+
+    usbh_bluetooth_sco_stop(bluetooth_class);
+
+    ret = usbh_set_interface(bluetooth_class->hport, bluetooth_class->intf + 1, alt);
+    if (ret < 0) {
+        return ret;
+    }
+    bluetooth_class->sco_altsetting = alt;
+    USB_LOG_INFO("Bluetooth select sco altsetting %u\r\n", alt);
+
+    if (alt == 0) {
+        return 0;
+    }
+
+    altsetting = &bluetooth_class->hport->config.intf[bluetooth_class->intf + 1].altsetting[alt];
+    for (uint8_t i = 0; i < altsetting->intf_desc.bNumEndpoints; i++) {
+        ep_desc = &altsetting->ep[i].ep_desc;
+        if (USB_GET_ENDPOINT_TYPE(ep_desc->bmAttributes) != USB_ENDPOINT_TYPE_ISOCHRONOUS) {
+            continue;
+        }
+        if (USB_GET_MAXPACKETSIZE(ep_desc->wMaxPacketSize) > USBH_BLUETOOTH_SCO_MPS) {
+            return -USB_ERR_NOTSUPP;
+        }
+        if (ep_desc->bEndpointAddress & 0x80) {
+            bluetooth_class->isoin = ep_desc;
+        } else {
+            bluetooth_class->isoout = ep_desc;
+        }
+    }
+
+    if (!bluetooth_class->isoin || !bluetooth_class->isoout) {
+        return -USB_ERR_NODEV;
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (!bluetooth_class->isoin_urb[i]) {
+            bluetooth_class->isoin_urb[i] = usbh_bluetooth_sco_urb_alloc();
+        }
+        if (!bluetooth_class->isoout_urb[i]) {
+            bluetooth_class->isoout_urb[i] = usbh_bluetooth_sco_urb_alloc();
+        }
+        if (!bluetooth_class->isoin_urb[i] || !bluetooth_class->isoout_urb[i]) {
+            return -USB_ERR_NOMEM;
+        }
+    }
+
+    usbh_bluetooth_rx_reset(&g_bluetooth_sco_rx);
+    g_bluetooth_sco_running = true;
+
+    /* iso has no data toggle, so two urbs per direction are kept queued */
+    for (uint8_t i = 0; i < 2; i++) {
+        usbh_bluetooth_sco_fill(bluetooth_class->isoin_urb[i], bluetooth_class->isoin, g_bluetooth_sco_buf[0][i]);
+        ret = usbh_submit_urb(bluetooth_class->isoin_urb[i]);
+        if (ret < 0) {
+            goto errout;
+        }
+        usbh_bluetooth_sco_fill(bluetooth_class->isoout_urb[i], bluetooth_class->isoout, g_bluetooth_sco_buf[1][i]);
+        ret = usbh_submit_urb(bluetooth_class->isoout_urb[i]);
+        if (ret < 0) {
+            goto errout;
+        }
+    }
+    return 0;
+
+errout:
+    USB_LOG_ERR("usbh_submit_urb failed: %d\r\n", ret);
+    usbh_bluetooth_sco_stop(bluetooth_class);
+    return ret;
+}
 #endif
 
 static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
@@ -41,6 +771,12 @@ static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
     }
 #endif
 
+    ret = usbh_bluetooth_init();
+    if (ret < 0) {
+        USB_LOG_ERR("Fail to init bluetooth\r\n");
+        return ret;
+    }
+
     memset(bluetooth_class, 0, sizeof(struct usbh_bluetooth));
 
     bluetooth_class->hport = hport;
@@ -95,7 +831,26 @@ static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
         return ret;
     }
     USB_LOG_INFO("Bluetooth select altsetting 0\r\n");
+
+    usbh_bluetooth_rx_setup(&g_bluetooth_evt_rx, USB_BLUETOOTH_HCI_EVT, g_bluetooth_evt_packet, sizeof(g_bluetooth_evt_packet),
+                            g_bluetooth_evt_pool, sizeof(g_bluetooth_evt_pool), &g_bluetooth_evt_sem);
+    usbh_bluetooth_rx_setup(&g_bluetooth_acl_rx, USB_BLUETOOTH_HCI_ACL, g_bluetooth_acl_packet, sizeof(g_bluetooth_acl_packet),
+                            g_bluetooth_acl_pool, sizeof(g_bluetooth_acl_pool), &g_bluetooth_acl_sem);
+#ifdef CONFIG_USBHOST_BLUETOOTH_SCO
+    /* sco packets are delivered by acl rx thread */
+    usbh_bluetooth_rx_setup(&g_bluetooth_sco_rx, USB_BLUETOOTH_HCI_SCO, g_bluetooth_sco_packet, sizeof(g_bluetooth_sco_packet),
+                            g_bluetooth_sco_rx_pool, sizeof(g_bluetooth_sco_rx_pool), &g_bluetooth_acl_sem);
+    chry_ringbuffer_init(&g_bluetooth_sco_tx_rb, g_bluetooth_sco_tx_pool, sizeof(g_bluetooth_sco_tx_pool));
 #endif
+#else
+    usbh_bluetooth_rx_setup(&g_bluetooth_acl_rx, USB_BLUETOOTH_HCI_NONE, g_bluetooth_acl_packet, sizeof(g_bluetooth_acl_packet),
+                            g_bluetooth_acl_pool, sizeof(g_bluetooth_acl_pool), &g_bluetooth_acl_sem);
+#endif
+    chry_ringbuffer_init(&g_bluetooth_tx.rb, g_bluetooth_tx_pool, sizeof(g_bluetooth_tx_pool));
+    g_bluetooth_tx.busy = false;
+    memset(&g_bluetooth_stat, 0, sizeof(struct usbh_bluetooth_stat));
+    g_bluetooth_running = true;
+
     strncpy(hport->config.intf[intf].devname, DEV_FORMAT, CONFIG_USBHOST_DEV_NAMELEN);
     USB_LOG_INFO("Register Bluetooth Class:%s\r\n", hport->config.intf[intf].devname);
     usbh_bluetooth_run(bluetooth_class);
@@ -104,6 +859,7 @@ static int usbh_bluetooth_connect(struct usbh_hubport *hport, uint8_t intf)
 
 static int usbh_bluetooth_disconnect(struct usbh_hubport *hport, uint8_t intf)
 {
+    size_t flags;
     int ret = 0;
 
     struct usbh_bluetooth *bluetooth_class = (struct usbh_bluetooth *)hport->config.intf[intf].priv;
@@ -113,6 +869,11 @@ static int usbh_bluetooth_disconnect(struct usbh_hubport *hport, uint8_t intf)
     }
 
     if (bluetooth_class) {
+        flags = usb_osal_enter_critical_section();
+        g_bluetooth_running = false;
+        usb_osal_leave_critical_section(flags);
+        g_bluetooth_acl_rx.running = false;
+
         if (bluetooth_class->bulkin) {
             usbh_kill_urb(&bluetooth_class->bulkin_urb);
         }
@@ -121,18 +882,27 @@ static int usbh_bluetooth_disconnect(struct usbh_hubport *hport, uint8_t intf)
             usbh_kill_urb(&bluetooth_class->bulkout_urb);
         }
 #ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+        g_bluetooth_evt_rx.running = false;
         if (bluetooth_class->intin) {
             usbh_kill_urb(&bluetooth_class->intin_urb);
         }
-
-        // if (bluetooth_class->isoin) {
-        //     usbh_kill_urb(&bluetooth_class->isoin_urb);
-        // }
-
-        // if (bluetooth_class->isoin) {
-        //     usbh_kill_urb(&bluetooth_class->isoinin_urb);
-        // }
+#ifdef CONFIG_USBHOST_BLUETOOTH_SCO
+        usbh_bluetooth_sco_free(bluetooth_class);
 #endif
+#endif
+        /* wake rx threads and blocked writers, they see the class is gone */
+        if (g_bluetooth_tx.mutex) {
+            usb_osal_sem_give(g_bluetooth_tx.sem);
+            usb_osal_sem_give(g_bluetooth_acl_sem);
+#ifndef CONFIG_USBHOST_BLUETOOTH_HCI_H4
+            usb_osal_sem_give(g_bluetooth_evt_sem);
+#endif
+        }
+        /* rx threads use the class state until they leave, do not clear it under them */
+        while (g_bluetooth_threads) {
+            usb_osal_msleep(1);
+        }
+
         if (hport->config.intf[intf].devname[0] != '\0') {
             usb_osal_thread_schedule_other();
             USB_LOG_INFO("Unregister Bluetooth Class:%s\r\n", hport->config.intf[intf].devname);
@@ -145,90 +915,31 @@ static int usbh_bluetooth_disconnect(struct usbh_hubport *hport, uint8_t intf)
     return ret;
 }
 
-#ifdef CONFIG_USBHOST_BLUETOOTH_HCI_LOG
-static void usbh_bluetooth_hci_dump(uint8_t *data, uint32_t len)
-{
-    uint32_t i = 0;
-
-    for (i = 0; i < len; i++) {
-        if (i % 16 == 0) {
-            USB_LOG_RAW("\r\n");
-        }
-
-        USB_LOG_RAW("%02x ", data[i]);
-    }
-
-    USB_LOG_RAW("\r\n");
-}
-#else
-#define usbh_bluetooth_hci_dump(data, len)
-#endif
-
-static int usbh_bluetooth_hci_bulk_out(uint8_t *buffer, uint32_t buflen)
-{
-    struct usbh_bluetooth *bluetooth_class = &g_bluetooth_class;
-    struct usbh_urb *urb = &bluetooth_class->bulkout_urb;
-    int ret;
-
-    usbh_bulk_urb_fill(urb, bluetooth_class->hport, bluetooth_class->bulkout, buffer, buflen, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-    ret = usbh_submit_urb(urb);
-    if (ret == 0) {
-        ret = urb->actual_length;
-    }
-    return ret;
-}
-
 #ifdef CONFIG_USBHOST_BLUETOOTH_HCI_H4
 int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 {
-    int ret;
-
-    g_bluetooth_tx_buf[0] = hci_type;
-    memcpy(&g_bluetooth_tx_buf[1], buffer, buflen);
-    usbh_bluetooth_hci_dump(g_bluetooth_tx_buf, buflen + 1);
-    ret = usbh_bluetooth_hci_bulk_out(g_bluetooth_tx_buf, buflen + 1);
-    return ret;
+    usbh_bluetooth_hci_dump(buffer, buflen);
+    return usbh_bluetooth_tx_queue(hci_type, buffer, buflen);
 }
 
 void usbh_bluetooth_hci_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
-
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.bulkin->wMaxPacketSize);
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
 
+    if (!usbh_bluetooth_thread_enter()) {
+        usb_osal_thread_delete(NULL);
+        return;
+    }
     USB_LOG_INFO("Create hc rx thread\r\n");
-    while (1) {
-        usbh_bulk_urb_fill(&g_bluetooth_class.bulkin_urb, g_bluetooth_class.hport, g_bluetooth_class.bulkin, &g_bluetooth_rx_buf[actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.bulkin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.bulkin_urb.actual_length;
-        if (g_bluetooth_class.bulkin_urb.actual_length != ep_mps) {
-            usbh_bluetooth_hci_dump(g_bluetooth_rx_buf, actual_len);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_rx_buf, actual_len);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
+
+    if (usbh_bluetooth_rx_start(&g_bluetooth_acl_rx, &g_bluetooth_class.bulkin_urb, g_bluetooth_class.bulkin,
+                                g_bluetooth_rx_buf[0], g_bluetooth_rx_buf[1], CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE, false) == 0) {
+        usbh_bluetooth_rx_loop(g_bluetooth_acl_sem, &g_bluetooth_acl_rx, NULL, g_bluetooth_acl_dispatch);
     }
-    // clang-format off
-delete :
-    USB_LOG_INFO("Delete hc acl rx thread\r\n");
+
+    USB_LOG_INFO("Delete hc rx thread\r\n");
+    usbh_bluetooth_thread_leave();
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 
 #else
@@ -255,16 +966,28 @@ int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 {
     int ret;
 
+    usbh_bluetooth_hci_dump(buffer, buflen);
+
     if (hci_type == USB_BLUETOOTH_HCI_CMD) {
-        g_bluetooth_cmd_buf[0] = USB_BLUETOOTH_HCI_CMD;
-        memcpy(&g_bluetooth_cmd_buf[1], buffer, buflen);
-        usbh_bluetooth_hci_dump(g_bluetooth_cmd_buf, buflen + 1);
-        ret = usbh_bluetooth_hci_cmd(&g_bluetooth_cmd_buf[1], buflen);
+        if (buflen > sizeof(g_bluetooth_cmd_buf)) {
+            return -USB_ERR_INVAL;
+        }
+        memcpy(g_bluetooth_cmd_buf, buffer, buflen);
+        ret = usbh_bluetooth_hci_cmd(g_bluetooth_cmd_buf, buflen);
     } else if (hci_type == USB_BLUETOOTH_HCI_ACL) {
-        g_bluetooth_tx_buf[0] = USB_BLUETOOTH_HCI_ACL;
-        memcpy(&g_bluetooth_tx_buf[1], buffer, buflen);
-        usbh_bluetooth_hci_dump(g_bluetooth_tx_buf, buflen + 1);
-        ret = usbh_bluetooth_hci_bulk_out(&g_bluetooth_tx_buf[1], buflen);
+        ret = usbh_bluetooth_tx_queue(USB_BLUETOOTH_HCI_NONE, buffer, buflen);
+#ifdef CONFIG_USBHOST_BLUETOOTH_SCO
+    } else if (hci_type == USB_BLUETOOTH_HCI_SCO) {
+        /* single writer, dropped rather than delayed when iso out can not keep up */
+        if (!g_bluetooth_sco_running) {
+            ret = -USB_ERR_NOTCONN;
+        } else if (chry_ringbuffer_get_free(&g_bluetooth_sco_tx_rb) < buflen) {
+            ret = -USB_ERR_BUSY;
+        } else {
+            chry_ringbuffer_write(&g_bluetooth_sco_tx_rb, buffer, buflen);
+            ret = buflen;
+        }
+#endif
     } else {
         ret = -1;
     }
@@ -274,96 +997,58 @@ int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen)
 
 void usbh_bluetooth_hci_evt_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint32_t interval;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
+    uint32_t size;
 
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.intin->wMaxPacketSize);
-    interval = g_bluetooth_class.intin->bInterval;
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
 
+    if (!usbh_bluetooth_thread_enter()) {
+        usb_osal_thread_delete(NULL);
+        return;
+    }
     USB_LOG_INFO("Create hc event rx thread\r\n");
-    while (1) {
-        usbh_int_urb_fill(&g_bluetooth_class.intin_urb, g_bluetooth_class.hport, g_bluetooth_class.intin, &g_bluetooth_evt_buf[1 + actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.intin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else if (ret == -USB_ERR_NAK) {
-                usb_osal_msleep(interval);
-                continue;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                usb_osal_msleep(interval);
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.intin_urb.actual_length;
-        if (g_bluetooth_class.intin_urb.actual_length != ep_mps) {
-            g_bluetooth_evt_buf[0] = USB_BLUETOOTH_HCI_EVT;
-            usbh_bluetooth_hci_dump(g_bluetooth_evt_buf, actual_len + 1);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_evt_buf, actual_len + 1);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
-        usb_osal_msleep(interval);
+
+    size = MIN(USB_GET_MAXPACKETSIZE(g_bluetooth_class.intin->wMaxPacketSize), USBH_BLUETOOTH_EVT_URB_SIZE);
+    if (usbh_bluetooth_rx_start(&g_bluetooth_evt_rx, &g_bluetooth_class.intin_urb, g_bluetooth_class.intin,
+                                g_bluetooth_evt_buf[0], g_bluetooth_evt_buf[1], size, true) == 0) {
+        usbh_bluetooth_rx_loop(g_bluetooth_evt_sem, &g_bluetooth_evt_rx, NULL, g_bluetooth_evt_dispatch);
     }
-    // clang-format off
-delete :
+
     USB_LOG_INFO("Delete hc event rx thread\r\n");
+    usbh_bluetooth_thread_leave();
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 
 void usbh_bluetooth_hci_acl_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
-    int ret;
-    uint32_t ep_mps;
-    uint8_t retry = 0;
-    uint16_t actual_len = 0;
+    struct usbh_bluetooth_rx *sco_rx = NULL;
 
-    ep_mps = USB_GET_MAXPACKETSIZE(g_bluetooth_class.bulkin->wMaxPacketSize);
+    (void)CONFIG_USB_OSAL_THREAD_GET_ARGV;
 
+    if (!usbh_bluetooth_thread_enter()) {
+        usb_osal_thread_delete(NULL);
+        return;
+    }
     USB_LOG_INFO("Create hc acl rx thread\r\n");
-    while (1) {
-        usbh_bulk_urb_fill(&g_bluetooth_class.bulkin_urb, g_bluetooth_class.hport, g_bluetooth_class.bulkin, &g_bluetooth_rx_buf[1 + actual_len], ep_mps, USB_OSAL_WAITING_FOREVER, NULL, NULL);
-        ret = usbh_submit_urb(&g_bluetooth_class.bulkin_urb);
-        if (ret < 0) {
-            if (ret == -USB_ERR_SHUTDOWN) {
-                goto delete;
-            } else {
-                retry++;
-                if (retry == 3) {
-                    retry = 0;
-                    goto delete;
-                }
-                continue;
-            }
-        }
-        actual_len += g_bluetooth_class.bulkin_urb.actual_length;
-        if (g_bluetooth_class.bulkin_urb.actual_length != ep_mps) {
-            g_bluetooth_rx_buf[0] = USB_BLUETOOTH_HCI_ACL;
-            usbh_bluetooth_hci_dump(g_bluetooth_rx_buf, actual_len + 1);
-            usbh_bluetooth_hci_read_callback(g_bluetooth_rx_buf, actual_len + 1);
-            actual_len = 0;
-        } else {
-            /* read continue util read short packet */
-        }
+
+#ifdef CONFIG_USBHOST_BLUETOOTH_SCO
+    sco_rx = &g_bluetooth_sco_rx;
+#endif
+    if (usbh_bluetooth_rx_start(&g_bluetooth_acl_rx, &g_bluetooth_class.bulkin_urb, g_bluetooth_class.bulkin,
+                                g_bluetooth_rx_buf[0], g_bluetooth_rx_buf[1], CONFIG_USBHOST_BLUETOOTH_RX_URB_SIZE, false) == 0) {
+        usbh_bluetooth_rx_loop(g_bluetooth_acl_sem, &g_bluetooth_acl_rx, sco_rx, g_bluetooth_acl_dispatch);
     }
-    // clang-format off
-delete :
+
     USB_LOG_INFO("Delete hc acl rx thread\r\n");
+    usbh_bluetooth_thread_leave();
     usb_osal_thread_delete(NULL);
-    // clang-format on
 }
 #endif
 
+void usbh_bluetooth_get_stat(struct usbh_bluetooth_stat *stat)
+{
+    memcpy(stat, &g_bluetooth_stat, sizeof(struct usbh_bluetooth_stat));
+}
+
 __WEAK void usbh_bluetooth_hci_read_callback(uint8_t *data, uint32_t len)
 {
     (void)data;
@@ -13,6 +13,15 @@
 #define USB_BLUETOOTH_HCI_EVT  0x04
 #define USB_BLUETOOTH_HCI_ISO  0x05
 
+struct usbh_bluetooth_stat {
+    uint32_t rx_packets;    /* hci packets delivered to usbh_bluetooth_hci_read_callback */
+    uint32_t rx_drops;      /* packets dropped because rx ring was full or packet was too large */
+    uint32_t rx_errors;     /* urbs completed with error, or unknown h4 packet type */
+    uint32_t tx_packets;    /* packets completed on bulk out */
+    uint32_t tx_errors;     /* bulk out urbs completed with error */
+    uint32_t sco_underruns; /* iso out packets sent empty because sco tx ring had no data */
+};
+
 struct usbh_bluetooth {
     struct usbh_hubport *hport;
     uint8_t intf;
@@ -25,9 +34,10 @@ struct usbh_bluetooth {
     struct usb_endpoint_descriptor *isoin;  /* Bulk IN endpoint */
     struct usb_endpoint_descriptor *isoout; /* Bulk OUT endpoint */
     struct usbh_urb intin_urb;              /* INTR IN urb */
-    struct usbh_urb *isoin_urb;             /* Bulk IN urb */
-    struct usbh_urb *isoout_urb;            /* Bulk OUT urb */
+    struct usbh_urb *isoin_urb[2];          /* ISO IN urbs */
+    struct usbh_urb *isoout_urb[2];         /* ISO OUT urbs */
     uint8_t num_of_intf_altsettings;
+    uint8_t sco_altsetting;
 #endif
 
     void *user_data;
@@ -37,6 +47,15 @@ struct usbh_bluetooth {
 extern "C" {
 #endif
 
+/**
+ * @brief Send one hci packet.
+ *
+ * Acl packets (and every packet in h4 mode) are copied into tx ring and sent back to back from bulk out
+ * complete callback, this only blocks while ring is full. Commands are sent on control endpoint.
+ * Sco packets are copied into sco tx ring, -USB_ERR_BUSY is returned when it is full.
+ *
+ * @return buflen on success, negative value on fail.
+ */
 int usbh_bluetooth_hci_write(uint8_t hci_type, uint8_t *buffer, uint32_t buflen);
 void usbh_bluetooth_hci_read_callback(uint8_t *data, uint32_t len);
 #ifdef CONFIG_USBHOST_BLUETOOTH_HCI_H4
@@ -49,6 +68,20 @@ void usbh_bluetooth_hci_acl_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 void usbh_bluetooth_run(struct usbh_bluetooth *bluetooth_class);
 void usbh_bluetooth_stop(struct usbh_bluetooth *bluetooth_class);
 
+void usbh_bluetooth_get_stat(struct usbh_bluetooth_stat *stat);
+
+#if !defined(CONFIG_USBHOST_BLUETOOTH_HCI_H4) && defined(CONFIG_USBHOST_BLUETOOTH_SCO)
+/**
+ * @brief Select isochronous altsetting for active sco links and start streaming, call it when a
+ * synchronous connection is completed or disconnected.
+ *
+ * @param sco_num number of active sco links, 0 stops streaming.
+ * @param voice_setting hci voice setting, input sample size and air coding select altsetting.
+ * @return On success will return 0, and others indicate fail.
+ */
+int usbh_bluetooth_sco_set(uint8_t sco_num, uint16_t voice_setting);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
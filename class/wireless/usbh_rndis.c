@@ -5,6 +5,8 @@
  */
 #include "usbh_core.h"
 #include "usbh_rndis.h"
+#include "usbh_net_rxbuf.h"
+#include "usbh_net_txq.h"
 #include "rndis_protocol.h"
 
 #undef USB_DBG_TAG
@@ -18,10 +20,18 @@ USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_buf[512];
 #define CONFIG_USBHOST_RNDIS_ETH_MAX_FRAME_SIZE 1514
 #define CONFIG_USBHOST_RNDIS_ETH_MSG_SIZE       (CONFIG_USBHOST_RNDIS_ETH_MAX_FRAME_SIZE + 44)
 
+#if defined(CONFIG_USBHOST_NET_RXBUF) && (CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE > CONFIG_USBHOST_NET_RXBUF_SIZE)
+#warning "CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE is larger than CONFIG_USBHOST_NET_RXBUF_SIZE, rndis rx frames are copied"
+#endif
+
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_rx_buffer[USB_ALIGN_UP(CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE, CONFIG_USB_ALIGN_SIZE)];
 static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_tx_buffer[USB_ALIGN_UP(CONFIG_USBHOST_RNDIS_ETH_MAX_TX_SIZE, CONFIG_USB_ALIGN_SIZE)];
 // static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_rndis_inttx_buffer[USB_ALIGN_UP(16, CONFIG_USB_ALIGN_SIZE)];
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+static struct usbh_net_txq g_rndis_txq;
+#endif
+
 static struct usbh_rndis g_rndis_class;
 
 static int usbh_rndis_get_notification(struct usbh_rndis *rndis_class)
@@ -406,6 +416,9 @@ static int usbh_rndis_connect(struct usbh_hubport *hport, uint8_t intf)
     strncpy(hport->config.intf[intf].devname, DEV_FORMAT, CONFIG_USBHOST_DEV_NAMELEN);
 
     USB_LOG_INFO("Register RNDIS Class:%s\r\n", hport->config.intf[intf].devname);
+#ifdef CONFIG_USBHOST_NET_TXQ
+    usbh_net_txq_init(&g_rndis_txq, &rndis_class->bulkout_urb, hport, rndis_class->bulkout);
+#endif
     usbh_rndis_run(rndis_class);
     return ret;
 query_errorout:
@@ -426,6 +439,9 @@ static int usbh_rndis_disconnect(struct usbh_hubport *hport, uint8_t intf)
 
         if (rndis_class->bulkout) {
             usbh_kill_urb(&rndis_class->bulkout_urb);
+#ifdef CONFIG_USBHOST_NET_TXQ
+            usbh_net_txq_flush(&g_rndis_txq);
+#endif
         }
 
         // if (rndis_class->intin) {
@@ -447,6 +463,7 @@ static int usbh_rndis_disconnect(struct usbh_hubport *hport, uint8_t intf)
 void usbh_rndis_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
 {
     uint32_t g_rndis_rx_length;
+    uint8_t *rx_buffer = NULL;
     int ret;
     uint32_t pmg_offset;
     rndis_data_packet_t *pmsg;
@@ -479,7 +496,10 @@ find_class:
 
     g_rndis_rx_length = 0;
     while (1) {
-        usbh_bulk_urb_fill(&g_rndis_class.bulkin_urb, g_rndis_class.hport, g_rndis_class.bulkin, &g_rndis_rx_buffer[g_rndis_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
+        if (g_rndis_rx_length == 0) {
+            rx_buffer = usbh_net_rxbuf_renew(rx_buffer, g_rndis_rx_buffer, CONFIG_USBHOST_RNDIS_ETH_MAX_RX_SIZE);
+        }
+        usbh_bulk_urb_fill(&g_rndis_class.bulkin_urb, g_rndis_class.hport, g_rndis_class.bulkin, &rx_buffer[g_rndis_rx_length], transfer_size, USB_OSAL_WAITING_FOREVER, NULL, NULL);
         ret = usbh_submit_urb(&g_rndis_class.bulkin_urb);
         if (ret < 0) {
             break;
@@ -499,7 +519,7 @@ find_class:
             while (g_rndis_rx_length > 0) {
                 USB_LOG_DBG("rxlen:%u\r\n", (unsigned int)g_rndis_rx_length);
 
-                pmsg = (rndis_data_packet_t *)(g_rndis_rx_buffer + pmg_offset);
+                pmsg = (rndis_data_packet_t *)(rx_buffer + pmg_offset);
 
                 /* Not word-aligned case */
                 if (pmg_offset & 0x3) {
@@ -508,7 +528,7 @@ find_class:
                 }
 
                 if (pmsg->MessageType == REMOTE_NDIS_PACKET_MSG) {
-                    uint8_t *buf = (uint8_t *)(g_rndis_rx_buffer + pmg_offset + sizeof(rndis_generic_msg_t) + pmsg->DataOffset);
+                    uint8_t *buf = (uint8_t *)(rx_buffer + pmg_offset + sizeof(rndis_generic_msg_t) + pmsg->DataOffset);
 
                     usbh_rndis_eth_input(buf, pmsg->DataLength);
                     pmg_offset += pmsg->MessageLength;
@@ -539,6 +559,7 @@ find_class:
 
     // clang-format off
 delete:
+    usbh_net_rxbuf_free(rx_buffer);
     USB_LOG_INFO("Delete rndis rx thread\r\n");
     usb_osal_thread_delete(NULL);
     // clang-format on
@@ -578,6 +599,41 @@ int usbh_rndis_eth_output(uint32_t buflen)
     return usbh_submit_urb(&g_rndis_class.bulkout_urb);
 }
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+/* glue reserves USBH_RNDIS_TX_HEADROOM before the frame for the packet message header */
+typedef char usbh_rndis_tx_headroom_check[(sizeof(rndis_data_packet_t) == USBH_RNDIS_TX_HEADROOM) ? 1 : -1];
+
+int usbh_rndis_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg)
+{
+    rndis_data_packet_t *hdr;
+    uint32_t len;
+
+    if (g_rndis_class.connect_status == false) {
+        return -USB_ERR_NOTCONN;
+    }
+
+    hdr = (rndis_data_packet_t *)(buf - USBH_RNDIS_TX_HEADROOM);
+    memset(hdr, 0, sizeof(rndis_data_packet_t));
+
+    hdr->MessageType = REMOTE_NDIS_PACKET_MSG;
+    hdr->MessageLength = sizeof(rndis_data_packet_t) + buflen;
+    hdr->DataOffset = sizeof(rndis_data_packet_t) - sizeof(rndis_generic_msg_t);
+    hdr->DataLength = buflen;
+
+    len = hdr->MessageLength;
+    /* same short packet byte as usbh_rndis_eth_output */
+    if (!(len % g_rndis_class.bulkout->wMaxPacketSize)) {
+        if (tailroom < 1) {
+            return -USB_ERR_NOMEM;
+        }
+        buf[buflen] = 0;
+        len += 1;
+    }
+
+    return usbh_net_txq_push(&g_rndis_txq, (uint8_t *)hdr, len, done, arg);
+}
+#endif
+
 __WEAK void usbh_rndis_run(struct usbh_rndis *rndis_class)
 {
     (void)rndis_class;
@@ -7,6 +7,10 @@
 #define USBH_RNDIS_H
 
 #include "usb_cdc.h"
+#include "usbh_net_txq.h"
+
+/* sizeof(rndis_data_packet_t) */
+#define USBH_RNDIS_TX_HEADROOM 44
 
 struct usbh_rndis {
     struct usbh_hubport *hport;
@@ -45,6 +49,9 @@ void usbh_rndis_stop(struct usbh_rndis *rndis_class);
 
 uint8_t *usbh_rndis_get_eth_txbuf(void);
 int usbh_rndis_eth_output(uint32_t buflen);
+/* Queue frame at buf without copy, USBH_RNDIS_TX_HEADROOM bytes before buf are overwritten by the driver header
+ * and must start CONFIG_USB_ALIGN_SIZE aligned, tailroom bytes after frame may be used for padding. done is called once sent */
+int usbh_rndis_eth_output_async(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg);
 void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen);
 void usbh_rndis_rx_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV);
 
@@ -719,6 +719,16 @@ struct usb_desc_header {
     0x04,                           /* bLength */     \
     USB_DESCRIPTOR_TYPE_STRING, /* bDescriptorType */ \
     WBVAL(id)                   /* wLangID0 */
+
+/* Define a string descriptor converted to UTF-16 at compile time from a string literal,
+ * needs C11 u"" literals and a little endian target, see string_descriptor_raw_callback */
+#define USB_STRING_DESCRIPTOR_DEFINE(name, str)                                               \
+    typedef char name##_too_long[(sizeof(u"" str) <= 0xff) ? 1 : -1];                         \
+    const struct {                                                                            \
+        uint8_t bLength;                                                                      \
+        uint8_t bDescriptorType;                                                              \
+        uint16_t wString[sizeof(u"" str) / 2 - 1];                                            \
+    } name = { sizeof(u"" str), USB_DESCRIPTOR_TYPE_STRING, u"" str }
 // clang-format on
 
 #endif /* USB_DEF_H */
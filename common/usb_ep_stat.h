@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USB_EP_STAT_H
+#define USB_EP_STAT_H
+
+#include <stdint.h>
+#include "usb_errno.h"
+#include "usb_osal.h"
+
+/* errors[] is indexed by -USB_ERR_* */
+#define USB_EP_STAT_ERR_NUM (USB_ERR_TIMEOUT + 1)
+
+struct usb_ep_stat {
+    uint8_t ep;              /* endpoint address */
+    uint32_t bytes;          /* payload of completed transfers, wraps */
+    uint32_t transfers;      /* transfers completed without error */
+    uint32_t short_packets;  /* transfers completed with less than requested */
+    uint32_t naks;           /* naks or retries reported by host controller, device controllers do not report them */
+    uint32_t errors[USB_EP_STAT_ERR_NUM];
+    uint32_t latency_min;    /* us from submit to completion of successful transfers, 0 without CONFIG_USB_EP_STAT_LATENCY */
+    uint32_t latency_max;
+    uint64_t latency_sum;    /* latency_sum / transfers is average */
+};
+
+static inline void usb_ep_stat_add(uint32_t *counter, uint32_t value)
+{
+#if defined(__GNUC__) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+#else
+    size_t flags = usb_osal_enter_critical_section();
+    *counter += value;
+    usb_osal_leave_critical_section(flags);
+#endif
+}
+
+/* Account one finished transfer, status is 0 or -USB_ERR_* and latency is us since submit */
+static inline void usb_ep_stat_complete(struct usb_ep_stat *stat, int status, uint32_t requested, uint32_t actual, uint32_t latency)
+{
+    if (status < 0) {
+        if (-status < USB_EP_STAT_ERR_NUM) {
+            usb_ep_stat_add(&stat->errors[-status], 1);
+        }
+        return;
+    }
+
+    usb_ep_stat_add(&stat->transfers, 1);
+    usb_ep_stat_add(&stat->bytes, actual);
+    if (actual < requested) {
+        usb_ep_stat_add(&stat->short_packets, 1);
+    }
+
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+    /* completions of one endpoint do not race, plain updates are enough */
+    if ((stat->latency_min == 0) || (latency < stat->latency_min)) {
+        stat->latency_min = latency;
+    }
+    if (latency > stat->latency_max) {
+        stat->latency_max = latency;
+    }
+    stat->latency_sum += latency;
+#else
+    (void)latency;
+#endif
+}
+
+#endif /* USB_EP_STAT_H */
@@ -28,6 +28,14 @@ struct usbh_iso_frame_packet {
     int errorcode;
 };
 
+/* urb transfer_flags */
+#define USBH_URB_BH            (1 << 0) /* run complete in a bottom half worker thread, needs CONFIG_USBHOST_URB_BH */
+#define USBH_URB_BH_QUEUED     (1 << 1) /* set by core while completion waits for a worker */
+#define USBH_URB_TIMEDOUT      (1 << 2) /* set by core when urb timer expires, kill reports -USB_ERR_TIMEOUT */
+#define USBH_URB_BH_PRIO_SHIFT 4
+#define USBH_URB_BH_PRIO_MASK  (0x0f << USBH_URB_BH_PRIO_SHIFT)
+#define USBH_URB_BH_PRIO(n)    (USBH_URB_BH | ((n) << USBH_URB_BH_PRIO_SHIFT)) /* worker n, worker 0 has highest priority */
+
 /**
  * @brief USB Urb Configuration.
  *
@@ -46,11 +54,22 @@ struct usbh_urb {
     int transfer_flags;
     uint32_t actual_length;
     uint32_t timeout;
+    uint32_t async_timeout; /* ms before an urb with complete is killed, 0 never, needs CONFIG_USBHOST_URB_TIMER */
     int errorcode;
     uint32_t num_of_iso_packets;
     uint32_t start_frame;
     usbh_complete_callback_t complete;
     void *arg;
+#ifdef CONFIG_USBHOST_URB_TIMER
+    usb_dlist_t timer_list;
+    uint32_t timer_expires;
+#endif
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+    uint32_t submit_time; /* usb_trace_timestamp at submit, for completion latency */
+#endif
+#ifdef CONFIG_USBHOST_URB_BH
+    int bh_nbytes; /* result of the completion waiting for bh worker */
+#endif
 #if defined(__ICCARM__) || defined(__ICCRISCV__) || defined(__ICCRX__)
     struct usbh_iso_frame_packet *iso_packet;
 #else
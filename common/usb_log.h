@@ -49,20 +49,77 @@
         _USB_DBG_LOG_X_END;                      \
     } while (0)
 
+#ifdef CONFIG_USB_LOG_DEFERRED
+#include <stdint.h>
+
+/*
+ * Deferred logging, USB_LOG_WRN/INFO/DBG only store format pointer and raw arguments into a ring,
+ * usb_log thread or usb_log_flush prints them later. USB_LOG_ERR and USB_LOG_RAW still print in place.
+ * Format strings must be literals, %s arguments are copied and may be truncated.
+ */
+struct usb_log_tag {
+    const char *name;
+    uint8_t level; /* runtime level, messages above it are dropped */
+};
+
+/* One per log call, tag is resolved on first use */
+struct usb_log_site {
+    const char *tag;
+    struct usb_log_tag *tag_entry;
+    uint32_t epoch;      /* rate limit window of count */
+    uint16_t count;      /* messages in window */
+    uint16_t suppressed; /* messages dropped by rate limit, reported in next window */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_log_record(struct usb_log_site *site, uint8_t level, const char *fmt, ...);
+/* Set runtime level of tag, NULL tag sets all tags */
+int usb_log_set_level(const char *tag, uint8_t level);
+/* Start usb_log thread, called by usbh_initialize and usbd_initialize */
+void usb_log_init(void);
+/* Print pending messages in caller context */
+void usb_log_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define usb_dbg_log_deferred(lvl, fmt, ...)                                       \
+    do {                                                                          \
+        static struct usb_log_site usb_log_site = { USB_DBG_TAG, NULL, 0, 0, 0 }; \
+        usb_log_record(&usb_log_site, lvl, fmt, ##__VA_ARGS__);                   \
+    } while (0)
+#endif
+
 #if (CONFIG_USB_DBG_LEVEL >= USB_DBG_LOG)
+#ifdef CONFIG_USB_LOG_DEFERRED
+#define USB_LOG_DBG(fmt, ...) usb_dbg_log_deferred(USB_DBG_LOG, fmt, ##__VA_ARGS__)
+#else
 #define USB_LOG_DBG(fmt, ...) usb_dbg_log_line("D", 0, fmt, ##__VA_ARGS__)
+#endif
 #else
 #define USB_LOG_DBG(...)  {}
 #endif
 
 #if (CONFIG_USB_DBG_LEVEL >= USB_DBG_INFO)
+#ifdef CONFIG_USB_LOG_DEFERRED
+#define USB_LOG_INFO(fmt, ...) usb_dbg_log_deferred(USB_DBG_INFO, fmt, ##__VA_ARGS__)
+#else
 #define USB_LOG_INFO(fmt, ...) usb_dbg_log_line("I", 32, fmt, ##__VA_ARGS__)
+#endif
 #else
 #define USB_LOG_INFO(...) {}
 #endif
 
 #if (CONFIG_USB_DBG_LEVEL >= USB_DBG_WARNING)
+#ifdef CONFIG_USB_LOG_DEFERRED
+#define USB_LOG_WRN(fmt, ...) usb_dbg_log_deferred(USB_DBG_WARNING, fmt, ##__VA_ARGS__)
+#else
 #define USB_LOG_WRN(fmt, ...) usb_dbg_log_line("W", 33, fmt, ##__VA_ARGS__)
+#endif
 #else
 #define USB_LOG_WRN(...) {}
 #endif
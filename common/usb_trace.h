@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USB_TRACE_H
+#define USB_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "usb_osal.h"
+
+#define USB_TRACE_SUBMIT    1 /* urb submitted or endpoint transfer started, setup valid on control submit */
+#define USB_TRACE_COMPLETE  2 /* urb or endpoint transfer finished, status and length are valid */
+#define USB_TRACE_BUS       3 /* device bus event, status holds USBD_EVENT_* */
+#define USB_TRACE_IRQ_ENTER 4 /* status holds interrupt status read by port */
+#define USB_TRACE_IRQ_EXIT  5
+
+#define USB_TRACE_FLAG_SETUP   (1 << 2) /* setup holds a setup packet */
+#define USB_TRACE_FLAG_DEVICE  (1 << 3) /* recorded by device stack */
+#define USB_TRACE_XFER_TYPE(f) ((f)&0x03) /* USB_ENDPOINT_TYPE_* */
+
+#define USB_TRACE_FILE_MAGIC   0x54425355 /* "USBT" */
+#define USB_TRACE_FILE_VERSION 1
+
+/* 32 bytes, dumped as is in little endian, tools/usb_trace/usbtrace2pcapng.py converts to pcapng */
+struct usb_trace_event {
+    uint32_t seq;       /* index + 1 once event is complete, 0 while it is written */
+    uint32_t timestamp; /* us from usb_trace_timestamp */
+    uint32_t id;        /* urb address, matches submit to complete */
+    int32_t status;     /* -USB_ERR_* on complete */
+    uint32_t length;    /* requested length on submit, actual length on complete */
+    uint8_t type;       /* USB_TRACE_* */
+    uint8_t flags;      /* USB_TRACE_FLAG_* and transfer type */
+    uint8_t ep;         /* endpoint address */
+    uint8_t dev_addr;
+    uint8_t setup[8];
+};
+
+struct usb_trace_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;
+    uint8_t busid;
+    uint8_t is_device;
+    uint16_t reserved;
+    uint32_t lost; /* events overwritten before they were dumped */
+};
+
+typedef void (*usb_trace_write_t)(const void *data, uint32_t len, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Free running us counter for trace events and endpoint latency, weak default returns 0 */
+uint32_t usb_trace_timestamp(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef CONFIG_USB_TRACE
+/* Ring written from interrupts and threads without lock, writers only reserve a slot with one atomic add */
+struct usb_trace_ring {
+    volatile uint32_t head; /* events reserved so far */
+    volatile bool enable;
+    struct usb_trace_event events[CONFIG_USB_TRACE_EVENTS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_trace_enable(struct usb_trace_ring *ring, bool enable);
+
+/**
+ * @brief Copy complete events after *cursor, events being written or already overwritten are skipped.
+ *
+ * @param cursor reader position, start with 0.
+ * @param lost increased by skipped events, may be NULL.
+ * @return number of events copied.
+ */
+uint32_t usb_trace_read(struct usb_trace_ring *ring, uint32_t *cursor, struct usb_trace_event *events, uint32_t max, uint32_t *lost);
+
+/* Write file header and all events of the ring through write, result is input of usbtrace2pcapng.py */
+void usb_trace_dump(struct usb_trace_ring *ring, uint8_t busid, bool is_device, usb_trace_write_t write, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline void usb_trace_record(struct usb_trace_ring *ring, uint8_t type, uint8_t flags, uint8_t dev_addr, uint8_t ep,
+                                    uint32_t id, int32_t status, uint32_t length, const void *setup)
+{
+    struct usb_trace_event *event;
+    uint32_t index;
+
+    if (!ring->enable) {
+        return;
+    }
+
+#if defined(__GNUC__) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+    index = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+#else
+    size_t irq_flags = usb_osal_enter_critical_section();
+    index = ring->head++;
+    usb_osal_leave_critical_section(irq_flags);
+#endif
+
+    event = &ring->events[index & (CONFIG_USB_TRACE_EVENTS - 1)];
+    event->seq = 0;
+#if defined(__GNUC__)
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+    event->timestamp = usb_trace_timestamp();
+    event->id = id;
+    event->status = status;
+    event->length = length;
+    event->type = type;
+    event->flags = flags;
+    event->ep = ep;
+    event->dev_addr = dev_addr;
+    if (setup) {
+        memcpy(event->setup, setup, 8);
+        event->flags |= USB_TRACE_FLAG_SETUP;
+    }
+#if defined(__GNUC__)
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+    event->seq = index + 1;
+}
+#else
+struct usb_trace_ring;
+
+static inline void usb_trace_enable(struct usb_trace_ring *ring, bool enable)
+{
+    (void)ring;
+    (void)enable;
+}
+
+static inline uint32_t usb_trace_read(struct usb_trace_ring *ring, uint32_t *cursor, struct usb_trace_event *events, uint32_t max, uint32_t *lost)
+{
+    (void)ring;
+    (void)cursor;
+    (void)events;
+    (void)max;
+    (void)lost;
+    return 0;
+}
+
+static inline void usb_trace_dump(struct usb_trace_ring *ring, uint8_t busid, bool is_device, usb_trace_write_t write, void *arg)
+{
+    (void)ring;
+    (void)busid;
+    (void)is_device;
+    (void)write;
+    (void)arg;
+}
+
+static inline void usb_trace_record(struct usb_trace_ring *ring, uint8_t type, uint8_t flags, uint8_t dev_addr, uint8_t ep,
+                                    uint32_t id, int32_t status, uint32_t length, const void *setup)
+{
+    (void)ring;
+    (void)type;
+    (void)flags;
+    (void)dev_addr;
+    (void)ep;
+    (void)id;
+    (void)status;
+    (void)length;
+    (void)setup;
+}
+#endif /* CONFIG_USB_TRACE */
+
+#endif /* USB_TRACE_H */
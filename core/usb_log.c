@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdarg.h>
+#include "usb_config.h"
+#include "usb_util.h"
+#include "usb_errno.h"
+#include "usb_osal.h"
+#include "usb_log.h"
+
+#ifdef CONFIG_USB_LOG_DEFERRED
+
+#if (CONFIG_USB_LOG_MSG_NUM & (CONFIG_USB_LOG_MSG_NUM - 1)) != 0
+#error "CONFIG_USB_LOG_MSG_NUM must be a power of 2"
+#endif
+#if CONFIG_USB_LOG_ARG_SIZE > 255
+#error "CONFIG_USB_LOG_ARG_SIZE must be below 256"
+#endif
+
+#define USB_LOG_LINE_SIZE 192
+
+/* argument types of a conversion */
+#define USB_LOG_ARG_INT    0
+#define USB_LOG_ARG_LONG   1
+#define USB_LOG_ARG_LLONG  2
+#define USB_LOG_ARG_SIZET  3
+#define USB_LOG_ARG_PTR    4
+#define USB_LOG_ARG_DOUBLE 5
+#define USB_LOG_ARG_STR    6
+#define USB_LOG_ARG_NONE   7 /* %% */
+#define USB_LOG_ARG_BAD    8 /* %n, %L and unknown conversions, formatting stops there */
+
+#define USB_LOG_MSG_TRUNCATED (1 << 0)
+
+struct usb_log_msg {
+    volatile uint32_t seq; /* index + 1 once message is complete, 0 while it is written */
+    const char *fmt;
+    const char *tag;
+    uint8_t level;
+    uint8_t flags;
+    uint8_t len; /* bytes used in args */
+    uint8_t args[CONFIG_USB_LOG_ARG_SIZE];
+};
+
+static struct usb_log_priv {
+    volatile uint32_t head;  /* messages reserved so far */
+    uint32_t tail;           /* next message to print */
+    volatile uint32_t epoch; /* seconds counted by usb_log thread, rate limit window */
+    uint32_t ms;
+    bool started;
+    uint8_t default_level;
+    usb_osal_thread_t thread;
+    usb_osal_mutex_t mutex;
+    struct usb_log_tag fallback; /* used when tags is full */
+    struct usb_log_tag tags[CONFIG_USB_LOG_TAG_NUM];
+    struct usb_log_msg msgs[CONFIG_USB_LOG_MSG_NUM];
+} g_usb_log = {
+    .default_level = CONFIG_USB_DBG_LEVEL,
+    .fallback = { "USB", CONFIG_USB_DBG_LEVEL },
+};
+
+#if defined(__GNUC__)
+#define usb_log_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define usb_log_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define usb_log_acquire()
+#define usb_log_release()
+#endif
+
+/* Parse conversion after '%', return end of it */
+static const char *usb_log_parse_spec(const char *p, uint8_t *type, uint8_t *stars)
+{
+    uint8_t lmod = 0;
+
+    *stars = 0;
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        (*stars)++;
+        p++;
+    }
+    while ((*p >= '0') && (*p <= '9')) {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            (*stars)++;
+            p++;
+        }
+        while ((*p >= '0') && (*p <= '9')) {
+            p++;
+        }
+    }
+
+    switch (*p) {
+        case 'h':
+            p++;
+            if (*p == 'h') {
+                p++;
+            }
+            break;
+        case 'l':
+            p++;
+            lmod = USB_LOG_ARG_LONG;
+            if (*p == 'l') {
+                p++;
+                lmod = USB_LOG_ARG_LLONG;
+            }
+            break;
+        case 'j':
+            p++;
+            lmod = USB_LOG_ARG_LLONG;
+            break;
+        case 'z':
+        case 't':
+            p++;
+            lmod = USB_LOG_ARG_SIZET;
+            break;
+        default:
+            break;
+    }
+
+    switch (*p) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            *type = lmod ? lmod : USB_LOG_ARG_INT;
+            break;
+        case 'c':
+            *type = USB_LOG_ARG_INT;
+            break;
+        case 'p':
+            *type = USB_LOG_ARG_PTR;
+            break;
+        case 's':
+            *type = USB_LOG_ARG_STR;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            *type = USB_LOG_ARG_DOUBLE;
+            break;
+        case '%':
+            *type = USB_LOG_ARG_NONE;
+            break;
+        default:
+            *type = USB_LOG_ARG_BAD;
+            return p;
+    }
+    return p + 1;
+}
+
+static bool usb_log_put_arg(struct usb_log_msg *msg, const void *value, uint32_t size)
+{
+    if ((msg->len + size) > CONFIG_USB_LOG_ARG_SIZE) {
+        return false;
+    }
+    memcpy(&msg->args[msg->len], value, size);
+    msg->len += size;
+    return true;
+}
+
+static bool usb_log_get_arg(const struct usb_log_msg *msg, uint32_t *offset, void *value, uint32_t size)
+{
+    if ((*offset + size) > msg->len) {
+        return false;
+    }
+    memcpy(value, &msg->args[*offset], size);
+    *offset += size;
+    return true;
+}
+
+/* Store raw arguments in order of conversions, strings are copied and cut to the space left */
+static void usb_log_pack(struct usb_log_msg *msg, const char *fmt, va_list ap)
+{
+    const char *p = fmt;
+    const char *str;
+    uint8_t type;
+    uint8_t stars;
+    bool ok = true;
+
+    while (*p && ok) {
+        if (*p++ != '%') {
+            continue;
+        }
+
+        p = usb_log_parse_spec(p, &type, &stars);
+        while (stars-- && ok) {
+            int star = va_arg(ap, int);
+            ok = usb_log_put_arg(msg, &star, sizeof(int));
+        }
+        if (!ok) {
+            break;
+        }
+
+        switch (type) {
+            case USB_LOG_ARG_INT: {
+                int value = va_arg(ap, int);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_LONG: {
+                long value = va_arg(ap, long);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_LLONG: {
+                long long value = va_arg(ap, long long);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_SIZET: {
+                size_t value = va_arg(ap, size_t);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_PTR: {
+                void *value = va_arg(ap, void *);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_DOUBLE: {
+                double value = va_arg(ap, double);
+                ok = usb_log_put_arg(msg, &value, sizeof(value));
+            } break;
+            case USB_LOG_ARG_STR:
+                str = va_arg(ap, const char *);
+                if (str == NULL) {
+                    str = "(null)";
+                }
+                if (msg->len >= CONFIG_USB_LOG_ARG_SIZE) {
+                    ok = false;
+                    break;
+                }
+                while (*str && (msg->len < (CONFIG_USB_LOG_ARG_SIZE - 1))) {
+                    msg->args[msg->len++] = *str++;
+                }
+                msg->args[msg->len++] = '\0';
+                if (*str) {
+                    /* string was cut, line is printed with truncation mark */
+                    msg->flags |= USB_LOG_MSG_TRUNCATED;
+                }
+                break;
+            case USB_LOG_ARG_NONE:
+                break;
+            default:
+                ok = false;
+                break;
+        }
+    }
+
+    if (!ok) {
+        msg->flags |= USB_LOG_MSG_TRUNCATED;
+    }
+}
+
+static void usb_log_vput(const char *tag, uint8_t level, const char *fmt, va_list ap)
+{
+    struct usb_log_msg msg;
+    struct usb_log_msg *slot;
+    uint32_t index;
+
+    msg.flags = 0;
+    msg.len = 0;
+    usb_log_pack(&msg, fmt, ap);
+
+#if defined(__GNUC__) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+    index = __atomic_fetch_add(&g_usb_log.head, 1, __ATOMIC_RELAXED);
+#else
+    size_t flags = usb_osal_enter_critical_section();
+    index = g_usb_log.head++;
+    usb_osal_leave_critical_section(flags);
+#endif
+
+    slot = &g_usb_log.msgs[index & (CONFIG_USB_LOG_MSG_NUM - 1)];
+    slot->seq = 0;
+    usb_log_release();
+    slot->fmt = fmt;
+    slot->tag = tag;
+    slot->level = level;
+    slot->flags = msg.flags;
+    slot->len = msg.len;
+    memcpy(slot->args, msg.args, msg.len);
+    usb_log_release();
+    slot->seq = index + 1;
+}
+
+static void usb_log_put(const char *tag, uint8_t level, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    usb_log_vput(tag, level, fmt, ap);
+    va_end(ap);
+}
+
+static struct usb_log_tag *usb_log_find_tag(const char *name)
+{
+    struct usb_log_tag *entry = &g_usb_log.fallback;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    for (uint8_t i = 0; i < CONFIG_USB_LOG_TAG_NUM; i++) {
+        if (g_usb_log.tags[i].name == NULL) {
+            g_usb_log.tags[i].name = name;
+            g_usb_log.tags[i].level = g_usb_log.default_level;
+            entry = &g_usb_log.tags[i];
+            break;
+        }
+        if ((g_usb_log.tags[i].name == name) || !strcmp(g_usb_log.tags[i].name, name)) {
+            entry = &g_usb_log.tags[i];
+            break;
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+    return entry;
+}
+
+void usb_log_record(struct usb_log_site *site, uint8_t level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (site->tag_entry == NULL) {
+        site->tag_entry = usb_log_find_tag(site->tag);
+    }
+    if (level > site->tag_entry->level) {
+        return;
+    }
+
+#if CONFIG_USB_LOG_RATE_LIMIT > 0
+    /* plain updates, a site racing with itself only miscounts a little */
+    if (site->epoch != g_usb_log.epoch) {
+        site->epoch = g_usb_log.epoch;
+        site->count = 0;
+        if (site->suppressed) {
+            usb_log_put(site->tag, USB_DBG_WARNING, "%u messages suppressed\r\n", site->suppressed);
+            site->suppressed = 0;
+        }
+    }
+    if (site->count >= CONFIG_USB_LOG_RATE_LIMIT) {
+        if (site->suppressed < 0xffff) {
+            site->suppressed++;
+        }
+        return;
+    }
+    site->count++;
+#endif
+
+    va_start(ap, fmt);
+    usb_log_vput(site->tag, level, fmt, ap);
+    va_end(ap);
+}
+
+int usb_log_set_level(const char *tag, uint8_t level)
+{
+    struct usb_log_tag *entry;
+
+    if (level > USB_DBG_LOG) {
+        return -USB_ERR_INVAL;
+    }
+
+    if (tag == NULL) {
+        g_usb_log.default_level = level;
+        g_usb_log.fallback.level = level;
+        for (uint8_t i = 0; i < CONFIG_USB_LOG_TAG_NUM; i++) {
+            g_usb_log.tags[i].level = level;
+        }
+        return 0;
+    }
+
+    entry = usb_log_find_tag(tag);
+    if (entry == &g_usb_log.fallback) {
+        return -USB_ERR_NOMEM;
+    }
+    entry->level = level;
+    return 0;
+}
+
+/* Copy one message, return false if a writer touched it meanwhile */
+static bool usb_log_copy(uint32_t index, struct usb_log_msg *msg)
+{
+    struct usb_log_msg *src = &g_usb_log.msgs[index & (CONFIG_USB_LOG_MSG_NUM - 1)];
+    uint32_t seq;
+
+    seq = src->seq;
+    usb_log_acquire();
+    if (seq != index + 1) {
+        return false;
+    }
+    memcpy(msg, src, sizeof(struct usb_log_msg));
+    usb_log_acquire();
+    return (src->seq == seq);
+}
+
+/* Format message into line, size leaves room for truncation mark and color end */
+static void usb_log_format(const struct usb_log_msg *msg, char *line, uint32_t size)
+{
+    static const char level_name[] = { 'E', 'W', 'I', 'D' };
+    static const uint8_t level_color[] = { 31, 33, 32, 0 };
+    const char *p = msg->fmt;
+    const char *start;
+    char spec[24];
+    uint32_t limit = size - 10;
+    uint32_t offset = 0;
+    uint32_t pos;
+    uint32_t len;
+    uint8_t type;
+    uint8_t stars;
+    int star;
+    int n = 0;
+
+    (void)level_color;
+#ifdef CONFIG_USB_PRINTF_COLOR_ENABLE
+    n = snprintf(line, size, "\033[%um[%c/%s] ", level_color[msg->level], level_name[msg->level], msg->tag);
+#else
+    n = snprintf(line, size, "[%c/%s] ", level_name[msg->level], msg->tag);
+#endif
+    pos = (n > 0) ? MIN((uint32_t)n, limit) : 0;
+
+    while (*p && (pos < limit)) {
+        if (*p != '%') {
+            line[pos++] = *p++;
+            continue;
+        }
+
+        start = p++;
+        p = usb_log_parse_spec(p, &type, &stars);
+        if (type == USB_LOG_ARG_NONE) {
+            line[pos++] = '%';
+            continue;
+        }
+        if (type == USB_LOG_ARG_BAD) {
+            break;
+        }
+
+        /* rebuild conversion with '*' replaced by stored values */
+        len = 0;
+        for (; start < p; start++) {
+            if (*start != '*') {
+                if (len < (sizeof(spec) - 1)) {
+                    spec[len++] = *start;
+                }
+                continue;
+            }
+            if (!usb_log_get_arg(msg, &offset, &star, sizeof(int))) {
+                goto out;
+            }
+            if ((star < 0) && (len > 0) && (spec[len - 1] == '.')) {
+                len--; /* negative precision means none */
+                continue;
+            }
+            n = snprintf(&spec[len], sizeof(spec) - len, "%d", star);
+            len = MIN(len + (uint32_t)MAX(n, 0), sizeof(spec) - 1);
+        }
+        spec[len] = '\0';
+
+        n = -1;
+        switch (type) {
+            case USB_LOG_ARG_INT: {
+                int value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_LONG: {
+                long value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_LLONG: {
+                long long value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_SIZET: {
+                size_t value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_PTR: {
+                void *value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_DOUBLE: {
+                double value;
+                if (usb_log_get_arg(msg, &offset, &value, sizeof(value))) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, value);
+                }
+            } break;
+            case USB_LOG_ARG_STR:
+                if (offset < msg->len) {
+                    n = snprintf(&line[pos], limit + 1 - pos, spec, (const char *)&msg->args[offset]);
+                    offset += strlen((const char *)&msg->args[offset]) + 1;
+                }
+                break;
+            default:
+                break;
+        }
+        if (n < 0) {
+            break;
+        }
+        pos = MIN(pos + (uint32_t)n, limit);
+    }
+
+out:
+    line[pos] = '\0';
+    if ((msg->flags & USB_LOG_MSG_TRUNCATED) || *p) {
+        n = snprintf(&line[pos], size - pos, "...\r\n");
+        pos = MIN(pos + (uint32_t)MAX(n, 0), size - 1);
+    }
+#ifdef CONFIG_USB_PRINTF_COLOR_ENABLE
+    snprintf(&line[pos], size - pos, "\033[0m");
+#endif
+}
+
+void usb_log_flush(void)
+{
+    struct usb_log_msg msg;
+    char line[USB_LOG_LINE_SIZE];
+    uint32_t head;
+    uint32_t lost = 0;
+    uint32_t seq;
+
+    if (g_usb_log.mutex) {
+        usb_osal_mutex_take(g_usb_log.mutex);
+    }
+
+    head = g_usb_log.head;
+    if ((head - g_usb_log.tail) > CONFIG_USB_LOG_MSG_NUM) {
+        lost = head - g_usb_log.tail - CONFIG_USB_LOG_MSG_NUM;
+        g_usb_log.tail = head - CONFIG_USB_LOG_MSG_NUM;
+    }
+
+    while (g_usb_log.tail != head) {
+        if (usb_log_copy(g_usb_log.tail, &msg)) {
+            if (lost) {
+                CONFIG_USB_PRINTF("[W/usb_log] %u messages lost\r\n", (unsigned int)lost);
+                lost = 0;
+            }
+            usb_log_format(&msg, line, sizeof(line));
+            CONFIG_USB_PRINTF("%s", line);
+        } else {
+            seq = g_usb_log.msgs[g_usb_log.tail & (CONFIG_USB_LOG_MSG_NUM - 1)].seq;
+            if ((seq == 0) || ((int32_t)(seq - (g_usb_log.tail + 1)) < 0)) {
+                /* writer has reserved but not finished it, print it next time */
+                break;
+            }
+            lost++;
+        }
+        g_usb_log.tail++;
+    }
+
+    if (lost) {
+        CONFIG_USB_PRINTF("[W/usb_log] %u messages lost\r\n", (unsigned int)lost);
+    }
+
+    if (g_usb_log.mutex) {
+        usb_osal_mutex_give(g_usb_log.mutex);
+    }
+}
+
+static void usb_log_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    while (1) {
+        usb_osal_msleep(CONFIG_USB_LOG_INTERVAL);
+        g_usb_log.ms += CONFIG_USB_LOG_INTERVAL;
+        if (g_usb_log.ms >= 1000) {
+            g_usb_log.ms -= 1000;
+            g_usb_log.epoch++;
+        }
+        usb_log_flush();
+    }
+}
+
+void usb_log_init(void)
+{
+    size_t flags;
+    bool started;
+
+    flags = usb_osal_enter_critical_section();
+    started = g_usb_log.started;
+    g_usb_log.started = true;
+    usb_osal_leave_critical_section(flags);
+
+    if (started) {
+        return;
+    }
+
+    g_usb_log.mutex = usb_osal_mutex_create();
+    g_usb_log.thread = usb_osal_thread_create("usb_log", CONFIG_USB_LOG_STACKSIZE, CONFIG_USB_LOG_PRIO, usb_log_thread, NULL);
+    if (g_usb_log.thread == NULL) {
+        USB_LOG_ERR("No memory to alloc for usb_log thread\r\n");
+    }
+}
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usb_config.h"
+#include "usb_util.h"
+#include "usb_trace.h"
+
+#if defined(CONFIG_USB_TRACE) || defined(CONFIG_USB_EP_STAT_LATENCY)
+__WEAK uint32_t usb_trace_timestamp(void)
+{
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_USB_TRACE
+
+#if (CONFIG_USB_TRACE_EVENTS & (CONFIG_USB_TRACE_EVENTS - 1)) != 0
+#error "CONFIG_USB_TRACE_EVENTS must be a power of 2"
+#endif
+
+#if defined(__GNUC__)
+#define usb_trace_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define usb_trace_acquire()
+#endif
+
+void usb_trace_enable(struct usb_trace_ring *ring, bool enable)
+{
+    ring->enable = enable;
+}
+
+/* Copy one event, return false if a writer touched it meanwhile */
+static bool usb_trace_copy(struct usb_trace_ring *ring, uint32_t index, struct usb_trace_event *event)
+{
+    struct usb_trace_event *src = &ring->events[index & (CONFIG_USB_TRACE_EVENTS - 1)];
+    uint32_t seq;
+
+    seq = src->seq;
+    usb_trace_acquire();
+    if (seq != index + 1) {
+        return false;
+    }
+    memcpy(event, src, sizeof(struct usb_trace_event));
+    usb_trace_acquire();
+    return (src->seq == seq);
+}
+
+uint32_t usb_trace_read(struct usb_trace_ring *ring, uint32_t *cursor, struct usb_trace_event *events, uint32_t max, uint32_t *lost)
+{
+    uint32_t head = ring->head;
+    uint32_t count = 0;
+    uint32_t skipped = 0;
+    uint32_t seq;
+
+    if ((head - *cursor) > CONFIG_USB_TRACE_EVENTS) {
+        skipped += head - *cursor - CONFIG_USB_TRACE_EVENTS;
+        *cursor = head - CONFIG_USB_TRACE_EVENTS;
+    }
+
+    while ((*cursor != head) && (count < max)) {
+        if (usb_trace_copy(ring, *cursor, &events[count])) {
+            count++;
+        } else {
+            seq = ring->events[*cursor & (CONFIG_USB_TRACE_EVENTS - 1)].seq;
+            if ((seq == 0) || ((int32_t)(seq - (*cursor + 1)) < 0)) {
+                /* writer has reserved but not finished it, read it next time */
+                break;
+            }
+            skipped++;
+        }
+        (*cursor)++;
+    }
+
+    if (lost) {
+        *lost += skipped;
+    }
+    return count;
+}
+
+void usb_trace_dump(struct usb_trace_ring *ring, uint8_t busid, bool is_device, usb_trace_write_t write, void *arg)
+{
+    struct usb_trace_file_header header;
+    struct usb_trace_event event;
+    uint32_t head = ring->head;
+    uint32_t index;
+
+    index = (head > CONFIG_USB_TRACE_EVENTS) ? (head - CONFIG_USB_TRACE_EVENTS) : 0;
+
+    memset(&header, 0, sizeof(struct usb_trace_file_header));
+    header.magic = USB_TRACE_FILE_MAGIC;
+    header.version = USB_TRACE_FILE_VERSION;
+    header.event_size = sizeof(struct usb_trace_event);
+    header.busid = busid;
+    header.is_device = is_device;
+    header.lost = index;
+    write(&header, sizeof(struct usb_trace_file_header), arg);
+
+    /* events written after head was sampled are left for the next dump */
+    for (; index != head; index++) {
+        if (usb_trace_copy(ring, index, &event)) {
+            write(&event, sizeof(struct usb_trace_event), arg);
+        }
+    }
+}
+#endif
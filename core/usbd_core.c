@@ -91,6 +91,121 @@ USB_NOCACHE_RAM_SECTION struct usbd_core_priv {
 
 struct usbd_bus g_usbdev_bus[CONFIG_USBDEV_MAX_BUS];
 
+#ifdef CONFIG_USB_TRACE
+struct usb_trace_ring g_usbd_trace_ring[CONFIG_USBDEV_MAX_BUS];
+
+static void usbd_trace_bus(uint8_t busid, uint8_t event)
+{
+    usb_trace_record(&g_usbd_trace_ring[busid], USB_TRACE_BUS, USB_TRACE_FLAG_DEVICE, 0, 0, 0, event, 0, NULL);
+}
+#else
+#define usbd_trace_bus(busid, event)
+#endif
+
+#ifdef CONFIG_USB_EP_STAT
+struct usbd_ep_stat_priv {
+    struct usb_ep_stat stat;
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+    uint32_t submit_time;
+#endif
+    uint32_t requested;
+    bool busy; /* submitted and not completed yet */
+};
+
+/* indexed by endpoint number, in endpoints in upper half */
+static struct usbd_ep_stat_priv g_usbd_ep_stat[CONFIG_USBDEV_MAX_BUS][32];
+static uint32_t g_usbd_irq_count[CONFIG_USBDEV_MAX_BUS];
+
+#define USBD_EP_STAT_INDEX(ep) (((ep)&0x0f) | (((ep)&0x80) >> 3))
+#endif
+
+#if defined(CONFIG_USBDEV_DESC_INDEX) && !defined(CONFIG_USBDEV_ADVANCE_DESC)
+#if CONFIG_USBDEV_DESC_INDEX_NUM > 255
+#error "CONFIG_USBDEV_DESC_INDEX_NUM must be below 256"
+#endif
+
+/* Offsets of descriptors reachable by GET_DESCRIPTOR, grouped by type in blob order, built by usbd_desc_register */
+struct usbd_desc_index {
+    bool valid;
+    uint8_t first[USB_DESCRIPTOR_TYPE_OTHER_SPEED + 1];
+    uint8_t count[USB_DESCRIPTOR_TYPE_OTHER_SPEED + 1];
+    uint16_t offset[CONFIG_USBDEV_DESC_INDEX_NUM];
+};
+
+static struct usbd_desc_index g_usbd_desc_index[CONFIG_USBDEV_MAX_BUS];
+#endif
+
+#if defined(CONFIG_USB_TRACE) || defined(CONFIG_USB_EP_STAT)
+void usbd_trace_ep(uint8_t busid, uint8_t type, uint8_t ep, uint32_t nbytes)
+{
+#ifdef CONFIG_USB_TRACE
+    usb_trace_record(&g_usbd_trace_ring[busid], type, USB_TRACE_FLAG_DEVICE, 0, ep, ep, 0, nbytes, NULL);
+#endif
+#ifdef CONFIG_USB_EP_STAT
+    struct usbd_ep_stat_priv *priv = &g_usbd_ep_stat[busid][USBD_EP_STAT_INDEX(ep)];
+
+    if (type == USB_TRACE_SUBMIT) {
+        priv->requested = nbytes;
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+        priv->submit_time = usb_trace_timestamp();
+#endif
+        priv->busy = true;
+    } else {
+        priv->busy = false;
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+        usb_ep_stat_complete(&priv->stat, 0, priv->requested, nbytes, usb_trace_timestamp() - priv->submit_time);
+#else
+        usb_ep_stat_complete(&priv->stat, 0, priv->requested, nbytes, 0);
+#endif
+    }
+#endif
+}
+
+#ifdef CONFIG_USB_EP_STAT
+/* dcd ports only report successful completions, count a transfer dropped by ep close or bus reset as shutdown error */
+static void usbd_ep_stat_abort(uint8_t busid, uint8_t ep)
+{
+    struct usbd_ep_stat_priv *priv = &g_usbd_ep_stat[busid][USBD_EP_STAT_INDEX(ep)];
+    bool busy;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    busy = priv->busy;
+    priv->busy = false;
+    usb_osal_leave_critical_section(flags);
+
+    if (busy) {
+        usb_ep_stat_complete(&priv->stat, -USB_ERR_SHUTDOWN, priv->requested, 0, 0);
+#ifdef CONFIG_USB_TRACE
+        usb_trace_record(&g_usbd_trace_ring[busid], USB_TRACE_COMPLETE, USB_TRACE_FLAG_DEVICE, 0, ep, ep, -USB_ERR_SHUTDOWN, 0, NULL);
+#endif
+    }
+}
+
+static void usbd_ep_stat_abort_all(uint8_t busid)
+{
+    for (uint8_t i = 0; i < 16; i++) {
+        usbd_ep_stat_abort(busid, i);
+        usbd_ep_stat_abort(busid, i | 0x80);
+    }
+}
+#endif
+
+void usbd_trace_irq(uint8_t busid, uint8_t type, uint32_t status)
+{
+    (void)status;
+#ifdef CONFIG_USB_TRACE
+    usb_trace_record(&g_usbd_trace_ring[busid], type, USB_TRACE_FLAG_DEVICE, 0, 0, 0, (int32_t)status, 0, NULL);
+#endif
+#ifdef CONFIG_USB_EP_STAT
+    if (type == USB_TRACE_IRQ_ENTER) {
+        /* only the dcd interrupt of this bus writes it */
+        g_usbd_irq_count[busid]++;
+    }
+#endif
+}
+#endif
+
 static void usbd_class_event_notify_handler(uint8_t busid, uint8_t event, void *arg);
 
 static void usbd_print_setup(struct usb_setup_packet *setup)
@@ -164,6 +279,9 @@ static bool usbd_reset_endpoint(uint8_t busid, const struct usb_endpoint_descrip
                 ep->bEndpointAddress,
                 USB_GET_ENDPOINT_TYPE(ep->bmAttributes));
 
+#ifdef CONFIG_USB_EP_STAT
+    usbd_ep_stat_abort(busid, ep->bEndpointAddress);
+#endif
     return usbd_ep_close(busid, ep->bEndpointAddress) == 0 ? true : false;
 }
 
@@ -233,6 +351,14 @@ static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **da
                 desc = (uint8_t *)g_usbd_core[busid].descriptors->msosv1_descriptor->string;
                 desc_len = g_usbd_core[busid].descriptors->msosv1_descriptor->string[0];
             } else {
+                if (g_usbd_core[busid].descriptors->string_descriptor_raw_callback) {
+                    /* prebuilt descriptor, no conversion */
+                    desc = g_usbd_core[busid].descriptors->string_descriptor_raw_callback(g_usbd_core[busid].speed, index);
+                    if (desc) {
+                        desc_len = desc[DESC_bLength];
+                        break;
+                    }
+                }
                 if (g_usbd_core[busid].descriptors->string_descriptor_callback == NULL) {
                     found = false;
                     break;
@@ -373,20 +499,32 @@ static bool usbd_get_descriptor(uint8_t busid, uint16_t type_index, uint8_t **da
 
     p = (uint8_t *)g_usbd_core[busid].descriptors;
 
-    cur_index = 0U;
+#ifdef CONFIG_USBDEV_DESC_INDEX
+    if (g_usbd_desc_index[busid].valid) {
+        struct usbd_desc_index *desc_index = &g_usbd_desc_index[busid];
 
-    while (p[DESC_bLength] != 0U) {
-        if (p[DESC_bDescriptorType] == type) {
-            if (cur_index == index) {
-                found = true;
-                break;
+        if (index < desc_index->count[type]) {
+            p += desc_index->offset[desc_index->first[type] + index];
+            found = true;
+        }
+    } else
+#endif
+    {
+        cur_index = 0U;
+
+        while (p[DESC_bLength] != 0U) {
+            if (p[DESC_bDescriptorType] == type) {
+                if (cur_index == index) {
+                    found = true;
+                    break;
+                }
+
+                cur_index++;
             }
 
-            cur_index++;
+            /* skip to next descriptor */
+            p += p[DESC_bLength];
         }
-
-        /* skip to next descriptor */
-        p += p[DESC_bLength];
     }
 
     if (found) {
@@ -1120,23 +1258,30 @@ void usbd_event_sof_handler(uint8_t busid)
 
 void usbd_event_connect_handler(uint8_t busid)
 {
+    usbd_trace_bus(busid, USBD_EVENT_CONNECTED);
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_CONNECTED);
 }
 
 void usbd_event_disconnect_handler(uint8_t busid)
 {
+    usbd_trace_bus(busid, USBD_EVENT_DISCONNECTED);
+#ifdef CONFIG_USB_EP_STAT
+    usbd_ep_stat_abort_all(busid);
+#endif
     g_usbd_core[busid].configuration = 0;
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_DISCONNECTED);
 }
 
 void usbd_event_resume_handler(uint8_t busid)
 {
+    usbd_trace_bus(busid, USBD_EVENT_RESUME);
     g_usbd_core[busid].is_suspend = false;
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_RESUME);
 }
 
 void usbd_event_suspend_handler(uint8_t busid)
 {
+    usbd_trace_bus(busid, USBD_EVENT_SUSPEND);
     if (g_usbd_core[busid].device_address > 0) {
         g_usbd_core[busid].is_suspend = true;
         g_usbd_core[busid].event_handler(busid, USBD_EVENT_SUSPEND);
@@ -1147,6 +1292,10 @@ void usbd_event_reset_handler(uint8_t busid)
 {
     struct usb_endpoint_descriptor ep0;
 
+    usbd_trace_bus(busid, USBD_EVENT_RESET);
+#ifdef CONFIG_USB_EP_STAT
+    usbd_ep_stat_abort_all(busid);
+#endif
     usbd_set_address(busid, 0);
     g_usbd_core[busid].device_address = 0;
     g_usbd_core[busid].configuration = 0;
@@ -1263,6 +1412,10 @@ void usbd_event_ep0_setup_complete_handler(uint8_t busid, uint8_t *psetup)
     struct usb_setup_packet *setup = &g_usbd_core[busid].setup;
 
     memcpy(setup, psetup, 8);
+#ifdef CONFIG_USB_TRACE
+    usb_trace_record(&g_usbd_trace_ring[busid], USB_TRACE_SUBMIT, USB_TRACE_FLAG_DEVICE, g_usbd_core[busid].device_address,
+                     0x00, 0x00, 0, setup->wLength, setup);
+#endif
 
 #ifdef CONFIG_USBDEV_EP0_THREAD
     usb_osal_mq_send(g_usbd_core[busid].usbd_ep0_mq, USB_EP0_STATE_SETUP);
@@ -1365,6 +1518,8 @@ static void usbd_event_ep0_out_complete_handler(uint8_t busid, uint8_t ep, uint3
 
 void usbd_event_ep_in_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    usbd_trace_ep(busid, USB_TRACE_COMPLETE, ep, nbytes);
+
     if (g_usbd_core[busid].tx_msg[ep & 0x7f].cb) {
         g_usbd_core[busid].tx_msg[ep & 0x7f].cb(busid, ep, nbytes);
     }
@@ -1372,6 +1527,8 @@ void usbd_event_ep_in_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbyte
 
 void usbd_event_ep_out_complete_handler(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
+    usbd_trace_ep(busid, USB_TRACE_COMPLETE, ep, nbytes);
+
     if (g_usbd_core[busid].rx_msg[ep & 0x7f].cb) {
         g_usbd_core[busid].rx_msg[ep & 0x7f].cb(busid, ep, nbytes);
     }
@@ -1391,12 +1548,64 @@ void usbd_desc_register(uint8_t busid, const struct usb_descriptor *desc)
     g_usbd_core[busid].rx_msg[0].cb = usbd_event_ep0_out_complete_handler;
 }
 #else
+#ifdef CONFIG_USBDEV_DESC_INDEX
+static inline bool usbd_desc_index_type(uint8_t type)
+{
+    return (type >= USB_DESCRIPTOR_TYPE_DEVICE) && (type <= USB_DESCRIPTOR_TYPE_OTHER_SPEED) &&
+           (type != USB_DESCRIPTOR_TYPE_INTERFACE) && (type != USB_DESCRIPTOR_TYPE_ENDPOINT);
+}
+
+static void usbd_desc_index_build(uint8_t busid, const uint8_t *desc)
+{
+    struct usbd_desc_index *desc_index = &g_usbd_desc_index[busid];
+    uint8_t next[USB_DESCRIPTOR_TYPE_OTHER_SPEED + 1];
+    const uint8_t *p;
+    uint32_t total = 0;
+    uint8_t type;
+
+    memset(desc_index, 0, sizeof(struct usbd_desc_index));
+
+    for (p = desc; p[DESC_bLength] != 0U; p += p[DESC_bLength]) {
+        type = p[DESC_bDescriptorType];
+        if (!usbd_desc_index_type(type)) {
+            continue;
+        }
+        if ((total == CONFIG_USBDEV_DESC_INDEX_NUM) || ((uint32_t)(p - desc) > 0xffff)) {
+            USB_LOG_WRN("descriptor index too small, fall back to linear search\r\n");
+            memset(desc_index, 0, sizeof(struct usbd_desc_index));
+            return;
+        }
+        desc_index->count[type]++;
+        total++;
+    }
+
+    total = 0;
+    for (type = 0; type <= USB_DESCRIPTOR_TYPE_OTHER_SPEED; type++) {
+        desc_index->first[type] = total;
+        next[type] = total;
+        total += desc_index->count[type];
+    }
+
+    for (p = desc; p[DESC_bLength] != 0U; p += p[DESC_bLength]) {
+        type = p[DESC_bDescriptorType];
+        if (usbd_desc_index_type(type)) {
+            desc_index->offset[next[type]++] = (uint16_t)(p - desc);
+        }
+    }
+
+    desc_index->valid = true;
+}
+#endif
+
 void usbd_desc_register(uint8_t busid, const uint8_t *desc)
 {
     memset(&g_usbd_core[busid], 0, sizeof(struct usbd_core_priv));
 
     g_usbd_core[busid].descriptors = desc;
     g_usbd_core[busid].intf_offset = 0;
+#ifdef CONFIG_USBDEV_DESC_INDEX
+    usbd_desc_index_build(busid, desc);
+#endif
 
     g_usbd_core[busid].tx_msg[0].ep = 0x80;
     g_usbd_core[busid].tx_msg[0].cb = usbd_event_ep0_in_complete_handler;
@@ -1491,6 +1700,27 @@ int usbd_send_remote_wakeup(uint8_t busid)
     }
 }
 
+#ifdef CONFIG_USB_EP_STAT
+int usbd_get_ep_stat(uint8_t busid, uint8_t ep, struct usb_ep_stat *stat)
+{
+    if ((busid >= CONFIG_USBDEV_MAX_BUS) || !stat) {
+        return -USB_ERR_INVAL;
+    }
+
+    memcpy(stat, &g_usbd_ep_stat[busid][USBD_EP_STAT_INDEX(ep)].stat, sizeof(struct usb_ep_stat));
+    stat->ep = ep;
+    return 0;
+}
+
+uint32_t usbd_get_irq_count(uint8_t busid)
+{
+    if (busid >= CONFIG_USBDEV_MAX_BUS) {
+        return 0;
+    }
+    return g_usbd_irq_count[busid];
+}
+#endif
+
 uint8_t usbd_get_ep0_next_state(uint8_t busid)
 {
     return g_usbd_core[busid].ep0_next_state;
@@ -1569,6 +1799,16 @@ int usbd_initialize(uint8_t busid, uintptr_t reg_base, void (*event_handler)(uin
 #endif
 
     g_usbd_core[busid].event_handler = event_handler;
+#ifdef CONFIG_USB_TRACE
+    usb_trace_enable(&g_usbd_trace_ring[busid], true);
+#endif
+#ifdef CONFIG_USB_LOG_DEFERRED
+    usb_log_init();
+#endif
+#ifdef CONFIG_USB_EP_STAT
+    memset(g_usbd_ep_stat[busid], 0, sizeof(g_usbd_ep_stat[busid]));
+    g_usbd_irq_count[busid] = 0;
+#endif
     ret = usb_dc_init(busid);
     usbd_class_event_notify_handler(busid, USBD_EVENT_INIT, NULL);
     g_usbd_core[busid].event_handler(busid, USBD_EVENT_INIT);
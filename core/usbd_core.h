@@ -26,6 +26,8 @@ extern "C" {
 #include "usb_memcpy.h"
 #include "usb_dcache.h"
 #include "usb_version.h"
+#include "usb_trace.h"
+#include "usb_ep_stat.h"
 
 enum usbd_event_type {
     /* USB DCD IRQ */
@@ -78,6 +80,8 @@ struct usb_descriptor {
     const uint8_t *(*device_quality_descriptor_callback)(uint8_t speed);
     const uint8_t *(*other_speed_descriptor_callback)(uint8_t speed);
     const char *(*string_descriptor_callback)(uint8_t speed, uint8_t index);
+    /* Optional, returns a complete string descriptor (see USB_STRING_DESCRIPTOR_DEFINE) or NULL to use string_descriptor_callback */
+    const uint8_t *(*string_descriptor_raw_callback)(uint8_t speed, uint8_t index);
     const struct usb_msosv1_descriptor *msosv1_descriptor;
     const struct usb_msosv2_descriptor *msosv2_descriptor;
     const struct usb_webusb_descriptor *webusb_url_descriptor;
@@ -91,6 +95,20 @@ struct usbd_bus {
 
 extern struct usbd_bus g_usbdev_bus[];
 
+#ifdef CONFIG_USB_TRACE
+extern struct usb_trace_ring g_usbd_trace_ring[CONFIG_USBDEV_MAX_BUS];
+#endif
+
+#if defined(CONFIG_USB_TRACE) || defined(CONFIG_USB_EP_STAT)
+/* Record endpoint transfer start or completion, id is the endpoint address as one transfer per endpoint is in flight */
+void usbd_trace_ep(uint8_t busid, uint8_t type, uint8_t ep, uint32_t nbytes);
+/* Record dcd interrupt entry and exit, entries are counted per bus */
+void usbd_trace_irq(uint8_t busid, uint8_t type, uint32_t status);
+#else
+#define usbd_trace_ep(busid, type, ep, nbytes)
+#define usbd_trace_irq(busid, type, status)
+#endif
+
 #ifdef USBD_IRQHandler
 #error USBD_IRQHandler is obsolete, please call USBD_IRQHandler(xxx) in your irq
 #endif
@@ -118,6 +136,13 @@ uint8_t usbd_get_ep0_next_state(uint8_t busid);
 int usbd_initialize(uint8_t busid, uintptr_t reg_base, void (*event_handler)(uint8_t busid, uint8_t event));
 int usbd_deinitialize(uint8_t busid);
 
+#ifdef CONFIG_USB_EP_STAT
+/* Copy counters of endpoint ep (address with direction bit), counters restart in usbd_initialize,
+ * transfers dropped by ep close or bus reset count as shutdown errors */
+int usbd_get_ep_stat(uint8_t busid, uint8_t ep, struct usb_ep_stat *stat);
+uint32_t usbd_get_irq_count(uint8_t busid);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
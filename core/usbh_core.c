@@ -22,6 +22,9 @@ USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t ep0_request_buffer[CONFIG_USBHOST
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX struct setup_align_buffer g_setup_buffer[CONFIG_USBHOST_MAX_BUS][CONFIG_USBHOST_MAX_EXTHUBS + 1][CONFIG_USBHOST_MAX_EHPORTS];
 
 struct usbh_bus g_usbhost_bus[CONFIG_USBHOST_MAX_BUS];
+#ifdef CONFIG_USB_TRACE
+struct usb_trace_ring g_usbh_trace_ring[CONFIG_USBHOST_MAX_BUS];
+#endif
 
 /* general descriptor field offsets */
 #define DESC_bLength         0 /** Length offset */
@@ -600,6 +603,597 @@ void usbh_hubport_release(struct usbh_hubport *hport)
     }
 }
 
+#ifdef CONFIG_USBHOST_URB_BH
+#if (CONFIG_USBHOST_URB_BH_NUM < 1) || (CONFIG_USBHOST_URB_BH_NUM > 16)
+#error "CONFIG_USBHOST_URB_BH_NUM must be between 1 and 16"
+#endif
+
+struct usbh_urb_bh {
+    usb_osal_thread_t thread;
+    usb_osal_sem_t sem;
+    usb_slist_t *head; /* urbs in completion order, linked by urb->list */
+    usb_slist_t *tail;
+    struct usbh_urb_bh_stat stat;
+};
+
+static struct usbh_urb_bh g_urb_bh[CONFIG_USBHOST_URB_BH_NUM];
+
+static void usbh_urb_bh_thread(CONFIG_USB_OSAL_THREAD_SET_ARGV)
+{
+    struct usbh_urb_bh *bh = &g_urb_bh[CONFIG_USB_OSAL_THREAD_GET_ARGV];
+    struct usbh_urb *urb;
+    usb_slist_t *node;
+    size_t flags;
+    int nbytes;
+
+    while (1) {
+        if (usb_osal_sem_take(bh->sem, USB_OSAL_WAITING_FOREVER) < 0) {
+            continue;
+        }
+
+        flags = usb_osal_enter_critical_section();
+        node = bh->head;
+        if (node) {
+            bh->head = node->next;
+            if (bh->head == NULL) {
+                bh->tail = NULL;
+            }
+            bh->stat.depth--;
+
+            urb = usb_slist_entry(node, struct usbh_urb, list);
+            urb->transfer_flags &= ~USBH_URB_BH_QUEUED;
+            nbytes = urb->bh_nbytes;
+        }
+        usb_osal_leave_critical_section(flags);
+
+        /* entry was cancelled */
+        if (node == NULL) {
+            continue;
+        }
+
+        urb->complete(urb->arg, nbytes);
+        bh->stat.completed++;
+    }
+}
+
+static void usbh_urb_bh_init(void)
+{
+    char name[16];
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_URB_BH_NUM; i++) {
+        if (g_urb_bh[i].thread) {
+            continue;
+        }
+
+        g_urb_bh[i].sem = usb_osal_sem_create(0);
+        if (g_urb_bh[i].sem == NULL) {
+            USB_LOG_ERR("Fail to create urb bh sem\r\n");
+            return;
+        }
+
+        snprintf(name, sizeof(name), "usbh_bh%u", i);
+        g_urb_bh[i].thread = usb_osal_thread_create(name, CONFIG_USBHOST_URB_BH_STACKSIZE, CONFIG_USBHOST_URB_BH_PRIO + i,
+                                                    usbh_urb_bh_thread, (void *)(uintptr_t)i);
+        if (g_urb_bh[i].thread == NULL) {
+            USB_LOG_ERR("Fail to create urb bh thread\r\n");
+            usb_osal_sem_delete(g_urb_bh[i].sem);
+            g_urb_bh[i].sem = NULL;
+            return;
+        }
+    }
+}
+
+static void usbh_urb_bh_deinit(void)
+{
+    for (uint8_t i = 0; i < CONFIG_USBHOST_URB_BH_NUM; i++) {
+        if (g_urb_bh[i].thread) {
+            usb_osal_thread_delete(g_urb_bh[i].thread);
+            usb_osal_sem_delete(g_urb_bh[i].sem);
+        }
+        memset(&g_urb_bh[i], 0, sizeof(struct usbh_urb_bh));
+    }
+}
+
+void usbh_urb_giveback(struct usbh_urb *urb)
+{
+    struct usbh_urb_bh *bh;
+    uint8_t index;
+    size_t flags;
+    int nbytes;
+
+    usbh_urb_timer_stop(urb);
+    usbh_trace_urb(urb, USB_TRACE_COMPLETE);
+
+    if (urb->complete == NULL) {
+        return;
+    }
+
+    index = (urb->transfer_flags & USBH_URB_BH_PRIO_MASK) >> USBH_URB_BH_PRIO_SHIFT;
+    if (index >= CONFIG_USBHOST_URB_BH_NUM) {
+        index = CONFIG_USBHOST_URB_BH_NUM - 1;
+    }
+    bh = &g_urb_bh[index];
+
+    nbytes = (urb->errorcode < 0) ? urb->errorcode : (int)urb->actual_length;
+
+    if (((urb->transfer_flags & USBH_URB_BH) == 0) || (bh->thread == NULL)) {
+        urb->complete(urb->arg, nbytes);
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (urb->transfer_flags & USBH_URB_BH_QUEUED) {
+        /* Urb went back on the bus before worker ran its callback. Only a nak carries no result and may be
+         * merged, worker still reports the completion queued first.
+         */
+        bh->stat.merged++;
+        usb_osal_leave_critical_section(flags);
+        USB_ASSERT_MSG(nbytes == -USB_ERR_NAK, "urb completed with %d before its bh callback ran", nbytes);
+        return;
+    }
+
+    urb->bh_nbytes = nbytes;
+    urb->transfer_flags |= USBH_URB_BH_QUEUED;
+    urb->list.next = NULL;
+    if (bh->tail) {
+        bh->tail->next = &urb->list;
+    } else {
+        bh->head = &urb->list;
+    }
+    bh->tail = &urb->list;
+
+    bh->stat.queued++;
+    bh->stat.depth++;
+    if (bh->stat.depth > bh->stat.max_depth) {
+        bh->stat.max_depth = bh->stat.depth;
+    }
+    usb_osal_leave_critical_section(flags);
+
+    usb_osal_sem_give(bh->sem);
+}
+
+void usbh_urb_bh_cancel(struct usbh_urb *urb)
+{
+    struct usbh_urb_bh *bh;
+    usb_slist_t *prev;
+    usb_slist_t *node;
+    size_t flags;
+
+    if (!urb) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    /* flag is cleared by worker under the same lock */
+    if ((urb->transfer_flags & USBH_URB_BH_QUEUED) == 0) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_URB_BH_NUM; i++) {
+        bh = &g_urb_bh[i];
+        prev = NULL;
+        for (node = bh->head; node; prev = node, node = node->next) {
+            if (node != &urb->list) {
+                continue;
+            }
+
+            if (prev) {
+                prev->next = node->next;
+            } else {
+                bh->head = node->next;
+            }
+            if (bh->tail == node) {
+                bh->tail = prev;
+            }
+            bh->stat.depth--;
+            urb->transfer_flags &= ~USBH_URB_BH_QUEUED;
+            break;
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+}
+
+void usbh_urb_bh_get_stat(uint8_t index, struct usbh_urb_bh_stat *stat)
+{
+    if (index < CONFIG_USBHOST_URB_BH_NUM) {
+        memcpy(stat, &g_urb_bh[index].stat, sizeof(struct usbh_urb_bh_stat));
+    }
+}
+#endif
+
+#ifdef CONFIG_USB_EP_STAT
+static uint32_t g_usbh_irq_count[CONFIG_USBHOST_MAX_BUS];
+
+static struct usb_ep_stat *usbh_ep_stat_find(struct usbh_hubport *hport, uint8_t ep, bool alloc)
+{
+    struct usb_ep_stat *stat = NULL;
+    size_t flags;
+
+    if ((ep & 0x7f) == 0) {
+        return &hport->ep_stat[0];
+    }
+
+    flags = usb_osal_enter_critical_section();
+    for (uint8_t i = 1; i < CONFIG_USBHOST_EP_STAT_NUM; i++) {
+        if (hport->ep_stat[i].ep == ep) {
+            stat = &hport->ep_stat[i];
+            break;
+        }
+        if (hport->ep_stat[i].ep == 0) {
+            if (alloc) {
+                hport->ep_stat[i].ep = ep;
+                stat = &hport->ep_stat[i];
+            }
+            break;
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+    return stat;
+}
+
+void usbh_ep_stat_nak(struct usbh_urb *urb)
+{
+    struct usb_ep_stat *stat;
+
+    /* endpoint may nak many times before its first completion */
+    stat = usbh_ep_stat_find(urb->hport, urb->ep->bEndpointAddress, true);
+    if (stat) {
+        usb_ep_stat_add(&stat->naks, 1);
+    }
+}
+
+int usbh_get_ep_stat(struct usbh_hubport *hport, uint8_t ep, struct usb_ep_stat *stat)
+{
+    struct usb_ep_stat *ep_stat;
+
+    if (!hport || !stat) {
+        return -USB_ERR_INVAL;
+    }
+
+    ep_stat = usbh_ep_stat_find(hport, ep, false);
+    if (!ep_stat) {
+        return -USB_ERR_NODEV;
+    }
+
+    memcpy(stat, ep_stat, sizeof(struct usb_ep_stat));
+    stat->ep = ep;
+    return 0;
+}
+
+uint32_t usbh_get_irq_count(uint8_t busid)
+{
+    if (busid >= CONFIG_USBHOST_MAX_BUS) {
+        return 0;
+    }
+    return g_usbh_irq_count[busid];
+}
+#endif
+
+#if defined(CONFIG_USB_TRACE) || defined(CONFIG_USB_EP_STAT)
+void usbh_trace_urb(struct usbh_urb *urb, uint8_t type)
+{
+#ifdef CONFIG_USB_TRACE
+    bool submit = (type == USB_TRACE_SUBMIT);
+
+    usb_trace_record(&g_usbh_trace_ring[urb->hport->bus->busid], type, USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes),
+                     urb->hport->dev_addr, urb->ep->bEndpointAddress, (uint32_t)(uintptr_t)urb, urb->errorcode,
+                     submit ? urb->transfer_buffer_length : urb->actual_length, (submit && urb->setup) ? urb->setup : NULL);
+#endif
+#ifdef CONFIG_USB_EP_STAT
+    struct usb_ep_stat *stat;
+
+    if (type == USB_TRACE_SUBMIT) {
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+        urb->submit_time = usb_trace_timestamp();
+#endif
+        return;
+    }
+
+    /* endpoints beyond CONFIG_USBHOST_EP_STAT_NUM are not counted */
+    stat = usbh_ep_stat_find(urb->hport, urb->ep->bEndpointAddress, true);
+    if (stat) {
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+        usb_ep_stat_complete(stat, urb->errorcode, urb->transfer_buffer_length, urb->actual_length,
+                             usb_trace_timestamp() - urb->submit_time);
+#else
+        usb_ep_stat_complete(stat, urb->errorcode, urb->transfer_buffer_length, urb->actual_length, 0);
+#endif
+    }
+#endif
+}
+
+void usbh_trace_irq(uint8_t busid, uint8_t type, uint32_t status)
+{
+    (void)status;
+#ifdef CONFIG_USB_TRACE
+    usb_trace_record(&g_usbh_trace_ring[busid], type, 0, 0, 0, 0, (int32_t)status, 0, NULL);
+#endif
+#ifdef CONFIG_USB_EP_STAT
+    if (type == USB_TRACE_IRQ_ENTER) {
+        /* only the hcd interrupt of this bus writes it */
+        g_usbh_irq_count[busid]++;
+    }
+#endif
+}
+#endif
+
+#ifdef CONFIG_USBHOST_URB_TIMER
+#if !defined(CONFIG_USBHOST_URB_TIMER_SOF) && (CONFIG_USBHOST_URB_TIMER_TICK_US < 1000)
+#error "CONFIG_USBHOST_URB_TIMER_TICK_US below 1000 needs CONFIG_USBHOST_URB_TIMER_SOF"
+#endif
+#if ((CONFIG_USBHOST_URB_TIMER_TICK_US < 1000) && ((1000 % CONFIG_USBHOST_URB_TIMER_TICK_US) != 0)) || \
+    ((CONFIG_USBHOST_URB_TIMER_TICK_US >= 1000) && ((CONFIG_USBHOST_URB_TIMER_TICK_US % 1000) != 0))
+#error "CONFIG_USBHOST_URB_TIMER_TICK_US must divide 1000 or be a multiple of 1000"
+#endif
+#if (CONFIG_USBHOST_URB_TIMER_WHEEL_BITS < 2) || (CONFIG_USBHOST_URB_TIMER_WHEEL_BITS > 8)
+#error "CONFIG_USBHOST_URB_TIMER_WHEEL_BITS must be between 2 and 8"
+#endif
+
+#define USBH_URB_WHEEL_LEVELS 3
+#define USBH_URB_WHEEL_BITS   CONFIG_USBHOST_URB_TIMER_WHEEL_BITS
+#define USBH_URB_WHEEL_SLOTS  (1U << USBH_URB_WHEEL_BITS)
+#define USBH_URB_WHEEL_MASK   (USBH_URB_WHEEL_SLOTS - 1)
+#define USBH_URB_WHEEL_RANGE  (1U << (USBH_URB_WHEEL_BITS * USBH_URB_WHEEL_LEVELS))
+
+/*
+ * Level 0 slots hold urbs expiring within one lap of ticks, upper levels hold coarser ranges and are
+ * moved down (cascaded) when level 0 wraps, so each tick only touches one slot.
+ */
+struct usbh_urb_wheel {
+    bool active;
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+    bool ready;      /* wheel goes active on first sof, hcd without sof keeps semaphore timeouts */
+    uint32_t sof_us; /* sof time not yet turned into ticks */
+#endif
+    uint32_t now; /* ticks since wheel start */
+    struct usb_osal_timer *timer;
+    usb_dlist_t slot[USBH_URB_WHEEL_LEVELS][USBH_URB_WHEEL_SLOTS];
+};
+
+static struct usbh_urb_wheel g_urb_wheel[CONFIG_USBHOST_MAX_BUS];
+
+static inline bool usbh_urb_timer_pending(struct usbh_urb *urb)
+{
+    /* zeroed urb has never been armed */
+    return urb->timer_list.next && !usb_dlist_isempty(&urb->timer_list);
+}
+
+static inline uint32_t usbh_urb_timer_ms2tick(uint32_t ms)
+{
+    /* one extra tick so that a partly elapsed tick never shortens the timeout */
+#if CONFIG_USBHOST_URB_TIMER_TICK_US >= 1000
+    return (ms + (CONFIG_USBHOST_URB_TIMER_TICK_US / 1000) - 1) / (CONFIG_USBHOST_URB_TIMER_TICK_US / 1000) + 1;
+#else
+    if (ms > (0x7fffffffU / (1000 / CONFIG_USBHOST_URB_TIMER_TICK_US))) {
+        ms = 0x7fffffffU / (1000 / CONFIG_USBHOST_URB_TIMER_TICK_US);
+    }
+    return ms * (1000 / CONFIG_USBHOST_URB_TIMER_TICK_US) + 1;
+#endif
+}
+
+static void usbh_urb_wheel_add(struct usbh_urb_wheel *wheel, struct usbh_urb *urb)
+{
+    uint32_t expires = urb->timer_expires;
+    uint32_t delta = expires - wheel->now;
+    usb_dlist_t *slot;
+
+    if (delta >= USBH_URB_WHEEL_RANGE) {
+        /* beyond wheel range, park in the furthest slot and add again when it is cascaded */
+        delta = USBH_URB_WHEEL_RANGE - 1;
+        expires = wheel->now + delta;
+    }
+
+    if (delta < USBH_URB_WHEEL_SLOTS) {
+        slot = &wheel->slot[0][expires & USBH_URB_WHEEL_MASK];
+    } else if (delta < (1U << (USBH_URB_WHEEL_BITS * 2))) {
+        slot = &wheel->slot[1][(expires >> USBH_URB_WHEEL_BITS) & USBH_URB_WHEEL_MASK];
+    } else {
+        slot = &wheel->slot[2][(expires >> (USBH_URB_WHEEL_BITS * 2)) & USBH_URB_WHEEL_MASK];
+    }
+
+    usb_dlist_insert_before(slot, &urb->timer_list);
+}
+
+static void usbh_urb_wheel_cascade(struct usbh_urb_wheel *wheel, usb_dlist_t *slot)
+{
+    usb_dlist_t list;
+    struct usbh_urb *urb;
+
+    if (usb_dlist_isempty(slot)) {
+        return;
+    }
+
+    /* detach slot first, parked urbs may land in it again */
+    list.next = slot->next;
+    list.prev = slot->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    usb_dlist_init(slot);
+
+    while (!usb_dlist_isempty(&list)) {
+        urb = usb_dlist_entry(list.next, struct usbh_urb, timer_list);
+        usb_dlist_remove(&urb->timer_list);
+        usbh_urb_wheel_add(wheel, urb);
+    }
+}
+
+uint32_t usbh_urb_timer_start(struct usbh_urb *urb)
+{
+    struct usbh_urb_wheel *wheel;
+    uint32_t ms;
+    size_t flags;
+
+    ms = urb->timeout ? urb->timeout : urb->async_timeout;
+    wheel = &g_urb_wheel[urb->hport->bus->busid];
+
+    flags = usb_osal_enter_critical_section();
+
+    urb->transfer_flags &= ~USBH_URB_TIMEDOUT;
+    if (usbh_urb_timer_pending(urb)) {
+        usb_dlist_remove(&urb->timer_list);
+    }
+
+    if ((ms == 0) || (ms == USB_OSAL_WAITING_FOREVER) || !wheel->active) {
+        usb_osal_leave_critical_section(flags);
+        return urb->timeout;
+    }
+
+    /* urb may have completed before hcd armed it */
+    if (urb->errorcode == -USB_ERR_BUSY) {
+        urb->timer_expires = wheel->now + usbh_urb_timer_ms2tick(ms);
+        usbh_urb_wheel_add(wheel, urb);
+    }
+
+    usb_osal_leave_critical_section(flags);
+    return USB_OSAL_WAITING_FOREVER;
+}
+
+void usbh_urb_timer_stop(struct usbh_urb *urb)
+{
+    size_t flags;
+
+    if (!urb) {
+        return;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (usbh_urb_timer_pending(urb)) {
+        usb_dlist_remove(&urb->timer_list);
+    }
+    usb_osal_leave_critical_section(flags);
+}
+
+static void usbh_urb_timer_tick(struct usbh_bus *bus)
+{
+    struct usbh_urb_wheel *wheel = &g_urb_wheel[bus->busid];
+    struct usbh_urb *urb;
+    usb_dlist_t expired;
+    usb_dlist_t *slot;
+    uint32_t index;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+
+    if (!wheel->active) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+
+    wheel->now++;
+    index = wheel->now & USBH_URB_WHEEL_MASK;
+    if (index == 0) {
+        if (((wheel->now >> USBH_URB_WHEEL_BITS) & USBH_URB_WHEEL_MASK) == 0) {
+            usbh_urb_wheel_cascade(wheel, &wheel->slot[2][(wheel->now >> (USBH_URB_WHEEL_BITS * 2)) & USBH_URB_WHEEL_MASK]);
+        }
+        usbh_urb_wheel_cascade(wheel, &wheel->slot[1][(wheel->now >> USBH_URB_WHEEL_BITS) & USBH_URB_WHEEL_MASK]);
+    }
+
+    /* urbs stay pending on expired list, so a complete callback that resubmits one of them takes it off */
+    usb_dlist_init(&expired);
+    slot = &wheel->slot[0][index];
+    while (!usb_dlist_isempty(slot)) {
+        usb_dlist_move_tail(&expired, slot->next);
+    }
+
+    /*
+     * Kill with the lock held, hcd kill nests its own critical section. Released in between, the urb
+     * could complete and be resubmitted, and the kill would abort that new submission.
+     */
+    while (!usb_dlist_isempty(&expired)) {
+        urb = usb_dlist_entry(expired.next, struct usbh_urb, timer_list);
+        usb_dlist_remove(&urb->timer_list);
+        if (urb->errorcode != -USB_ERR_BUSY) {
+            continue;
+        }
+        urb->transfer_flags |= USBH_URB_TIMEDOUT;
+        usbh_kill_urb(urb);
+        urb->transfer_flags &= ~USBH_URB_TIMEDOUT;
+    }
+
+    usb_osal_leave_critical_section(flags);
+}
+
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+void usbh_urb_timer_sof(struct usbh_bus *bus, uint32_t us)
+{
+    struct usbh_urb_wheel *wheel = &g_urb_wheel[bus->busid];
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (!wheel->ready) {
+        usb_osal_leave_critical_section(flags);
+        return;
+    }
+    /* urbs submitted before the first sof keep their semaphore timeout */
+    wheel->active = true;
+    wheel->sof_us += us;
+    usb_osal_leave_critical_section(flags);
+
+    while (wheel->sof_us >= CONFIG_USBHOST_URB_TIMER_TICK_US) {
+        wheel->sof_us -= CONFIG_USBHOST_URB_TIMER_TICK_US;
+        usbh_urb_timer_tick(bus);
+    }
+}
+#else
+static void usbh_urb_timer_handler(void *argument)
+{
+    usbh_urb_timer_tick((struct usbh_bus *)argument);
+}
+#endif
+
+static void usbh_urb_timer_init(struct usbh_bus *bus)
+{
+    struct usbh_urb_wheel *wheel = &g_urb_wheel[bus->busid];
+
+    memset(wheel, 0, sizeof(struct usbh_urb_wheel));
+    for (uint8_t i = 0; i < USBH_URB_WHEEL_LEVELS; i++) {
+        for (uint32_t j = 0; j < USBH_URB_WHEEL_SLOTS; j++) {
+            usb_dlist_init(&wheel->slot[i][j]);
+        }
+    }
+
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+    wheel->ready = true;
+#else
+    wheel->timer = usb_osal_timer_create("usbh_wheel", CONFIG_USBHOST_URB_TIMER_TICK_US / 1000, usbh_urb_timer_handler, bus, true);
+    if (wheel->timer == NULL) {
+        /* hcd keeps using semaphore timeouts */
+        USB_LOG_ERR("Fail to create urb timer\r\n");
+        return;
+    }
+    usb_osal_timer_start(wheel->timer);
+    wheel->active = true;
+#endif
+}
+
+static void usbh_urb_timer_deinit(struct usbh_bus *bus)
+{
+    struct usbh_urb_wheel *wheel = &g_urb_wheel[bus->busid];
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    wheel->active = false;
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+    wheel->ready = false;
+#endif
+    for (uint8_t i = 0; i < USBH_URB_WHEEL_LEVELS; i++) {
+        for (uint32_t j = 0; j < USBH_URB_WHEEL_SLOTS; j++) {
+            while (!usb_dlist_isempty(&wheel->slot[i][j])) {
+                usb_dlist_remove(wheel->slot[i][j].next);
+            }
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+
+    if (wheel->timer) {
+        usb_osal_timer_stop(wheel->timer);
+        usb_osal_timer_delete(wheel->timer);
+        wheel->timer = NULL;
+    }
+}
+#endif
+
 static void usbh_bus_init(struct usbh_bus *bus, uint8_t busid, uintptr_t reg_base)
 {
     memset(bus, 0, sizeof(struct usbh_bus));
@@ -646,6 +1240,18 @@ int usbh_initialize(uint8_t busid, uintptr_t reg_base, usbh_event_handler_t even
 #elif defined(__ICCARM__) || defined(__ICCRX__) || defined(__ICCRISCV__)
     usbh_class_info_table_begin = (struct usbh_class_info *)__section_begin(".usbh_class_info");
     usbh_class_info_table_end = (struct usbh_class_info *)__section_end(".usbh_class_info");
+#endif
+#ifdef CONFIG_USBHOST_URB_BH
+    usbh_urb_bh_init();
+#endif
+#ifdef CONFIG_USBHOST_URB_TIMER
+    usbh_urb_timer_init(bus);
+#endif
+#ifdef CONFIG_USB_TRACE
+    usb_trace_enable(&g_usbh_trace_ring[busid], true);
+#endif
+#ifdef CONFIG_USB_LOG_DEFERRED
+    usb_log_init();
 #endif
     usbh_hub_initialize(bus);
     return 0;
@@ -667,8 +1273,17 @@ int usbh_deinitialize(uint8_t busid)
 
     usbh_hub_deinitialize(bus);
 
+#ifdef CONFIG_USBHOST_URB_TIMER
+    usbh_urb_timer_deinit(bus);
+#endif
+
     usb_slist_remove(&g_bus_head, &bus->list);
 
+#ifdef CONFIG_USBHOST_URB_BH
+    if (usb_slist_isempty(&g_bus_head)) {
+        usbh_urb_bh_deinit();
+    }
+#endif
     return 0;
 }
 
@@ -921,7 +1536,38 @@ static void usbh_print_hubport_info(struct usbh_hubport *hport)
     }
 }
 
-static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, int dev_addr, int vid, int pid)
+#ifdef CONFIG_USB_EP_STAT
+static void usbh_print_ep_stat(struct usbh_hubport *hport)
+{
+    static const char *err_table[USB_EP_STAT_ERR_NUM] = {
+        "", "nomem", "inval", "nodev", "notconn", "notsupp", "busy", "range",
+        "stall", "babble", "nak", "dt", "io", "shutdown", "timeout"
+    };
+    struct usb_ep_stat *stat;
+
+    for (uint8_t i = 0; i < CONFIG_USBHOST_EP_STAT_NUM; i++) {
+        stat = &hport->ep_stat[i];
+        if ((i > 0) && (stat->ep == 0)) {
+            break;
+        }
+
+        USB_LOG_RAW("    EP 0x%02x: %u transfers, %u bytes, %u short, %u naks\r\n",
+                    stat->ep, stat->transfers, stat->bytes, stat->short_packets, stat->naks);
+#ifdef CONFIG_USB_EP_STAT_LATENCY
+        uint32_t avg = stat->transfers ? (uint32_t)(stat->latency_sum / stat->transfers) : 0;
+        USB_LOG_RAW("        latency min/avg/max %u/%u/%u us\r\n", stat->latency_min, avg, stat->latency_max);
+#endif
+
+        for (uint8_t j = 1; j < USB_EP_STAT_ERR_NUM; j++) {
+            if (stat->errors[j]) {
+                USB_LOG_RAW("        %s errors: %u\r\n", err_table[j], stat->errors[j]);
+            }
+        }
+    }
+}
+#endif
+
+static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, bool stat, int dev_addr, int vid, int pid)
 {
     static const char *speed_table[] = {
         "UNKNOWN",
@@ -971,6 +1617,7 @@ static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, in
     bus = hub->bus;
 
     (void)speed_table;
+    (void)stat;
 
     if (hub->is_roothub) {
         if (astree) {
@@ -983,6 +1630,11 @@ static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, in
                     USB_LOG_RAW("Bus %03u Device %03u: ID %04x:%04x %s %s root hub\r\n",
                                 bus->busid, hub->hub_addr, 0xffff, 0xffff,
                                 "Cherry-Embedded", root_speed_table[hub->speed]);
+#ifdef CONFIG_USB_EP_STAT
+                    if (stat) {
+                        USB_LOG_RAW("    %u irqs\r\n", usbh_get_irq_count(bus->busid));
+                    }
+#endif
                 }
             }
         }
@@ -1030,6 +1682,11 @@ static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, in
                         if (verbose) {
                             usbh_print_hubport_info(hport);
                         }
+#ifdef CONFIG_USB_EP_STAT
+                        if (stat) {
+                            usbh_print_ep_stat(hport);
+                        }
+#endif
                     }
                 }
             }
@@ -1049,7 +1706,7 @@ static void usbh_list_device(struct usbh_hub *hub, bool astree, bool verbose, in
                         hub_next = hport->config.intf[intf].priv;
 
                         if (hub_next && hub_next->connected) {
-                            usbh_list_device(hub_next, astree, verbose, dev_addr, vid, pid);
+                            usbh_list_device(hub_next, astree, verbose, stat, dev_addr, vid, pid);
                         }
                     }
                 } else if (astree) {
@@ -1074,7 +1731,8 @@ void lsusb_help(void)
                 "    - increase verbosity (show descriptors)\r\n"
                 "-s [[bus]:][dev_addr]\r\n"
                 "    - show only devices with specified device and/or\r\n"
-                "      bus numbers (in decimal)\r\n"
+                "      bus numbers (in decimal), with endpoint and irq\r\n"
+                "      counters when CONFIG_USB_EP_STAT is defined\r\n"
                 "-d vendor:[product]\r\n"
                 "    - show only devices with the specified vendor and\r\n"
                 "      product ID numbers (in hexadecimal)\r\n"
@@ -1097,6 +1755,7 @@ int lsusb(int argc, char **argv)
     int pid = -1;
     bool astree = false;
     bool verbose = false;
+    bool stat = false;
 
     if (argc < 2) {
         lsusb_help();
@@ -1118,6 +1777,7 @@ int lsusb(int argc, char **argv)
         } else if (!strcmp(*argv, "-t") || !strcmp(*argv, "--tree")) {
             astree = true;
         } else if (!strcmp(*argv, "-s")) {
+            stat = true;
             if (argc > 1) {
                 argc--;
                 argv++;
@@ -1189,6 +1849,7 @@ int lsusb(int argc, char **argv)
         vid = -1;
         pid = -1;
         verbose = false;
+        stat = false;
     }
 
     usb_slist_for_each(bus_list, &g_bus_head)
@@ -1200,7 +1861,7 @@ int lsusb(int argc, char **argv)
             }
         }
 
-        usbh_list_device(&bus->hcd.roothub, astree, verbose, dev_addr, vid, pid);
+        usbh_list_device(&bus->hcd.roothub, astree, verbose, stat, dev_addr, vid, pid);
     }
 
     return 0;
@@ -23,6 +23,8 @@
 #include "usb_memcpy.h"
 #include "usb_dcache.h"
 #include "usb_version.h"
+#include "usb_trace.h"
+#include "usb_ep_stat.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -150,6 +152,9 @@ struct usbh_hubport {
     struct usb_endpoint_descriptor ep0;
     struct usbh_urb ep0_urb;
     usb_osal_mutex_t mutex;
+#ifdef CONFIG_USB_EP_STAT
+    struct usb_ep_stat ep_stat[CONFIG_USBHOST_EP_STAT_NUM]; /* ep0 first, others in order of first submit */
+#endif
 };
 
 struct usbh_hub {
@@ -314,6 +319,100 @@ struct usbh_hubport *usbh_find_hubport(uint8_t busid, uint8_t hub_index, uint8_t
 
 int lsusb(int argc, char **argv);
 
+#ifdef CONFIG_USB_TRACE
+extern struct usb_trace_ring g_usbh_trace_ring[CONFIG_USBHOST_MAX_BUS];
+
+#endif
+
+#if defined(CONFIG_USB_TRACE) || defined(CONFIG_USB_EP_STAT)
+/* Record urb submit or complete on the trace ring and endpoint counters, submit of a control urb carries the setup packet */
+void usbh_trace_urb(struct usbh_urb *urb, uint8_t type);
+/* Record hcd interrupt entry and exit, entries are counted per bus */
+void usbh_trace_irq(uint8_t busid, uint8_t type, uint32_t status);
+#else
+#define usbh_trace_urb(urb, type)
+#define usbh_trace_irq(busid, type, status)
+#endif
+
+#ifdef CONFIG_USB_EP_STAT
+/* Count a nak or retry of urb, called by hcd when the controller reports one */
+void usbh_ep_stat_nak(struct usbh_urb *urb);
+/* Copy counters of endpoint ep (address with direction bit) of hport, counters restart when device reconnects */
+int usbh_get_ep_stat(struct usbh_hubport *hport, uint8_t ep, struct usb_ep_stat *stat);
+uint32_t usbh_get_irq_count(uint8_t busid);
+#else
+#define usbh_ep_stat_nak(urb)
+#endif
+
+#ifdef CONFIG_USBHOST_URB_TIMER
+/**
+ * @brief Arm urb deadline on the wheel of its bus, called by hcd in usbh_submit_urb once urb is queued.
+ *
+ * Deadline is urb->timeout for sync urbs and urb->async_timeout for urbs with complete. When it expires
+ * the wheel kills the urb, which then finishes with -USB_ERR_TIMEOUT.
+ *
+ * @return timeout for hcd to wait on, USB_OSAL_WAITING_FOREVER when the wheel tracks the urb.
+ */
+uint32_t usbh_urb_timer_start(struct usbh_urb *urb);
+/* Disarm urb deadline, called from usbh_urb_giveback and by hcd in usbh_kill_urb */
+void usbh_urb_timer_stop(struct usbh_urb *urb);
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+/* Advance wheel by one (micro)frame of us microseconds, called by hcd from its sof interrupt */
+void usbh_urb_timer_sof(struct usbh_bus *bus, uint32_t us);
+#endif
+#else
+static inline uint32_t usbh_urb_timer_start(struct usbh_urb *urb)
+{
+    return urb->timeout;
+}
+
+static inline void usbh_urb_timer_stop(struct usbh_urb *urb)
+{
+    (void)urb;
+}
+#endif
+
+#ifdef CONFIG_USBHOST_URB_BH
+struct usbh_urb_bh_stat {
+    uint32_t queued;    /* completions handed to worker */
+    uint32_t completed; /* callbacks run by worker */
+    uint32_t merged;    /* nak completions of an urb that was still queued, dropped */
+    uint32_t depth;
+    uint32_t max_depth;
+};
+
+/**
+ * @brief Finish an urb, called by hcd from interrupt once urb is done.
+ *
+ * Urbs with USBH_URB_BH in transfer_flags are queued and complete runs in worker thread
+ * USBH_URB_BH_PRIO(n), where it may sleep, take locks and resubmit. Other urbs complete at once.
+ * Such an urb must not be resubmitted before its callback ran, result of the queued completion is kept.
+ */
+void usbh_urb_giveback(struct usbh_urb *urb);
+/* Drop a completion still waiting for worker, called by hcd in usbh_kill_urb. A callback already running is not waited for */
+void usbh_urb_bh_cancel(struct usbh_urb *urb);
+void usbh_urb_bh_get_stat(uint8_t index, struct usbh_urb_bh_stat *stat);
+#else
+static inline void usbh_urb_giveback(struct usbh_urb *urb)
+{
+    usbh_urb_timer_stop(urb);
+    usbh_trace_urb(urb, USB_TRACE_COMPLETE);
+
+    if (urb->complete) {
+        if (urb->errorcode < 0) {
+            urb->complete(urb->arg, urb->errorcode);
+        } else {
+            urb->complete(urb->arg, urb->actual_length);
+        }
+    }
+}
+
+static inline void usbh_urb_bh_cancel(struct usbh_urb *urb)
+{
+    (void)urb;
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
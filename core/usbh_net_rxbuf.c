@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_net_rxbuf.h"
+
+#ifdef CONFIG_USBHOST_NET_RXBUF
+
+#define USBH_NET_RXBUF_BLOCK USB_ALIGN_UP(CONFIG_USBHOST_NET_RXBUF_SIZE, CONFIG_USB_ALIGN_SIZE)
+
+static USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t g_usbh_net_rxbuf[CONFIG_USBHOST_NET_RXBUF_NUM][USBH_NET_RXBUF_BLOCK];
+static uint16_t g_usbh_net_rxbuf_ref[CONFIG_USBHOST_NET_RXBUF_NUM];
+
+static int usbh_net_rxbuf_index(const uint8_t *buf)
+{
+    if ((buf < &g_usbh_net_rxbuf[0][0]) || (buf >= &g_usbh_net_rxbuf[CONFIG_USBHOST_NET_RXBUF_NUM - 1][USBH_NET_RXBUF_BLOCK])) {
+        return -1;
+    }
+    return (int)((uint32_t)(buf - &g_usbh_net_rxbuf[0][0]) / USBH_NET_RXBUF_BLOCK);
+}
+
+uint8_t *usbh_net_rxbuf_alloc(uint32_t size)
+{
+    size_t flags;
+
+    if (size > USBH_NET_RXBUF_BLOCK) {
+        return NULL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    for (uint8_t i = 0; i < CONFIG_USBHOST_NET_RXBUF_NUM; i++) {
+        if (g_usbh_net_rxbuf_ref[i] == 0) {
+            g_usbh_net_rxbuf_ref[i] = 1;
+            usb_osal_leave_critical_section(flags);
+            return g_usbh_net_rxbuf[i];
+        }
+    }
+    usb_osal_leave_critical_section(flags);
+    return NULL;
+}
+
+int usbh_net_rxbuf_ref(const uint8_t *buf)
+{
+    int index = usbh_net_rxbuf_index(buf);
+    size_t flags;
+
+    if (index < 0) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    g_usbh_net_rxbuf_ref[index]++;
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
+int usbh_net_rxbuf_free(const uint8_t *buf)
+{
+    int index = usbh_net_rxbuf_index(buf);
+    size_t flags;
+
+    if (index < 0) {
+        return -USB_ERR_INVAL;
+    }
+
+    flags = usb_osal_enter_critical_section();
+    if (g_usbh_net_rxbuf_ref[index]) {
+        g_usbh_net_rxbuf_ref[index]--;
+    }
+    usb_osal_leave_critical_section(flags);
+    return 0;
+}
+
+uint8_t *usbh_net_rxbuf_renew(uint8_t *buf, uint8_t *fallback, uint32_t size)
+{
+    int index = usbh_net_rxbuf_index(buf);
+
+    /* nothing was passed up or all frames are already freed, reuse block */
+    if ((index >= 0) && (g_usbh_net_rxbuf_ref[index] == 1)) {
+        return buf;
+    }
+
+    usbh_net_rxbuf_free(buf);
+    buf = usbh_net_rxbuf_alloc(size);
+    return buf ? buf : fallback;
+}
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_NET_RXBUF_H
+#define USBH_NET_RXBUF_H
+
+#include <stdint.h>
+
+/*
+ * Rx buffer pool shared by host net drivers. A driver rx thread owns one reference on the block it fills and parses,
+ * the network glue takes one more for every frame it keeps past eth_input, block is reused once all are dropped.
+ * Frames from any other buffer are not refcounted and must be copied before eth_input returns.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_USBHOST_NET_RXBUF
+/* Return a block with one reference, NULL if pool is empty or size is larger than block */
+uint8_t *usbh_net_rxbuf_alloc(uint32_t size);
+
+/* Take one reference on the block holding buf, -USB_ERR_INVAL if buf is not from pool */
+int usbh_net_rxbuf_ref(const uint8_t *buf);
+
+/* Drop one reference on the block holding buf, -USB_ERR_INVAL if buf is not from pool */
+int usbh_net_rxbuf_free(const uint8_t *buf);
+
+/**
+ * @brief Get rx buffer for next transfer, called by rx thread before a new transfer is started.
+ *
+ * @param buf buffer of last transfer, kept if nobody else holds it, otherwise its reference is dropped.
+ * @param fallback driver static buffer, returned when pool is empty or too small.
+ * @param size bytes the driver may receive into the buffer.
+ */
+uint8_t *usbh_net_rxbuf_renew(uint8_t *buf, uint8_t *fallback, uint32_t size);
+#else
+#define usbh_net_rxbuf_renew(buf, fallback, size) (fallback)
+#define usbh_net_rxbuf_free(buf)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USBH_NET_RXBUF_H */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_net_rxbuf.h"
+#include "usbh_net_rxq.h"
+
+#ifdef CONFIG_USBHOST_URB_BH
+
+static void usbh_net_rxq_complete(void *arg, int nbytes);
+
+static uint8_t *usbh_net_rxq_renew(struct usbh_net_rxq *rxq, uint8_t index)
+{
+    return usbh_net_rxbuf_renew(rxq->buf[index], &rxq->fallback[index * rxq->stride], rxq->size);
+}
+
+/* Submit urb on next free buffer unless it is running or stopped */
+static void usbh_net_rxq_kick(struct usbh_net_rxq *rxq)
+{
+    uint8_t index;
+    size_t flags;
+    bool start;
+    int ret;
+
+    flags = usb_osal_enter_critical_section();
+    start = !rxq->busy && (rxq->status == 0) && (rxq->filled < rxq->num);
+    if (start) {
+        rxq->busy = true;
+    }
+    index = (rxq->head + rxq->filled) % rxq->num;
+    usb_osal_leave_critical_section(flags);
+
+    if (!start) {
+        return;
+    }
+
+    usbh_bulk_urb_fill(rxq->urb, rxq->hport, rxq->ep, rxq->buf[index], rxq->size, 0, usbh_net_rxq_complete, rxq);
+    rxq->urb->transfer_flags |= USBH_URB_BH;
+    ret = usbh_submit_urb(rxq->urb);
+    if (ret < 0) {
+        flags = usb_osal_enter_critical_section();
+        rxq->status = ret;
+        rxq->busy = false;
+        usb_osal_leave_critical_section(flags);
+        usb_osal_sem_give(rxq->sem);
+    }
+}
+
+static void usbh_net_rxq_complete(void *arg, int nbytes)
+{
+    struct usbh_net_rxq *rxq = (struct usbh_net_rxq *)arg;
+    size_t flags;
+
+    flags = usb_osal_enter_critical_section();
+    if (nbytes < 0) {
+        rxq->status = nbytes;
+    } else {
+        rxq->len[(rxq->head + rxq->filled) % rxq->num] = nbytes;
+        rxq->filled++;
+    }
+    rxq->busy = false;
+    usb_osal_leave_critical_section(flags);
+
+    usbh_net_rxq_kick(rxq);
+    usb_osal_sem_give(rxq->sem);
+}
+
+void usbh_net_rxq_init(struct usbh_net_rxq *rxq, struct usbh_urb *urb, struct usbh_hubport *hport, struct usb_endpoint_descriptor *ep,
+                       uint8_t *fallback, uint32_t stride, uint8_t num, uint32_t size)
+{
+    rxq->urb = urb;
+    rxq->hport = hport;
+    rxq->ep = ep;
+    rxq->fallback = fallback;
+    rxq->stride = stride;
+    rxq->num = MIN(num, USBH_NET_RXQ_MAX_NUM);
+    rxq->size = MIN(size, stride);
+}
+
+int usbh_net_rxq_start(struct usbh_net_rxq *rxq)
+{
+    if (rxq->sem == NULL) {
+        rxq->sem = usb_osal_sem_create(0);
+        if (rxq->sem == NULL) {
+            return -USB_ERR_NOMEM;
+        }
+    }
+    usb_osal_sem_reset(rxq->sem);
+
+    for (uint8_t i = 0; i < rxq->num; i++) {
+        rxq->buf[i] = usbh_net_rxq_renew(rxq, i);
+    }
+    rxq->head = 0;
+    rxq->filled = 0;
+    rxq->busy = false;
+    rxq->status = 0;
+
+    usbh_net_rxq_kick(rxq);
+    return rxq->status;
+}
+
+int usbh_net_rxq_wait(struct usbh_net_rxq *rxq, uint8_t **buf, uint32_t *len)
+{
+    /* filled is only decreased by rx thread, completion may only add more */
+    while (rxq->filled == 0) {
+        if ((rxq->status < 0) && !rxq->busy) {
+            return rxq->status;
+        }
+        usb_osal_sem_take(rxq->sem, USB_OSAL_WAITING_FOREVER);
+    }
+
+    *buf = rxq->buf[rxq->head];
+    *len = rxq->len[rxq->head];
+    return 0;
+}
+
+void usbh_net_rxq_release(struct usbh_net_rxq *rxq)
+{
+    uint8_t index = rxq->head;
+    size_t flags;
+
+    rxq->buf[index] = usbh_net_rxq_renew(rxq, index);
+
+    flags = usb_osal_enter_critical_section();
+    rxq->head = (index + 1) % rxq->num;
+    rxq->filled--;
+    usb_osal_leave_critical_section(flags);
+
+    usbh_net_rxq_kick(rxq);
+}
+
+void usbh_net_rxq_free(struct usbh_net_rxq *rxq)
+{
+    for (uint8_t i = 0; i < USBH_NET_RXQ_MAX_NUM; i++) {
+        usbh_net_rxbuf_free(rxq->buf[i]);
+        rxq->buf[i] = NULL;
+    }
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_NET_RXQ_H
+#define USBH_NET_RXQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Rx buffer ring of host net drivers. Hcd keeps one urb per endpoint, so buffers take turns on the bulk in urb:
+ * completion restarts it on next free buffer in a CONFIG_USBHOST_URB_BH worker while rx thread parses the filled
+ * ones, bus only waits when every buffer is waiting to be parsed. Buffers come from usbh_net_rxbuf pool when it
+ * is large enough, else from the driver static buffers.
+ */
+
+#define USBH_NET_RXQ_MAX_NUM 8
+
+#ifdef CONFIG_USBHOST_URB_BH
+struct usbh_net_rxq {
+    struct usbh_urb *urb;
+    struct usbh_hubport *hport;
+    struct usb_endpoint_descriptor *ep;
+    uint8_t *fallback; /* num static buffers of stride bytes */
+    uint32_t stride;
+    uint32_t size; /* transfer length */
+    uint8_t num;
+
+    uint8_t *buf[USBH_NET_RXQ_MAX_NUM];
+    uint32_t len[USBH_NET_RXQ_MAX_NUM];
+    uint8_t head;   /* oldest filled buffer */
+    uint8_t filled; /* buffers waiting for rx thread, the one behind them is on the bus when busy */
+    bool busy;
+    int status; /* urb error, ring is stopped */
+    usb_osal_sem_t sem;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set up ring, call before usbh_net_rxq_start.
+ *
+ * @param fallback num dma usable buffers of stride bytes, used when usbh_net_rxbuf pool is off, empty or too small.
+ * @param size bytes of every transfer, not larger than stride.
+ */
+void usbh_net_rxq_init(struct usbh_net_rxq *rxq, struct usbh_urb *urb, struct usbh_hubport *hport, struct usb_endpoint_descriptor *ep,
+                       uint8_t *fallback, uint32_t stride, uint8_t num, uint32_t size);
+
+/* Start first transfer from rx thread */
+int usbh_net_rxq_start(struct usbh_net_rxq *rxq);
+
+/**
+ * @brief Wait for oldest filled buffer, buffers are returned in bus order.
+ *
+ * @return 0 with buf and len set, or urb error once ring is stopped and all filled buffers are consumed.
+ */
+int usbh_net_rxq_wait(struct usbh_net_rxq *rxq, uint8_t **buf, uint32_t *len);
+
+/* Give buffer from usbh_net_rxq_wait back to ring, frames taken by usbh_net_rxbuf_ref stay valid */
+void usbh_net_rxq_release(struct usbh_net_rxq *rxq);
+
+/* Drop pool buffers, call when rx thread exits after ring is stopped */
+void usbh_net_rxq_free(struct usbh_net_rxq *rxq);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* USBH_NET_RXQ_H */
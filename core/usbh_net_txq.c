@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "usbh_core.h"
+#include "usbh_net_txq.h"
+
+#ifdef CONFIG_USBHOST_NET_TXQ
+
+static void usbh_net_txq_complete(void *arg, int nbytes);
+
+static int usbh_net_txq_submit(struct usbh_net_txq *txq, uint8_t *buf, uint32_t len)
+{
+    usbh_bulk_urb_fill(txq->urb, txq->hport, txq->ep, buf, len, 0, usbh_net_txq_complete, txq);
+    txq->urb->transfer_flags |= USBH_URB_BH;
+    return usbh_submit_urb(txq->urb);
+}
+
+/* Remove head entry into entry, entry->done stays NULL if queue was flushed meanwhile. Return true if more are queued */
+static bool usbh_net_txq_pop(struct usbh_net_txq *txq, struct usbh_net_txq_entry *entry)
+{
+    size_t flags;
+    bool more;
+
+    flags = usb_osal_enter_critical_section();
+    if (txq->count == 0) {
+        usb_osal_leave_critical_section(flags);
+        return false;
+    }
+    memcpy(entry, &txq->entry[txq->head], sizeof(struct usbh_net_txq_entry));
+    txq->head = (txq->head + 1) % CONFIG_USBHOST_NET_TXQ_NUM;
+    txq->count--;
+    more = (txq->count > 0);
+    usb_osal_leave_critical_section(flags);
+
+    return more;
+}
+
+/* Copy up to count frames from head into agg_buf, return frames packed, less than 2 is not worth a copy */
+static uint8_t usbh_net_txq_pack(struct usbh_net_txq *txq, uint8_t count, uint32_t *len)
+{
+    struct usbh_net_txq_entry *entry;
+    uint32_t offset = 0;
+    uint32_t start;
+    uint8_t i;
+
+    for (i = 0; i < count; i++) {
+        entry = &txq->entry[(txq->head + i) % CONFIG_USBHOST_NET_TXQ_NUM];
+        start = (offset + txq->agg_align - 1) & ~((uint32_t)txq->agg_align - 1);
+        if ((start + entry->len) > txq->agg_size) {
+            break;
+        }
+        if (i == 1) {
+            /* first frame is only copied once a second one fits */
+            memcpy(txq->agg_buf, txq->entry[txq->head].buf, txq->entry[txq->head].len);
+        }
+        if (i > 0) {
+            memcpy(&txq->agg_buf[start], entry->buf, entry->len);
+        }
+        offset = start + entry->len;
+    }
+
+    if ((i > 1) && txq->agg_end) {
+        offset = txq->agg_end(txq->agg_buf, offset);
+    }
+    *len = offset;
+    return (i > 1) ? i : 0;
+}
+
+/* Start next transfer or mark urb idle, called by the only consumer while urb is idle */
+static void usbh_net_txq_kick(struct usbh_net_txq *txq)
+{
+    struct usbh_net_txq_entry entry;
+    uint32_t len;
+    uint8_t count;
+    size_t flags;
+    int ret;
+
+    while (1) {
+        flags = usb_osal_enter_critical_section();
+        count = txq->count;
+        if (count == 0) {
+            txq->busy = false;
+            txq->agg = false;
+        }
+        usb_osal_leave_critical_section(flags);
+
+        if (count == 0) {
+            return;
+        }
+
+        /* entries from head to count are stable, push only appends behind them */
+        count = txq->agg_buf ? usbh_net_txq_pack(txq, count, &len) : 0;
+        txq->agg = (count > 0);
+        if (txq->agg) {
+            ret = usbh_net_txq_submit(txq, txq->agg_buf, len);
+        } else {
+            count = 1;
+            ret = usbh_net_txq_submit(txq, txq->entry[txq->head].buf, txq->entry[txq->head].len);
+            if (ret == 0) {
+                return;
+            }
+        }
+
+        /* packed frames are sent from agg_buf, single frame here could not be started */
+        while (count--) {
+            entry.done = NULL;
+            usbh_net_txq_pop(txq, &entry);
+            if (entry.done) {
+                entry.done(entry.arg, ret);
+            }
+        }
+        if (ret == 0) {
+            return;
+        }
+    }
+}
+
+static void usbh_net_txq_complete(void *arg, int nbytes)
+{
+    struct usbh_net_txq *txq = (struct usbh_net_txq *)arg;
+    struct usbh_net_txq_entry entry;
+
+    /* killed on disconnect, queued frames are released by usbh_net_txq_flush */
+    if (nbytes == -USB_ERR_SHUTDOWN) {
+        return;
+    }
+
+    entry.done = NULL;
+    if (!txq->agg) {
+        usbh_net_txq_pop(txq, &entry);
+    }
+    /* start next transfer before releasing this frame, bus is idle as short as possible */
+    usbh_net_txq_kick(txq);
+    if (entry.done) {
+        entry.done(entry.arg, (nbytes < 0) ? nbytes : 0);
+    }
+}
+
+void usbh_net_txq_init(struct usbh_net_txq *txq, struct usbh_urb *urb, struct usbh_hubport *hport, struct usb_endpoint_descriptor *ep)
+{
+    memset(txq, 0, sizeof(struct usbh_net_txq));
+    txq->urb = urb;
+    txq->hport = hport;
+    txq->ep = ep;
+}
+
+void usbh_net_txq_set_agg(struct usbh_net_txq *txq, uint8_t *buf, uint32_t size, uint8_t align, usbh_net_txq_agg_end_t end)
+{
+    txq->agg_buf = buf;
+    txq->agg_size = size;
+    txq->agg_align = align ? align : 1;
+    txq->agg_end = end;
+}
+
+int usbh_net_txq_push(struct usbh_net_txq *txq, uint8_t *buf, uint32_t len, usbh_net_txq_done_t done, void *arg)
+{
+    struct usbh_net_txq_entry *entry;
+    size_t flags;
+    bool start;
+    int ret;
+
+    flags = usb_osal_enter_critical_section();
+    if (txq->count >= CONFIG_USBHOST_NET_TXQ_NUM) {
+        usb_osal_leave_critical_section(flags);
+        return -USB_ERR_BUSY;
+    }
+    entry = &txq->entry[(txq->head + txq->count) % CONFIG_USBHOST_NET_TXQ_NUM];
+    entry->buf = buf;
+    entry->len = len;
+    entry->done = done;
+    entry->arg = arg;
+    txq->count++;
+    start = !txq->busy;
+    txq->busy = true;
+    usb_osal_leave_critical_section(flags);
+
+    if (!start) {
+        return 0;
+    }
+
+    /* urb was idle so queue was empty, this frame is head */
+    txq->agg = false;
+    ret = usbh_net_txq_submit(txq, txq->entry[txq->head].buf, txq->entry[txq->head].len);
+    if (ret < 0) {
+        /* push is not reentrant, so this frame is still the only one queued */
+        flags = usb_osal_enter_critical_section();
+        txq->head = (txq->head + 1) % CONFIG_USBHOST_NET_TXQ_NUM;
+        txq->count--;
+        txq->busy = false;
+        usb_osal_leave_critical_section(flags);
+    }
+    return ret;
+}
+
+void usbh_net_txq_flush(struct usbh_net_txq *txq)
+{
+    struct usbh_net_txq_entry entry;
+    size_t flags;
+    bool more;
+
+    do {
+        entry.done = NULL;
+        more = usbh_net_txq_pop(txq, &entry);
+        if (entry.done) {
+            entry.done(entry.arg, -USB_ERR_SHUTDOWN);
+        }
+    } while (more);
+
+    flags = usb_osal_enter_critical_section();
+    txq->busy = false;
+    txq->agg = false;
+    usb_osal_leave_critical_section(flags);
+}
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2025, sakumisu
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USBH_NET_TXQ_H
+#define USBH_NET_TXQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Asynchronous tx queue of host net drivers. Frames are sent in order through the bulk out urb of the driver,
+ * next frame is submitted from the completion of the previous one in a CONFIG_USBHOST_URB_BH worker, so the
+ * network stack never waits for the bus. Frame memory is owned by the caller until done is called.
+ */
+
+/* status is 0 or -USB_ERR_*, called from urb bh worker, or from usbh_net_txq_flush */
+typedef void (*usbh_net_txq_done_t)(void *arg, int status);
+/* Finish packed transfer of len bytes in buf, return its final length */
+typedef uint32_t (*usbh_net_txq_agg_end_t)(uint8_t *buf, uint32_t len);
+
+#ifdef CONFIG_USBHOST_NET_TXQ
+#ifndef CONFIG_USBHOST_URB_BH
+#error "CONFIG_USBHOST_NET_TXQ needs CONFIG_USBHOST_URB_BH"
+#endif
+
+struct usbh_net_txq_entry {
+    uint8_t *buf; /* frame with driver header, CONFIG_USB_ALIGN_SIZE aligned */
+    uint32_t len;
+    usbh_net_txq_done_t done;
+    void *arg;
+};
+
+struct usbh_net_txq {
+    struct usbh_urb *urb;
+    struct usbh_hubport *hport;
+    struct usb_endpoint_descriptor *ep;
+    struct usbh_net_txq_entry entry[CONFIG_USBHOST_NET_TXQ_NUM];
+    uint8_t head;  /* oldest entry, on the bus unless agg is set */
+    uint8_t count; /* entries queued, head included */
+    bool busy;     /* urb is on the bus */
+    bool agg;      /* urb carries agg_buf, its frames are already completed */
+    uint8_t agg_align;
+    uint8_t *agg_buf;
+    uint32_t agg_size;
+    usbh_net_txq_agg_end_t agg_end;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usbh_net_txq_init(struct usbh_net_txq *txq, struct usbh_urb *urb, struct usbh_hubport *hport, struct usb_endpoint_descriptor *ep);
+
+/**
+ * @brief Pack frames waiting behind a busy urb into buf and send them with one transfer, for devices that accept
+ * several frames with their driver header in one bulk transfer. Packed frames are copied and completed at once.
+ *
+ * @param buf dma usable buffer owned by the queue from now on.
+ * @param size bytes of buf frames may fill, room end needs must follow them.
+ * @param align alignment of every frame inside buf, power of 2.
+ * @param end called on packed transfer before it is sent, NULL if not needed.
+ */
+void usbh_net_txq_set_agg(struct usbh_net_txq *txq, uint8_t *buf, uint32_t size, uint8_t align, usbh_net_txq_agg_end_t end);
+
+/**
+ * @brief Queue one frame, starts the urb if queue was idle. Not reentrant, call from one thread per queue.
+ *
+ * @return 0 if frame is queued and done will be called, -USB_ERR_BUSY if queue is full,
+ * other error if frame could not be started, done is not called on error.
+ */
+int usbh_net_txq_push(struct usbh_net_txq *txq, uint8_t *buf, uint32_t len, usbh_net_txq_done_t done, void *arg);
+
+/* Call done with -USB_ERR_SHUTDOWN for all queued frames, use after bulk out urb is killed */
+void usbh_net_txq_flush(struct usbh_net_txq *txq);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif /* USBH_NET_TXQ_H */
@@ -55,15 +55,25 @@ void usbd_adb_notify_write_done(void)
 
 static uint16_t csh_sput_cb(chry_readline_t *rl, const void *data, uint16_t size)
 {
+    uint16_t written = 0;
+    int ret;
+
     (void)rl;
 
     if (!usb_device_is_configured(0)) {
         return size;
     }
 
-    if (usbd_adb_can_write() && size) {
-        usbd_abd_write(ADB_SHELL_LOALID, data, size);
-        xEventGroupWaitBits(event_hdl, 0x20, pdTRUE, pdFALSE, portMAX_DELAY);
+    while (usbd_adb_can_write() && (written < size)) {
+        ret = usbd_adb_write(ADB_SHELL_LOALID, (const uint8_t *)data + written, size - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret == -USB_ERR_BUSY) {
+            /* wait for a sent packet or host ack */
+            xEventGroupWaitBits(event_hdl, 0x20, pdTRUE, pdFALSE, portMAX_DELAY);
+        } else {
+            break;
+        }
     }
 
     return size;
@@ -377,14 +377,8 @@ void usbd_audio_open(uint8_t busid, uint8_t intf)
         /* setup first out ep read transfer */
         usbd_ep_start_read(busid, AUDIO_OUT_EP, read_buffer, AUDIO_OUT_PACKET);
 #if USING_FEEDBACK == 1
-#ifdef CONFIG_USB_HS
-        uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_HS(AUDIO_FREQ);
-        AUDIO_FEEDBACK_TO_BUF_HS(s_speaker_feedback_buffer, feedback_value);
-#else
-        uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_FS(AUDIO_FREQ);
-        AUDIO_FEEDBACK_TO_BUF_FS(s_speaker_feedback_buffer, feedback_value);
-#endif
-        usbd_ep_start_write(busid, AUDIO_OUT_FEEDBACK_EP, s_speaker_feedback_buffer, FEEDBACK_ENDP_PACKET_SIZE);
+        /* call usbd_audio_feedback_sof() and usbd_audio_feedback_set_level() from codec side to track its clock */
+        usbd_audio_feedback_start(busid, s_speaker_sample_rate);
 #endif
         USB_LOG_RAW("OPEN1\r\n");
     } else {
@@ -397,6 +391,9 @@ void usbd_audio_close(uint8_t busid, uint8_t intf)
 {
     if (intf == 1) {
         rx_flag = 0;
+#if USING_FEEDBACK == 1
+        usbd_audio_feedback_stop(busid);
+#endif
         USB_LOG_RAW("CLOSE1\r\n");
     } else {
         tx_flag = 0;
@@ -450,21 +447,6 @@ void usbd_audio_iso_in_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
     ep_tx_busy_flag = false;
 }
 
-#if USING_FEEDBACK == 1
-void usbd_audio_iso_out_feedback_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
-{
-    USB_LOG_RAW("actual feedback len:%d\r\n", nbytes);
-#ifdef CONFIG_USB_HS
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_HS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_HS(s_speaker_feedback_buffer, feedback_value);
-#else
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_FS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_FS(s_speaker_feedback_buffer, feedback_value);
-#endif
-    usbd_ep_start_write(busid, AUDIO_OUT_FEEDBACK_EP, s_speaker_feedback_buffer, FEEDBACK_ENDP_PACKET_SIZE);
-}
-#endif
-
 static struct usbd_endpoint audio_out_ep = {
     .ep_cb = usbd_audio_iso_out_callback,
     .ep_addr = AUDIO_OUT_EP
@@ -475,13 +457,6 @@ static struct usbd_endpoint audio_in_ep = {
     .ep_addr = AUDIO_IN_EP
 };
 
-#if USING_FEEDBACK == 1
-static struct usbd_endpoint audio_out_feedback_ep = {
-    .ep_cb = usbd_audio_iso_out_feedback_callback,
-    .ep_addr = AUDIO_OUT_FEEDBACK_EP
-};
-#endif
-
 struct usbd_interface intf0;
 struct usbd_interface intf1;
 struct usbd_interface intf2;
@@ -514,7 +489,7 @@ void audio_v2_init(uint8_t busid, uintptr_t reg_base)
     usbd_add_endpoint(busid, &audio_in_ep);
     usbd_add_endpoint(busid, &audio_out_ep);
 #if USING_FEEDBACK == 1
-    usbd_add_endpoint(busid, &audio_out_feedback_ep);
+    usbd_audio_feedback_init(busid, AUDIO_OUT_FEEDBACK_EP);
 #endif
 
     usbd_initialize(busid, reg_base, usbd_event_handler);
@@ -14,11 +14,9 @@
 #define USBD_LANGID_STRING 1033
 
 #ifdef CONFIG_USB_HS
-#define EP_INTERVAL               0x04
-#define FEEDBACK_ENDP_PACKET_SIZE 0x04
+#define EP_INTERVAL 0x04
 #else
-#define EP_INTERVAL               0x01
-#define FEEDBACK_ENDP_PACKET_SIZE 0x03
+#define EP_INTERVAL 0x01
 #endif
 
 #define AUDIO_OUT_EP          0x01
@@ -63,6 +61,9 @@
 
 #define AUDIO_OUT_PACKET ((uint32_t)((AUDIO_OUT_MAX_FREQ * HALF_WORD_BYTES * OUT_CHANNEL_NUM) / 1000))
 
+#define AUDIO_OUT_FRAME_BYTES (HALF_WORD_BYTES * OUT_CHANNEL_NUM)
+#define AUDIO_OUT_RING_FRAMES (8 * AUDIO_OUT_PACKET / AUDIO_OUT_FRAME_BYTES) /* 8ms at max freq */
+
 #if USING_FEEDBACK == 0
 #define USB_AUDIO_CONFIG_DESC_SIZ (9 +                                                     \
                                    AUDIO_V2_AC_DESCRIPTOR_INIT_LEN +                       \
@@ -271,10 +272,24 @@ static const uint8_t default_sampling_freq_table[] = {
 };
 
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t read_buffer[AUDIO_OUT_PACKET];
-USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t s_speaker_feedback_buffer[4];
 
 volatile bool rx_flag = 0;
 volatile uint32_t s_speaker_sample_rate;
+#if USING_FEEDBACK == 1
+volatile uint32_t s_speaker_ring_level;   /* audio frames waiting for codec */
+volatile uint32_t s_speaker_sample_count; /* free running count of audio frames played by codec */
+
+/* Call from codec (i2s dma) completion with the number of audio frames played */
+void audio_v2_speaker_consumed(uint32_t frames)
+{
+    s_speaker_sample_count += frames;
+    if (s_speaker_ring_level > frames) {
+        s_speaker_ring_level -= frames;
+    } else {
+        s_speaker_ring_level = 0;
+    }
+}
+#endif
 
 static void usbd_event_handler(uint8_t busid, uint8_t event)
 {
@@ -295,6 +310,11 @@ static void usbd_event_handler(uint8_t busid, uint8_t event)
             break;
         case USBD_EVENT_CLR_REMOTE_WAKEUP:
             break;
+#if USING_FEEDBACK == 1
+        case USBD_EVENT_SOF:
+            usbd_audio_feedback_sof(busid, s_speaker_sample_count);
+            break;
+#endif
 
         default:
             break;
@@ -307,14 +327,8 @@ void usbd_audio_open(uint8_t busid, uint8_t intf)
     /* setup first out ep read transfer */
     usbd_ep_start_read(busid, AUDIO_OUT_EP, read_buffer, AUDIO_OUT_PACKET);
 #if USING_FEEDBACK == 1
-#ifdef CONFIG_USB_HS
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_HS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_HS(s_speaker_feedback_buffer, feedback_value);
-#else
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_FS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_FS(s_speaker_feedback_buffer, feedback_value);
-#endif
-    usbd_ep_start_write(busid, AUDIO_OUT_FEEDBACK_EP, s_speaker_feedback_buffer, FEEDBACK_ENDP_PACKET_SIZE);
+    s_speaker_ring_level = 0;
+    usbd_audio_feedback_start(busid, s_speaker_sample_rate);
 #endif
     USB_LOG_RAW("OPEN\r\n");
 }
@@ -323,6 +337,9 @@ void usbd_audio_close(uint8_t busid, uint8_t intf)
 {
     USB_LOG_RAW("CLOSE\r\n");
     rx_flag = 0;
+#if USING_FEEDBACK == 1
+    usbd_audio_feedback_stop(busid);
+#endif
 }
 
 void usbd_audio_set_sampling_freq(uint8_t busid, uint8_t ep, uint32_t sampling_freq)
@@ -355,36 +372,22 @@ void usbd_audio_get_sampling_freq_table(uint8_t busid, uint8_t ep, uint8_t **sam
 void usbd_audio_iso_out_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
     USB_LOG_RAW("actual out len:%d\r\n", (unsigned int)nbytes);
-    usbd_ep_start_read(busid, AUDIO_OUT_EP, read_buffer, AUDIO_OUT_PACKET);
-}
-
 #if USING_FEEDBACK == 1
-void usbd_audio_iso_out_feedback_callback(uint8_t busid, uint8_t ep, uint32_t nbytes)
-{
-    USB_LOG_RAW("actual feedback len:%d\r\n", (unsigned int)nbytes);
-#ifdef CONFIG_USB_HS
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_HS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_HS(s_speaker_feedback_buffer, feedback_value);
-#else
-    uint32_t feedback_value = AUDIO_FREQ_TO_FEEDBACK_FS(s_speaker_sample_rate);
-    AUDIO_FEEDBACK_TO_BUF_FS(s_speaker_feedback_buffer, feedback_value);
+    /* copy read_buffer into the codec ring here */
+    s_speaker_ring_level += nbytes / AUDIO_OUT_FRAME_BYTES;
+    if (s_speaker_ring_level > AUDIO_OUT_RING_FRAMES) {
+        s_speaker_ring_level = AUDIO_OUT_RING_FRAMES;
+    }
+    usbd_audio_feedback_set_level(busid, s_speaker_ring_level, AUDIO_OUT_RING_FRAMES / 2);
 #endif
-    usbd_ep_start_write(busid, AUDIO_OUT_FEEDBACK_EP, s_speaker_feedback_buffer, FEEDBACK_ENDP_PACKET_SIZE);
+    usbd_ep_start_read(busid, AUDIO_OUT_EP, read_buffer, AUDIO_OUT_PACKET);
 }
-#endif
 
 static struct usbd_endpoint audio_out_ep = {
     .ep_cb = usbd_audio_iso_out_callback,
     .ep_addr = AUDIO_OUT_EP
 };
 
-#if USING_FEEDBACK == 1
-static struct usbd_endpoint audio_out_feedback_ep = {
-    .ep_cb = usbd_audio_iso_out_feedback_callback,
-    .ep_addr = AUDIO_OUT_FEEDBACK_EP
-};
-#endif
-
 struct usbd_interface intf0;
 struct usbd_interface intf1;
 
@@ -408,7 +411,7 @@ void audio_v2_init(uint8_t busid, uintptr_t reg_base)
     usbd_add_interface(busid, usbd_audio_init_intf(busid, &intf1, 0x0200, audio_entity_table, 2));
     usbd_add_endpoint(busid, &audio_out_ep);
 #if USING_FEEDBACK == 1
-    usbd_add_endpoint(busid, &audio_out_feedback_ep);
+    usbd_audio_feedback_init(busid, AUDIO_OUT_FEEDBACK_EP);
 #endif
     usbd_initialize(busid, reg_base, usbd_event_handler);
 }
@@ -11,7 +11,8 @@
 #define CONFIG_BOOTUF2_INDEX_URL "https://github.com/cherry-embedded"
 #define CONFIG_BOOTUF2_JOIN_URL  "http://qm.qq.com/cgi-bin/qm/qr?_wv=1027&k=GyH2M5XfWTHQzmZis4ClpgvfdObPrvtk&authKey=LmcLhfno%2BiW51wmgVC%2F8WoYwUXqiclzWDHMU1Jy1d6S8cECJ4Q7bfJ%2FTe67RLakI&noverify=0&group_code=642693751"
 
-#define CONFIG_BOOTUF2_CACHE_SIZE         4096
+#define CONFIG_BOOTUF2_CACHE_SIZE         8192
+#define CONFIG_BOOTUF2_PAGE_SIZE          4096
 #define CONFIG_BOOTUF2_SECTOR_SIZE        512
 #define CONFIG_BOOTUF2_SECTOR_PER_CLUSTER 2
 #define CONFIG_BOOTUF2_SECTOR_RESERVED    1
@@ -20,6 +21,7 @@
 
 #define CONFIG_BOOTUF2_FAMILYID      0xFFFFFFFF
 #define CONFIG_BOOTUF2_FLASHMAX      0x800000
-#define CONFIG_BOOTUF2_PAGE_COUNTMAX 1024
+#define CONFIG_BOOTUF2_FLASH_BASE    0x00000000
+#define CONFIG_BOOTUF2_PAGE_COUNTMAX 2048
 
 #endif
\ No newline at end of file
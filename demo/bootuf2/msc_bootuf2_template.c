@@ -233,4 +233,10 @@ int bootuf2_flash_write(uint32_t address, const uint8_t *data, size_t size)
 {
     USB_LOG_INFO("address:%08x, size:%d\n", (unsigned int)address, (unsigned int)size);
     return 0;
-}
\ No newline at end of file
+}
+
+int bootuf2_flash_erase(uint32_t address, size_t size)
+{
+    USB_LOG_INFO("erase address:%08x, size:%d\n", (unsigned int)address, (unsigned int)size);
+    return 0;
+}
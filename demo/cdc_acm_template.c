@@ -168,10 +168,16 @@ static const uint8_t cdc_descriptor[] = {
 };
 #endif
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+/* bulk endpoints and their buffers are owned by the cdc acm stream */
+uint8_t read_buffer[2048];
+uint8_t write_buffer[2048];
+#else
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t read_buffer[2048]; /* 2048 is only for test speed , please use CDC_MAX_MPS for common*/
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t write_buffer[2048];
 
 volatile bool ep_tx_busy_flag = false;
+#endif
 
 static void usbd_event_handler(uint8_t busid, uint8_t event)
 {
@@ -187,9 +193,11 @@ static void usbd_event_handler(uint8_t busid, uint8_t event)
         case USBD_EVENT_SUSPEND:
             break;
         case USBD_EVENT_CONFIGURED:
+#ifndef CONFIG_USBDEV_CDC_ACM_STREAM
             ep_tx_busy_flag = false;
             /* setup first out ep read transfer */
             usbd_ep_start_read(busid, CDC_OUT_EP, read_buffer, 2048);
+#endif
             break;
         case USBD_EVENT_SET_REMOTE_WAKEUP:
             break;
@@ -201,6 +209,12 @@ static void usbd_event_handler(uint8_t busid, uint8_t event)
     }
 }
 
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+void usbd_cdc_acm_stream_rx_callback(uint8_t busid, uint8_t intf, uint32_t nbytes)
+{
+    USB_LOG_RAW("actual out len:%d\r\n", (unsigned int)nbytes);
+}
+#else
 void usbd_cdc_acm_bulk_out(uint8_t busid, uint8_t ep, uint32_t nbytes)
 {
     USB_LOG_RAW("actual out len:%d\r\n", (unsigned int)nbytes);
@@ -234,6 +248,7 @@ struct usbd_endpoint cdc_in_ep = {
     .ep_addr = CDC_IN_EP,
     .ep_cb = usbd_cdc_acm_bulk_in
 };
+#endif
 
 static struct usbd_interface intf0;
 static struct usbd_interface intf1;
@@ -252,8 +267,12 @@ void cdc_acm_init(uint8_t busid, uintptr_t reg_base)
 #endif
     usbd_add_interface(busid, usbd_cdc_acm_init_intf(busid, &intf0));
     usbd_add_interface(busid, usbd_cdc_acm_init_intf(busid, &intf1));
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+    usbd_cdc_acm_stream_init(busid, 0, CDC_IN_EP, CDC_OUT_EP);
+#else
     usbd_add_endpoint(busid, &cdc_out_ep);
     usbd_add_endpoint(busid, &cdc_in_ep);
+#endif
     usbd_initialize(busid, reg_base, usbd_event_handler);
 }
 
@@ -270,10 +289,18 @@ void usbd_cdc_acm_set_dtr(uint8_t busid, uint8_t intf, bool dtr)
 
 void cdc_acm_data_send_with_dtr_test(uint8_t busid)
 {
+#ifdef CONFIG_USBDEV_CDC_ACM_STREAM
+    /* drain rx ring so bulk out keeps running, then queue test data while tx ring has room */
+    usbd_cdc_acm_read(busid, 0, read_buffer, sizeof(read_buffer));
+    if (usbd_cdc_acm_is_open(busid, 0) && (usbd_cdc_acm_get_tx_free(busid, 0) >= sizeof(write_buffer))) {
+        usbd_cdc_acm_write(busid, 0, write_buffer, sizeof(write_buffer));
+    }
+#else
     if (dtr_enable) {
         ep_tx_busy_flag = true;
         usbd_ep_start_write(busid, CDC_IN_EP, write_buffer, 2048);
         while (ep_tx_busy_flag) {
         }
     }
+#endif
 }
\ No newline at end of file
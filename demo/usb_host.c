@@ -116,6 +116,18 @@ delete:
 #endif
 
 #if CONFIG_TEST_USBH_HID
+#ifdef CONFIG_USBHOST_HID_POLL
+#include "usbh_hid_poll.h"
+
+void usbh_hid_poll_report_callback(struct usbh_hid *hid_class, uint8_t *report, uint32_t len)
+{
+    USB_LOG_RAW("hid%u: ", hid_class->minor);
+    for (uint32_t i = 0; i < len; i++) {
+        USB_LOG_RAW("0x%02x ", report[i]);
+    }
+    USB_LOG_RAW("nbytes:%u\r\n", (unsigned int)len);
+}
+#else
 USB_NOCACHE_RAM_SECTION USB_MEM_ALIGNX uint8_t hid_buffer[128];
 
 void usbh_hid_callback(void *arg, int nbytes)
@@ -156,6 +168,7 @@ delete:
     // clang-format on
 }
 #endif
+#endif
 
 #if CONFIG_TEST_USBH_MSC
 
@@ -340,7 +353,9 @@ void usbh_cdc_acm_stop(struct usbh_cdc_acm *cdc_acm_class)
 #if CONFIG_TEST_USBH_HID
 void usbh_hid_run(struct usbh_hid *hid_class)
 {
+#ifndef CONFIG_USBHOST_HID_POLL
     usb_osal_thread_create("usbh_hid", 2048, CONFIG_USBHOST_PSC_PRIO + 1, usbh_hid_thread, hid_class);
+#endif
 }
 
 void usbh_hid_stop(struct usbh_hid *hid_class)
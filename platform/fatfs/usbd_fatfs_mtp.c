@@ -195,20 +195,31 @@ int usbd_mtp_closedir(MTP_DIR *dir)
     return result;
 }
 
+#ifndef DT_DIR
+#define DT_DIR 4
+#endif
+#ifndef DT_REG
+#define DT_REG 8
+#endif
+
 struct mtp_dirent *usbd_mtp_readdir(MTP_DIR *dir)
 {
+    static struct mtp_dirent dirent;
     FILINFO fno;
     FRESULT result;
+    size_t len;
 
     result = f_readdir((DIR *)dir, &fno);
     if (result != FR_OK || fno.fname[0] == 0)
         return NULL;
 
-    static struct mtp_dirent dirent;
-    memset(&dirent, 0, sizeof(struct mtp_dirent));
-    strncpy(dirent.d_name, fno.fname, sizeof(dirent.d_name) - 1);
-    dirent.d_name[sizeof(dirent.d_name) - 1] = '\0';
-    dirent.d_namlen = strlen(dirent.d_name);
+    len = MIN(strlen(fno.fname), sizeof(dirent.d_name) - 1);
+    memcpy(dirent.d_name, fno.fname, len);
+    dirent.d_name[len] = '\0';
+    dirent.d_namlen = len;
+    dirent.d_reclen = sizeof(struct mtp_dirent);
+    /* type comes with the directory entry, so listing a folder does not need a stat per entry */
+    dirent.d_type = (fno.fattrib & AM_DIR) ? DT_DIR : DT_REG;
 
     return &dirent;
 }
@@ -7,6 +7,7 @@
 #include "diskio.h"
 #include "usbh_core.h"
 #include "usbh_msc.h"
+#include "usbh_msc_blk.h"
 
 struct usbh_msc *active_msc_class;
 
@@ -28,64 +29,27 @@ int USB_disk_status(void)
     return RES_OK;
 }
 
+/* fatfs moves fat, directory and partial file sectors through one sector window, cache those */
 int USB_disk_read(BYTE *buff, LBA_t sector, UINT count)
 {
     int ret;
-    uint8_t *align_buf;
 
-    align_buf = (uint8_t *)buff;
-
-    if ((uint32_t)buff & (CONFIG_USB_ALIGN_SIZE - 1)) {
-        align_buf = (uint8_t *)aligned_alloc(CONFIG_USB_ALIGN_SIZE, count * active_msc_class->blocksize);
-        if (!align_buf) {
-            printf("msc get align buf failed\r\n");
-            return -USB_ERR_NOMEM;
-        }
-    }
-
-    ret = usbh_msc_scsi_read10(active_msc_class, sector, align_buf, count);
+    ret = usbh_msc_blk_read(active_msc_class, sector, buff, count, count == 1);
     if (ret < 0) {
-        ret = RES_ERROR;
-    } else {
-        ret = RES_OK;
-    }
-
-    if ((uint32_t)buff & (CONFIG_USB_ALIGN_SIZE - 1)) {
-        usb_memcpy(buff, align_buf, count * active_msc_class->blocksize);
-        free(align_buf);
+        return RES_ERROR;
     }
-
-    return ret;
+    return RES_OK;
 }
 
 int USB_disk_write(const BYTE *buff, LBA_t sector, UINT count)
 {
     int ret;
-    uint8_t *align_buf;
-
-    align_buf = (uint8_t *)buff;
 
-    if ((uint32_t)buff & (CONFIG_USB_ALIGN_SIZE - 1)) {
-        align_buf = (uint8_t *)aligned_alloc(CONFIG_USB_ALIGN_SIZE, count * active_msc_class->blocksize);
-        if (!align_buf) {
-            printf("msc get align buf failed\r\n");
-            return -USB_ERR_NOMEM;
-        }
-        usb_memcpy(align_buf, buff, count * active_msc_class->blocksize);
-    }
-
-    ret = usbh_msc_scsi_write10(active_msc_class, sector, align_buf, count);
+    ret = usbh_msc_blk_write(active_msc_class, sector, buff, count, count == 1);
     if (ret < 0) {
-        ret = RES_ERROR;
-    } else {
-        ret = RES_OK;
-    }
-
-    if ((uint32_t)buff & (CONFIG_USB_ALIGN_SIZE - 1)) {
-        free(align_buf);
+        return RES_ERROR;
     }
-
-    return ret;
+    return RES_OK;
 }
 
 int USB_disk_ioctl(BYTE cmd, void *buff)
@@ -94,7 +58,7 @@ int USB_disk_ioctl(BYTE cmd, void *buff)
 
     switch (cmd) {
         case CTRL_SYNC:
-            result = RES_OK;
+            result = (usbh_msc_blk_sync(active_msc_class) < 0) ? RES_ERROR : RES_OK;
             break;
 
         case GET_SECTOR_SIZE:
@@ -11,6 +11,7 @@
 #include "esp_check.h"
 #include "esp_netif.h"
 #include "usbh_core.h"
+#include "usbh_net_rxbuf.h"
 #include <string.h>
 
 #if TCPIP_THREAD_STACKSIZE < 1024
@@ -35,6 +36,14 @@ static void usbh_net_input_common(struct usbh_net_netif_glue *netif_glue, uint8_
 {
     uint8_t *input_buf = buf;
 
+#ifdef CONFIG_USBHOST_NET_RXBUF
+    /* frame in a pool block goes up without copy, block stays referenced until usbh_net_free */
+    if (usbh_net_rxbuf_ref(buf) == 0) {
+        esp_netif_receive(netif_glue->base.netif, buf, len, NULL);
+        return;
+    }
+#endif
+
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
     input_buf = usb_osal_malloc(len);
     if (input_buf == NULL) {
@@ -49,6 +58,11 @@ static void usbh_net_input_common(struct usbh_net_netif_glue *netif_glue, uint8_
 
 static void usbh_net_free(void *h, void *buffer)
 {
+#ifdef CONFIG_USBHOST_NET_RXBUF
+    if (usbh_net_rxbuf_free(buffer) == 0) {
+        return;
+    }
+#endif
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
     usb_osal_free(buffer);
 #endif
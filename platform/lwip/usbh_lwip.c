@@ -13,6 +13,8 @@
 #endif
 
 #include "usbh_core.h"
+#include "usbh_net_rxbuf.h"
+#include "usbh_net_txq.h"
 
 #if LWIP_TCPIP_CORE_LOCKING_INPUT != 1
 #warning suggest you to set LWIP_TCPIP_CORE_LOCKING_INPUT to 1, usb handles eth input with own thread
@@ -30,6 +32,14 @@
 #error TCPIP_THREAD_STACKSIZE must be >= 1024
 #endif
 
+#if defined(CONFIG_USBHOST_NET_RXBUF) && (LWIP_SUPPORT_CUSTOM_PBUF != 1)
+#error CONFIG_USBHOST_NET_RXBUF needs LWIP_SUPPORT_CUSTOM_PBUF
+#endif
+
+#if defined(CONFIG_USBHOST_RTL8152_CSUM_OFFLOAD) && (LWIP_CHECKSUM_CTRL_PER_NETIF != 1)
+#error CONFIG_USBHOST_RTL8152_CSUM_OFFLOAD needs LWIP_CHECKSUM_CTRL_PER_NETIF
+#endif
+
 // #define CONFIG_USBHOST_PLATFORM_CDC_ECM
 // #define CONFIG_USBHOST_PLATFORM_CDC_RNDIS
 // #define CONFIG_USBHOST_PLATFORM_CDC_NCM
@@ -53,6 +63,55 @@ void usbh_lwip_eth_output_common(struct pbuf *p, uint8_t *buf)
     }
 }
 
+#ifdef CONFIG_USBHOST_NET_RXBUF
+struct usbh_lwip_rx_pbuf {
+    struct pbuf_custom pc;
+    uint8_t *buf; /* payload may be moved by lwip, keep frame start for pool */
+};
+
+LWIP_MEMPOOL_DECLARE(USBH_RX_PBUF, CONFIG_USBHOST_NET_RXBUF_PBUF_NUM, sizeof(struct usbh_lwip_rx_pbuf), "usbh rx pbuf");
+
+static void usbh_lwip_rx_pbuf_free(struct pbuf *p)
+{
+    struct usbh_lwip_rx_pbuf *rx_pbuf = (struct usbh_lwip_rx_pbuf *)p;
+
+    usbh_net_rxbuf_free(rx_pbuf->buf);
+    LWIP_MEMPOOL_FREE(USBH_RX_PBUF, rx_pbuf);
+}
+
+/* Hand frame in a pool block to lwip without copy, block stays referenced until pbuf is freed */
+static struct pbuf *usbh_lwip_rx_pbuf_alloc(uint8_t *buf, uint32_t len)
+{
+    struct usbh_lwip_rx_pbuf *rx_pbuf;
+
+    if (usbh_net_rxbuf_ref(buf) < 0) {
+        return NULL;
+    }
+
+    rx_pbuf = (struct usbh_lwip_rx_pbuf *)LWIP_MEMPOOL_ALLOC(USBH_RX_PBUF);
+    if (rx_pbuf == NULL) {
+        usbh_net_rxbuf_free(buf);
+        return NULL;
+    }
+
+    rx_pbuf->buf = buf;
+    rx_pbuf->pc.custom_free_function = usbh_lwip_rx_pbuf_free;
+    return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx_pbuf->pc, buf, len);
+}
+
+static void usbh_lwip_rx_pbuf_init(void)
+{
+    static bool init = false;
+
+    if (!init) {
+        LWIP_MEMPOOL_INIT(USBH_RX_PBUF);
+        init = true;
+    }
+}
+#else
+#define usbh_lwip_rx_pbuf_init()
+#endif
+
 void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
 {
 #if LWIP_TCPIP_CORE_LOCKING_INPUT
@@ -63,6 +122,17 @@ void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
     err_t err;
     struct pbuf *p;
 
+#ifdef CONFIG_USBHOST_NET_RXBUF
+    p = usbh_lwip_rx_pbuf_alloc(buf, len);
+    if (p != NULL) {
+        err = netif->input(p, netif);
+        if (err != ERR_OK) {
+            pbuf_free(p);
+        }
+        return;
+    }
+#endif
+
     p = pbuf_alloc(PBUF_RAW, len, type);
     if (p != NULL) {
 #if LWIP_TCPIP_CORE_LOCKING_INPUT
@@ -79,6 +149,85 @@ void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
     }
 }
 
+#ifdef CONFIG_USBHOST_NET_TXQ
+/* Padding some drivers append so that transfer ends with a short packet */
+#define USBH_LWIP_TX_TAILROOM 4
+
+typedef int (*usbh_lwip_output_async_t)(uint8_t *buf, uint32_t buflen, uint32_t tailroom, usbh_net_txq_done_t done, void *arg);
+
+/* Called from urb bh worker or from disconnect, never with core lock held */
+static void usbh_lwip_tx_done(void *arg, int status)
+{
+    (void)status;
+
+    LOCK_TCPIP_CORE();
+    pbuf_free((struct pbuf *)arg);
+    UNLOCK_TCPIP_CORE();
+}
+
+/* Copy frame into a new pbuf whose driver header starts aligned, for chains and pbufs without headroom */
+static struct pbuf *usbh_lwip_tx_pbuf_copy(struct pbuf *p, uint16_t headroom)
+{
+    struct pbuf *q;
+    uint16_t offset;
+
+    q = pbuf_alloc(PBUF_RAW, p->tot_len + headroom + USBH_LWIP_TX_TAILROOM + CONFIG_USB_ALIGN_SIZE, PBUF_RAM);
+    if (q == NULL) {
+        return NULL;
+    }
+
+    offset = USB_ALIGN_UP((uintptr_t)q->payload, CONFIG_USB_ALIGN_SIZE) - (uintptr_t)q->payload + headroom;
+    pbuf_remove_header(q, offset);
+    /* single PBUF_RAM, shrink lengths only and keep tailroom allocated */
+    q->len = p->tot_len;
+    q->tot_len = p->tot_len;
+    pbuf_copy_partial(p, q->payload, p->tot_len, 0);
+    return q;
+}
+
+/* Queue p without copy when it is one pbuf with aligned headroom, otherwise queue a copy. Runs with core lock held */
+static err_t usbh_lwip_eth_output_async(struct pbuf *p, uint16_t headroom, usbh_lwip_output_async_t output)
+{
+    struct pbuf *q = NULL;
+    uint32_t tailroom = 0;
+    int ret;
+
+    if ((p->next == NULL) && (pbuf_add_header(p, headroom) == 0)) {
+        if (((uintptr_t)p->payload % CONFIG_USB_ALIGN_SIZE) == 0) {
+            /* tcp does not retransmit a segment while driver holds a reference */
+            pbuf_ref(p);
+            q = p;
+        }
+        pbuf_remove_header(p, headroom);
+    }
+
+    if (q == NULL) {
+        q = usbh_lwip_tx_pbuf_copy(p, headroom);
+        if (q == NULL) {
+            return ERR_MEM;
+        }
+        tailroom = USBH_LWIP_TX_TAILROOM;
+    }
+
+    ret = output((uint8_t *)q->payload, p->tot_len, tailroom, usbh_lwip_tx_done, q);
+    if ((ret == -USB_ERR_NOMEM) && (q == p)) {
+        /* driver needs padding after frame */
+        pbuf_free(q);
+        q = usbh_lwip_tx_pbuf_copy(p, headroom);
+        if (q == NULL) {
+            return ERR_MEM;
+        }
+        ret = output((uint8_t *)q->payload, p->tot_len, USBH_LWIP_TX_TAILROOM, usbh_lwip_tx_done, q);
+    }
+
+    if (ret < 0) {
+        pbuf_free(q);
+        return ERR_BUF;
+    }
+    return ERR_OK;
+}
+#endif
+
 struct usb_osal_timer *dhcp_handle;
 
 static void dhcp_timeout(void *arg)
@@ -112,6 +261,11 @@ struct netif g_cdc_ecm_netif;
 
 static err_t usbh_cdc_ecm_linkoutput(struct netif *netif, struct pbuf *p)
 {
+#ifdef CONFIG_USBHOST_NET_TXQ
+    (void)netif;
+
+    return usbh_lwip_eth_output_async(p, USBH_CDC_ECM_TX_HEADROOM, usbh_cdc_ecm_eth_output_async);
+#else
     int ret;
     (void)netif;
 
@@ -122,6 +276,7 @@ static err_t usbh_cdc_ecm_linkoutput(struct netif *netif, struct pbuf *p)
     } else {
         return ERR_OK;
     }
+#endif
 }
 
 void usbh_cdc_ecm_eth_input(uint8_t *buf, uint32_t buflen)
@@ -154,6 +309,7 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
+    usbh_lwip_rx_pbuf_init();
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_cdc_ecm_if_init, tcpip_input);
     netif_set_default(netif);
     while (!netif_is_up(netif)) {
@@ -216,6 +372,11 @@ struct netif g_rndis_netif;
 
 static err_t usbh_rndis_linkoutput(struct netif *netif, struct pbuf *p)
 {
+#ifdef CONFIG_USBHOST_NET_TXQ
+    (void)netif;
+
+    return usbh_lwip_eth_output_async(p, USBH_RNDIS_TX_HEADROOM, usbh_rndis_eth_output_async);
+#else
     int ret;
     (void)netif;
 
@@ -226,6 +387,7 @@ static err_t usbh_rndis_linkoutput(struct netif *netif, struct pbuf *p)
     } else {
         return ERR_OK;
     }
+#endif
 }
 
 void usbh_rndis_eth_input(uint8_t *buf, uint32_t buflen)
@@ -258,6 +420,7 @@ void usbh_rndis_run(struct usbh_rndis *rndis_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
+    usbh_lwip_rx_pbuf_init();
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_rndis_if_init, tcpip_input);
     netif_set_default(netif);
     while (!netif_is_up(netif)) {
@@ -304,6 +467,11 @@ struct netif g_cdc_ncm_netif;
 
 static err_t usbh_cdc_ncm_linkoutput(struct netif *netif, struct pbuf *p)
 {
+#ifdef CONFIG_USBHOST_NET_TXQ
+    (void)netif;
+
+    return usbh_lwip_eth_output_async(p, USBH_CDC_NCM_TX_HEADROOM, usbh_cdc_ncm_eth_output_async);
+#else
     int ret;
     (void)netif;
 
@@ -314,6 +482,7 @@ static err_t usbh_cdc_ncm_linkoutput(struct netif *netif, struct pbuf *p)
     } else {
         return ERR_OK;
     }
+#endif
 }
 
 void usbh_cdc_ncm_eth_input(uint8_t *buf, uint32_t buflen)
@@ -346,6 +515,7 @@ void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
+    usbh_lwip_rx_pbuf_init();
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_cdc_ncm_if_init, tcpip_input);
     netif_set_default(netif);
     while (!netif_is_up(netif)) {
@@ -387,6 +557,11 @@ struct netif g_asix_netif;
 
 static err_t usbh_asix_linkoutput(struct netif *netif, struct pbuf *p)
 {
+#ifdef CONFIG_USBHOST_NET_TXQ
+    (void)netif;
+
+    return usbh_lwip_eth_output_async(p, USBH_ASIX_TX_HEADROOM, usbh_asix_eth_output_async);
+#else
     int ret;
     (void)netif;
 
@@ -397,6 +572,7 @@ static err_t usbh_asix_linkoutput(struct netif *netif, struct pbuf *p)
     } else {
         return ERR_OK;
     }
+#endif
 }
 
 void usbh_asix_eth_input(uint8_t *buf, uint32_t buflen)
@@ -429,6 +605,7 @@ void usbh_asix_run(struct usbh_asix *asix_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
+    usbh_lwip_rx_pbuf_init();
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_asix_if_init, tcpip_input);
     netif_set_default(netif);
     while (!netif_is_up(netif)) {
@@ -470,6 +647,11 @@ struct netif g_rtl8152_netif;
 
 static err_t usbh_rtl8152_linkoutput(struct netif *netif, struct pbuf *p)
 {
+#ifdef CONFIG_USBHOST_NET_TXQ
+    (void)netif;
+
+    return usbh_lwip_eth_output_async(p, USBH_RTL8152_TX_HEADROOM, usbh_rtl8152_eth_output_async);
+#else
     int ret;
     (void)netif;
 
@@ -480,6 +662,7 @@ static err_t usbh_rtl8152_linkoutput(struct netif *netif, struct pbuf *p)
     } else {
         return ERR_OK;
     }
+#endif
 }
 
 void usbh_rtl8152_eth_input(uint8_t *buf, uint32_t buflen)
@@ -498,6 +681,10 @@ static err_t usbh_rtl8152_if_init(struct netif *netif)
     netif->name[1] = 'X';
     netif->output = etharp_output;
     netif->linkoutput = usbh_rtl8152_linkoutput;
+#ifdef CONFIG_USBHOST_RTL8152_CSUM_OFFLOAD
+    /* chip fills tcp/udp checksums, received ones are still checked because lwip has no per frame flag */
+    NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL & ~(NETIF_CHECKSUM_GEN_TCP | NETIF_CHECKSUM_GEN_UDP));
+#endif
     return ERR_OK;
 }
 
@@ -512,6 +699,7 @@ void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
     IP4_ADDR(&g_netmask, 0, 0, 0, 0);
     IP4_ADDR(&g_gateway, 0, 0, 0, 0);
 
+    usbh_lwip_rx_pbuf_init();
     netif = netif_add(netif, &g_ipaddr, &g_netmask, &g_gateway, NULL, usbh_rtl8152_if_init, tcpip_input);
     netif_set_default(netif);
     while (!netif_is_up(netif)) {
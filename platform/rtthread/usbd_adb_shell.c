@@ -66,7 +66,8 @@ static rt_ssize_t usbd_adb_shell_write(struct rt_device *dev,
                                        const void *buffer,
                                        rt_size_t size)
 {
-    int ret = 0;
+    rt_size_t written = 0;
+    int ret;
 
     RT_ASSERT(dev != RT_NULL);
 
@@ -74,10 +75,16 @@ static rt_ssize_t usbd_adb_shell_write(struct rt_device *dev,
         return size;
     }
 
-    if (usbd_adb_can_write() && size) {
-        usb_osal_sem_reset(g_usbd_adb_shell.tx_done);
-        usbd_abd_write(ADB_SHELL_LOALID, buffer, size);
-        usb_osal_sem_take(g_usbd_adb_shell.tx_done, 0xffffffff);
+    while (usbd_adb_can_write() && (written < size)) {
+        ret = usbd_adb_write(ADB_SHELL_LOALID, (const uint8_t *)buffer + written, size - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret == -USB_ERR_BUSY) {
+            /* wait for a sent packet or host ack */
+            usb_osal_sem_take(g_usbd_adb_shell.tx_done, 0xffffffff);
+        } else {
+            break;
+        }
     }
 
     return size;
@@ -17,6 +17,7 @@
 #include <netif/ethernetif.h>
 
 #include "usbh_core.h"
+#include "usbh_net_rxbuf.h"
 
 #include "lwip/opt.h"
 
@@ -48,6 +49,10 @@
 #error RT_LWIP_TCPTHREAD_STACKSIZE must be >= 2048
 #endif
 
+#if defined(CONFIG_USBHOST_NET_RXBUF) && (LWIP_SUPPORT_CUSTOM_PBUF != 1)
+#error CONFIG_USBHOST_NET_RXBUF needs LWIP_SUPPORT_CUSTOM_PBUF
+#endif
+
 // #define CONFIG_USBHOST_PLATFORM_CDC_ECM
 // #define CONFIG_USBHOST_PLATFORM_CDC_RNDIS
 // #define CONFIG_USBHOST_PLATFORM_CDC_NCM
@@ -66,6 +71,55 @@ void usbh_lwip_eth_output_common(struct pbuf *p, uint8_t *buf)
     }
 }
 
+#ifdef CONFIG_USBHOST_NET_RXBUF
+struct usbh_lwip_rx_pbuf {
+    struct pbuf_custom pc;
+    uint8_t *buf; /* payload may be moved by lwip, keep frame start for pool */
+};
+
+LWIP_MEMPOOL_DECLARE(USBH_RX_PBUF, CONFIG_USBHOST_NET_RXBUF_PBUF_NUM, sizeof(struct usbh_lwip_rx_pbuf), "usbh rx pbuf");
+
+static void usbh_lwip_rx_pbuf_free(struct pbuf *p)
+{
+    struct usbh_lwip_rx_pbuf *rx_pbuf = (struct usbh_lwip_rx_pbuf *)p;
+
+    usbh_net_rxbuf_free(rx_pbuf->buf);
+    LWIP_MEMPOOL_FREE(USBH_RX_PBUF, rx_pbuf);
+}
+
+/* Hand frame in a pool block to lwip without copy, block stays referenced until pbuf is freed */
+static struct pbuf *usbh_lwip_rx_pbuf_alloc(uint8_t *buf, uint32_t len)
+{
+    struct usbh_lwip_rx_pbuf *rx_pbuf;
+
+    if (usbh_net_rxbuf_ref(buf) < 0) {
+        return NULL;
+    }
+
+    rx_pbuf = (struct usbh_lwip_rx_pbuf *)LWIP_MEMPOOL_ALLOC(USBH_RX_PBUF);
+    if (rx_pbuf == NULL) {
+        usbh_net_rxbuf_free(buf);
+        return NULL;
+    }
+
+    rx_pbuf->buf = buf;
+    rx_pbuf->pc.custom_free_function = usbh_lwip_rx_pbuf_free;
+    return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx_pbuf->pc, buf, len);
+}
+
+static void usbh_lwip_rx_pbuf_init(void)
+{
+    static bool init = false;
+
+    if (!init) {
+        LWIP_MEMPOOL_INIT(USBH_RX_PBUF);
+        init = true;
+    }
+}
+#else
+#define usbh_lwip_rx_pbuf_init()
+#endif
+
 void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
 {
 #if LWIP_TCPIP_CORE_LOCKING_INPUT
@@ -76,6 +130,17 @@ void usbh_lwip_eth_input_common(struct netif *netif, uint8_t *buf, uint32_t len)
     err_t err;
     struct pbuf *p;
 
+#ifdef CONFIG_USBHOST_NET_RXBUF
+    p = usbh_lwip_rx_pbuf_alloc(buf, len);
+    if (p != NULL) {
+        err = netif->input(p, netif);
+        if (err != ERR_OK) {
+            pbuf_free(p);
+        }
+        return;
+    }
+#endif
+
     p = pbuf_alloc(PBUF_RAW, len, type);
     if (p != NULL) {
 #if LWIP_TCPIP_CORE_LOCKING_INPUT
@@ -147,6 +212,7 @@ void usbh_cdc_ecm_run(struct usbh_cdc_ecm *cdc_ecm_class)
     g_cdc_ecm_dev.eth_tx = rt_usbh_cdc_ecm_eth_tx;
     g_cdc_ecm_dev.parent.user_data = cdc_ecm_class;
 
+    usbh_lwip_rx_pbuf_init();
     eth_device_init(&g_cdc_ecm_dev, "u0");
     eth_device_linkchange(&g_cdc_ecm_dev, RT_TRUE);
 
@@ -236,6 +302,7 @@ void usbh_rndis_run(struct usbh_rndis *rndis_class)
     g_rndis_dev.eth_tx = rt_usbh_rndis_eth_tx;
     g_rndis_dev.parent.user_data = rndis_class;
 
+    usbh_lwip_rx_pbuf_init();
     eth_device_init(&g_rndis_dev, "u2");
     eth_device_linkchange(&g_rndis_dev, RT_TRUE);
 
@@ -308,6 +375,7 @@ void usbh_cdc_ncm_run(struct usbh_cdc_ncm *cdc_ncm_class)
     g_cdc_ncm_dev.eth_tx = rt_usbh_cdc_ncm_eth_tx;
     g_cdc_ncm_dev.parent.user_data = cdc_ncm_class;
 
+    usbh_lwip_rx_pbuf_init();
     eth_device_init(&g_cdc_ncm_dev, "u1");
     eth_device_linkchange(&g_cdc_ncm_dev, RT_TRUE);
 
@@ -377,6 +445,7 @@ void usbh_asix_run(struct usbh_asix *asix_class)
     g_asix_dev.eth_tx = rt_usbh_asix_eth_tx;
     g_asix_dev.parent.user_data = asix_class;
 
+    usbh_lwip_rx_pbuf_init();
     eth_device_init(&g_asix_dev, "u3");
     eth_device_linkchange(&g_asix_dev, RT_TRUE);
 
@@ -446,6 +515,7 @@ void usbh_rtl8152_run(struct usbh_rtl8152 *rtl8152_class)
     g_rtl8152_dev.eth_tx = rt_usbh_rtl8152_eth_tx;
     g_rtl8152_dev.parent.user_data = rtl8152_class;
 
+    usbh_lwip_rx_pbuf_init();
     eth_device_init(&g_rtl8152_dev, "u4");
     eth_device_linkchange(&g_rtl8152_dev, RT_TRUE);
 
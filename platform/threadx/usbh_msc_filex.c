@@ -23,6 +23,7 @@
 #include "fx_api.h"
 #include "usbh_core.h"
 #include "usbh_msc.h"
+#include "usbh_msc_blk.h"
 
 /* The RAM driver relies on the fx_media_format call to be made prior to
    the fx_media_open call. The following call will format the default
@@ -195,8 +196,8 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     case FX_DRIVER_READ: {
         msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
 
-        ret = usbh_msc_scsi_read10(msc_class, media_ptr->fx_media_driver_logical_sector + media_ptr->fx_media_hidden_sectors, media_ptr->fx_media_driver_buffer,
-                                   media_ptr->fx_media_driver_sectors);
+        ret = usbh_msc_blk_read(msc_class, media_ptr->fx_media_driver_logical_sector + media_ptr->fx_media_hidden_sectors, media_ptr->fx_media_driver_buffer,
+                                media_ptr->fx_media_driver_sectors, media_ptr->fx_media_driver_sector_type != FX_DATA_SECTOR);
 
         if (ret < 0) {
             media_ptr->fx_media_driver_status = FX_IO_ERROR;
@@ -210,8 +211,9 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     case FX_DRIVER_WRITE: {
         msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
 
-        ret = usbh_msc_scsi_write10(msc_class, media_ptr->fx_media_driver_logical_sector + media_ptr->fx_media_hidden_sectors,
-                                    media_ptr->fx_media_driver_buffer, media_ptr->fx_media_driver_sectors);
+        ret = usbh_msc_blk_write(msc_class, media_ptr->fx_media_driver_logical_sector + media_ptr->fx_media_hidden_sectors,
+                                 media_ptr->fx_media_driver_buffer, media_ptr->fx_media_driver_sectors,
+                                 media_ptr->fx_media_driver_sector_type != FX_DATA_SECTOR);
         if (ret < 0) {
             media_ptr->fx_media_driver_status = FX_IO_ERROR;
             return;
@@ -222,6 +224,12 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     }
 
     case FX_DRIVER_FLUSH: {
+        msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
+
+        if (usbh_msc_blk_sync(msc_class) < 0) {
+            media_ptr->fx_media_driver_status = FX_IO_ERROR;
+            return;
+        }
         /* Return driver success.  */
         media_ptr->fx_media_driver_status = FX_SUCCESS;
         break;
@@ -253,8 +261,10 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     }
 
     case FX_DRIVER_UNINIT: {
-        /* There is nothing to do in this case for the RAM driver.  For actual
-           devices some shutdown processing may be necessary.  */
+        msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
+
+        /* Write back merged sectors before media goes away.  */
+        usbh_msc_blk_sync(msc_class);
 
         /* Successful driver request.  */
         media_ptr->fx_media_driver_status = FX_SUCCESS;
@@ -264,7 +274,7 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     case FX_DRIVER_BOOT_READ: {
         msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
 
-        ret = usbh_msc_scsi_read10(msc_class, 0, media_ptr->fx_media_driver_buffer, 1);
+        ret = usbh_msc_blk_read(msc_class, 0, media_ptr->fx_media_driver_buffer, 1, true);
         if (ret < 0) {
             media_ptr->fx_media_driver_status = FX_IO_ERROR;
             return;
@@ -278,7 +288,7 @@ VOID _fx_usbh_msc_driver(FX_MEDIA *media_ptr)
     case FX_DRIVER_BOOT_WRITE: {
         msc_class = (struct usbh_msc *)media_ptr->fx_media_driver_info;
 
-        ret = usbh_msc_scsi_write10(msc_class, 0, media_ptr->fx_media_driver_buffer, 1);
+        ret = usbh_msc_blk_write(msc_class, 0, media_ptr->fx_media_driver_buffer, 1, true);
         if (ret < 0) {
             media_ptr->fx_media_driver_status = FX_IO_ERROR;
             return;
@@ -44,16 +44,42 @@ static struct bootuf2_FILE files[] = {
     [3] = { .Name = "JOIN    HTM", .Content = file_JOIN, .FileSize = sizeof(file_JOIN) - 1 },
 };
 
+#define BOOTUF2_CHUNK_SIZE     256
+#define BOOTUF2_CHUNK_PER_PAGE (CONFIG_BOOTUF2_PAGE_SIZE / BOOTUF2_CHUNK_SIZE)
+#define BOOTUF2_CHUNK_FULL     (0xffffffffU >> (32 - BOOTUF2_CHUNK_PER_PAGE))
+#define BOOTUF2_PAGE_SLOTS     (CONFIG_BOOTUF2_CACHE_SIZE / CONFIG_BOOTUF2_PAGE_SIZE)
+
+#if (CONFIG_BOOTUF2_PAGE_SIZE % BOOTUF2_CHUNK_SIZE) || (BOOTUF2_CHUNK_PER_PAGE > 32) || (BOOTUF2_CHUNK_PER_PAGE == 0)
+#error "CONFIG_BOOTUF2_PAGE_SIZE must be a multiple of 256 and no more than 8192"
+#endif
+
+#if BOOTUF2_PAGE_SLOTS == 0
+#error "CONFIG_BOOTUF2_CACHE_SIZE must hold at least one page"
+#endif
+
+/*!< cached sectors of virtual disk */
+#define BOOTUF2_CACHED_DBR  0
+#define BOOTUF2_CACHED_FAT  1
+#define BOOTUF2_CACHED_ROOT 2
+
+struct bootuf2_page {
+    uint32_t address; /*!< page aligned target address */
+    uint32_t valid;   /*!< one bit per 256 byte chunk */
+    uint32_t age;
+    uint8_t *data;
+};
+
 struct bootuf2_data {
     const struct bootuf2_DBR *const DBR;
     struct bootuf2_STATE *const STATE;
-    uint8_t *const fbuff;
     uint8_t *const erase;
-    size_t page_count;
     uint8_t *const cache;
-    const size_t cache_size;
-    uint32_t cached_address;
-    size_t cached_bytes;
+    uint8_t (*const sector)[CONFIG_BOOTUF2_SECTOR_SIZE];
+    uint32_t fat_used;  /*!< sectors per fat holding cluster chains */
+    uint32_t root_used; /*!< root sectors holding entries */
+    struct bootuf2_page page[BOOTUF2_PAGE_SLOTS];
+    uint32_t page_age;
+    struct bootuf2_stat stat;
 };
 
 /*!< define DBRs */
@@ -93,23 +119,22 @@ static struct bootuf2_STATE bootuf2_STATE = {
     .Enable = 1,
 };
 
-/*!< define flash cache */
+/*!< define flash cache, split into pages */
 static uint8_t __attribute__((aligned(4))) bootuf2_disk_cache[CONFIG_BOOTUF2_CACHE_SIZE];
 
-/*!< define flash buff */
-static uint8_t __attribute__((aligned(4))) bootuf2_disk_fbuff[256];
-
 /*!< define erase flag buff */
 static uint8_t __attribute__((aligned(4))) bootuf2_disk_erase[BOOTUF2_DIVCEIL(CONFIG_BOOTUF2_PAGE_COUNTMAX, 8)];
 
+/*!< define precomputed dbr, first fat and first root sector */
+static uint8_t __attribute__((aligned(4))) bootuf2_disk_sector[3][CONFIG_BOOTUF2_SECTOR_SIZE];
+
 /*!< define disk */
 static struct bootuf2_data bootuf2_disk = {
     .DBR = &bootuf2_DBR,
     .STATE = &bootuf2_STATE,
-    .fbuff = bootuf2_disk_fbuff,
     .erase = bootuf2_disk_erase,
     .cache = bootuf2_disk_cache,
-    .cache_size = sizeof(bootuf2_disk_cache),
+    .sector = bootuf2_disk_sector,
 };
 
 static void fname_copy(char *dst, char const *src, uint16_t len)
@@ -196,7 +221,7 @@ static void bootuf2block_state_update(struct bootuf2_STATE *STATE,
     }
 
     USB_LOG_DBG("UF2 block total %d written %d index %d\r\n",
-                uf2->NumberOfBllock, STATE->NumberOfWritten, uf2->BlockIndex);
+                uf2->NumberOfBlock, STATE->NumberOfWritten, uf2->BlockIndex);
 }
 
 static bool bootuf2block_state_check(struct bootuf2_STATE *STATE)
@@ -205,195 +230,347 @@ static bool bootuf2block_state_check(struct bootuf2_STATE *STATE)
            STATE->NumberOfBlock;
 }
 
-static int bootuf2_flash_flush(struct bootuf2_data *ctx)
+static int bootuf2_page_erase_once(struct bootuf2_data *ctx, uint32_t address)
 {
+    uint32_t index;
+    uint8_t mask;
     int err;
 
-    if (ctx->cached_bytes == 0) {
+    /*!< pages outside erase map are left to bootuf2_flash_write, address below base wraps */
+    index = (address - CONFIG_BOOTUF2_FLASH_BASE) / CONFIG_BOOTUF2_PAGE_SIZE;
+    if (index >= CONFIG_BOOTUF2_PAGE_COUNTMAX) {
         return 0;
     }
 
-    err = bootuf2_flash_write(ctx->cached_address, ctx->cache, ctx->cached_bytes);
+    mask = 1 << (index % 8);
+    if (ctx->erase[index / 8] & mask) {
+        return 0;
+    }
 
+    err = bootuf2_flash_erase(address, CONFIG_BOOTUF2_PAGE_SIZE);
     if (err) {
-        USB_LOG_ERR("UF2 slot flash write error %d at offset %08lx len %d\r\n",
-                    err, ctx->cached_address, ctx->cached_bytes);
-        return -1;
+        return err;
     }
 
-    ctx->cached_bytes = 0;
+    ctx->erase[index / 8] |= mask;
+    ctx->stat.pages_erased++;
 
     return 0;
 }
 
-int bootuf2_flash_write_internal(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+static int bootuf2_page_flush(struct bootuf2_data *ctx, struct bootuf2_page *page)
 {
-    /*!< 1.cache not empty and address not continue */
-    /*!< 2.cache full */
-    if ((ctx->cached_bytes && ((ctx->cached_address + ctx->cached_bytes) != uf2->TargetAddress)) ||
-        (ctx->cached_bytes == ctx->cache_size)) {
-        int err = bootuf2_flash_flush(ctx);
-        if (err)
-            return err;
+    uint32_t start;
+    uint32_t end;
+    int err;
+
+    if (page->valid == 0) {
+        return 0;
     }
 
-    /*!< write len always is 256, cache_size always is a multiple of 256 */
-    memcpy(ctx->cache + ctx->cached_bytes, uf2->Data, uf2->PayloadSize);
+    err = bootuf2_page_erase_once(ctx, page->address);
+    if (err) {
+        goto failed;
+    }
 
-    ctx->cached_address = uf2->TargetAddress - ctx->cached_bytes;
-    ctx->cached_bytes += uf2->PayloadSize;
+    if (page->valid == BOOTUF2_CHUNK_FULL) {
+        err = bootuf2_flash_write(page->address, page->data, CONFIG_BOOTUF2_PAGE_SIZE);
+        if (err) {
+            goto failed;
+        }
+        ctx->stat.pages_programmed++;
+        ctx->stat.bytes_programmed += CONFIG_BOOTUF2_PAGE_SIZE;
+    } else {
+        /*!< page evicted or image ended inside it, program each run of chunks */
+        for (start = 0; start < BOOTUF2_CHUNK_PER_PAGE; start = end) {
+            if ((page->valid & (1U << start)) == 0) {
+                end = start + 1;
+                continue;
+            }
+            for (end = start; (end < BOOTUF2_CHUNK_PER_PAGE) && (page->valid & (1U << end)); end++) {
+            }
+
+            err = bootuf2_flash_write(page->address + start * BOOTUF2_CHUNK_SIZE,
+                                      page->data + start * BOOTUF2_CHUNK_SIZE,
+                                      (end - start) * BOOTUF2_CHUNK_SIZE);
+            if (err) {
+                goto failed;
+            }
+            ctx->stat.partial_programs++;
+            ctx->stat.bytes_programmed += (end - start) * BOOTUF2_CHUNK_SIZE;
+        }
+    }
 
+    page->valid = 0;
+    ctx->stat.last_time = bootuf2_get_time_ms();
     return 0;
+
+failed:
+    USB_LOG_ERR("UF2 page flash error %d at offset %08lx\r\n",
+                err, (unsigned long)page->address);
+    ctx->stat.flash_errors++;
+    page->valid = 0;
+    return -1;
 }
 
-void bootuf2_init(void)
+static int bootuf2_flash_flush(struct bootuf2_data *ctx)
 {
-    struct bootuf2_data *ctx;
+    int ret = 0;
 
-    ctx = &bootuf2_disk;
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (bootuf2_page_flush(ctx, &ctx->page[i])) {
+            ret = -1;
+        }
+    }
 
-    fcalculate_cluster(ctx);
+    return ret;
+}
 
-    ctx->cached_bytes = 0;
-    ctx->cached_address = 0;
+int bootuf2_flash_write_internal(struct bootuf2_data *ctx, struct bootuf2_BLOCK *uf2)
+{
+    struct bootuf2_page *page = NULL;
+    uint32_t address;
+    uint32_t chunk;
+    int err;
+
+    /*!< uncommon payload layout, write through */
+    if ((uf2->PayloadSize != BOOTUF2_CHUNK_SIZE) ||
+        (uf2->TargetAddress % BOOTUF2_CHUNK_SIZE)) {
+        if ((uf2->PayloadSize == 0) || (uf2->PayloadSize > sizeof(uf2->Data))) {
+            return -1;
+        }
+        err = bootuf2_flash_write(uf2->TargetAddress, uf2->Data, uf2->PayloadSize);
+        if (err) {
+            ctx->stat.flash_errors++;
+            return -1;
+        }
+        ctx->stat.bytes_programmed += uf2->PayloadSize;
+        return 0;
+    }
+
+    address = uf2->TargetAddress & ~(CONFIG_BOOTUF2_PAGE_SIZE - 1);
+    chunk = (uf2->TargetAddress - address) / BOOTUF2_CHUNK_SIZE;
+
+    /*!< merge into page already cached, or take a free or the oldest slot */
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        if (ctx->page[i].valid && (ctx->page[i].address == address)) {
+            page = &ctx->page[i];
+            break;
+        }
+        if ((page == NULL) || (page->valid && ((ctx->page[i].valid == 0) || (ctx->page[i].age < page->age)))) {
+            page = &ctx->page[i];
+        }
+    }
+
+    if (page->valid && (page->address != address)) {
+        bootuf2_page_flush(ctx, page);
+    }
+
+    page->address = address;
+    page->valid |= (1U << chunk);
+    page->age = ++ctx->page_age;
+    memcpy(page->data + chunk * BOOTUF2_CHUNK_SIZE, uf2->Data, BOOTUF2_CHUNK_SIZE);
+
+    if (page->valid == BOOTUF2_CHUNK_FULL) {
+        return bootuf2_page_flush(ctx, page);
+    }
+
+    return 0;
 }
 
-int boot2uf2_read_sector(uint32_t start_sector, uint8_t *buff, uint32_t sector_count)
+static void bootuf2_make_sector(struct bootuf2_data *ctx, uint32_t start_sector, uint8_t *buff)
 {
-    struct bootuf2_data *ctx;
+    uint32_t sector_relative = start_sector;
 
-    ctx = &bootuf2_disk;
+    memset(buff, 0, ctx->DBR->BPB.BytesPerSector);
 
-    while (sector_count) {
-        memset(buff, 0, ctx->DBR->BPB.BytesPerSector);
+    /*!< DBR sector */
+    if (start_sector == BOOTUF2_SECTOR_DBR_END) {
+        memcpy(buff, ctx->DBR, sizeof(struct bootuf2_DBR));
+        buff[510] = 0x55;
+        buff[511] = 0xaa;
+    }
+    /*!< FAT sector */
+    else if (start_sector < BOOTUF2_SECTOR_FAT_END(ctx->DBR)) {
+        uint16_t *buff16 = (uint16_t *)buff;
 
-        uint32_t sector_relative = start_sector;
+        sector_relative -= BOOTUF2_SECTOR_RSVD_END(ctx->DBR);
 
-        /*!< DBR sector */
-        if (start_sector == BOOTUF2_SECTOR_DBR_END) {
-            memcpy(buff, ctx->DBR, sizeof(struct bootuf2_DBR));
-            buff[510] = 0x55;
-            buff[511] = 0xaa;
+        /*!< Perform the same operation on all FAT tables */
+        while (sector_relative >= ctx->DBR->BPB.SectorsPerFAT) {
+            sector_relative -= ctx->DBR->BPB.SectorsPerFAT;
         }
-        /*!< FAT sector */
-        else if (start_sector < BOOTUF2_SECTOR_FAT_END(ctx->DBR)) {
-            uint16_t *buff16 = (uint16_t *)buff;
 
-            sector_relative -= BOOTUF2_SECTOR_RSVD_END(ctx->DBR);
+        uint16_t cluster_unused = files[ARRAY_SIZE(files) - 1].ClusterEnd + 1;
+        uint16_t cluster_absolute_first = sector_relative *
+                                          BOOTUF2_FAT16_PER_SECTOR(ctx->DBR);
+
+        /*!< cluster used link to chain, or unsed */
+        for (uint16_t i = 0, cluster_absolute = cluster_absolute_first;
+             i < BOOTUF2_FAT16_PER_SECTOR(ctx->DBR);
+             i++, cluster_absolute++) {
+            if (cluster_absolute >= cluster_unused)
+                buff16[i] = 0;
+            else
+                buff16[i] = cluster_absolute + 1;
+        }
 
-            /*!< Perform the same operation on all FAT tables */
-            while (sector_relative >= ctx->DBR->BPB.SectorsPerFAT) {
-                sector_relative -= ctx->DBR->BPB.SectorsPerFAT;
-            }
+        /*!< cluster 0 and 1 */
+        if (sector_relative == 0) {
+            buff[0] = ctx->DBR->BPB.MediaDescriptor;
+            buff[1] = 0xff;
+            buff16[1] = 0xffff;
+        }
 
-            uint16_t cluster_unused = files[ARRAY_SIZE(files) - 1].ClusterEnd + 1;
-            uint16_t cluster_absolute_first = sector_relative *
-                                              BOOTUF2_FAT16_PER_SECTOR(ctx->DBR);
-
-            /*!< cluster used link to chain, or unsed */
-            for (uint16_t i = 0, cluster_absolute = cluster_absolute_first;
-                 i < BOOTUF2_FAT16_PER_SECTOR(ctx->DBR);
-                 i++, cluster_absolute++) {
-                if (cluster_absolute >= cluster_unused)
-                    buff16[i] = 0;
-                else
-                    buff16[i] = cluster_absolute + 1;
-            }
+        /*!< cluster end of file */
+        for (uint32_t i = 0; i < ARRAY_SIZE(files); i++) {
+            uint16_t cluster_file_last = files[i].ClusterEnd;
 
-            /*!< cluster 0 and 1 */
-            if (sector_relative == 0) {
-                buff[0] = ctx->DBR->BPB.MediaDescriptor;
-                buff[1] = 0xff;
-                buff16[1] = 0xffff;
+            if (cluster_file_last >= cluster_absolute_first) {
+                uint16_t idx = cluster_file_last - cluster_absolute_first;
+                if (idx < BOOTUF2_FAT16_PER_SECTOR(ctx->DBR)) {
+                    buff16[idx] = 0xffff;
+                }
             }
+        }
+    }
+    /*!< root entries */
+    else if (start_sector < BOOTUF2_SECTOR_ROOT_END(ctx->DBR)) {
+        sector_relative -= BOOTUF2_SECTOR_FAT_END(ctx->DBR);
+
+        struct bootuf2_ENTRY *ent = (void *)buff;
+        int remain_entries = BOOTUF2_ENTRY_PER_SECTOR(ctx->DBR);
+
+        uint32_t file_index_first;
+
+        /*!< volume label entry */
+        if (sector_relative == 0) {
+            fname_copy(ent->Name, (char const *)ctx->DBR->BPB.VolumeLabel, 11);
+            ent->Attribute = 0x28;
+            ent++;
+            remain_entries--;
+            file_index_first = 0;
+        } else {
+            /*!< -1 to account for volume label in first sector */
+            file_index_first = sector_relative * BOOTUF2_ENTRY_PER_SECTOR(ctx->DBR) - 1;
+        }
 
-            /*!< cluster end of file */
-            for (uint32_t i = 0; i < ARRAY_SIZE(files); i++) {
-                uint16_t cluster_file_last = files[i].ClusterEnd;
+        for (uint32_t idx = file_index_first;
+             (remain_entries > 0) && (idx < ARRAY_SIZE(files));
+             idx++, ent++) {
+            const uint32_t cluster_beg = files[idx].ClusterBeg;
 
-                if (cluster_file_last >= cluster_absolute_first) {
-                    uint16_t idx = cluster_file_last - cluster_absolute_first;
-                    if (idx < BOOTUF2_FAT16_PER_SECTOR(ctx->DBR)) {
-                        buff16[idx] = 0xffff;
-                    }
-                }
+            const struct bootuf2_FILE *f = &files[idx];
+
+            if ((0 == f->FileSize) &&
+                (0 != idx)) {
+                continue;
             }
+
+            fname_copy(ent->Name, f->Name, 11);
+            ent->Attribute = 0x05;
+            ent->CreateTimeTeenth = BOOTUF2_SECONDS_INT % 2 * 100;
+            ent->CreateTime = BOOTUF2_DOS_TIME;
+            ent->CreateDate = BOOTUF2_DOS_DATE;
+            ent->LastAccessDate = BOOTUF2_DOS_DATE;
+            ent->FirstClustH16 = cluster_beg >> 16;
+            ent->UpdateTime = BOOTUF2_DOS_TIME;
+            ent->UpdateDate = BOOTUF2_DOS_DATE;
+            ent->FirstClustL16 = cluster_beg & 0xffff;
+            ent->FileSize = f->FileSize;
         }
-        /*!< root entries */
-        else if (start_sector < BOOTUF2_SECTOR_ROOT_END(ctx->DBR)) {
-            sector_relative -= BOOTUF2_SECTOR_FAT_END(ctx->DBR);
+    }
+    /*!< data */
+    else if (start_sector < BOOTUF2_SECTOR_DATA_END(ctx->DBR)) {
+        sector_relative -= BOOTUF2_SECTOR_ROOT_END(ctx->DBR);
 
-            struct bootuf2_ENTRY *ent = (void *)buff;
-            int remain_entries = BOOTUF2_ENTRY_PER_SECTOR(ctx->DBR);
+        int fid = ffind_by_cluster(2 + sector_relative / ctx->DBR->BPB.SectorsPerCluster);
 
-            uint32_t file_index_first;
+        if (fid >= 0) {
+            const struct bootuf2_FILE *f = &files[fid];
 
-            /*!< volume label entry */
-            if (sector_relative == 0) {
-                fname_copy(ent->Name, (char const *)ctx->DBR->BPB.VolumeLabel, 11);
-                ent->Attribute = 0x28;
-                ent++;
-                remain_entries--;
-                file_index_first = 0;
-            } else {
-                /*!< -1 to account for volume label in first sector */
-                file_index_first = sector_relative * BOOTUF2_ENTRY_PER_SECTOR(ctx->DBR) - 1;
-            }
+            uint32_t sector_relative_file =
+                sector_relative -
+                (files[fid].ClusterBeg - 2) * ctx->DBR->BPB.SectorsPerCluster;
 
-            for (uint32_t idx = file_index_first;
-                 (remain_entries > 0) && (idx < ARRAY_SIZE(files));
-                 idx++, ent++) {
-                const uint32_t cluster_beg = files[idx].ClusterBeg;
+            size_t fcontent_offset = sector_relative_file * ctx->DBR->BPB.BytesPerSector;
+            size_t fcontent_length = f->FileSize;
 
-                const struct bootuf2_FILE *f = &files[idx];
+            if (fcontent_length > fcontent_offset) {
+                const void *src = (void *)((uint8_t *)(f->Content) + fcontent_offset);
+                size_t copy_size = fcontent_length - fcontent_offset;
 
-                if ((0 == f->FileSize) &&
-                    (0 != idx)) {
-                    continue;
+                if (copy_size > ctx->DBR->BPB.BytesPerSector) {
+                    copy_size = ctx->DBR->BPB.BytesPerSector;
                 }
 
-                fname_copy(ent->Name, f->Name, 11);
-                ent->Attribute = 0x05;
-                ent->CreateTimeTeenth = BOOTUF2_SECONDS_INT % 2 * 100;
-                ent->CreateTime = BOOTUF2_DOS_TIME;
-                ent->CreateDate = BOOTUF2_DOS_DATE;
-                ent->LastAccessDate = BOOTUF2_DOS_DATE;
-                ent->FirstClustH16 = cluster_beg >> 16;
-                ent->UpdateTime = BOOTUF2_DOS_TIME;
-                ent->UpdateDate = BOOTUF2_DOS_DATE;
-                ent->FirstClustL16 = cluster_beg & 0xffff;
-                ent->FileSize = f->FileSize;
+                memcpy(buff, src, copy_size);
             }
         }
-        /*!< data */
-        else if (start_sector < BOOTUF2_SECTOR_DATA_END(ctx->DBR)) {
-            sector_relative -= BOOTUF2_SECTOR_ROOT_END(ctx->DBR);
+    }
+    /*!< unknown sector, ignore */
+}
 
-            int fid = ffind_by_cluster(2 + sector_relative / ctx->DBR->BPB.SectorsPerCluster);
+void bootuf2_init(void)
+{
+    struct bootuf2_data *ctx;
 
-            if (fid >= 0) {
-                const struct bootuf2_FILE *f = &files[fid];
+    ctx = &bootuf2_disk;
 
-                uint32_t sector_relative_file =
-                    sector_relative -
-                    (files[fid].ClusterBeg - 2) * ctx->DBR->BPB.SectorsPerCluster;
+    fcalculate_cluster(ctx);
 
-                size_t fcontent_offset = sector_relative_file * ctx->DBR->BPB.BytesPerSector;
-                size_t fcontent_length = f->FileSize;
+    /*!< the virtual disk never changes once clusters are placed, build fixed sectors once */
+    ctx->fat_used = BOOTUF2_DIVCEIL((uint32_t)files[ARRAY_SIZE(files) - 1].ClusterEnd + 1,
+                                    BOOTUF2_FAT16_PER_SECTOR(ctx->DBR));
+    ctx->root_used = BOOTUF2_DIVCEIL((uint32_t)ARRAY_SIZE(files) + 1,
+                                     BOOTUF2_ENTRY_PER_SECTOR(ctx->DBR));
 
-                if (fcontent_length > fcontent_offset) {
-                    const void *src = (void *)((uint8_t *)(f->Content) + fcontent_offset);
-                    size_t copy_size = fcontent_length - fcontent_offset;
+    bootuf2_make_sector(ctx, BOOTUF2_SECTOR_DBR_END, ctx->sector[BOOTUF2_CACHED_DBR]);
+    bootuf2_make_sector(ctx, BOOTUF2_SECTOR_RSVD_END(ctx->DBR), ctx->sector[BOOTUF2_CACHED_FAT]);
+    bootuf2_make_sector(ctx, BOOTUF2_SECTOR_FAT_END(ctx->DBR), ctx->sector[BOOTUF2_CACHED_ROOT]);
 
-                    if (copy_size > ctx->DBR->BPB.BytesPerSector) {
-                        copy_size = ctx->DBR->BPB.BytesPerSector;
-                    }
+    for (uint32_t i = 0; i < BOOTUF2_PAGE_SLOTS; i++) {
+        ctx->page[i].valid = 0;
+        ctx->page[i].data = ctx->cache + i * CONFIG_BOOTUF2_PAGE_SIZE;
+    }
+    ctx->page_age = 0;
+}
 
-                    memcpy(buff, src, copy_size);
-                }
+int boot2uf2_read_sector(uint32_t start_sector, uint8_t *buff, uint32_t sector_count)
+{
+    struct bootuf2_data *ctx;
+    uint32_t sector_relative;
+
+    ctx = &bootuf2_disk;
+
+    while (sector_count) {
+        if (start_sector == BOOTUF2_SECTOR_DBR_END) {
+            memcpy(buff, ctx->sector[BOOTUF2_CACHED_DBR], ctx->DBR->BPB.BytesPerSector);
+        } else if ((start_sector >= BOOTUF2_SECTOR_RSVD_END(ctx->DBR)) &&
+                   (start_sector < BOOTUF2_SECTOR_FAT_END(ctx->DBR))) {
+            sector_relative = (start_sector - BOOTUF2_SECTOR_RSVD_END(ctx->DBR)) % ctx->DBR->BPB.SectorsPerFAT;
+
+            if (sector_relative == 0) {
+                memcpy(buff, ctx->sector[BOOTUF2_CACHED_FAT], ctx->DBR->BPB.BytesPerSector);
+            } else if (sector_relative >= ctx->fat_used) {
+                memset(buff, 0, ctx->DBR->BPB.BytesPerSector);
+            } else {
+                bootuf2_make_sector(ctx, start_sector, buff);
             }
+        } else if ((start_sector >= BOOTUF2_SECTOR_FAT_END(ctx->DBR)) &&
+                   (start_sector < BOOTUF2_SECTOR_ROOT_END(ctx->DBR))) {
+            sector_relative = start_sector - BOOTUF2_SECTOR_FAT_END(ctx->DBR);
+
+            if (sector_relative == 0) {
+                memcpy(buff, ctx->sector[BOOTUF2_CACHED_ROOT], ctx->DBR->BPB.BytesPerSector);
+            } else if (sector_relative >= ctx->root_used) {
+                memset(buff, 0, ctx->DBR->BPB.BytesPerSector);
+            } else {
+                bootuf2_make_sector(ctx, start_sector, buff);
+            }
+        } else {
+            bootuf2_make_sector(ctx, start_sector, buff);
         }
-        /*!< unknown sector, ignore */
 
         start_sector++;
         sector_count--;
@@ -417,18 +594,25 @@ int bootuf2_write_sector(uint32_t start_sector, const uint8_t *buff, uint32_t se
               (uf2->MagicEnd == BOOTUF2_MAGIC_END) &&
               (uf2->Flags & BOOTUF2_FLAG_FAMILID_PRESENT) &&
               !(uf2->Flags & BOOTUF2_FLAG_NOT_MAIN_FLASH))) {
+            ctx->stat.sectors_ignored++;
             goto next;
         }
 
         if (uf2->FamilyID == CONFIG_BOOTUF2_FAMILYID) {
-            if (bootuf2block_check_writable(ctx->STATE, uf2, CONFIG_BOOTUF2_FLASHMAX)) {
+            if (bootuf2block_check_writable(ctx->STATE, uf2, BOOTUF2_BLOCKSMAX)) {
+                if (ctx->STATE->NumberOfWritten == 0) {
+                    ctx->stat.first_time = bootuf2_get_time_ms();
+                }
                 bootuf2_flash_write_internal(ctx, uf2);
-                bootuf2block_state_update(ctx->STATE, uf2, CONFIG_BOOTUF2_FLASHMAX);
+                bootuf2block_state_update(ctx->STATE, uf2, BOOTUF2_BLOCKSMAX);
+                ctx->stat.last_time = bootuf2_get_time_ms();
             } else {
+                ctx->stat.blocks_duplicate++;
                 USB_LOG_DBG("UF2 block %d already written\r\n",
                             uf2->BlockIndex);
             }
         } else {
+            ctx->stat.sectors_ignored++;
             USB_LOG_DBG("UF2 block illegal id %08x\r\n", uf2->FamilyID);
         }
 
@@ -460,4 +644,49 @@ bool bootuf2_is_write_done(void)
     } else {
         return false;
     }
-}
\ No newline at end of file
+}
+
+void bootuf2_get_stat(struct bootuf2_stat *stat)
+{
+    memcpy(stat, &bootuf2_disk.stat, sizeof(struct bootuf2_stat));
+    stat->blocks_total = bootuf2_disk.STATE->NumberOfBlock;
+    stat->blocks_written = bootuf2_disk.STATE->NumberOfWritten;
+}
+
+uint8_t bootuf2_get_progress(void)
+{
+    struct bootuf2_STATE *STATE = bootuf2_disk.STATE;
+
+    if ((STATE->NumberOfBlock == 0) || (STATE->NumberOfBlock == 0xffffffff)) {
+        return 0;
+    }
+
+    if (STATE->NumberOfWritten >= STATE->NumberOfBlock) {
+        return 100;
+    }
+
+    return (uint8_t)((uint64_t)STATE->NumberOfWritten * 100 / STATE->NumberOfBlock);
+}
+
+uint32_t bootuf2_get_throughput(void)
+{
+    uint32_t elapsed = bootuf2_disk.stat.last_time - bootuf2_disk.stat.first_time;
+
+    if (elapsed == 0) {
+        return 0;
+    }
+
+    return (uint32_t)((uint64_t)bootuf2_disk.stat.bytes_programmed * 1000 / elapsed);
+}
+
+__WEAK int bootuf2_flash_erase(uint32_t address, size_t size)
+{
+    (void)address;
+    (void)size;
+    return 0;
+}
+
+__WEAK uint32_t bootuf2_get_time_ms(void)
+{
+    return 0;
+}
@@ -47,6 +47,21 @@ struct bootuf2_STATE
     uint8_t Enable;
 };
 
+struct bootuf2_stat
+{
+    uint32_t blocks_total;     /*!< NumberOfBlock of image, 0xffffffff if images were mixed */
+    uint32_t blocks_written;
+    uint32_t blocks_duplicate; /*!< blocks written again by host */
+    uint32_t sectors_ignored;  /*!< fat and directory updates, other family */
+    uint32_t bytes_programmed;
+    uint32_t pages_programmed; /*!< full page programs */
+    uint32_t partial_programs; /*!< programs of a page not fully covered by image */
+    uint32_t pages_erased;
+    uint32_t flash_errors;
+    uint32_t first_time; /*!< bootuf2_get_time_ms() at first block */
+    uint32_t last_time;  /*!< bootuf2_get_time_ms() at last block or program */
+};
+
 struct bootuf2_DBR
 {
     /*!< offset 0   */
@@ -146,9 +161,9 @@ struct bootuf2_FILE
 #define BOOTUF2_ENTRY_PER_SECTOR(pDBR) (pDBR->BPB.BytesPerSector / sizeof(struct bootuf2_ENTRY))
 #define BOOTUF2_CLUSTERSMAX (0xFFF0 - 2)
 #define BOOTUF2_SECTOR_DBR_END (0)
-#define BOOTUF2_SECTOR_RSVD_END(pDBR) BOOTUF2_SECTOR_DBR_END + (pDBR->BPB.ReservedSectors)
-#define BOOTUF2_SECTOR_FAT_END(pDBR) BOOTUF2_SECTOR_RSVD_END(pDBR) + (pDBR->BPB.SectorsPerFAT * pDBR->BPB.NumberOfFAT)
-#define BOOTUF2_SECTOR_ROOT_END(pDBR) BOOTUF2_SECTOR_FAT_END(pDBR) + (pDBR->BPB.RootEntries / (pDBR->BPB.BytesPerSector / sizeof(struct bootuf2_ENTRY)))
+#define BOOTUF2_SECTOR_RSVD_END(pDBR) (BOOTUF2_SECTOR_DBR_END + (pDBR->BPB.ReservedSectors))
+#define BOOTUF2_SECTOR_FAT_END(pDBR) ((uint32_t)BOOTUF2_SECTOR_RSVD_END(pDBR) + ((uint32_t)pDBR->BPB.SectorsPerFAT * pDBR->BPB.NumberOfFAT))
+#define BOOTUF2_SECTOR_ROOT_END(pDBR) (BOOTUF2_SECTOR_FAT_END(pDBR) + (pDBR->BPB.RootEntries / (pDBR->BPB.BytesPerSector / sizeof(struct bootuf2_ENTRY))))
 #define BOOTUF2_SECTOR_DATA_END(pDBR) (pDBR->BPB.Sectors + pDBR->BPB.SectorsOver32MB)
 
 #define BOOTUF2_SECTORS_PER_FAT(n) \
@@ -212,7 +227,17 @@ uint32_t bootuf2_get_sector_count(void);
 
 bool bootuf2_is_write_done(void);
 
+void bootuf2_get_stat(struct bootuf2_stat *stat);
+/*!< percent of blocks written */
+uint8_t bootuf2_get_progress(void);
+/*!< bytes programmed per second, needs bootuf2_get_time_ms */
+uint32_t bootuf2_get_throughput(void);
+
 void boot2uf2_flash_init(void);
+/*!< size is CONFIG_BOOTUF2_PAGE_SIZE for whole pages, pages are erased before the first write */
 int bootuf2_flash_write(uint32_t address, const uint8_t *data, size_t size);
+/*!< called once per page inside erase map, default does nothing and leaves erase to bootuf2_flash_write */
+int bootuf2_flash_erase(uint32_t address, size_t size);
+uint32_t bootuf2_get_time_ms(void);
 
 #endif /*  BOOTUF2_H */
@@ -601,6 +601,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
     g_chipidea_udc[busid].in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_chipidea_udc[busid].in_ep[ep_idx].xfer_len = data_len;
     g_chipidea_udc[busid].in_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     usb_dcache_clean((uintptr_t)data, USB_ALIGN_UP(data_len, CONFIG_USB_ALIGN_SIZE));
     chipidea_start_xfer(busid, ep, (uint8_t *)data, data_len);
@@ -626,6 +627,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
     g_chipidea_udc[busid].out_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_chipidea_udc[busid].out_ep[ep_idx].xfer_len = data_len;
     g_chipidea_udc[busid].out_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     usb_dcache_invalidate((uintptr_t)data, USB_ALIGN_UP(data_len, CONFIG_USB_ALIGN_SIZE));
     chipidea_start_xfer(busid, ep, data, data_len);
@@ -643,6 +645,7 @@ void USBD_IRQHandler(uint8_t busid)
     int_status = USB_OTG_DEV->USBSTS;
     int_status &= USB_OTG_DEV->USBINTR;
     USB_OTG_DEV->USBSTS = int_status;
+    usbd_trace_irq(busid, USB_TRACE_IRQ_ENTER, int_status);
 
     if (int_status & intr_error) {
         USB_LOG_ERR("usbd intr error!\r\n");
@@ -737,4 +740,5 @@ void USBD_IRQHandler(uint8_t busid)
             usbd_event_ep0_setup_complete_handler(busid, (uint8_t *)&qhd0->setup_request);
         }
     }
+    usbd_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
\ No newline at end of file
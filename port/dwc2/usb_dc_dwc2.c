@@ -900,6 +900,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
     g_dwc2_udc[busid].in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_dwc2_udc[busid].in_ep[ep_idx].xfer_len = data_len;
     g_dwc2_udc[busid].in_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     USB_OTG_INEP(ep_idx)->DIEPTSIZ &= ~(USB_OTG_DIEPTSIZ_PKTCNT);
     USB_OTG_INEP(ep_idx)->DIEPTSIZ &= ~(USB_OTG_DIEPTSIZ_XFRSIZ);
@@ -977,6 +978,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
     g_dwc2_udc[busid].out_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_dwc2_udc[busid].out_ep[ep_idx].xfer_len = data_len;
     g_dwc2_udc[busid].out_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     USB_OTG_OUTEP(ep_idx)->DOEPTSIZ &= ~(USB_OTG_DOEPTSIZ_PKTCNT);
     USB_OTG_OUTEP(ep_idx)->DOEPTSIZ &= ~(USB_OTG_DOEPTSIZ_XFRSIZ);
@@ -1030,6 +1032,7 @@ void USBD_IRQHandler(uint8_t busid)
         if (gint_status == 0) {
             return;
         }
+        usbd_trace_irq(busid, USB_TRACE_IRQ_ENTER, gint_status);
 
         if (!g_dwc2_udc[busid].user_params.device_dma_enable) {
             /* Handle RxQLevel Interrupt */
@@ -1218,5 +1221,6 @@ process_setup:
             }
             USB_OTG_GLB->GOTGINT |= temp;
         }
+        usbd_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
     }
 }
@@ -794,6 +794,9 @@ int usb_hc_init(struct usbh_bus *bus)
     /* Enable interrupts matching to the Host mode ONLY */
     USB_OTG_GLB->GINTMSK |= (USB_OTG_GINTMSK_PRTIM | USB_OTG_GINTMSK_HCIM |
                              USB_OTG_GINTSTS_DISCINT);
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+    USB_OTG_GLB->GINTMSK |= USB_OTG_GINTMSK_SOFM;
+#endif
 
     dwc2_drivebus(bus, 1);
     usb_osal_msleep(200);
@@ -1001,6 +1004,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     struct dwc2_chan *chan;
     struct usbh_bus *bus;
     size_t flags;
+    uint32_t timeout;
     int ret = 0;
     int chidx;
 
@@ -1069,6 +1073,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = chan;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    usbh_trace_urb(urb, USB_TRACE_SUBMIT);
 
     usb_osal_leave_critical_section(flags);
 
@@ -1106,9 +1111,11 @@ int usbh_submit_urb(struct usbh_urb *urb)
             break;
     }
 
+    timeout = usbh_urb_timer_start(urb);
+
     if (urb->timeout > 0) {
         /* wait until timeout or sem give */
-        ret = usb_osal_sem_take(chan->waitsem, urb->timeout);
+        ret = usb_osal_sem_take(chan->waitsem, timeout);
         if (ret < 0) {
             goto errout_timeout;
         }
@@ -1130,6 +1137,9 @@ int usbh_kill_urb(struct usbh_urb *urb)
     struct usbh_bus *bus;
     size_t flags;
 
+    usbh_urb_bh_cancel(urb);
+    usbh_urb_timer_stop(urb);
+
     if (!urb || !urb->hcpriv || !urb->hport->bus) {
         return -USB_ERR_INVAL;
     }
@@ -1142,7 +1152,7 @@ int usbh_kill_urb(struct usbh_urb *urb)
 
     dwc2_halt(bus, chan->chidx);
 
-    urb->errorcode = -USB_ERR_SHUTDOWN;
+    urb->errorcode = (urb->transfer_flags & USBH_URB_TIMEDOUT) ? -USB_ERR_TIMEOUT : -USB_ERR_SHUTDOWN;
 
     if (urb->timeout) {
         usb_osal_sem_give(chan->waitsem);
@@ -1150,9 +1160,8 @@ int usbh_kill_urb(struct usbh_urb *urb)
         dwc2_chan_free(chan);
     }
 
-    if (urb->complete) {
-        urb->complete(urb->arg, urb->errorcode);
-    }
+    /* traces the urb and runs complete, in a bh worker for USBH_URB_BH */
+    usbh_urb_giveback(urb);
 
     usb_osal_leave_critical_section(flags);
 
@@ -1171,13 +1180,7 @@ static inline void dwc2_urb_waitup(struct usbh_urb *urb)
         dwc2_chan_free(chan);
     }
 
-    if (urb->complete) {
-        if (urb->errorcode < 0) {
-            urb->complete(urb->arg, urb->errorcode);
-        } else {
-            urb->complete(urb->arg, urb->actual_length);
-        }
-    }
+    usbh_urb_giveback(urb);
 }
 
 static void dwc2_inchan_irq_handler(struct usbh_bus *bus, uint8_t ch_num)
@@ -1242,6 +1245,7 @@ static void dwc2_inchan_irq_handler(struct usbh_bus *bus, uint8_t ch_num)
             urb->errorcode = -USB_ERR_STALL;
             dwc2_urb_waitup(urb);
         } else if (chan_intstatus & USB_OTG_HCINT_NAK) {
+            usbh_ep_stat_nak(urb);
             if (chan->do_ssplit) {
                 /* restart ssplit transfer */
                 switch (USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes)) {
@@ -1395,6 +1399,7 @@ static void dwc2_outchan_irq_handler(struct usbh_bus *bus, uint8_t ch_num)
             urb->errorcode = -USB_ERR_STALL;
             dwc2_urb_waitup(urb);
         } else if (chan_intstatus & USB_OTG_HCINT_NAK) {
+            usbh_ep_stat_nak(urb);
             if (chan->do_ssplit) {
                 /* restart ssplit transfer */
                 switch (USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes)) {
@@ -1540,6 +1545,7 @@ void USBH_IRQHandler(uint8_t busid)
         if (gint_status == 0) {
             return;
         }
+        usbh_trace_irq(busid, USB_TRACE_IRQ_ENTER, gint_status);
 
         if (gint_status & USB_OTG_GINTSTS_HPRTINT) {
             dwc2_port_irq_handler(bus);
@@ -1564,5 +1570,12 @@ void USBH_IRQHandler(uint8_t busid)
             }
             USB_OTG_GLB->GINTSTS = USB_OTG_GINTSTS_HCINT;
         }
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+        if (gint_status & USB_OTG_GINTSTS_SOF) {
+            USB_OTG_GLB->GINTSTS = USB_OTG_GINTSTS_SOF;
+            usbh_urb_timer_sof(bus, (usbh_get_port_speed(bus, 0) == USB_SPEED_HIGH) ? 125 : 1000);
+        }
+#endif
+        usbh_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
     }
 }
\ No newline at end of file
@@ -629,13 +629,7 @@ static void ehci_urb_waitup(struct usbh_bus *bus, struct usbh_urb *urb)
         ehci_qh_free(bus, qh);
     }
 
-    if (urb->complete) {
-        if (urb->errorcode < 0) {
-            urb->complete(urb->arg, urb->errorcode);
-        } else {
-            urb->complete(urb->arg, urb->actual_length);
-        }
-    }
+    usbh_urb_giveback(urb);
 }
 
 static void ehci_qh_scan_qtds(struct usbh_bus *bus, struct ehci_qh_hw *qhead, struct ehci_qh_hw *qh)
@@ -1193,6 +1187,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
 {
     struct ehci_qh_hw *qh = NULL;
     size_t flags;
+    uint32_t timeout;
     int ret = 0;
     struct usbh_hub *hub;
     struct usbh_hubport *hport;
@@ -1236,6 +1231,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = NULL;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    usbh_trace_urb(urb, USB_TRACE_SUBMIT);
 
     usb_osal_leave_critical_section(flags);
 
@@ -1267,9 +1263,11 @@ int usbh_submit_urb(struct usbh_urb *urb)
             break;
     }
 
+    timeout = usbh_urb_timer_start(urb);
+
     if (urb->timeout > 0) {
         /* wait until timeout or sem give */
-        ret = usb_osal_sem_take(qh->waitsem, urb->timeout);
+        ret = usb_osal_sem_take(qh->waitsem, timeout);
         if (ret < 0) {
             goto errout_timeout;
         }
@@ -1292,6 +1290,9 @@ int usbh_kill_urb(struct usbh_urb *urb)
     size_t flags;
     bool remove_in_iaad = false;
 
+    usbh_urb_bh_cancel(urb);
+    usbh_urb_timer_stop(urb);
+
     if (!urb || !urb->hport || !urb->hcpriv || !urb->hport->bus) {
         return -USB_ERR_INVAL;
     }
@@ -1338,7 +1339,7 @@ int usbh_kill_urb(struct usbh_urb *urb)
 
     qh = (struct ehci_qh_hw *)urb->hcpriv;
     qh->remove_in_iaad = 0;
-    urb->errorcode = -USB_ERR_SHUTDOWN;
+    urb->errorcode = (urb->transfer_flags & USBH_URB_TIMEDOUT) ? -USB_ERR_TIMEOUT : -USB_ERR_SHUTDOWN;
 
     if (urb->timeout) {
         usb_osal_sem_give(qh->waitsem);
@@ -1361,9 +1362,8 @@ int usbh_kill_urb(struct usbh_urb *urb)
         EHCI_HCOR->usbsts = EHCI_USBSTS_IAA;
     }
 
-    if (urb->complete) {
-        urb->complete(urb->arg, urb->errorcode);
-    }
+    /* traces the urb and runs complete, in a bh worker for USBH_URB_BH */
+    usbh_urb_giveback(urb);
 
     usb_osal_leave_critical_section(flags);
 
@@ -1405,6 +1405,7 @@ void USBH_IRQHandler(uint8_t busid)
 
     usbsts = EHCI_HCOR->usbsts & EHCI_HCOR->usbintr;
     EHCI_HCOR->usbsts = usbsts;
+    usbh_trace_irq(busid, USB_TRACE_IRQ_ENTER, usbsts);
 
     if (usbsts & EHCI_USBSTS_INT) {
         ehci_scan_async_list(bus);
@@ -1452,4 +1453,5 @@ void USBH_IRQHandler(uint8_t busid)
 
     if (usbsts & EHCI_USBSTS_FATAL) {
     }
+    usbh_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
\ No newline at end of file
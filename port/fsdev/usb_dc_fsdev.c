@@ -295,6 +295,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
     g_fsdev_udc.in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_fsdev_udc.in_ep[ep_idx].xfer_len = data_len;
     g_fsdev_udc.in_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     data_len = MIN(data_len, g_fsdev_udc.in_ep[ep_idx].ep_mps);
 
@@ -319,6 +320,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
     g_fsdev_udc.out_ep[ep_idx].xfer_buf = data;
     g_fsdev_udc.out_ep[ep_idx].xfer_len = data_len;
     g_fsdev_udc.out_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     PCD_SET_EP_RX_STATUS(USB, ep_idx, USB_EP_RX_VALID);
 
@@ -334,6 +336,7 @@ void USBD_IRQHandler(uint8_t busid)
     uint16_t store_ep[8];
 
     wIstr = USB->ISTR;
+    usbd_trace_irq(busid, USB_TRACE_IRQ_ENTER, wIstr);
     if (wIstr & USB_ISTR_CTR) {
         while ((USB->ISTR & USB_ISTR_CTR) != 0U) {
             wIstr = USB->ISTR;
@@ -497,6 +500,7 @@ void USBD_IRQHandler(uint8_t busid)
     if (wIstr & USB_ISTR_ESOF) {
         USB->ISTR &= (uint16_t)(~USB_ISTR_ESOF);
     }
+    usbd_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
 
 static void fsdev_write_pma(USB_TypeDef *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
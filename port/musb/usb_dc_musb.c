@@ -629,6 +629,7 @@ int usbd_ep_start_write(uint8_t busid, const uint8_t ep, const uint8_t *data, ui
     g_musb_udc.in_ep[ep_idx].xfer_buf = (uint8_t *)data;
     g_musb_udc.in_ep[ep_idx].xfer_len = data_len;
     g_musb_udc.in_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     if (data_len == 0) {
         if (ep_idx == 0x00) {
@@ -683,6 +684,7 @@ int usbd_ep_start_read(uint8_t busid, const uint8_t ep, uint8_t *data, uint32_t
     g_musb_udc.out_ep[ep_idx].xfer_buf = data;
     g_musb_udc.out_ep[ep_idx].xfer_len = data_len;
     g_musb_udc.out_ep[ep_idx].actual_xfer_len = 0;
+    usbd_trace_ep(busid, USB_TRACE_SUBMIT, ep, data_len);
 
     if (data_len == 0) {
         if (ep_idx == 0) {
@@ -796,6 +798,7 @@ void USBD_IRQHandler(uint8_t busid)
     rxis = HWREGH(USB_BASE + MUSB_RXIS_OFFSET);
 
     HWREGB(USB_BASE + MUSB_IS_OFFSET) = is;
+    usbd_trace_irq(busid, USB_TRACE_IRQ_ENTER, is);
 
     old_ep_idx = musb_get_active_ep();
 
@@ -895,4 +898,5 @@ void USBD_IRQHandler(uint8_t busid)
     }
 
     musb_set_active_ep(old_ep_idx);
+    usbd_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
@@ -588,6 +588,9 @@ int usb_hc_init(struct usbh_bus *bus)
     regval = USB_IE_RESET | USB_IE_CONN | USB_IE_DISCON |
              USB_IE_RESUME | USB_IE_SUSPND |
              USB_IE_BABBLE | USB_IE_SESREQ | USB_IE_VBUSERR;
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+    regval |= USB_IE_SOF;
+#endif
 
     HWREGB(USB_BASE + MUSB_IE_OFFSET) = regval;
     HWREGH(USB_BASE + MUSB_TXIE_OFFSET) = USB_TXIE_EP0;
@@ -745,6 +748,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     struct usbh_bus *bus;
     int chidx;
     size_t flags;
+    uint32_t timeout;
     int ret = 0;
 
     if (!urb || !urb->hport || !urb->ep || !urb->hport->bus) {
@@ -780,6 +784,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = pipe;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    usbh_trace_urb(urb, USB_TRACE_SUBMIT);
 
     switch (USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes)) {
         case USB_ENDPOINT_TYPE_CONTROL:
@@ -807,9 +812,11 @@ int usbh_submit_urb(struct usbh_urb *urb)
     }
     usb_osal_leave_critical_section(flags);
 
+    timeout = usbh_urb_timer_start(urb);
+
     if (urb->timeout > 0) {
         /* wait until timeout or sem give */
-        ret = usb_osal_sem_take(pipe->waitsem, urb->timeout);
+        ret = usb_osal_sem_take(pipe->waitsem, timeout);
         if (ret < 0) {
             goto errout_timeout;
         }
@@ -831,6 +838,9 @@ int usbh_kill_urb(struct usbh_urb *urb)
     struct usbh_bus *bus;
     size_t flags;
 
+    usbh_urb_bh_cancel(urb);
+    usbh_urb_timer_stop(urb);
+
     if (!urb || !urb->hcpriv || !urb->hport->bus) {
         return -USB_ERR_INVAL;
     }
@@ -842,7 +852,7 @@ int usbh_kill_urb(struct usbh_urb *urb)
     flags = usb_osal_enter_critical_section();
 
     pipe = (struct musb_pipe *)urb->hcpriv;
-    urb->errorcode = -USB_ERR_SHUTDOWN;
+    urb->errorcode = (urb->transfer_flags & USBH_URB_TIMEDOUT) ? -USB_ERR_TIMEOUT : -USB_ERR_SHUTDOWN;
 
     if (urb->ep->bEndpointAddress & 0x80) {
         HWREGH(USB_BASE + MUSB_RXIE_OFFSET) &= ~(1 << (urb->ep->bEndpointAddress & 0x0f));
@@ -860,9 +870,8 @@ int usbh_kill_urb(struct usbh_urb *urb)
         musb_pipe_free(pipe);
     }
 
-    if (urb->complete) {
-        urb->complete(urb->arg, urb->errorcode);
-    }
+    /* traces the urb and runs complete, in a bh worker for USBH_URB_BH */
+    usbh_urb_giveback(urb);
 
     usb_osal_leave_critical_section(flags);
     return 0;
@@ -882,13 +891,7 @@ static void musb_urb_waitup(struct usbh_urb *urb)
         musb_pipe_free(pipe);
     }
 
-    if (urb->complete) {
-        if (urb->errorcode < 0) {
-            urb->complete(urb->arg, urb->errorcode);
-        } else {
-            urb->complete(urb->arg, urb->actual_length);
-        }
-    }
+    usbh_urb_giveback(urb);
 }
 
 void handle_ep0(struct usbh_bus *bus)
@@ -1030,6 +1033,7 @@ void USBH_IRQHandler(uint8_t busid)
     rxis = HWREGH(USB_BASE + MUSB_RXIS_OFFSET);
 
     HWREGB(USB_BASE + MUSB_IS_OFFSET) = is;
+    usbh_trace_irq(busid, USB_TRACE_IRQ_ENTER, is);
 
     old_ep_idx = musb_get_active_ep(bus);
 
@@ -1050,6 +1054,9 @@ void USBH_IRQHandler(uint8_t busid)
     }
 
     if (is & USB_IS_SOF) {
+#ifdef CONFIG_USBHOST_URB_TIMER_SOF
+        usbh_urb_timer_sof(bus, (usbh_get_port_speed(bus, 0) == USB_SPEED_HIGH) ? 125 : 1000);
+#endif
     }
 
     if (is & USB_IS_RESUME) {
@@ -1170,4 +1177,5 @@ void USBH_IRQHandler(uint8_t busid)
         }
     }
     musb_set_active_ep(bus, old_ep_idx);
+    usbh_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
@@ -498,6 +498,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     struct usbh_bus *bus;
     int chidx;
     size_t flags;
+    uint32_t timeout;
     int ret = 0;
 
     if (!urb || !urb->hport || !urb->ep || !urb->hport->bus) {
@@ -534,6 +535,7 @@ int usbh_submit_urb(struct usbh_urb *urb)
     urb->hcpriv = pipe;
     urb->errorcode = -USB_ERR_BUSY;
     urb->actual_length = 0;
+    usbh_trace_urb(urb, USB_TRACE_SUBMIT);
     usb_osal_leave_critical_section(flags);
 
     switch (USB_GET_ENDPOINT_TYPE(urb->ep->bmAttributes)) {
@@ -549,9 +551,11 @@ int usbh_submit_urb(struct usbh_urb *urb)
             break;
     }
 
+    timeout = usbh_urb_timer_start(urb);
+
     if (urb->timeout > 0) {
         /* wait until timeout or sem give */
-        ret = usb_osal_sem_take(pipe->waitsem, urb->timeout);
+        ret = usb_osal_sem_take(pipe->waitsem, timeout);
         if (ret < 0) {
             goto errout_timeout;
         }
@@ -580,6 +584,9 @@ int usbh_kill_urb(struct usbh_urb *urb)
     struct usbh_bus *bus;
     size_t flags;
 
+    usbh_urb_bh_cancel(urb);
+    usbh_urb_timer_stop(urb);
+
     if (!urb || !urb->hcpriv || !urb->hport->bus) {
         return -USB_ERR_INVAL;
     }
@@ -591,7 +598,7 @@ int usbh_kill_urb(struct usbh_urb *urb)
     flags = usb_osal_enter_critical_section();
 
     pipe = (struct rp2040_pipe *)urb->hcpriv;
-    urb->errorcode = -USB_ERR_SHUTDOWN;
+    urb->errorcode = (urb->transfer_flags & USBH_URB_TIMEDOUT) ? -USB_ERR_TIMEOUT : -USB_ERR_SHUTDOWN;
 
     usb_hw_clear->int_ep_ctrl = 1 << pipe->chidx;
     usb_hw_clear->buf_status = 1 << (pipe->chidx * 2 + 0);
@@ -605,9 +612,8 @@ int usbh_kill_urb(struct usbh_urb *urb)
         rp2040_pipe_free(pipe);
     }
 
-    if (urb->complete) {
-        urb->complete(urb->arg, urb->errorcode);
-    }
+    /* traces the urb and runs complete, in a bh worker for USBH_URB_BH */
+    usbh_urb_giveback(urb);
 
     usb_osal_leave_critical_section(flags);
 
@@ -626,13 +632,7 @@ static void rp2040_urb_waitup(struct usbh_urb *urb)
         rp2040_pipe_free(pipe);
     }
 
-    if (urb->complete) {
-        if (urb->errorcode < 0) {
-            urb->complete(urb->arg, urb->errorcode);
-        } else {
-            urb->complete(urb->arg, urb->actual_length);
-        }
-    }
+    usbh_urb_giveback(urb);
 }
 
 static void rp2040_handle_buffer_status(struct usbh_bus *bus)
@@ -756,6 +756,7 @@ void USBH_IRQHandler(uint8_t busid)
 
     bus = &g_usbhost_bus[busid];
     status = usb_hw->ints;
+    usbh_trace_irq(busid, USB_TRACE_IRQ_ENTER, status);
 
     if (status & USB_INTS_HOST_CONN_DIS_BITS) {
         handled |= USB_INTS_HOST_CONN_DIS_BITS;
@@ -821,6 +822,7 @@ void USBH_IRQHandler(uint8_t busid)
     if (status ^ handled) {
         USB_LOG_ERR("Unhandled IRQ 0x%x\n", (uint)(status ^ handled));
     }
+    usbh_trace_irq(busid, USB_TRACE_IRQ_EXIT, 0);
 }
 
 void rp2040_usbh_irq(void)
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Convert CherryUSB trace dumps (usb_trace_dump output, see common/usb_trace.h) into pcapng
+with the Linux usbmon link type, so Wireshark decodes setup packets and transfers.
+
+    python3 usbtrace2pcapng.py host_bus0.bin device_bus0.bin -o capture.pcapng
+
+Each dump becomes one capture interface. Only submit and complete events have a usbmon form,
+bus and irq events are counted and listed with --verbose. Payload is not recorded by the
+device side, so packets carry the 64 byte usbmon header only.
+"""
+import sys
+import struct
+import argparse
+
+USB_TRACE_FILE_MAGIC = 0x54425355 # "USBT"
+USB_TRACE_HEADER = struct.Struct("<IHHBBHI")
+USB_TRACE_EVENT = struct.Struct("<IIIiIBBBB8s")
+
+USB_TRACE_SUBMIT = 1
+USB_TRACE_COMPLETE = 2
+USB_TRACE_BUS = 3
+USB_TRACE_IRQ_ENTER = 4
+USB_TRACE_IRQ_EXIT = 5
+
+USB_TRACE_FLAG_SETUP = 1 << 2
+USB_TRACE_FLAG_DEVICE = 1 << 3
+
+LINKTYPE_USB_LINUX_MMAPPED = 220
+USBMON_HEADER = struct.Struct("<QBBBBHbbqiiII8siiII")
+
+# USB_ENDPOINT_TYPE_* to usbmon transfer type
+XFER_TYPE = {0: 2, 1: 0, 2: 3, 3: 1}
+
+# -USB_ERR_* to linux errno used by usbmon
+STATUS = {
+    0: 0,
+    -4: -19,   # NOTCONN -> ENODEV
+    -8: -32,   # STALL -> EPIPE
+    -9: -75,   # BABBLE -> EOVERFLOW
+    -11: -84,  # DT -> EILSEQ
+    -13: -2,   # SHUTDOWN -> ENOENT, urb killed
+    -14: -110, # TIMEOUT -> ETIMEDOUT
+}
+EINPROGRESS = -115
+EPROTO = -71
+
+
+def pcapng_block(block_type, body):
+    pad = (4 - len(body) % 4) % 4
+    length = 12 + len(body) + pad
+    return struct.pack("<II", block_type, length) + body + b"\0" * pad + struct.pack("<I", length)
+
+
+def pcapng_shb():
+    return pcapng_block(0x0A0D0D0A, struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1))
+
+
+def pcapng_idb(name):
+    name = name.encode("utf-8")
+    opts = struct.pack("<HH", 2, len(name)) + name + b"\0" * ((4 - len(name) % 4) % 4)
+    opts += struct.pack("<HH", 0, 0)
+    return pcapng_block(0x00000001, struct.pack("<HHI", LINKTYPE_USB_LINUX_MMAPPED, 0, 0xFFFF) + opts)
+
+
+def pcapng_epb(ifid, ts_us, data):
+    body = struct.pack("<IIIII", ifid, ts_us >> 32, ts_us & 0xFFFFFFFF, len(data), len(data)) + data
+    return pcapng_block(0x00000006, body)
+
+
+def read_dump(path):
+    with open(path, "rb") as f:
+        buf = f.read()
+    if len(buf) < USB_TRACE_HEADER.size:
+        raise ValueError("%s: too short" % path)
+    magic, version, event_size, busid, is_device, _, lost = USB_TRACE_HEADER.unpack_from(buf, 0)
+    if magic != USB_TRACE_FILE_MAGIC:
+        raise ValueError("%s: not a usb trace dump" % path)
+    if version != 1 or event_size != USB_TRACE_EVENT.size:
+        raise ValueError("%s: unsupported version %d event size %d" % (path, version, event_size))
+    events = []
+    for off in range(USB_TRACE_HEADER.size, len(buf) - event_size + 1, event_size):
+        events.append(USB_TRACE_EVENT.unpack_from(buf, off))
+    return busid, bool(is_device), lost, events
+
+
+def convert(path, ifid, busnum, out, verbose):
+    busid, is_device, lost, events = read_dump(path)
+    if busnum is None:
+        busnum = busid + (65 if is_device else 1)
+
+    count = {"packets": 0, "bus": 0, "irq": 0}
+    epnum_of = {}
+    ts_high = 0
+    ts_last = None
+
+    for seq, ts, urb_id, status, length, etype, flags, ep, dev_addr, setup in events:
+        # timestamps are 32 bit us, unwrap assuming events are in order
+        if ts_last is not None and ts < ts_last and (ts_last - ts) > 0x80000000:
+            ts_high += 1 << 32
+        ts_last = ts
+        ts_us = ts_high + ts
+
+        if etype in (USB_TRACE_IRQ_ENTER, USB_TRACE_IRQ_EXIT):
+            count["irq"] += 1
+            if verbose:
+                print("%10d us irq %s 0x%08x" % (ts_us, "enter" if etype == USB_TRACE_IRQ_ENTER else "exit", status & 0xFFFFFFFF))
+            continue
+        if etype == USB_TRACE_BUS:
+            count["bus"] += 1
+            if verbose:
+                print("%10d us bus event %d" % (ts_us, status))
+            continue
+        if etype not in (USB_TRACE_SUBMIT, USB_TRACE_COMPLETE):
+            continue
+
+        if is_device:
+            xfer_type = 2 if (ep & 0x7F) == 0 else 3
+            urb_id = (busid << 8) | ep
+        else:
+            xfer_type = XFER_TYPE[flags & 0x03]
+
+        # control transfers report direction of data stage in epnum
+        epnum = ep
+        if flags & USB_TRACE_FLAG_SETUP:
+            epnum = (ep & 0x7F) | (setup[0] & 0x80)
+            epnum_of[urb_id] = epnum
+        elif xfer_type == 2:
+            epnum = epnum_of.get(urb_id, ep)
+
+        if etype == USB_TRACE_SUBMIT:
+            mon_type = ord("S")
+            mon_status = EINPROGRESS
+        else:
+            mon_type = ord("C")
+            mon_status = STATUS.get(status, EPROTO)
+
+        if flags & USB_TRACE_FLAG_SETUP:
+            flag_setup = 0
+        else:
+            flag_setup = ord("-")
+            setup = b"\0" * 8
+        flag_data = ord("<") if (epnum & 0x80) else ord(">")
+
+        hdr = USBMON_HEADER.pack(urb_id, mon_type, xfer_type, epnum, dev_addr, busnum, flag_setup, flag_data,
+                                 ts_us // 1000000, ts_us % 1000000, mon_status, length, 0, setup, 0, 0, 0, 0)
+        out.write(pcapng_epb(ifid, ts_us, hdr))
+        count["packets"] += 1
+
+    print("%s: %s bus %d, %d packets, %d irq events, %d bus events, %d events lost" %
+          (path, "device" if is_device else "host", busid, count["packets"], count["irq"], count["bus"], lost))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert CherryUSB trace dumps to usbmon pcapng")
+    parser.add_argument("dumps", nargs="+", help="files written by usb_trace_dump")
+    parser.add_argument("-o", "--output", default="usbtrace.pcapng", help="pcapng file to write")
+    parser.add_argument("-b", "--bus", type=int, default=None,
+                        help="usbmon bus number for all dumps, default host busid + 1 and device busid + 65")
+    parser.add_argument("-v", "--verbose", action="store_true", help="list bus and irq events")
+    args = parser.parse_args()
+
+    with open(args.output, "wb") as out:
+        out.write(pcapng_shb())
+        for ifid, path in enumerate(args.dumps):
+            out.write(pcapng_idb("usbtrace%d" % ifid))
+        for ifid, path in enumerate(args.dumps):
+            try:
+                convert(path, ifid, args.bus, out, args.verbose)
+            except (OSError, ValueError) as e:
+                print(e)
+                sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()